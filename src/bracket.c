@@ -37,7 +37,7 @@
 
 void bracket(double* x_lower, double* x_minimum, double* x_upper,
              double* f_lower, double* f_minimum, double* f_upper,
-             double* f_vec1, double* f_vec2)
+             double** f_vec1, double** f_vec2)
 {
   double f_left = *f_lower;
   double f_right = *f_upper;
@@ -55,18 +55,18 @@ void bracket(double* x_lower, double* x_minimum, double* x_upper,
   int last = 0; /* indicates whether upwards is left or right */
   long nb_eval = 0;
 
-  double* vecu = g_calc.linmin.vecu_bracket;
-  double* f_vec3 = g_calc.linmin.f_vec3;
+  if (g_calc.linmin.vecu_bracket == NULL)
+    g_calc.linmin.vecu_bracket =
+        (double*)Malloc(g_calc.ndimtot * sizeof(double));
 
-  if (vecu == NULL)
-    vecu = (double*)Malloc(g_calc.ndimtot * sizeof(double));
+  if (g_calc.linmin.f_vec3 == NULL)
+    g_calc.linmin.f_vec3 = (double*)Malloc(g_calc.mdim * sizeof(double));
 
-  if (f_vec3 == NULL)
-    f_vec3 = (double*)Malloc(g_calc.mdim * sizeof(double));
+  double* vecu = g_calc.linmin.vecu_bracket;
 
-  p_left = f_vec1;
-  p_right = f_vec2;
-  p_center = f_vec3;
+  p_left = *f_vec1;
+  p_right = *f_vec2;
+  p_center = g_calc.linmin.f_vec3;
 
   if (f_right >= f_left) {
     x_center = x_left;
@@ -98,8 +98,10 @@ void bracket(double* x_lower, double* x_minimum, double* x_upper,
         *f_lower = f_left;
         *f_upper = f_right;
         *f_minimum = f_center;
-        for (int i = 0; i < g_calc.mdim; i++)
-          f_vec1[i] = p_center[i];
+        /* hand out the buffers instead of copying them */
+        *f_vec1 = p_center;
+        *f_vec2 = p_left;
+        g_calc.linmin.f_vec3 = p_right;
         return;
       } else if (f_center > f_right) {
         /* OK, go right! */
@@ -44,11 +44,11 @@
 
 extern double *xicom, *delcom;
 
-void bracket(double*, double*, double*, double*, double*, double*, double*,
-             double*);
-double brent(double, double, double, double, double, double*, double*, double*,
-             double*);
+void bracket(double*, double*, double*, double*, double*, double*, double**,
+             double**);
+double brent(double, double, double, double, double, double*, double*, double**,
+             double**);
 
-double linmin(double*, double*, double, double*, double*, double*, double*);
+double linmin(double*, double*, double, double*, double*, double**, double**);
 
 #endif  // BRACKET_H_INCLUDED
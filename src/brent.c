@@ -37,7 +37,7 @@
 #include "utils.h"
 
 double brent(double ax, double bx, double cx, double fbx, double tol,
-             double* xmin, double* xmin2, double* fxmin, double* fxmin2)
+             double* xmin, double* xmin2, double** fxmin, double** fxmin2)
 /* take bracket (a,b,c), f(b), tol, pointers to xmin, xmin2, vectors fxmin,
  * fxmin2 */
 {
@@ -58,16 +58,16 @@ double brent(double ax, double bx, double cx, double fbx, double tol,
   double w_lower, w_upper;
   double *p_w, *p_z, *p_u, *p_temp;
 
-  double* vecu = g_calc.linmin.vecu_brent;
-  double* fxu = NULL; /* Vector of location u */
-
   double p = 0, q = 0, r = 0;
 
-  if (fxu == NULL)
-    fxu = (double*)Malloc(g_calc.mdim * sizeof(double));
+  if (g_calc.linmin.f_vecu == NULL)
+    g_calc.linmin.f_vecu = (double*)Malloc(g_calc.mdim * sizeof(double));
 
-  if (vecu == NULL)
-    vecu = (double*)Malloc(g_calc.ndimtot * sizeof(double));
+  if (g_calc.linmin.vecu_brent == NULL)
+    g_calc.linmin.vecu_brent =
+        (double*)Malloc(g_calc.ndimtot * sizeof(double));
+
+  double* vecu = g_calc.linmin.vecu_brent;
 
   z = bx;
   f_z = fbx;
@@ -78,9 +78,9 @@ double brent(double ax, double bx, double cx, double fbx, double tol,
   for (j = 0; j < g_calc.ndimtot; j++)
     vecu[j] = xicom[j] + v * delcom[j]; /*set vecu */
 
-  p_z = fxmin;
-  p_w = fxmin2;
-  p_u = fxu;
+  p_z = *fxmin;
+  p_w = *fxmin2;
+  p_u = g_calc.linmin.f_vecu; /* Vector of location u */
   f_v = f_w = calc_forces(vecu, p_w, 0);
 
   for (iter = 1; iter <= ITMAX; iter++) {
@@ -91,12 +91,10 @@ double brent(double ax, double bx, double cx, double fbx, double tol,
     if (fabs(z - midpoint) <= t2 - 0.5 * (x_right - x_left)) {
       *xmin = z;
       *xmin2 = w;
-      /* Put correct values in pointers */
-      for (j = 0; j < g_calc.mdim; j++) {
-        w_lower = p_z[j]; /* temporary storage */
-        fxmin2[j] = p_w[j];
-        fxmin[j] = w_lower;
-      }
+      /* Put correct buffers in pointers */
+      *fxmin = p_z;
+      *fxmin2 = p_w;
+      g_calc.linmin.f_vecu = p_u;
       return f_z;
     }
     if (fabs(e) > tolerance) {
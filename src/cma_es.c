@@ -0,0 +1,399 @@
+/****************************************************************
+ *
+ * cma_es.c: Implementation of the covariance matrix adaptation
+ *	evolution strategy (CMA-ES) for global optimization
+ *
+ ****************************************************************
+ *
+ * Copyright 2002-2017 - the potfit development team
+ *
+ * https://www.potfit.net/
+ *
+ ****************************************************************
+ *
+ * This file is part of potfit.
+ *
+ * potfit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * potfit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with potfit; if not, see <http://www.gnu.org/licenses/>.
+ *
+ ****************************************************************/
+
+#include "potfit.h"
+
+#if defined(CMAES)
+
+#if defined(MKL)
+#include <mkl_lapack.h>
+#elif defined(ACML)
+#include <acml.h>
+#elif defined(__ACCELERATE__)
+#include <Accelerate/Accelerate.h>
+#elif defined(LAPACK)
+/* Fortran LAPACK (reference or OpenBLAS) comes without a C header */
+void dsyev_(const char*, const char*, const int*, double*, const int*, double*,
+            double*, const int*, int*);
+#else
+#error No math library defined!
+#endif  // MKL
+
+#include "force.h"
+#include "memory.h"
+#include "optimize.h"
+#include "potential_input.h"
+#include "potential_output.h"
+#include "random.h"
+
+#define TOLX 1.E-12     /* smallest step size relative to the start */
+#define MAX_COND 1.E14  /* largest condition number of the covariance */
+
+/****************************************************************
+ *
+ * eigen_decomp: eigenvalues d and eigenvectors (rows of b) of the
+ *	symmetric matrix c with the lapack driver dsyev
+ *
+ ****************************************************************/
+
+static void eigen_decomp(double** c, double** b, double* d, int n)
+{
+  char jobz[1] = "V";
+  char uplo[1] = "U";
+  int info = 0;
+#if !defined(ACML)
+  static double* work;
+  int worksize = 64 * n;
+
+  if (work == NULL)
+    work = (double*)Malloc(worksize * sizeof(double));
+#endif  // ACML
+
+  memcpy(&b[0][0], &c[0][0], n * n * sizeof(double));
+
+  // the matrix is symmetric, row major order only swaps upper and lower
+#if defined(MKL)
+  dsyev(jobz, uplo, &n, &b[0][0], &n, d, work, &worksize, &info);
+#elif defined(ACML)
+  dsyev(jobz[0], uplo[0], n, &b[0][0], n, d, &info);
+#elif defined(__ACCELERATE__) || defined(LAPACK)
+  dsyev_(jobz, uplo, &n, &b[0][0], &n, d, work, &worksize, &info);
+#endif
+
+  if (info != 0)
+    error(1, "Eigenvalue decomposition in cma-es failed (info = %d)\n", info);
+}
+
+/****************************************************************
+ *
+ * run_cma_es: covariance matrix adaptation evolution strategy
+ *
+ * Every generation draws lambda parameter vectors from a normal
+ * distribution around the mean m and evaluates them together with
+ * calc_errors(), so the groups of processes or threads share the
+ * whole generation. The mu best samples move the mean, the
+ * covariance learns the correlations of the parameters from them
+ * and the step size sigma follows the length of the evolution path.
+ * The parameters are sampled relative to their bounds (analytic
+ * potentials) or their start values (tabulated potentials), the
+ * algorithm follows N. Hansen, "The CMA Evolution Strategy: A
+ * Tutorial", arXiv:1604.00772.
+ *
+ ****************************************************************/
+
+void run_cma_es(double* const xi)
+{
+  const int n = g_calc.ndim;
+  const int* idx = g_pot.opt_pot.idx;
+
+  if (g_param.cmaes_threshold == 0.0)
+    return;
+
+  const int lambda = g_param.cmaes_lambda > 0
+                         ? g_param.cmaes_lambda
+                         : 4 + (int)floor(3.0 * log(n));
+  const int mu = lambda / 2;
+
+  // recombination weights of the mu best samples
+  double* w = (double*)Malloc(mu * sizeof(double));
+  double w_sum = 0.0;
+  double w_sq = 0.0;
+
+  for (int i = 0; i < mu; i++) {
+    w[i] = log(mu + 0.5) - log(i + 1.0);
+    w_sum += w[i];
+  }
+  for (int i = 0; i < mu; i++) {
+    w[i] /= w_sum;
+    w_sq += w[i] * w[i];
+  }
+
+  const double mueff = 1.0 / w_sq;
+
+  // learning rates of the paths, the covariance and the step size
+  const double cc = (4.0 + mueff / n) / (n + 4.0 + 2.0 * mueff / n);
+  const double cs = (mueff + 2.0) / (n + mueff + 5.0);
+  const double c1 = 2.0 / ((n + 1.3) * (n + 1.3) + mueff);
+  const double cmu = MIN(1.0 - c1, 2.0 * (mueff - 2.0 + 1.0 / mueff) /
+                                       ((n + 2.0) * (n + 2.0) + mueff));
+  const double damps =
+      1.0 + 2.0 * MAX(0.0, sqrt((mueff - 1.0) / (n + 1.0)) - 1.0) + cs;
+  const double chin = sqrt(n) * (1.0 - 1.0 / (4.0 * n) + 1.0 / (21.0 * n * n));
+
+  // the decomposition of the covariance is only updated every few
+  // generations, its cost would dominate for many parameters
+  const int eigen_gap = MAX(1, (int)(lambda / ((c1 + cmu) * n * 10.0)));
+
+  double sigma = g_param.cmaes_sigma;
+
+  // scale of each parameter, the search runs in scaled coordinates
+  double* scale = (double*)Malloc(n * sizeof(double));
+  double* lower = NULL;
+  double* upper = NULL;
+
+#if defined(APOT)
+  lower = (double*)Malloc(n * sizeof(double));
+  upper = (double*)Malloc(n * sizeof(double));
+
+  for (int i = 0; i < n; i++) {
+    lower[i] = g_pot.apot_table
+                   .pmin[g_pot.apot_table.idxpot[i]][g_pot.apot_table.idxparam[i]];
+    upper[i] = g_pot.apot_table
+                   .pmax[g_pot.apot_table.idxpot[i]][g_pot.apot_table.idxparam[i]];
+    scale[i] = upper[i] - lower[i];
+    if (scale[i] <= 0.0)
+      scale[i] = MAX(fabs(xi[idx[i]]), 1.0);
+  }
+#else
+  // tabulated values near zero get a tenth of the mean magnitude
+  double mean_abs = 0.0;
+
+  for (int i = 0; i < n; i++)
+    mean_abs += fabs(xi[idx[i]]) / n;
+  for (int i = 0; i < n; i++)
+    scale[i] = MAX(fabs(xi[idx[i]]), 0.1 * mean_abs);
+  if (mean_abs == 0.0)
+    for (int i = 0; i < n; i++)
+      scale[i] = 1.0;
+#endif  // APOT
+
+  // mean, evolution paths and the decomposition C = B^T diag(d^2) B
+  double* m = (double*)Malloc(n * sizeof(double));
+  double* m_old = (double*)Malloc(n * sizeof(double));
+  double* pc = (double*)Malloc(n * sizeof(double));
+  double* ps = (double*)Malloc(n * sizeof(double));
+  double* d = (double*)Malloc(n * sizeof(double));
+  double* tmp = (double*)Malloc(n * sizeof(double));
+  double** C = mat_double(n, n);
+  double** B = mat_double(n, n);
+
+  for (int i = 0; i < n; i++) {
+    C[i][i] = 1.0;
+    B[i][i] = 1.0;
+    d[i] = 1.0;
+  }
+
+  // samples of one generation in scaled coordinates and as full
+  // parameter vectors for calc_errors
+  double** y = mat_double(lambda, n);
+  double** pop = mat_double(lambda, g_calc.ndimtot);
+  double* cost = (double*)Malloc(lambda * sizeof(double));
+  int* rank = (int*)Malloc(lambda * sizeof(int));
+
+  for (int k = 0; k < lambda; k++)
+    memcpy(pop[k], xi, g_calc.ndimtot * sizeof(double));
+
+  // the start point, xi holds the optimum for the tempfile
+  double* x0 = (double*)Malloc(g_calc.ndimtot * sizeof(double));
+  double* best = (double*)Malloc(g_calc.ndimtot * sizeof(double));
+  double* forces = (double*)Malloc(g_calc.mdim * sizeof(double));
+
+  memcpy(x0, xi, g_calc.ndimtot * sizeof(double));
+  memcpy(best, xi, g_calc.ndimtot * sizeof(double));
+
+  double min_cost = calc_forces(xi, forces, 3);
+  double crit = 0.0;
+  int gen = 0;
+  int eigen_gen = 0;
+
+  printf("CMA-ES with %d samples per generation (mu = %d)\n", lambda, mu);
+  printf("Generation\tOptimum\t\tAverage error sum\tMax-Min\t\tsigma\n");
+  printf("%5d\t\t%15f\t%20f\n", gen, min_cost, min_cost);
+  fflush(stdout);
+
+  do {
+    // sample y_k = m + sigma * B^T (d .* z_k) and the parameters
+    for (int k = 0; k < lambda; k++) {
+      for (int j = 0; j < n; j++)
+        tmp[j] = d[j] * normdist();
+
+      for (int i = 0; i < n; i++) {
+        double sum = 0.0;
+        for (int j = 0; j < n; j++)
+          sum += B[j][i] * tmp[j];
+        y[k][i] = m[i] + sigma * sum;
+      }
+
+      for (int i = 0; i < n; i++) {
+        double val = x0[idx[i]] + scale[i] * y[k][i];
+        // samples outside of the bounds are repaired and count as such
+        if (lower != NULL && (val < lower[i] || val > upper[i])) {
+          val = val < lower[i] ? lower[i] : upper[i];
+          y[k][i] = (val - x0[idx[i]]) / scale[i];
+        }
+        pop[k][idx[i]] = val;
+      }
+    }
+
+    calc_errors(pop, cost, lambda, g_calc.ndimtot);
+
+    // rank the samples by their cost
+    for (int k = 0; k < lambda; k++) {
+      int l = k;
+      while (l > 0 && cost[rank[l - 1]] > cost[k]) {
+        rank[l] = rank[l - 1];
+        l--;
+      }
+      rank[l] = k;
+    }
+
+    if (cost[rank[0]] < min_cost) {
+      min_cost = cost[rank[0]];
+      memcpy(best, pop[rank[0]], g_calc.ndimtot * sizeof(double));
+
+      if (*g_files.tempfile != '\0') {
+#if defined(APOT)
+        update_apot_table(best);
+#else
+        memcpy(xi, best, g_calc.ndimtot * sizeof(double));
+#endif  // APOT
+        write_pot_table_potfit(g_files.tempfile);
+      }
+    }
+
+    // recombination of the mean
+    memcpy(m_old, m, n * sizeof(double));
+    for (int i = 0; i < n; i++) {
+      m[i] = 0.0;
+      for (int l = 0; l < mu; l++)
+        m[i] += w[l] * y[rank[l]][i];
+    }
+
+    // step size path with C^(-1/2) (m - m_old) / sigma
+    for (int j = 0; j < n; j++) {
+      double sum = 0.0;
+      for (int i = 0; i < n; i++)
+        sum += B[j][i] * (m[i] - m_old[i]);
+      tmp[j] = sum / d[j];
+    }
+
+    double ps_norm = 0.0;
+    for (int i = 0; i < n; i++) {
+      double sum = 0.0;
+      for (int j = 0; j < n; j++)
+        sum += B[j][i] * tmp[j];
+      ps[i] = (1.0 - cs) * ps[i] + sqrt(cs * (2.0 - cs) * mueff) * sum / sigma;
+      ps_norm += ps[i] * ps[i];
+    }
+    ps_norm = sqrt(ps_norm);
+
+    // stall the covariance path while the step size grows quickly
+    const int hsig = ps_norm / sqrt(1.0 - pow(1.0 - cs, 2.0 * (gen + 1))) /
+                         chin <
+                     1.4 + 2.0 / (n + 1.0);
+
+    for (int i = 0; i < n; i++)
+      pc[i] = (1.0 - cc) * pc[i] +
+              hsig * sqrt(cc * (2.0 - cc) * mueff) * (m[i] - m_old[i]) / sigma;
+
+    // rank-one and rank-mu update of the covariance
+    const double c_old = 1.0 - c1 - cmu + (1 - hsig) * c1 * cc * (2.0 - cc);
+
+    for (int i = 0; i < n; i++) {
+      for (int j = 0; j <= i; j++) {
+        double sum = 0.0;
+        for (int l = 0; l < mu; l++)
+          sum += w[l] * (y[rank[l]][i] - m_old[i]) * (y[rank[l]][j] - m_old[j]);
+        C[i][j] = c_old * C[i][j] + c1 * pc[i] * pc[j] +
+                  cmu * sum / (sigma * sigma);
+        C[j][i] = C[i][j];
+      }
+    }
+
+    sigma *= exp((cs / damps) * (ps_norm / chin - 1.0));
+
+    gen++;
+
+    if (gen - eigen_gen >= eigen_gap) {
+      eigen_gen = gen;
+      eigen_decomp(C, B, d, n);
+      for (int i = 0; i < n; i++)
+        d[i] = sqrt(MAX(d[i], 0.0));
+    }
+
+    double cost_sum = 0.0;
+    for (int k = 0; k < lambda; k++)
+      cost_sum += cost[k];
+
+    crit = cost[rank[lambda - 1]] - cost[rank[0]];
+
+    printf("%5d\t\t%15f\t%20f\t%.2e\t%.2e\n", gen, min_cost, cost_sum / lambda,
+           crit, sigma);
+    fflush(stdout);
+
+    // End optimization if break flagfile exists
+    if (g_files.flagfile && *g_files.flagfile != '\0') {
+      FILE* ff = fopen(g_files.flagfile, "r");
+
+      if (NULL != ff) {
+        printf("\nCMA-ES terminated ");
+        printf("in presence of break flagfile \"%s\"!\n\n", g_files.flagfile);
+        fclose(ff);
+        remove(g_files.flagfile);
+        break;
+      }
+    }
+
+    // the distribution has collapsed or became degenerate
+    double d_min = d[0];
+    double d_max = d[0];
+    for (int i = 1; i < n; i++) {
+      d_min = MIN(d_min, d[i]);
+      d_max = MAX(d_max, d[i]);
+    }
+
+    if (sigma * d_max < TOLX || d_max * d_max > MAX_COND * d_min * d_min) {
+      printf("The sample distribution has degenerated, stopping CMA-ES.\n");
+      break;
+    }
+  } while (crit >= g_param.cmaes_threshold &&
+           min_cost >= g_param.cmaes_threshold);
+
+  printf("Finished CMA-ES after %d generations.\n", gen);
+  fflush(stdout);
+
+#if defined(MPI)
+  // only the first group takes part in the following optimization, unless
+  // its line search evaluates several points
+  if (g_param.linmin_points == 1)
+    stop_groups();
+#endif  // MPI
+
+  memcpy(xi, best, g_calc.ndimtot * sizeof(double));
+
+  if (*g_files.tempfile != '\0') {
+#if defined(APOT)
+    update_apot_table(xi);
+#endif  // APOT
+    write_pot_table_potfit(g_files.tempfile);
+  }
+}
+
+#endif  // CMAES
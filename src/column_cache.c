@@ -0,0 +1,449 @@
+/****************************************************************
+ *
+ * column_cache.c: stored contributions of the pair potential columns
+ *
+ ****************************************************************
+ *
+ * Copyright 2002-2017 - the potfit development team
+ *
+ * https://www.potfit.net/
+ *
+ ****************************************************************
+ *
+ * This file is part of potfit.
+ *
+ * potfit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * potfit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with potfit; if not, see <http://www.gnu.org/licenses/>.
+ *
+ ****************************************************************/
+
+/****************************************************************
+ *
+ *  The pair potential columns contribute additively to the forces,
+ *  energies and stresses. The contribution of every column to the
+ *  local configurations is kept between force calculations, so only
+ *  the columns whose potential table has changed are evaluated again,
+ *  e.g. a single column after a one-parameter move of the simulated
+ *  annealing. The cache needs paircol times the size of the local
+ *  force vector.
+ *
+ *  The neighbors are sorted by configuration and column, which also
+ *  tells the columns a configuration depends on. Configurations that
+ *  do not contain any of the changed columns, e.g. the binaries of a
+ *  multicomponent fit, keep their residuals and error sum from the
+ *  previous force calculation.
+ *
+ ****************************************************************/
+
+#include "potfit.h"
+
+#include "chempot.h"
+#include "column_cache.h"
+#include "force.h"
+#include "memory.h"
+#include "splines.h"
+#include "utils.h"
+
+#if defined(PAIR)
+
+#if defined(STRESS)
+#define NSTRESS 6
+#else
+#define NSTRESS 0
+#endif  // STRESS
+
+typedef struct {
+  int init;
+
+  int natoms;       /* number of local atoms */
+  int len;          /* length of the contribution of one column */
+  int* start;       /* neighbors of column col in local configuration i: */
+  int* idx;         /*   idx[start[i * paircol + col]] ... and the atom */
+  int* atom;        /*   within the configuration in atom[] */
+  double** contrib; /* contribution of each column, local force vector */
+  double* table;    /* potential table the contributions belong to */
+  int* changed;     /* columns to evaluate in this force calculation */
+  double* resid;    /* residuals of the local configurations */
+  double* error;    /* error sums of the local configurations */
+#if defined(APOT)
+  double* cp;       /* chemical potentials the residuals belong to */
+  int* changed_cp;  /* chemical potentials changed in this calculation */
+#endif  // APOT
+} column_cache_t;
+
+static column_cache_t g_ccache;
+
+/****************************************************************
+  build_column_cache
+    sort the neighbors of the local configurations by column
+****************************************************************/
+
+static void build_column_cache(void)
+{
+  const int paircol = g_calc.paircol;
+  int num_neigh = 0;
+
+  g_ccache.natoms = 0;
+  for (int i = 0; i < g_mpi.myconf; i++) {
+    g_ccache.natoms += g_config.inconf[g_mpi.firstconf + i];
+    num_neigh += g_config.conf_neigh[i].len;
+  }
+
+  g_ccache.len = 3 * g_ccache.natoms + (1 + NSTRESS) * g_mpi.myconf;
+  g_ccache.start = (int*)Realloc(g_ccache.start,
+                                 (g_mpi.myconf * paircol + 1) * sizeof(int));
+  g_ccache.idx = (int*)Realloc(g_ccache.idx, MAX(1, num_neigh) * sizeof(int));
+  g_ccache.atom = (int*)Realloc(g_ccache.atom, MAX(1, num_neigh) * sizeof(int));
+  g_ccache.table = (double*)Realloc(g_ccache.table,
+                                    g_pot.calc_pot.len * sizeof(double));
+  g_ccache.resid = (double*)Realloc(g_ccache.resid,
+                                    MAX(1, g_ccache.len) * sizeof(double));
+  g_ccache.error = (double*)Realloc(g_ccache.error,
+                                    MAX(1, g_mpi.myconf) * sizeof(double));
+
+  if (g_ccache.contrib == NULL) {
+    g_ccache.contrib = (double**)Malloc(paircol * sizeof(double*));
+    g_ccache.changed = (int*)Malloc(paircol * sizeof(int));
+#if defined(APOT)
+    const int num_cp = g_param.ntypes + g_param.compnodes;
+    g_ccache.cp = (double*)Malloc(num_cp * sizeof(double));
+    g_ccache.changed_cp = (int*)Malloc(num_cp * sizeof(int));
+#endif  // APOT
+  }
+
+  for (int col = 0; col < paircol; col++)
+    g_ccache.contrib[col] = (double*)Realloc(
+        g_ccache.contrib[col], MAX(1, g_ccache.len) * sizeof(double));
+
+  int n = 0;
+
+  for (int i = 0; i < g_mpi.myconf; i++) {
+    const int natoms = g_config.inconf[g_mpi.firstconf + i];
+    neigh_list_t* nl = g_config.conf_neigh + i;
+
+    for (int col = 0; col < paircol; col++) {
+      g_ccache.start[i * paircol + col] = n;
+      for (int a = 0; a < natoms; a++) {
+        for (int k = nl->start[a]; k < nl->start[a + 1]; k++) {
+          if (nl->col[0][k] == col && nl->r[k] < g_pot.calc_pot.end[col]) {
+            g_ccache.idx[n] = k;
+            g_ccache.atom[n] = a;
+            n++;
+          }
+        }
+      }
+    }
+  }
+
+  g_ccache.start[g_mpi.myconf * paircol] = n;
+
+  g_ccache.init = 1;
+}
+
+/****************************************************************
+  invalidate_column_cache
+    rebuild the cache and evaluate all columns in the next force
+    calculation, e.g. after the neighbor lists have changed
+****************************************************************/
+
+void invalidate_column_cache(void) { g_ccache.init = 0; }
+
+/****************************************************************
+  add_column
+    contribution of column col to local configuration i
+****************************************************************/
+
+static void add_column(double* xi, int i, int col)
+{
+  const int config_idx = g_mpi.firstconf + i;
+  const int first_atom = g_config.cnfstart[config_idx];
+  const int uf = g_config.conf_uf[i];
+#if defined(STRESS)
+  const int us = g_config.conf_us[i];
+#endif  // STRESS
+  neigh_list_t* nl = g_config.conf_neigh + i;
+
+  // forces of the local atoms, energy and stresses of the configuration
+  double* f = g_ccache.contrib[col];
+  double* e = g_ccache.contrib[col] + 3 * g_ccache.natoms + i;
+#if defined(STRESS)
+  double* s = e + g_mpi.myconf + 5 * i;
+#endif  // STRESS
+
+  memset(f + 3 * (first_atom - g_mpi.firstatom), 0,
+         3 * g_config.inconf[config_idx] * sizeof(double));
+  *e = 0.0;
+#if defined(STRESS)
+  memset(s, 0, 6 * sizeof(double));
+#endif  // STRESS
+
+  for (int n = g_ccache.start[i * g_calc.paircol + col];
+       n < g_ccache.start[i * g_calc.paircol + col + 1]; n++) {
+    const int k = g_ccache.idx[n];
+    const int n_i = 3 * (first_atom + g_ccache.atom[n] - g_mpi.firstatom);
+    double phi_val = 0.0;
+    double phi_grad = 0.0;
+
+    if (uf)
+      phi_val = splint_comb_dir(&g_pot.calc_pot, xi, nl->slot[0][k],
+                                nl->shift[0][k], nl->step[0][k], &phi_grad);
+    else
+      phi_val = splint_dir(&g_pot.calc_pot, xi, nl->slot[0][k],
+                           nl->shift[0][k], nl->step[0][k]);
+
+    // avoid double counting if atom is interacting with itself
+    if (nl->nr[k] == first_atom + g_ccache.atom[n]) {
+      phi_val *= 0.5;
+      phi_grad *= 0.5;
+    }
+
+    *e += phi_val;
+
+    if (uf) {
+      vector tmp_force;
+      tmp_force.x = nl->dist_r[k].x * phi_grad;
+      tmp_force.y = nl->dist_r[k].y * phi_grad;
+      tmp_force.z = nl->dist_r[k].z * phi_grad;
+      f[n_i + 0] += tmp_force.x;
+      f[n_i + 1] += tmp_force.y;
+      f[n_i + 2] += tmp_force.z;
+      // actio = reactio
+      const int n_j = 3 * (nl->nr[k] - g_mpi.firstatom);
+      f[n_j + 0] -= tmp_force.x;
+      f[n_j + 1] -= tmp_force.y;
+      f[n_j + 2] -= tmp_force.z;
+#if defined(STRESS)
+      if (us) {
+        s[0] -= nl->dist[k].x * tmp_force.x;
+        s[1] -= nl->dist[k].y * tmp_force.y;
+        s[2] -= nl->dist[k].z * tmp_force.z;
+        s[3] -= nl->dist[k].x * tmp_force.y;
+        s[4] -= nl->dist[k].y * tmp_force.z;
+        s[5] -= nl->dist[k].z * tmp_force.x;
+      }
+#endif  // STRESS
+    }
+  }
+}
+
+/****************************************************************
+  sum_columns
+    residuals and partial error sum of local configuration i
+****************************************************************/
+
+static void sum_columns(double* xi_opt, double* forces, int i)
+{
+  const int paircol = g_calc.paircol;
+  const int config_idx = g_mpi.firstconf + i;
+  const int uf = g_config.conf_uf[i];
+  const double weight = g_config.conf_weight[config_idx];
+  conf_sum_t* csum = g_calc.conf_sum + config_idx;
+
+  csum->error = 0.0;
+
+  for (int a = 0; a < g_config.inconf[config_idx]; a++) {
+    const int n_i = 3 * (g_config.cnfstart[config_idx] + a);
+    const int l = n_i - 3 * g_mpi.firstatom;
+
+    if (!uf) {
+      memset(forces + n_i, 0, 3 * sizeof(double));
+      continue;
+    }
+
+    for (int d = 0; d < 3; d++) {
+      double sum = -g_config.force_0[n_i + d];
+      for (int col = 0; col < paircol; col++)
+        sum += g_ccache.contrib[col][l + d];
+      forces[n_i + d] = sum;
+    }
+
+#if defined(FWEIGHT) || defined(CONTRIB)
+    atom_t* atom = g_config.conf_atoms + n_i / 3 - g_mpi.firstatom;
+#endif  // FWEIGHT || CONTRIB
+#if defined(FWEIGHT)
+    // weigh by absolute value of force
+    forces[n_i + 0] /= FORCE_EPS + atom->absforce;
+    forces[n_i + 1] /= FORCE_EPS + atom->absforce;
+    forces[n_i + 2] /= FORCE_EPS + atom->absforce;
+#endif  // FWEIGHT
+
+#if defined(CONTRIB)
+    if (atom->contrib)
+#endif  // CONTRIB
+      csum->error += weight * (dsquare(forces[n_i + 0]) +
+                               dsquare(forces[n_i + 1]) +
+                               dsquare(forces[n_i + 2]));
+  }
+
+  // energy contributions
+  const int e = 3 * g_ccache.natoms + i;
+  double energy = 0.0;
+
+#if defined(APOT)
+  if (g_param.enable_cp)
+    energy += chemical_potential(g_param.ntypes, g_config.na_type[config_idx],
+                                 xi_opt + g_pot.cp_start);
+#endif  // APOT
+  for (int col = 0; col < paircol; col++)
+    energy += g_ccache.contrib[col][e];
+
+  forces[g_calc.energy_p + config_idx] =
+      energy / (double)g_config.inconf[config_idx] -
+      g_config.force_0[g_calc.energy_p + config_idx];
+  csum->error += weight * g_param.eweight *
+                 dsquare(forces[g_calc.energy_p + config_idx]);
+
+#if defined(STRESS)
+  // stress contributions
+  const int stress_idx = g_calc.stress_p + 6 * config_idx;
+  const int s = 3 * g_ccache.natoms + g_mpi.myconf + 6 * i;
+
+  if (uf && g_config.conf_us[i]) {
+    for (int j = 0; j < 6; j++) {
+      double stress = 0.0;
+      for (int col = 0; col < paircol; col++)
+        stress += g_ccache.contrib[col][s + j];
+      forces[stress_idx + j] = stress / g_config.conf_vol[i] -
+                               g_config.force_0[stress_idx + j];
+      csum->error += weight * g_param.sweight * dsquare(forces[stress_idx + j]);
+    }
+  } else
+    memset(forces + stress_idx, 0, 6 * sizeof(double));
+#endif  // STRESS
+}
+
+/****************************************************************
+  depends_on_changes
+    check if local configuration i contains a changed column or
+    chemical potential
+****************************************************************/
+
+static int depends_on_changes(int i)
+{
+  const int paircol = g_calc.paircol;
+
+  for (int col = 0; col < paircol; col++)
+    if (g_ccache.changed[col] && g_ccache.start[i * paircol + col + 1] >
+                                     g_ccache.start[i * paircol + col])
+      return 1;
+
+#if defined(APOT)
+  if (g_param.enable_cp) {
+    const int* na_type = g_config.na_type[g_mpi.firstconf + i];
+
+    for (int j = 0; j < g_param.ntypes; j++)
+      if (g_ccache.changed_cp[j] && na_type[j] > 0)
+        return 1;
+    // composition nodes depend on the composition of the configuration
+    for (int j = g_param.ntypes; j < g_param.ntypes + g_param.compnodes; j++)
+      if (g_ccache.changed_cp[j])
+        return 1;
+  }
+#endif  // APOT
+
+  return 0;
+}
+
+/****************************************************************
+  copy_residuals
+    store the residuals of local configuration i in the cache
+    (to_cache == 1) or restore them from there (to_cache == 0)
+****************************************************************/
+
+static void copy_residuals(double* forces, int i, int to_cache)
+{
+  const int config_idx = g_mpi.firstconf + i;
+  const int n_i = 3 * g_config.cnfstart[config_idx];
+  const int l = n_i - 3 * g_mpi.firstatom;
+  const size_t size = 3 * g_config.inconf[config_idx] * sizeof(double);
+  double* e = g_ccache.resid + 3 * g_ccache.natoms + i;
+#if defined(STRESS)
+  double* s = g_ccache.resid + 3 * g_ccache.natoms + g_mpi.myconf + 6 * i;
+#endif  // STRESS
+
+  if (to_cache) {
+    memcpy(g_ccache.resid + l, forces + n_i, size);
+    *e = forces[g_calc.energy_p + config_idx];
+#if defined(STRESS)
+    memcpy(s, forces + g_calc.stress_p + 6 * config_idx, 6 * sizeof(double));
+#endif  // STRESS
+    g_ccache.error[i] = g_calc.conf_sum[config_idx].error;
+  } else {
+    memcpy(forces + n_i, g_ccache.resid + l, size);
+    forces[g_calc.energy_p + config_idx] = *e;
+#if defined(STRESS)
+    memcpy(forces + g_calc.stress_p + 6 * config_idx, s, 6 * sizeof(double));
+#endif  // STRESS
+    g_calc.conf_sum[config_idx].error = g_ccache.error[i];
+  }
+}
+
+/****************************************************************
+  calc_forces_column_cache
+    evaluate the columns whose table differs from the stored one
+    and update the splines of these columns, then sum up all
+    columns into the force vector of the local configurations that
+    depend on them; the residuals of the other configurations are
+    taken from the cache, the partial error sums are left in
+    g_calc.conf_sum
+****************************************************************/
+
+void calc_forces_column_cache(double* xi, double* xi_opt, double* forces)
+{
+  const int paircol = g_calc.paircol;
+  int rebuild = !g_ccache.init;
+
+  if (rebuild)
+    build_column_cache();
+
+  for (int col = 0; col < paircol; col++) {
+    // the two gradients are stored in front of the table of each column
+    const int first = g_pot.calc_pot.first[col] - 2;
+    const size_t size = (g_pot.calc_pot.last[col] - first + 1) * sizeof(double);
+
+    g_ccache.changed[col] =
+        rebuild || memcmp(xi + first, g_ccache.table + first, size) != 0;
+
+    if (g_ccache.changed[col]) {
+      memcpy(g_ccache.table + first, xi + first, size);
+      update_splines(xi, col, 1, 1);
+    }
+  }
+
+#if defined(APOT)
+  if (g_param.enable_cp) {
+    for (int j = 0; j < g_param.ntypes + g_param.compnodes; j++) {
+      const double cp = xi_opt[g_pot.cp_start + j];
+      g_ccache.changed_cp[j] = rebuild || cp != g_ccache.cp[j];
+      g_ccache.cp[j] = cp;
+    }
+  }
+#endif  // APOT
+
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic)
+#endif  // _OPENMP
+  for (int i = 0; i < g_mpi.myconf; i++) {
+    if (!rebuild && !depends_on_changes(i)) {
+      copy_residuals(forces, i, 0);
+      continue;
+    }
+    for (int col = 0; col < paircol; col++)
+      if (g_ccache.changed[col])
+        add_column(xi, i, col);
+    sum_columns(xi_opt, forces, i);
+    copy_residuals(forces, i, 1);
+  }
+}
+
+#endif  // PAIR
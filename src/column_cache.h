@@ -0,0 +1,41 @@
+/****************************************************************
+ *
+ * column_cache.h: stored contributions of the pair potential columns
+ *
+ ****************************************************************
+ *
+ * Copyright 2002-2017 - the potfit development team
+ *
+ * https://www.potfit.net/
+ *
+ ****************************************************************
+ *
+ * This file is part of potfit.
+ *
+ * potfit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * potfit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with potfit; if not, see <http://www.gnu.org/licenses/>.
+ *
+ ****************************************************************/
+
+#ifndef COLUMN_CACHE_H_INCLUDED
+#define COLUMN_CACHE_H_INCLUDED
+
+#if defined(PAIR)
+
+void invalidate_column_cache(void);
+
+void calc_forces_column_cache(double* xi, double* xi_opt, double* forces);
+
+#endif  // PAIR
+
+#endif  // COLUMN_CACHE_H_INCLUDED
@@ -49,6 +49,11 @@ typedef struct {
   vector cell_scale;
   int have_box_vector;
   sym_tens* stresses;
+  int max_atom_type;
+  int with_forces;
+  int with_stresses;
+  long offset;     /* file position of the first configuration to read */
+  int num_configs; /* number of configurations to read, 0 for all */
 #if defined(CONTRIB)
   int have_contrib_box_vector;
   int n_spheres;
@@ -59,6 +64,16 @@ typedef struct {
 #endif  // CONTRIB
 } config_state;
 
+// neighbor candidate of the linked cell search: atom and periodic image
+typedef struct {
+  int j;
+  int ix, iy, iz;
+} neigh_candidate_t;
+
+void parse_config_file(config_state* cstate, double* mindist);
+#if defined(MPI)
+void index_config_file(config_state* cstate);
+#endif  // MPI
 void reset_cstate(config_state* cstate);
 void create_memory_for_config(config_state* cstate);
 void init_atom_memory(atom_t* atom);
@@ -66,6 +81,12 @@ void read_box_vector(char const* pline, vector* pvect, config_state* cstate);
 void read_chemical_elements(char* psrc, config_state* cstate);
 void init_box_vectors(config_state* cstate);
 void init_neighbors(config_state* cstate, double* mindist);
+void find_neighbors(config_state* cstate, double* mindist, int count_only);
+int find_neighbors_cells(config_state* cstate, double* mindist,
+                         int count_only);
+int compare_candidates(const void* a, const void* b);
+void add_neighbor(config_state* cstate, double* mindist, int count_only, int i,
+                  int j, int ix, int iy, int iz);
 void set_neighbor_slot(neigh_t* neighbor, int col, double r, int neighbor_slot);
 void init_angles(config_state* cstate);
 
@@ -86,19 +107,10 @@ void read_config(const char* filename)
 {
   config_state cstate;
 
-  char buffer[1024];
-  char* ptr = NULL;
-  char* res = NULL;
-
-  int max_atom_type = -1;
-  int with_forces = 0;
-  int with_stresses = 0;
-
-  fpos_t filepos;
-
   memset(&cstate, 0, sizeof(cstate));
 
   cstate.filename = filename;
+  cstate.max_atom_type = -1;
 
   // initialize elements array if not yet done from potential file
   if (g_config.elements == NULL) {
@@ -111,6 +123,46 @@ void read_config(const char* filename)
   } else
     cstate.num_fixed_elements = g_param.ntypes;
 
+#if defined(MPI)
+  // each process reads its own configurations, see read_config_part()
+  if (g_param.distributed_input) {
+    index_config_file(&cstate);
+    return;
+  }
+#endif  // MPI
+
+  double* mindist = init_mindist();
+
+  // reuse the tables of a previous run if the configurations did not change
+  int cached = 0;
+  uint64_t cache_key = 0;
+
+  if (g_param.neigh_cache) {
+    cache_key = config_cache_key(filename);
+    cached = read_config_cache(filename, cache_key, mindist,
+                               &cstate.max_atom_type, &cstate.with_forces,
+                               &cstate.with_stresses);
+  }
+
+  if (!cached) {
+    parse_config_file(&cstate, mindist);
+
+    if (g_param.neigh_cache)
+      write_config_cache(filename, cache_key, mindist, cstate.max_atom_type,
+                         cstate.with_forces, cstate.with_stresses);
+  }
+
+  finish_config(mindist, cstate.max_atom_type, cstate.with_forces,
+                cstate.with_stresses);
+}
+
+/****************************************************************
+  init_mindist
+    initial minimal distances are the cutoff radii
+****************************************************************/
+
+double* init_mindist(void)
+{
   // initialize minimum distance array
   double* mindist = (double*)Malloc(isquare(g_param.ntypes) * sizeof(double));
 
@@ -127,33 +179,269 @@ void read_config(const char* filename)
     }
   }
 
+  return mindist;
+}
+
+/****************************************************************
+  finish_config
+    type statistics, reference force vector and potential ranges
+    of all configurations
+****************************************************************/
+
+void finish_config(double* mindist, int max_atom_type, int with_forces,
+                   int with_stresses)
+{
+  // calculate the total number of the atom types
+  g_config.na_type =
+      (int**)Realloc(g_config.na_type, (g_config.nconf + 1) * sizeof(int*));
+
+  g_config.na_type[g_config.nconf] = (int*)Malloc(g_param.ntypes * sizeof(int));
+
+  for (int i = 0; i < g_config.nconf; i++)
+    for (int j = 0; j < g_param.ntypes; j++)
+      g_config.na_type[g_config.nconf][j] += g_config.na_type[i][j];
+
+  // print diagnostic message
+  printf("\nRead %d configurations (%d with forces, %d with stresses)\n",
+         g_config.nconf, with_forces, with_stresses);
+  printf("with a total of %d atoms (", g_config.natoms);
+
+  for (int i = 0; i < g_param.ntypes; i++) {
+    printf("%d %s (%.2f%%)", g_config.na_type[g_config.nconf][i],
+           g_config.elements[i],
+           100.0 * g_config.na_type[g_config.nconf][i] / g_config.natoms);
+    if (i != (g_param.ntypes - 1))
+      printf(", ");
+  }
+  printf(").\n");
+
+  // be pedantic about too large g_param.ntypes
+  if ((max_atom_type + 1) < g_param.ntypes) {
+    error(0, "There are less than %d atom types in your configurations!\n",
+          g_param.ntypes);
+    error(1, "Please adjust \"ntypes\" in your parameter file.\n");
+  }
+
+#if defined(KIM)
+  if (g_param.ntypes > g_kim.freeparams.nspecies)
+    error(1, "The KIM model %s does only support %d species!\n", g_kim.model_name, g_kim.freeparams.nspecies);
+
+  // check if all atom types are supported by the KIM model
+  for (int i = 0; i < g_param.ntypes; ++i) {
+    int found = 0;
+    for (int j = 0; j < g_kim.freeparams.nspecies; ++j) {
+      if (strcmp(g_config.elements[i], g_kim.freeparams.species[j]) == 0) {
+        found = 1;
+        break;
+      }
+    }
+    if (!found)
+      error(1, "The KIM model %s does not support the species %s!\n", g_kim.model_name, g_config.elements[i]);
+  }
+#endif // KIM
+
+  /* mdim is the dimension of the force vector:
+     - 3*natoms forces
+     - nconf cohesive energies,
+     - 6*nconf stress tensor components */
+  g_calc.mdim = 3 * g_config.natoms + g_config.nconf;
+#if defined(STRESS)
+  g_calc.mdim += 6 * g_config.nconf;
+#endif  // STRESS
+
+  // mdim has additional components for EAM-like potentials
+#if defined(EAM) || defined(ADP) || defined(MEAM)
+  g_calc.mdim += g_config.nconf;     // nconf limiting constraints
+  g_calc.mdim += 2 * g_param.ntypes; // g_param.ntypes dummy constraints
+#if defined(TBEAM)
+  g_calc.mdim +=
+      2 * g_param.ntypes; // additional dummy constraints for s-band
+#endif                    // TBEAM
+#endif                    // EAM || ADP || MEAM
+
+  // mdim has additional components for analytic potentials
+#if defined(APOT)
+  // 1 slot for each analytic parameter -> punishment
+  g_calc.mdim += g_pot.opt_pot.idxlen;
+  // 1 slot for each analytic potential -> punishment
+  g_calc.mdim += g_pot.apot_table.number + 1;
+#endif  // APOT
+
+  // copy forces into single vector
+  g_config.force_0 = (double*)Malloc(g_calc.mdim * sizeof(double));
+
+  int k = 0;
+
+  /* first forces */
+  for (int i = 0; i < g_config.natoms; i++) {
+    g_config.force_0[k++] = g_config.atoms[i].force.x;
+    g_config.force_0[k++] = g_config.atoms[i].force.y;
+    g_config.force_0[k++] = g_config.atoms[i].force.z;
+  }
+
+  // then cohesive energies
+  for (int i = 0; i < g_config.nconf; i++)
+    g_config.force_0[k++] = g_config.coheng[i];
+
+#if defined(STRESS)
+  // then stresses
+  for (int i = 0; i < g_config.nconf; i++) {
+    if (g_config.usestress[i]) {
+      g_config.force_0[k++] = g_config.stress[i].xx;
+      g_config.force_0[k++] = g_config.stress[i].yy;
+      g_config.force_0[k++] = g_config.stress[i].zz;
+      g_config.force_0[k++] = g_config.stress[i].xy;
+      g_config.force_0[k++] = g_config.stress[i].yz;
+      g_config.force_0[k++] = g_config.stress[i].zx;
+    } else
+      k += 6;
+  }
+#endif  // STRESS
+
+  if (g_param.write_pair == 1)
+    write_pair_distribution_file();
+
+/* assign correct distances to different tables */
+#if defined(APOT)
+  double min = 10.0;
+
+  /* pair potentials */
+  for (int i = 0; i < g_param.ntypes; i++) {
+    for (int j = 0; j < g_param.ntypes; j++) {
+      k = (i <= j) ? i * g_param.ntypes + j - ((i * (i + 1)) / 2)
+                   : j * g_param.ntypes + i - ((j * (j + 1)) / 2);
+      if (mindist[k] >= 99.9)
+        mindist[k] = 2.5;
+      g_config.rmin[i * g_param.ntypes + j] = mindist[k];
+      g_pot.apot_table.begin[k] = mindist[k] * 0.95;
+      g_pot.opt_pot.begin[k] = mindist[k] * 0.95;
+      g_pot.calc_pot.begin[k] = mindist[k] * 0.95;
+      min = MIN(min, mindist[k]);
+    }
+  }
+
+/* transfer functions */
+#if defined(EAM) || defined(ADP) || defined(MEAM)
+  for (int i = g_calc.paircol; i < g_calc.paircol + g_param.ntypes; i++) {
+    g_pot.apot_table.begin[i] = min * 0.95;
+    g_pot.opt_pot.begin[i] = min * 0.95;
+    g_pot.calc_pot.begin[i] = min * 0.95;
+  }
+#if defined(TBEAM)
+  for (int i = g_calc.paircol + 2 * g_param.ntypes;
+       i < g_calc.paircol + 3 * g_param.ntypes; i++) {
+    g_pot.apot_table.begin[i] = min * 0.95;
+    g_pot.opt_pot.begin[i] = min * 0.95;
+    g_pot.calc_pot.begin[i] = min * 0.95;
+  }
+#endif  // TBEAM
+#endif  // EAM || ADP || MEAM
+
+/* dipole and quadrupole functions */
+#if defined(ADP)
+  for (int i = 0; i < g_calc.paircol; i++) {
+    int j = g_calc.paircol + 2 * g_param.ntypes + i;
+    g_pot.apot_table.begin[j] = min * 0.95;
+    g_pot.opt_pot.begin[j] = min * 0.95;
+    g_pot.calc_pot.begin[j] = min * 0.95;
+    j = 2 * g_calc.paircol + 2 * g_param.ntypes + i;
+    g_pot.apot_table.begin[j] = min * 0.95;
+    g_pot.opt_pot.begin[j] = min * 0.95;
+    g_pot.calc_pot.begin[j] = min * 0.95;
+  }
+#endif  // ADP
+
+#if defined(MEAM)
+  /* f_ij */
+  for (int i = 0; i < g_calc.paircol; i++) {
+    int j = g_calc.paircol + 2 * g_param.ntypes + i;
+    g_pot.apot_table.begin[j] = min * 0.95;
+    g_pot.opt_pot.begin[j] = min * 0.95;
+    g_pot.calc_pot.begin[j] = min * 0.95;
+  }
+  /* g_i */
+  /* g_i takes cos(theta) as an argument, so we need to tabulate it only
+     in the range of [-1:1]. Actually we use [-1.1:1.1] to be safe. */
+  for (int i = 0; i < g_param.ntypes; i++) {
+    int j = 2 * g_calc.paircol + 2 * g_param.ntypes + i;
+    g_pot.apot_table.begin[j] = -1.1;
+    g_pot.opt_pot.begin[j] = -1.1;
+    g_pot.calc_pot.begin[j] = -1.1;
+    g_pot.apot_table.end[j] = 1.1;
+    g_pot.opt_pot.end[j] = 1.1;
+    g_pot.calc_pot.end[j] = 1.1;
+  }
+#endif  // MEAM
+
+  /* recalculate step, invstep and xcoord for new tables */
+  for (int i = 0; i < g_pot.calc_pot.ncols; i++) {
+    g_pot.calc_pot.step[i] =
+        (g_pot.calc_pot.end[i] - g_pot.calc_pot.begin[i]) / (APOT_STEPS - 1);
+    g_pot.calc_pot.invstep[i] = 1.0 / g_pot.calc_pot.step[i];
+    for (int j = 0; j < APOT_STEPS; j++) {
+      int index = i * APOT_STEPS + (i + 1) * 2 + j;
+      g_pot.calc_pot.xcoord[index] =
+          g_pot.calc_pot.begin[i] + j * g_pot.calc_pot.step[i];
+    }
+  }
+
+#if !defined(KIM)
+  // distributed input updates the slots on each process
+  if (!g_param.distributed_input)
+    update_slots(g_config.atoms, g_config.natoms);
+#endif  // KIM
+#endif  // APOT
+
+  print_minimal_distances_matrix(mindist);
+}
+
+/****************************************************************
+  parse_config_file
+    reads all configurations and calculates the neighbor lists
+****************************************************************/
+
+void parse_config_file(config_state* cstate, double* mindist)
+{
+  char buffer[1024];
+  char* ptr = NULL;
+  char* res = NULL;
+
+  fpos_t filepos;
+
   // open file
-  FILE* config_file = fopen(filename, "r");
+  FILE* config_file = fopen(cstate->filename, "r");
 
   if (config_file == NULL)
-    error(1, "Could not open file %s\n", filename);
+    error(1, "Could not open file %s\n", cstate->filename);
 
-  printf(
-      "Reading the config file >> %s << and calculating neighbor lists ...\n",
-      filename);
-  fflush(stdout);
+  if (cstate->offset > 0 && fseek(config_file, cstate->offset, SEEK_SET) != 0)
+    error(1, "Could not seek to configuration %d in %s\n", cstate->config + 1,
+          cstate->filename);
+
+  if (g_mpi.myid == 0) {
+    printf(
+        "Reading the config file >> %s << and calculating neighbor lists ...\n",
+        cstate->filename);
+    fflush(stdout);
+  }
 
   // read configurations until the end of the file
   do {
     res = fgets(buffer, 1024, config_file);
 
-    ++cstate.line;
+    ++cstate->line;
 
     if (res == NULL)
-      error(1, "Unexpected end of file in %s\n", filename);
+      error(1, "Unexpected end of file in %s\n", cstate->filename);
 
     if (res[0] == '#' && res[1] == 'N') {
-      reset_cstate(&cstate);
-      ++cstate.config;
+      reset_cstate(cstate);
+      ++cstate->config;
 
-      if (sscanf(res + 3, "%d %d", &cstate.atom_count, &cstate.use_force) < 2)
+      if (sscanf(res + 3, "%d %d", &cstate->atom_count, &cstate->use_force) <
+          2)
         error(1, "%s: Error in atom number specification on line %d\n",
-              filename, cstate.line);
+              cstate->filename, cstate->line);
     } else
       continue;
 
@@ -163,22 +451,22 @@ void read_config(const char* filename)
 #else
     int min_atom_count = 2;
 #endif  // THREEBODY
-    if (cstate.atom_count < min_atom_count)
+    if (cstate->atom_count < min_atom_count)
       error(1,
             "Configuration %d (starting on line %d) has not enough atoms, "
             "please remove it.\n",
-            g_config.nconf + 1, cstate.line);
+            g_config.nconf + 1, cstate->line);
 
-    create_memory_for_config(&cstate);
+    create_memory_for_config(cstate);
 
-    for (int i = g_config.natoms; i < g_config.natoms + cstate.atom_count; i++)
+    for (int i = g_config.natoms; i < g_config.natoms + cstate->atom_count; i++)
       memset(g_config.atoms + i, 0, sizeof(atom_t));
 
-    g_config.inconf[g_config.nconf] = cstate.atom_count;
+    g_config.inconf[g_config.nconf] = cstate->atom_count;
     g_config.cnfstart[g_config.nconf] = g_config.natoms;
-    g_config.useforce[g_config.nconf] = cstate.use_force;
+    g_config.useforce[g_config.nconf] = cstate->use_force;
 #if defined(STRESS)
-    cstate.stresses = g_config.stress + g_config.nconf;
+    cstate->stresses = g_config.stress + g_config.nconf;
 #endif  // STRESS
 
 #if defined(KIM)
@@ -192,16 +480,16 @@ void read_config(const char* filename)
 
       if (res == NULL || feof(config_file))
         error(1, "Incomplete header on line %d in configuration file %s\n",
-              cstate.line, filename);
+              cstate->line, cstate->filename);
 
       if ((ptr = strchr(res, '\n')) != NULL)
         *ptr = '\0';
 
-      cstate.line++;
+      cstate->line++;
 
       if (res[0] != '#') {
         warning("Ignoring unknown header item in line %d of file >> %s <<:\n",
-                cstate.line, filename);
+                cstate->line, cstate->filename);
         warning("  \"%s\"\n", res);
       }
 
@@ -209,18 +497,18 @@ void read_config(const char* filename)
         /* read the box vectors */
         case 'x':
         case 'X':
-          read_box_vector(res + 3, &cstate.box_x, &cstate);
-          cstate.have_box_vector |= 1 << 0;
+          read_box_vector(res + 3, &cstate->box_x, cstate);
+          cstate->have_box_vector |= 1 << 0;
           break;
         case 'y':
         case 'Y':
-          read_box_vector(res + 3, &cstate.box_y, &cstate);
-          cstate.have_box_vector |= 1 << 1;
+          read_box_vector(res + 3, &cstate->box_y, cstate);
+          cstate->have_box_vector |= 1 << 1;
           break;
         case 'z':
         case 'Z':
-          read_box_vector(res + 3, &cstate.box_z, &cstate);
-          cstate.have_box_vector |= 1 << 2;
+          read_box_vector(res + 3, &cstate->box_z, cstate);
+          cstate->have_box_vector |= 1 << 2;
           break;
 #if defined(CONTRIB)
         case 'b':
@@ -228,33 +516,33 @@ void read_config(const char* filename)
           switch (res[3]) {
             case 'o':
             case 'O':
-              if (cstate.have_contrib_box_vector & 1) {
+              if (cstate->have_contrib_box_vector & 1) {
                 error(0, "There can only be one box of contributing atoms\n");
-                error(1, "  This occured in %s on line %d\n", filename,
-                      cstate.line);
+                error(1, "  This occured in %s on line %d\n", cstate->filename,
+                      cstate->line);
               }
-              read_box_vector(res + 5, &cstate.cbox_o, &cstate);
-              cstate.have_contrib_box_vector |= 1 << 0;
+              read_box_vector(res + 5, &cstate->cbox_o, cstate);
+              cstate->have_contrib_box_vector |= 1 << 0;
               break;
             case 'a':
             case 'A':
-              read_box_vector(res + 5, &cstate.cbox_a, &cstate);
-              cstate.have_contrib_box_vector |= 1 << 1;
+              read_box_vector(res + 5, &cstate->cbox_a, cstate);
+              cstate->have_contrib_box_vector |= 1 << 1;
               break;
             case 'b':
             case 'B':
-              read_box_vector(res + 5, &cstate.cbox_b, &cstate);
-              cstate.have_contrib_box_vector |= 1 << 2;
+              read_box_vector(res + 5, &cstate->cbox_b, cstate);
+              cstate->have_contrib_box_vector |= 1 << 2;
               break;
             case 'c':
             case 'C':
-              read_box_vector(res + 5, &cstate.cbox_c, &cstate);
-              cstate.have_contrib_box_vector |= 1 << 3;
+              read_box_vector(res + 5, &cstate->cbox_c, cstate);
+              cstate->have_contrib_box_vector |= 1 << 3;
               break;
             case 's':
             case 'S':
-              read_sphere_center(res + 5, &cstate);
-              cstate.n_spheres++;
+              read_sphere_center(res + 5, cstate);
+              cstate->n_spheres++;
               break;
           }
         } break;
@@ -262,36 +550,37 @@ void read_config(const char* filename)
         case 'e':
         case 'E':
           if (sscanf(res + 3, "%lf\n", &(g_config.coheng[g_config.nconf])) == 1)
-            cstate.have_energy = 1;
+            cstate->have_energy = 1;
           else
-            error(1, "%s: Error in energy on line %d\n", filename, cstate.line);
+            error(1, "%s: Error in energy on line %d\n", cstate->filename,
+                  cstate->line);
           break;
         case 'w':
         case 'W':
           if (sscanf(res + 3, "%lf\n",
                      &(g_config.conf_weight[g_config.nconf])) != 1)
-            error(1, "%s: Error in configuration weight on line %d\n", filename,
-                  cstate.line);
+            error(1, "%s: Error in configuration weight on line %d\n",
+                  cstate->filename, cstate->line);
           if (g_config.conf_weight[g_config.nconf] < 0.0)
             error(1, "%s: The configuration weight is negative on line %d\n",
-                  filename, cstate.line);
+                  cstate->filename, cstate->line);
           break;
         case 'c':
         case 'C':
           fgetpos(config_file, &filepos);
-          read_chemical_elements(res, &cstate);
+          read_chemical_elements(res, cstate);
           fsetpos(config_file, &filepos);
           break;
 #if defined(STRESS)
         case 's':
         case 'S':
           if (sscanf(res + 3, "%lf %lf %lf %lf %lf %lf\n",
-                     &(cstate.stresses->xx), &(cstate.stresses->yy),
-                     &(cstate.stresses->zz), &(cstate.stresses->xy),
-                     &(cstate.stresses->yz), &(cstate.stresses->zx)) == 6)
-            cstate.have_stress = 1;
+                     &(cstate->stresses->xx), &(cstate->stresses->yy),
+                     &(cstate->stresses->zz), &(cstate->stresses->xy),
+                     &(cstate->stresses->yz), &(cstate->stresses->zx)) == 6)
+            cstate->have_stress = 1;
           else
-            error(1, "Error in stress tensor on line %d\n", cstate.line);
+            error(1, "Error in stress tensor on line %d\n", cstate->line);
           break;
 #endif  // STRESS
         case 'f':
@@ -301,7 +590,7 @@ void read_config(const char* filename)
           if (res[1] != '#') {
             warning(
                 "Ignoring unknown header item in line %d of file >> %s <<:\n",
-                cstate.line, filename);
+                cstate->line, cstate->filename);
             warning("  \"%s\"\n", res);
           }
           break;
@@ -309,58 +598,59 @@ void read_config(const char* filename)
 
     } while (res[1] != 'F');
 
-    if (cstate.have_energy == 0)
-      error(1, "%s: missing energy in configuration %d!\n", filename,
+    if (cstate->have_energy == 0)
+      error(1, "%s: missing energy in configuration %d!\n", cstate->filename,
             g_config.nconf + 1);
 
-    if (cstate.have_box_vector != 7)
+    if (cstate->have_box_vector != 7)
       error(1, "Incomplete box vectors for config %d!\n", g_config.nconf + 1);
 
 #if defined(CONTRIB)
-    if (cstate.have_contrib_box_vector && cstate.have_contrib_box_vector != 15)
+    if (cstate->have_contrib_box_vector &&
+        cstate->have_contrib_box_vector != 15)
       error(1, "Incomplete box of contributing atoms for config %d!\n",
             g_config.nconf + 1);
 #endif  // CONTRIB
 
-    if (cstate.use_force)
-      with_forces++;
+    if (cstate->use_force)
+      cstate->with_forces++;
 
 #if defined(STRESS)
-    if (cstate.have_stress == 1) {
-      with_stresses++;
+    if (cstate->have_stress == 1) {
+      cstate->with_stresses++;
       g_config.usestress[g_config.nconf] = 1;
     }
 #endif  // STRESS
 
-    g_config.volume[g_config.nconf] = make_box(&cstate);
+    g_config.volume[g_config.nconf] = make_box(cstate);
 
 #if defined(KIM)
     if (g_kim.NBC == KIM_NEIGHBOR_TYPE_OPBC) {
       double small_value = 1e-8;
-      if(cstate.box_x.y > small_value || cstate.box_x.z > small_value
-	    || cstate.box_y.z > small_value || cstate.box_y.x > small_value
-	    || cstate.box_z.x > small_value || cstate.box_z.y > small_value){
+      if(cstate->box_x.y > small_value || cstate->box_x.z > small_value
+	    || cstate->box_y.z > small_value || cstate->box_y.x > small_value
+	    || cstate->box_z.x > small_value || cstate->box_z.y > small_value){
         error(1,"KIM: simulation box of configuration %d is not orthogonal. Try to use 'NEIGH_RVEC' "
 	      "instead of 'MI_OPBC'.\n", g_config.nconf);
       } else {
         // store the box size info in box_vectors
-        g_kim.box_vectors[3 * g_config.nconf + 0] = cstate.box_x.x;
-        g_kim.box_vectors[3 * g_config.nconf + 1] = cstate.box_y.y;
-        g_kim.box_vectors[3 * g_config.nconf + 2] = cstate.box_z.z;
+        g_kim.box_vectors[3 * g_config.nconf + 0] = cstate->box_x.x;
+        g_kim.box_vectors[3 * g_config.nconf + 1] = cstate->box_y.y;
+        g_kim.box_vectors[3 * g_config.nconf + 2] = cstate->box_z.z;
       }
     }
 #endif   // KIM
 
     // read the atoms
-    for (int i = 0; i < cstate.atom_count; i++) {
+    for (int i = 0; i < cstate->atom_count; i++) {
       atom_t* atom = g_config.atoms + g_config.natoms + i;
 
       if (7 > fscanf(config_file, "%d %lf %lf %lf %lf %lf %lf\n", &(atom->type),
                      &(atom->pos.x), &(atom->pos.y), &(atom->pos.z),
                      &(atom->force.x), &(atom->force.y), &(atom->force.z)))
-        error(1, "Corrupt configuration file on line %d\n", cstate.line + 1);
+        error(1, "Corrupt configuration file on line %d\n", cstate->line + 1);
 
-      cstate.line++;
+      cstate->line++;
 
       if (g_param.global_cell_scale != 1.0) {
         atom->pos.x *= g_param.global_cell_scale;
@@ -372,7 +662,7 @@ void read_config(const char* filename)
         error(
             1,
             "Corrupt configuration file on line %d: Incorrect atom type (%d)\n",
-            cstate.line, atom->type);
+            cstate->line, atom->type);
 
       atom->absforce = sqrt(dsquare(atom->force.x) + dsquare(atom->force.y) +
                             dsquare(atom->force.z));
@@ -380,275 +670,181 @@ void read_config(const char* filename)
       atom->conf = g_config.nconf;
 
 #if defined(CONTRIB)
-      if (cstate.have_contrib_box_vector || cstate.n_spheres != 0)
-        atom->contrib = does_contribute(atom->pos, &cstate);
+      if (cstate->have_contrib_box_vector || cstate->n_spheres != 0)
+        atom->contrib = does_contribute(atom->pos, cstate);
       else
         atom->contrib = 1;
 #endif  // CONTRIB
 
       g_config.na_type[g_config.nconf][atom->type] += 1;
 
-      max_atom_type = MAX(max_atom_type, atom->type);
+      cstate->max_atom_type = MAX(cstate->max_atom_type, atom->type);
     }
 
-    init_box_vectors(&cstate);
+    init_box_vectors(cstate);
 
-    init_neighbors(&cstate, mindist);
+    init_neighbors(cstate, mindist);
 
-    init_angles(&cstate);
+    init_angles(cstate);
 
     // increment natoms and configuration number
-    g_config.natoms += cstate.atom_count;
+    g_config.natoms += cstate->atom_count;
     g_config.nconf++;
 
-  } while (!feof(config_file));
+  } while (!feof(config_file) &&
+           (cstate->num_configs == 0 || g_config.nconf < cstate->num_configs));
 
   // close config file
   fclose(config_file);
 
   // the calculation of the neighbor lists is now complete
-  printf(
-      "Reading the config file >> %s << and calculating neighbor lists ... "
-      "done\n",
-      filename);
-
-  // calculate the total number of the atom types
-  g_config.na_type =
-      (int**)Realloc(g_config.na_type, (g_config.nconf + 1) * sizeof(int*));
-
-  g_config.na_type[g_config.nconf] = (int*)Malloc(g_param.ntypes * sizeof(int));
-
-  for (int i = 0; i < g_config.nconf; i++)
-    for (int j = 0; j < g_param.ntypes; j++)
-      g_config.na_type[g_config.nconf][j] += g_config.na_type[i][j];
+  if (g_mpi.myid == 0)
+    printf(
+        "Reading the config file >> %s << and calculating neighbor lists ... "
+        "done\n",
+        cstate->filename);
+}
 
-  // print diagnostic message
-  printf("\nRead %d configurations (%d with forces, %d with stresses)\n",
-         g_config.nconf, with_forces, with_stresses);
-  printf("with a total of %d atoms (", g_config.natoms);
+#if defined(MPI)
 
-  for (int i = 0; i < g_param.ntypes; i++) {
-    printf("%d %s (%.2f%%)", g_config.na_type[g_config.nconf][i],
-           g_config.elements[i],
-           100.0 * g_config.na_type[g_config.nconf][i] / g_config.natoms);
-    if (i != (g_param.ntypes - 1))
-      printf(", ");
-  }
-  printf(").\n");
-
-  // be pedantic about too large g_param.ntypes
-  if ((max_atom_type + 1) < g_param.ntypes) {
-    error(0, "There are less than %d atom types in your configurations!\n",
-          g_param.ntypes);
-    error(1, "Please adjust \"ntypes\" in your parameter file.\n");
-  }
+/****************************************************************
+  index_config_file
+    distributed input: only stores the position, size and
+    use_force flag of each configuration in the file
+****************************************************************/
 
-#if defined(KIM)
-  if (g_param.ntypes > g_kim.freeparams.nspecies)
-    error(1, "The KIM model %s does only support %d species!\n", g_kim.model_name, g_kim.freeparams.nspecies);
+void index_config_file(config_state* cstate)
+{
+  char buffer[1024];
 
-  // check if all atom types are supported by the KIM model
-  for (int i = 0; i < g_param.ntypes; ++i) {
-    int found = 0;
-    for (int j = 0; j < g_kim.freeparams.nspecies; ++j) {
-      if (strcmp(g_config.elements[i], g_kim.freeparams.species[j]) == 0) {
-        found = 1;
-        break;
-      }
-    }
-    if (!found)
-      error(1, "The KIM model %s does not support the species %s!\n", g_kim.model_name, g_config.elements[i]);
-  }
-#endif // KIM
+  FILE* config_file = fopen(cstate->filename, "r");
 
-  /* mdim is the dimension of the force vector:
-     - 3*natoms forces
-     - nconf cohesive energies,
-     - 6*nconf stress tensor components */
-  g_calc.mdim = 3 * g_config.natoms + g_config.nconf;
-#if defined(STRESS)
-  g_calc.mdim += 6 * g_config.nconf;
-#endif  // STRESS
+  if (config_file == NULL)
+    error(1, "Could not open file %s\n", cstate->filename);
 
-  // mdim has additional components for EAM-like potentials
-#if defined(EAM) || defined(ADP) || defined(MEAM)
-  g_calc.mdim += g_config.nconf;     // nconf limiting constraints
-  g_calc.mdim += 2 * g_param.ntypes; // g_param.ntypes dummy constraints
-#if defined(TBEAM)
-  g_calc.mdim +=
-      2 * g_param.ntypes; // additional dummy constraints for s-band
-#endif                    // TBEAM
-#endif                    // EAM || ADP || MEAM
+  printf("Indexing the config file >> %s << ...\n", cstate->filename);
+  fflush(stdout);
 
-  // mdim has additional components for analytic potentials
-#if defined(APOT)
-  // 1 slot for each analytic parameter -> punishment
-  g_calc.mdim += g_pot.opt_pot.idxlen;
-  // 1 slot for each analytic potential -> punishment
-  g_calc.mdim += g_pot.apot_table.number + 1;
-#endif  // APOT
+  while (1) {
+    long offset = ftell(config_file);
+    char* res = fgets(buffer, 1024, config_file);
 
-  // copy forces into single vector
-  g_config.force_0 = (double*)Malloc(g_calc.mdim * sizeof(double));
+    if (res == NULL)
+      break;
 
-  int k = 0;
+    cstate->line++;
 
-  /* first forces */
-  for (int i = 0; i < g_config.natoms; i++) {
-    g_config.force_0[k++] = g_config.atoms[i].force.x;
-    g_config.force_0[k++] = g_config.atoms[i].force.y;
-    g_config.force_0[k++] = g_config.atoms[i].force.z;
-  }
+    if (res[0] != '#')
+      continue;
 
-  // then cohesive energies
-  for (int i = 0; i < g_config.nconf; i++)
-    g_config.force_0[k++] = g_config.coheng[i];
+    if (res[1] == 'N') {
+      int nconf = g_config.nconf + 1;
 
-#if defined(STRESS)
-  // then stresses
-  for (int i = 0; i < g_config.nconf; i++) {
-    if (g_config.usestress[i]) {
-      g_config.force_0[k++] = g_config.stress[i].xx;
-      g_config.force_0[k++] = g_config.stress[i].yy;
-      g_config.force_0[k++] = g_config.stress[i].zz;
-      g_config.force_0[k++] = g_config.stress[i].xy;
-      g_config.force_0[k++] = g_config.stress[i].yz;
-      g_config.force_0[k++] = g_config.stress[i].zx;
-    } else
-      k += 6;
+      if (sscanf(res + 3, "%d %d", &cstate->atom_count, &cstate->use_force) <
+          2)
+        error(1, "%s: Error in atom number specification on line %d\n",
+              cstate->filename, cstate->line);
+
+      g_config.inconf = (int*)Realloc(g_config.inconf, nconf * sizeof(int));
+      g_config.cnfstart = (int*)Realloc(g_config.cnfstart, nconf * sizeof(int));
+      g_config.useforce = (int*)Realloc(g_config.useforce, nconf * sizeof(int));
+      g_config.conf_offset =
+          (long*)Realloc(g_config.conf_offset, nconf * sizeof(long));
+      g_config.conf_line =
+          (int*)Realloc(g_config.conf_line, nconf * sizeof(int));
+
+      g_config.inconf[g_config.nconf] = cstate->atom_count;
+      g_config.cnfstart[g_config.nconf] = g_config.natoms;
+      g_config.useforce[g_config.nconf] = cstate->use_force;
+      g_config.conf_offset[g_config.nconf] = offset;
+      g_config.conf_line[g_config.nconf] = cstate->line - 1;
+
+      g_config.natoms += cstate->atom_count;
+      g_config.nconf++;
+    } else if (res[1] == 'C' || res[1] == 'c')
+      read_chemical_elements(res, cstate);
   }
-#endif  // STRESS
 
-  if (g_param.write_pair == 1)
-    write_pair_distribution_file();
+  fclose(config_file);
 
-/* assign correct distances to different tables */
-#if defined(APOT)
-  double min = 10.0;
+  if (g_config.nconf == 0)
+    error(1, "No configurations found in %s\n", cstate->filename);
 
-  /* pair potentials */
-  for (int i = 0; i < g_param.ntypes; i++) {
-    for (int j = 0; j < g_param.ntypes; j++) {
-      k = (i <= j) ? i * g_param.ntypes + j - ((i * (i + 1)) / 2)
-                   : j * g_param.ntypes + i - ((j * (j + 1)) / 2);
-      if (mindist[k] >= 99.9)
-        mindist[k] = 2.5;
-      g_config.rmin[i * g_param.ntypes + j] = mindist[k];
-      g_pot.apot_table.begin[k] = mindist[k] * 0.95;
-      g_pot.opt_pot.begin[k] = mindist[k] * 0.95;
-      g_pot.calc_pot.begin[k] = mindist[k] * 0.95;
-      min = MIN(min, mindist[k]);
-    }
-  }
+  printf("Indexing the config file >> %s << ... done (%d configurations)\n",
+         cstate->filename, g_config.nconf);
+}
 
-/* transfer functions */
-#if defined(EAM) || defined(ADP) || defined(MEAM)
-  for (int i = g_calc.paircol; i < g_calc.paircol + g_param.ntypes; i++) {
-    g_pot.apot_table.begin[i] = min * 0.95;
-    g_pot.opt_pot.begin[i] = min * 0.95;
-    g_pot.calc_pot.begin[i] = min * 0.95;
-  }
-#if defined(TBEAM)
-  for (int i = g_calc.paircol + 2 * g_param.ntypes;
-       i < g_calc.paircol + 3 * g_param.ntypes; i++) {
-    g_pot.apot_table.begin[i] = min * 0.95;
-    g_pot.opt_pot.begin[i] = min * 0.95;
-    g_pot.calc_pot.begin[i] = min * 0.95;
-  }
-#endif  // TBEAM
-#endif  // EAM || ADP || MEAM
+/****************************************************************
+  read_config_part
+    distributed input: reads num_configs configurations starting
+    at the given file position into g_config, all atom and
+    configuration indices are local to the calling process
+****************************************************************/
 
-/* dipole and quadrupole functions */
-#if defined(ADP)
-  for (int i = 0; i < g_calc.paircol; i++) {
-    int j = g_calc.paircol + 2 * g_param.ntypes + i;
-    g_pot.apot_table.begin[j] = min * 0.95;
-    g_pot.opt_pot.begin[j] = min * 0.95;
-    g_pot.calc_pot.begin[j] = min * 0.95;
-    j = 2 * g_calc.paircol + 2 * g_param.ntypes + i;
-    g_pot.apot_table.begin[j] = min * 0.95;
-    g_pot.opt_pot.begin[j] = min * 0.95;
-    g_pot.calc_pot.begin[j] = min * 0.95;
-  }
-#endif  // ADP
+void read_config_part(const char* filename, long offset, int line,
+                      int first_config, int num_configs, double* mindist,
+                      int* max_atom_type, int* with_forces,
+                      int* with_stresses)
+{
+  config_state cstate;
 
-#if defined(MEAM)
-  /* f_ij */
-  for (int i = 0; i < g_calc.paircol; i++) {
-    int j = g_calc.paircol + 2 * g_param.ntypes + i;
-    g_pot.apot_table.begin[j] = min * 0.95;
-    g_pot.opt_pot.begin[j] = min * 0.95;
-    g_pot.calc_pot.begin[j] = min * 0.95;
-  }
-  /* g_i */
-  /* g_i takes cos(theta) as an argument, so we need to tabulate it only
-     in the range of [-1:1]. Actually we use [-1.1:1.1] to be safe. */
-  for (int i = 0; i < g_param.ntypes; i++) {
-    int j = 2 * g_calc.paircol + 2 * g_param.ntypes + i;
-    g_pot.apot_table.begin[j] = -1.1;
-    g_pot.opt_pot.begin[j] = -1.1;
-    g_pot.calc_pot.begin[j] = -1.1;
-    g_pot.apot_table.end[j] = 1.1;
-    g_pot.opt_pot.end[j] = 1.1;
-    g_pot.calc_pot.end[j] = 1.1;
-  }
-#endif  // MEAM
+  memset(&cstate, 0, sizeof(cstate));
 
-  /* recalculate step, invstep and xcoord for new tables */
-  for (int i = 0; i < g_pot.calc_pot.ncols; i++) {
-    g_pot.calc_pot.step[i] =
-        (g_pot.calc_pot.end[i] - g_pot.calc_pot.begin[i]) / (APOT_STEPS - 1);
-    g_pot.calc_pot.invstep[i] = 1.0 / g_pot.calc_pot.step[i];
-    for (int j = 0; j < APOT_STEPS; j++) {
-      int index = i * APOT_STEPS + (i + 1) * 2 + j;
-      g_pot.calc_pot.xcoord[index] =
-          g_pot.calc_pot.begin[i] + j * g_pot.calc_pot.step[i];
-    }
-  }
+  cstate.filename = filename;
+  cstate.max_atom_type = -1;
+  cstate.offset = offset;
+  cstate.line = line;
+  cstate.config = first_config;
+  cstate.num_configs = num_configs;
 
-#if !defined(KIM)
-  update_slots();
-#endif  // KIM
-#endif  // APOT
+  // the element names were already collected by the root process
+  cstate.num_fixed_elements = g_param.ntypes;
 
-  print_minimal_distances_matrix(mindist);
+  if (num_configs > 0)
+    parse_config_file(&cstate, mindist);
+
+  *max_atom_type = cstate.max_atom_type;
+  *with_forces = cstate.with_forces;
+  *with_stresses = cstate.with_stresses;
 }
 
+#endif  // MPI
+
 #if defined(APOT)
 
 /****************************************************************
   update_slots:
-    recalculate the slots of the atoms for analytic potential
+    recalculate the slots of the given atoms for analytic potential
 ****************************************************************/
 
-void update_slots(void)
+void update_slots(atom_t* atoms, int natoms)
 {
-  for (int i = 0; i < g_config.natoms; i++) {
-    for (int j = 0; j < g_config.atoms[i].num_neigh; j++) {
-      double r = g_config.atoms[i].neigh[j].r;
+  for (int i = 0; i < natoms; i++) {
+    for (int j = 0; j < atoms[i].num_neigh; j++) {
+      double r = atoms[i].neigh[j].r;
 
       // update slots for pair potential part, slot 0
-      update_neighbor_slots(g_config.atoms[i].neigh + j, r, 0);
+      update_neighbor_slots(atoms[i].neigh + j, r, 0);
 
 #if defined EAM || defined ADP || defined MEAM
       // update slots for eam transfer functions, slot 1
-      update_neighbor_slots(g_config.atoms[i].neigh + j, r, 1);
+      update_neighbor_slots(atoms[i].neigh + j, r, 1);
 #if defined(TBEAM)
       // update slots for tbeam transfer functions, s-band, slot 2
-      update_neighbor_slots(g_config.atoms[i].neigh + j, r, 2);
+      update_neighbor_slots(atoms[i].neigh + j, r, 2);
 #endif  // TBEAM
 #endif  // EAM || ADP || MEAM
 
 #if defined(MEAM)
       // update slots for MEAM f functions, slot 2
-      update_neighbor_slots(g_config.atoms[i].neigh + j, r, 2);
+      update_neighbor_slots(atoms[i].neigh + j, r, 2);
 #endif  // MEAM
 
 #if defined(ADP)
       // update slots for adp dipole functions, slot 2
-      update_neighbor_slots(g_config.atoms[i].neigh + j, r, 2);
+      update_neighbor_slots(atoms[i].neigh + j, r, 2);
       // update slots for adp quadrupole functions, slot 3
-      update_neighbor_slots(g_config.atoms[i].neigh + j, r, 3);
+      update_neighbor_slots(atoms[i].neigh + j, r, 3);
 #endif  // ADP
 
     }  // end loop over all neighbors
@@ -656,20 +852,18 @@ void update_slots(void)
 
 #if defined(THREEBODY) && defined(MEAM)
   // update angular slots
-  for (int i = 0; i < g_config.natoms; i++) {
-    for (int j = 0; j < g_config.atoms[i].num_angles; j++) {
-      double rr = g_config.atoms[i].angle_part[j].cos + 1.1;
-      int col =
-          2 * g_calc.paircol + 2 * g_param.ntypes + g_config.atoms[i].type;
-      g_config.atoms[i].angle_part[j].slot =
+  for (int i = 0; i < natoms; i++) {
+    for (int j = 0; j < atoms[i].num_angles; j++) {
+      double rr = atoms[i].angle_part[j].cos + 1.1;
+      int col = 2 * g_calc.paircol + 2 * g_param.ntypes + atoms[i].type;
+      atoms[i].angle_part[j].slot =
           (int)(rr * g_pot.calc_pot.invstep[col]);
-      g_config.atoms[i].angle_part[j].step = g_pot.calc_pot.step[col];
-      g_config.atoms[i].angle_part[j].shift =
-          (rr -
-           g_config.atoms[i].angle_part[j].slot * g_pot.calc_pot.step[col]) *
+      atoms[i].angle_part[j].step = g_pot.calc_pot.step[col];
+      atoms[i].angle_part[j].shift =
+          (rr - atoms[i].angle_part[j].slot * g_pot.calc_pot.step[col]) *
           g_pot.calc_pot.invstep[col];
       // move slot to the correct potential
-      g_config.atoms[i].angle_part[j].slot += g_pot.calc_pot.first[col];
+      atoms[i].angle_part[j].slot += g_pot.calc_pot.first[col];
     }
   }
 #endif  // THREEBODY && MEAM
@@ -772,9 +966,9 @@ void create_memory_for_config(config_state* cstate)
   g_config.atoms = (atom_t*)Realloc(
       g_config.atoms, (g_config.natoms + cstate->atom_count) * sizeof(atom_t));
 
-  for (int i = 0; i < cstate->atom_count; i++)
-    g_config.atoms[g_config.natoms + i].neigh =
-        (neigh_t*)Malloc(sizeof(neigh_t));
+  // neighbor and angle tables are allocated in init_neighbors/init_angles
+  memset(g_config.atoms + g_config.natoms, 0,
+         cstate->atom_count * sizeof(atom_t));
 
   g_config.coheng = (double*)Realloc(g_config.coheng, nconf * sizeof(double));
   g_config.coheng[g_config.nconf] = 0.0;
@@ -966,12 +1160,45 @@ void init_box_vectors(config_state* cstate)
 
 /****************************************************************
   init_neighbors
+    the neighbors are first counted, then stored in one array for
+    all atoms of the configuration
 ****************************************************************/
 
 void init_neighbors(config_state* cstate, double* mindist)
 {
-  vector d;
-  vector dd;
+  find_neighbors(cstate, mindist, 1);
+
+  int num_neigh = 0;
+
+  for (int i = g_config.natoms; i < g_config.natoms + cstate->atom_count; i++)
+    num_neigh += g_config.atoms[i].num_neigh;
+
+  if (num_neigh == 0)
+    return;
+
+  neigh_t* arena = (neigh_t*)Malloc(num_neigh * sizeof(neigh_t));
+
+  for (int i = g_config.natoms; i < g_config.natoms + cstate->atom_count; i++) {
+    g_config.atoms[i].neigh = arena;
+    arena += g_config.atoms[i].num_neigh;
+    g_config.atoms[i].num_neigh = 0;
+  }
+
+  find_neighbors(cstate, mindist, 0);
+}
+
+/****************************************************************
+  find_neighbors
+    count_only: only count the neighbors of each atom in num_neigh
+    otherwise:  store the neighbors in the preallocated tables
+****************************************************************/
+
+void find_neighbors(config_state* cstate, double* mindist, int count_only)
+{
+  // large configurations are binned into linked cells
+  if (cstate->atom_count >= NEIGH_CELL_ATOMS &&
+      find_neighbors_cells(cstate, mindist, count_only))
+    return;
 
   // compute the neighbor table
   for (int i = g_config.natoms; i < g_config.natoms + cstate->atom_count; i++) {
@@ -987,128 +1214,307 @@ void init_neighbors(config_state* cstate, double* mindist)
     for (int j = j_start; j < g_config.natoms + cstate->atom_count; j++)
 #endif  // THREEBODY
     {
-      d.x = g_config.atoms[j].pos.x - g_config.atoms[i].pos.x;
-      d.y = g_config.atoms[j].pos.y - g_config.atoms[i].pos.y;
-      d.z = g_config.atoms[j].pos.z - g_config.atoms[i].pos.z;
-
       for (int ix = -cstate->cell_scale.x; ix <= cstate->cell_scale.x; ix++) {
         for (int iy = -cstate->cell_scale.y; iy <= cstate->cell_scale.y; iy++) {
           for (int iz = -cstate->cell_scale.z; iz <= cstate->cell_scale.z;
                iz++) {
             if ((i == j) && (ix == 0) && (iy == 0) && (iz == 0))
               continue;
-            dd.x = d.x + ix * cstate->box_x.x + iy * cstate->box_y.x +
-                   iz * cstate->box_z.x;
-            dd.y = d.y + ix * cstate->box_x.y + iy * cstate->box_y.y +
-                   iz * cstate->box_z.y;
-            dd.z = d.z + ix * cstate->box_x.z + iy * cstate->box_y.z +
-                   iz * cstate->box_z.z;
-            double r = sqrt(SPROD(dd, dd));
-            int type1 = g_config.atoms[i].type;
-            int type2 = g_config.atoms[j].type;
-
-            if (r <= g_config.rcut[type1 * g_param.ntypes + type2]) {
-              int short_distance = 0;
-
-              if (r <= g_config.rmin[type1 * g_param.ntypes + type2]) {
-                warning("Configuration %i: Distance %i\n", cstate->config, r);
-                warning(" atom %d (type %d) at pos: %f %f %f\n",
-                        i - g_config.natoms, type1, g_config.atoms[i].pos.x,
-                        g_config.atoms[i].pos.y, g_config.atoms[i].pos.z);
-                warning(" atom %d (type %d) at pos: %f %f %f\n",
-                        j - g_config.natoms, type2, dd.x, dd.y, dd.z);
+            add_neighbor(cstate, mindist, count_only, i, j, ix, iy, iz);
+          } /* loop over images in z direction */
+        }   /* loop over images in y direction */
+      }     /* loop over images in x direction */
+    }       /* second loop over atoms (neighbors) */
+  }         /* first loop over atoms */
+}
+
+/****************************************************************
+  find_neighbors_cells
+    linked cell version of find_neighbors
+
+    the atoms are sorted into cells in fractional coordinates,
+    every cell is at least rcutmax high in each direction;
+    the neighbors of each atom are sorted by atom and image,
+    so the tables are identical to the ones of the direct search
+
+    returns 0 if the box is too small for 3 cells in a direction
+****************************************************************/
+
+int compare_candidates(const void* a, const void* b)
+{
+  const neigh_candidate_t* c1 = (const neigh_candidate_t*)a;
+  const neigh_candidate_t* c2 = (const neigh_candidate_t*)b;
+
+  if (c1->j != c2->j)
+    return c1->j - c2->j;
+  if (c1->ix != c2->ix)
+    return c1->ix - c2->ix;
+  if (c1->iy != c2->iy)
+    return c1->iy - c2->iy;
+  return c1->iz - c2->iz;
+}
+
+int find_neighbors_cells(config_state* cstate, double* mindist, int count_only)
+{
+  vector* tbox[3] = {&cstate->tbox_x, &cstate->tbox_y, &cstate->tbox_z};
+  vector* box[3] = {&cstate->box_x, &cstate->box_y, &cstate->box_z};
+  int nb[3];
+
+  // number of cells in each direction, a small margin guards against rounding
+  for (int a = 0; a < 3; a++) {
+    double height = 1.0 / sqrt(SPROD(*tbox[a], *tbox[a]));
+    nb[a] = (int)floor(height / (g_config.rcutmax * (1.0 + 1e-8)));
+    if (nb[a] < 3)
+      return 0;
+  }
+
+  int natoms = cstate->atom_count;
+  int ncells = nb[0] * nb[1] * nb[2];
+
+  int* head = (int*)malloc(ncells * sizeof(int));
+  int* next = (int*)malloc(natoms * sizeof(int));
+  int* cell = (int*)malloc(3 * natoms * sizeof(int));
+  int* offset = (int*)malloc(3 * natoms * sizeof(int));
+  int max_cand = natoms;
+  neigh_candidate_t* cand =
+      (neigh_candidate_t*)malloc(max_cand * sizeof(neigh_candidate_t));
+
+  if (head == NULL || next == NULL || cell == NULL || offset == NULL ||
+      cand == NULL)
+    error(1, "Cannot allocate memory for linked cells\n");
+
+  for (int c = 0; c < ncells; c++)
+    head[c] = -1;
+
+  // bin the atoms, offset is the number of boxes an atom lies outside
+  for (int n = 0; n < natoms; n++) {
+    atom_t* atom = g_config.atoms + g_config.natoms + n;
+    for (int a = 0; a < 3; a++) {
+      double s = SPROD(atom->pos, *tbox[a]);
+      double fs = floor(s);
+      int c = (int)((s - fs) * nb[a]);
+      offset[3 * n + a] = (int)fs;
+      cell[3 * n + a] = MIN(MAX(c, 0), nb[a] - 1);
+    }
+    int c = (cell[3 * n] * nb[1] + cell[3 * n + 1]) * nb[2] + cell[3 * n + 2];
+    next[n] = head[c];
+    head[c] = n;
+  }
+
+  double rc2 = g_config.rcutmax * g_config.rcutmax * (1.0 + 1e-8);
+
+  for (int n = 0; n < natoms; n++) {
+    int i = g_config.natoms + n;
+    int num_cand = 0;
+
+    for (int ox = -1; ox <= 1; ox++) {
+      for (int oy = -1; oy <= 1; oy++) {
+        for (int oz = -1; oz <= 1; oz++) {
+          int o[3] = {ox, oy, oz};
+          int c[3];
+          int shift[3];
+
+          for (int a = 0; a < 3; a++) {
+            c[a] = cell[3 * n + a] + o[a];
+            shift[a] = 0;
+            if (c[a] < 0) {
+              c[a] += nb[a];
+              shift[a] = -1;
+            } else if (c[a] >= nb[a]) {
+              c[a] -= nb[a];
+              shift[a] = 1;
+            }
+          }
+
+          for (int m = head[(c[0] * nb[1] + c[1]) * nb[2] + c[2]]; m >= 0;
+               m = next[m]) {
+            int j = g_config.natoms + m;
+#if !defined(THREEBODY)
+#if defined(KIM)
+            if (g_kim.is_half_neighbors == 1 && j < i)
+              continue;
+#else
+            if (j < i)
+              continue;
+#endif  // KIM
+#endif  // !THREEBODY
+            int ix = shift[0] + offset[3 * n] - offset[3 * m];
+            int iy = shift[1] + offset[3 * n + 1] - offset[3 * m + 1];
+            int iz = shift[2] + offset[3 * n + 2] - offset[3 * m + 2];
+
+            // the direct search is limited to these images
+            if (abs(ix) > cstate->cell_scale.x ||
+                abs(iy) > cstate->cell_scale.y || abs(iz) > cstate->cell_scale.z)
+              continue;
+            if ((i == j) && (ix == 0) && (iy == 0) && (iz == 0))
+              continue;
+
+            vector dd;
+
+            dd.x = g_config.atoms[j].pos.x - g_config.atoms[i].pos.x +
+                   ix * box[0]->x + iy * box[1]->x + iz * box[2]->x;
+            dd.y = g_config.atoms[j].pos.y - g_config.atoms[i].pos.y +
+                   ix * box[0]->y + iy * box[1]->y + iz * box[2]->y;
+            dd.z = g_config.atoms[j].pos.z - g_config.atoms[i].pos.z +
+                   ix * box[0]->z + iy * box[1]->z + iz * box[2]->z;
+
+            if (SPROD(dd, dd) > rc2)
+              continue;
+
+            if (num_cand == max_cand) {
+              max_cand *= 2;
+              cand = (neigh_candidate_t*)realloc(
+                  cand, max_cand * sizeof(neigh_candidate_t));
+              if (cand == NULL)
+                error(1, "Cannot allocate memory for linked cells\n");
+            }
+
+            cand[num_cand].j = j;
+            cand[num_cand].ix = ix;
+            cand[num_cand].iy = iy;
+            cand[num_cand].iz = iz;
+            num_cand++;
+          }
+        }
+      }
+    }
+
+    qsort(cand, num_cand, sizeof(neigh_candidate_t), compare_candidates);
+
+    for (int k = 0; k < num_cand; k++)
+      add_neighbor(cstate, mindist, count_only, i, cand[k].j, cand[k].ix,
+                   cand[k].iy, cand[k].iz);
+  }
+
+  free(cand);
+  free(offset);
+  free(cell);
+  free(next);
+  free(head);
+
+  return 1;
+}
+
+/****************************************************************
+  add_neighbor
+    checks atom j in periodic image (ix,iy,iz) as neighbor of atom i
+****************************************************************/
+
+void add_neighbor(config_state* cstate, double* mindist, int count_only,
+                  int i, int j, int ix, int iy, int iz)
+{
+  vector d;
+  vector dd;
+
+  d.x = g_config.atoms[j].pos.x - g_config.atoms[i].pos.x;
+  d.y = g_config.atoms[j].pos.y - g_config.atoms[i].pos.y;
+  d.z = g_config.atoms[j].pos.z - g_config.atoms[i].pos.z;
+
+  dd.x = d.x + ix * cstate->box_x.x + iy * cstate->box_y.x +
+         iz * cstate->box_z.x;
+  dd.y = d.y + ix * cstate->box_x.y + iy * cstate->box_y.y +
+         iz * cstate->box_z.y;
+  dd.z = d.z + ix * cstate->box_x.z + iy * cstate->box_y.z +
+         iz * cstate->box_z.z;
+  double r = sqrt(SPROD(dd, dd));
+  int type1 = g_config.atoms[i].type;
+  int type2 = g_config.atoms[j].type;
+
+  if (r > g_config.rcut[type1 * g_param.ntypes + type2])
+    return;
+
+  if (count_only) {
+    g_config.atoms[i].num_neigh++;
+    return;
+  }
+
+  int short_distance = 0;
+
+  if (r <= g_config.rmin[type1 * g_param.ntypes + type2]) {
+    warning("Configuration %i: Distance %i\n", cstate->config, r);
+    warning(" atom %d (type %d) at pos: %f %f %f\n", i - g_config.natoms, type1,
+            g_config.atoms[i].pos.x, g_config.atoms[i].pos.y,
+            g_config.atoms[i].pos.z);
+    warning(" atom %d (type %d) at pos: %f %f %f\n", j - g_config.natoms, type2,
+            dd.x, dd.y, dd.z);
 #if !defined(KIM)
-                short_distance = 1;
+    short_distance = 1;
 #endif // !KIM
-              }
-              g_config.atoms[i].neigh = (neigh_t*)Realloc(
-                  g_config.atoms[i].neigh,
-                  (g_config.atoms[i].num_neigh + 1) * sizeof(neigh_t));
-              dd.x /= r;
-              dd.y /= r;
-              dd.z /= r;
+  }
+  dd.x /= r;
+  dd.y /= r;
+  dd.z /= r;
 
-              int k = g_config.atoms[i].num_neigh++;
+  int k = g_config.atoms[i].num_neigh++;
 
-              neigh_t* n = g_config.atoms[i].neigh + k;
+  neigh_t* n = g_config.atoms[i].neigh + k;
 
-              memset(n, 0, sizeof(neigh_t));
+  memset(n, 0, sizeof(neigh_t));
 
-              n->type = type2;
-              n->nr = j;
-              n->r = r;
-              n->r2 = r * r;
-              n->inv_r = 1.0 / r;
-              n->dist_r = dd;
-              n->dist.x = dd.x * r;
-              n->dist.y = dd.y * r;
-              n->dist.z = dd.z * r;
+  n->type = type2;
+  n->nr = j;
+  n->r = r;
+  n->r2 = r * r;
+  n->inv_r = 1.0 / r;
+  n->dist_r = dd;
+  n->dist.x = dd.x * r;
+  n->dist.y = dd.y * r;
+  n->dist.z = dd.z * r;
 
 #if defined(ADP)
-              n->sqrdist.xx = dd.x * dd.x * r * r;
-              n->sqrdist.yy = dd.y * dd.y * r * r;
-              n->sqrdist.zz = dd.z * dd.z * r * r;
-              n->sqrdist.yz = dd.y * dd.z * r * r;
-              n->sqrdist.zx = dd.z * dd.x * r * r;
-              n->sqrdist.xy = dd.x * dd.y * r * r;
+  n->sqrdist.xx = dd.x * dd.x * r * r;
+  n->sqrdist.yy = dd.y * dd.y * r * r;
+  n->sqrdist.zz = dd.z * dd.z * r * r;
+  n->sqrdist.yz = dd.y * dd.z * r * r;
+  n->sqrdist.zx = dd.z * dd.x * r * r;
+  n->sqrdist.xy = dd.x * dd.y * r * r;
 #endif  // ADP
 
-              /* pre-compute index and shift into potential table */
+  /* pre-compute index and shift into potential table */
+
+  if (short_distance)
+    return;
 
-              if (!short_distance) {
-                /* pair potential */
-                int col = (type1 <= type2)
-                              ? type1 * g_param.ntypes + type2 -
-                                    ((type1 * (type1 + 1)) / 2)
-                              : type2 * g_param.ntypes + type1 -
-                                    ((type2 * (type2 + 1)) / 2);
-                set_neighbor_slot(g_config.atoms[i].neigh + k, col, r, 0);
+  /* pair potential */
+  int col = (type1 <= type2)
+                ? type1 * g_param.ntypes + type2 - ((type1 * (type1 + 1)) / 2)
+                : type2 * g_param.ntypes + type1 - ((type2 * (type2 + 1)) / 2);
+  set_neighbor_slot(n, col, r, 0);
 
-                mindist[col] = MIN(mindist[col], r);
+  mindist[col] = MIN(mindist[col], r);
 
 #if defined(EAM) || defined(ADP) || defined(MEAM)
-                /* transfer function */
-                col = g_calc.paircol + type2;
-                set_neighbor_slot(g_config.atoms[i].neigh + k, col, r, 1);
+  /* transfer function */
+  col = g_calc.paircol + type2;
+  set_neighbor_slot(n, col, r, 1);
 #if defined(TBEAM)
-                /* transfer function - d band */
-                col = g_calc.paircol + 2 * g_param.ntypes + type2;
-                set_neighbor_slot(g_config.atoms[i].neigh + k, col, r, 2);
+  /* transfer function - d band */
+  col = g_calc.paircol + 2 * g_param.ntypes + type2;
+  set_neighbor_slot(n, col, r, 2);
 #endif  // TBEAM
 #endif  // EAM || ADP || MEAM
 
 #if defined(MEAM)
-                /* Store slots and stuff for f(r_ij) */
-                col = g_calc.paircol + 2 * g_param.ntypes +
-                      g_config.atoms[i].neigh[k].col[0];
-                set_neighbor_slot(g_config.atoms[i].neigh + k, col, r, 2);
+  /* Store slots and stuff for f(r_ij) */
+  col = g_calc.paircol + 2 * g_param.ntypes + n->col[0];
+  set_neighbor_slot(n, col, r, 2);
 #endif  // MEAM
 
 #if defined(ADP)
-                /* dipole part */
-                col = g_calc.paircol + 2 * g_param.ntypes +
-                      g_config.atoms[i].neigh[k].col[0];
-                set_neighbor_slot(g_config.atoms[i].neigh + k, col, r, 2);
-
-                /* quadrupole part */
-                col = 2 * g_calc.paircol + 2 * g_param.ntypes +
-                      g_config.atoms[i].neigh[k].col[0];
-                set_neighbor_slot(g_config.atoms[i].neigh + k, col, r, 3);
+  /* dipole part */
+  col = g_calc.paircol + 2 * g_param.ntypes + n->col[0];
+  set_neighbor_slot(n, col, r, 2);
+
+  /* quadrupole part */
+  col = 2 * g_calc.paircol + 2 * g_param.ntypes + n->col[0];
+  set_neighbor_slot(n, col, r, 3);
 #endif  // ADP
 
 #if defined(STIWEB)
-                /* Store slots and stuff for exp. function */
-                col = g_calc.paircol + g_config.atoms[i].neigh[k].col[0];
-                set_neighbor_slot(g_config.atoms[i].neigh + k, col, r, 1);
+  /* Store slots and stuff for exp. function */
+  col = g_calc.paircol + n->col[0];
+  set_neighbor_slot(n, col, r, 1);
 #endif  // STIWEB
-
-              } /* !sh_dist */
-            }   /* r < r_cut */
-          }     /* loop over images in z direction */
-        }       /* loop over images in y direction */
-      }         /* loop over images in x direction */
-    }           /* second loop over atoms (neighbors) */
-  }             /* first loop over atoms */
 }
 
 /****************************************************************
@@ -1190,10 +1596,24 @@ void init_angles(config_state* cstate)
 // for TERSOFF we create a full neighbor list,
 // for all other potentials only a half list
 #if defined(THREEBODY)
+  // the number of triples is known, store them in one array
+  int num_angles = 0;
+
+  for (int i = g_config.natoms; i < g_config.natoms + cstate->atom_count; i++) {
+    int nnn = g_config.atoms[i].num_neigh;
+#if defined(TERSOFF)
+    num_angles += nnn * (nnn - 1);
+#else
+    num_angles += nnn * (nnn - 1) / 2;
+#endif  // TERSOFF
+  }
+
+  angle_t* arena = (angle_t*)Malloc(MAX(1, num_angles) * sizeof(angle_t));
+
   for (int i = g_config.natoms; i < g_config.natoms + cstate->atom_count; i++) {
     int nnn = g_config.atoms[i].num_neigh;
     int ijk = 0;
-    g_config.atoms[i].angle_part = (angle_t*)Malloc(sizeof(angle_t));
+    g_config.atoms[i].angle_part = arena;
 #if defined(TERSOFF)
     for (int j = 0; j < nnn; j++) {
 #else
@@ -1208,9 +1628,6 @@ void init_angles(config_state* cstate)
       for (int k = j + 1; k < nnn; k++) {
 #endif  // TERSOFF
 
-        g_config.atoms[i].angle_part = (angle_t*)Realloc(
-            g_config.atoms[i].angle_part, (ijk + 1) * sizeof(angle_t));
-
         memset(g_config.atoms[i].angle_part + ijk, 0, sizeof(angle_t));
 
         double ccos = g_config.atoms[i].neigh[j].dist_r.x *
@@ -1260,6 +1677,7 @@ void init_angles(config_state* cstate)
       } /* third loop over atoms */
     }   /* second loop over atoms */
     g_config.atoms[i].num_angles = ijk;
+    arena += ijk;
   }     /* first loop over atoms */
 #endif  // THREEBODY
 }
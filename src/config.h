@@ -31,9 +31,27 @@
 #define CONFIG_H_INCLUDED
 
 void read_config(const char* filename);
+double* init_mindist(void);
+void finish_config(double* mindist, int max_atom_type, int with_forces,
+                   int with_stresses);
+
+#if defined(MPI)
+void read_config_part(const char* filename, long offset, int line,
+                      int first_config, int num_configs, double* mindist,
+                      int* max_atom_type, int* with_forces,
+                      int* with_stresses);
+#endif  // MPI
+
+// binary cache of configurations and neighbor lists (config_cache.c)
+uint64_t config_cache_key(const char* filename);
+int read_config_cache(const char* filename, uint64_t key, double* mindist,
+                      int* max_atom_type, int* with_forces, int* with_stresses);
+void write_config_cache(const char* filename, uint64_t key,
+                        const double* mindist, int max_atom_type,
+                        int with_forces, int with_stresses);
 
 #if defined(APOT)
-void update_slots(void);
+void update_slots(atom_t* atoms, int natoms);
 void update_neighbor_slots(neigh_t* neighbor, double r, int neighbor_slot);
 #endif  // APOT
 
@@ -0,0 +1,487 @@
+/****************************************************************
+ *
+ * config_cache.c: binary cache of configurations and neighbor lists
+ *
+ ****************************************************************
+ *
+ * Copyright 2002-2017 - the potfit development team
+ *
+ * https://www.potfit.net/
+ *
+ ****************************************************************
+ *
+ * This file is part of potfit.
+ *
+ * potfit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * potfit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with potfit; if not, see <http://www.gnu.org/licenses/>.
+ *
+ ****************************************************************/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "potfit.h"
+
+#include "config.h"
+#include "memory.h"
+
+/* The cache file <config>.nbcache holds everything read_config() computes
+   while parsing the configuration file:
+
+     header | elements | mindist | per-config data | atoms | neighbors | angles
+
+   Every section starts at a multiple of CACHE_ALIGN. The neighbor and angle
+   tables of all atoms are stored back to back in one flat array each, the
+   pointers in the atom table are restored from the neighbor counts. The
+   file is mapped copy-on-write, so the force routines can still write
+   into the neighbor tables. */
+
+#define CACHE_MAGIC "potfitnb"
+#define CACHE_VERSION 1
+#define CACHE_ALIGN 64
+#define CACHE_ELEMENT_LEN 32
+
+typedef struct {
+  char magic[8];
+  uint64_t key;
+  int version;
+  int ntypes;
+  int nconf;
+  int natoms;
+  int max_atom_type;
+  int with_forces;
+  int with_stresses;
+  int size_atom;
+  int size_neigh;
+  int size_angle;
+  long num_neigh;
+  long num_angles;
+  long size; /* total size of the file */
+} cache_header_t;
+
+// compile time options which change the content of the cache
+
+static const char cache_options[] = ""
+#if defined(APOT)
+                                    "apot "
+#endif  // APOT
+#if defined(STRESS)
+                                    "stress "
+#endif  // STRESS
+#if defined(CONTRIB)
+                                    "contrib "
+#endif  // CONTRIB
+#if defined(THREEBODY)
+                                    "threebody "
+#endif  // THREEBODY
+    ;
+
+uint64_t hash_bytes(uint64_t hash, const void* data, size_t len);
+long cache_section(long* offset, long size);
+char* cache_filename(const char* filename);
+void set_table_pointers(char* neigh, char* angle);
+
+/****************************************************************
+  hash_bytes
+    64 bit FNV-1a hash
+****************************************************************/
+
+uint64_t hash_bytes(uint64_t hash, const void* data, size_t len)
+{
+  const unsigned char* p = (const unsigned char*)data;
+
+  for (size_t i = 0; i < len; i++) {
+    hash ^= p[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+/****************************************************************
+  config_cache_key
+    hash over all input the neighbor tables depend on:
+    the configuration file, the cutoff radii, the interaction
+    and the sampling grid of the potential
+****************************************************************/
+
+uint64_t config_cache_key(const char* filename)
+{
+  uint64_t key = 14695981039346656037ULL;
+  int n = g_param.ntypes;
+  char buffer[65536];
+  size_t len = 0;
+
+  FILE* config_file = fopen(filename, "rb");
+
+  if (config_file == NULL)
+    return 0;
+
+  while ((len = fread(buffer, 1, sizeof(buffer), config_file)) > 0)
+    key = hash_bytes(key, buffer, len);
+
+  fclose(config_file);
+
+  key = hash_bytes(key, cache_options, strlen(cache_options));
+  key = hash_bytes(key, g_pot.interaction_name,
+                   strlen(g_pot.interaction_name));
+  key = hash_bytes(key, &n, sizeof(n));
+  key = hash_bytes(key, &g_param.global_cell_scale, sizeof(double));
+
+  for (int i = 0; i < n; i++)
+    key = hash_bytes(key, g_config.elements[i],
+                     strlen(g_config.elements[i]) + 1);
+
+  key = hash_bytes(key, g_config.rcut, n * n * sizeof(double));
+  if (g_config.rmin != NULL)
+    key = hash_bytes(key, g_config.rmin, n * n * sizeof(double));
+
+  pot_table_t* pt = &g_pot.calc_pot;
+
+  key = hash_bytes(key, &g_pot.format_type, sizeof(g_pot.format_type));
+  key = hash_bytes(key, &pt->ncols, sizeof(int));
+  key = hash_bytes(key, &pt->len, sizeof(int));
+  key = hash_bytes(key, pt->begin, pt->ncols * sizeof(double));
+  key = hash_bytes(key, pt->end, pt->ncols * sizeof(double));
+  key = hash_bytes(key, pt->step, pt->ncols * sizeof(double));
+  key = hash_bytes(key, pt->first, pt->ncols * sizeof(int));
+  key = hash_bytes(key, pt->last, pt->ncols * sizeof(int));
+  if (g_pot.format_type == POTENTIAL_FORMAT_TABULATED_NON_EQ_DIST)
+    key = hash_bytes(key, pt->xcoord, pt->len * sizeof(double));
+
+  return key;
+}
+
+/****************************************************************
+  cache_section
+    returns the aligned offset of a section and advances offset
+****************************************************************/
+
+long cache_section(long* offset, long size)
+{
+  long start = (*offset + CACHE_ALIGN - 1) / CACHE_ALIGN * CACHE_ALIGN;
+
+  *offset = start + size;
+
+  return start;
+}
+
+/****************************************************************
+  cache_filename
+****************************************************************/
+
+char* cache_filename(const char* filename)
+{
+  char* name = (char*)malloc(strlen(filename) + 16);
+
+  if (name == NULL)
+    error(1, "Cannot allocate memory for cache file name\n");
+
+  sprintf(name, "%s.nbcache", filename);
+
+  return name;
+}
+
+/****************************************************************
+  set_table_pointers
+    point the neighbor and angle tables of all atoms into the
+    flat arrays of the cache
+****************************************************************/
+
+void set_table_pointers(char* neigh, char* angle)
+{
+  neigh_t* pn = (neigh_t*)neigh;
+#if defined(THREEBODY)
+  angle_t* pa = (angle_t*)angle;
+#endif  // THREEBODY
+
+  for (int i = 0; i < g_config.natoms; i++) {
+    g_config.atoms[i].neigh = pn;
+    pn += g_config.atoms[i].num_neigh;
+#if defined(THREEBODY)
+    g_config.atoms[i].angle_part = pa;
+    pa += g_config.atoms[i].num_angles;
+#endif  // THREEBODY
+  }
+}
+
+/****************************************************************
+  read_config_cache
+    returns 1 if the cache matches key and was loaded,
+    0 if the configuration file needs to be read
+****************************************************************/
+
+int read_config_cache(const char* filename, uint64_t key, double* mindist,
+                      int* max_atom_type, int* with_forces, int* with_stresses)
+{
+  cache_header_t header;
+  struct stat st;
+  int n = g_param.ntypes;
+
+  if (key == 0)
+    return 0;
+
+  char* name = cache_filename(filename);
+  int fd = open(name, O_RDONLY);
+
+  if (fd < 0) {
+    free(name);
+    return 0;
+  }
+
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(header) ||
+      read(fd, &header, sizeof(header)) != sizeof(header) ||
+      memcmp(header.magic, CACHE_MAGIC, 8) != 0 ||
+      header.version != CACHE_VERSION || header.key != key ||
+      header.ntypes != n || header.size != (long)st.st_size ||
+      header.size_atom != (int)sizeof(atom_t) ||
+      header.size_neigh != (int)sizeof(neigh_t)
+#if defined(THREEBODY)
+      || header.size_angle != (int)sizeof(angle_t)
+#endif  // THREEBODY
+          ) {
+    printf("Neighbor cache %s is missing or outdated.\n", name);
+    close(fd);
+    free(name);
+    return 0;
+  }
+
+  // the mapping is kept until the program exits, like all other tables
+  char* base = (char*)mmap(NULL, header.size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE, fd, 0);
+
+  close(fd);
+
+  if (base == MAP_FAILED) {
+    warning("Could not map neighbor cache %s\n", name);
+    free(name);
+    return 0;
+  }
+
+  int nconf = header.nconf;
+  int natoms = header.natoms;
+  long offset = sizeof(header);
+
+  g_config.nconf = nconf;
+  g_config.natoms = natoms;
+
+  char* elements = base + cache_section(&offset, n * CACHE_ELEMENT_LEN);
+  for (int i = 0; i < n; i++) {
+    const char* element = elements + i * CACHE_ELEMENT_LEN;
+    g_config.elements[i] = (char*)Malloc(strlen(element) + 1);
+    strcpy((char*)g_config.elements[i], element);
+  }
+
+  memcpy(mindist, base + cache_section(&offset, n * n * sizeof(double)),
+         n * n * sizeof(double));
+
+#define CACHE_ARRAY(dest, type, count)                                 \
+  dest = (type*)Malloc(MAX(1, count) * sizeof(type));                 \
+  memcpy(dest, base + cache_section(&offset, (count) * sizeof(type)), \
+         (count) * sizeof(type));
+
+  CACHE_ARRAY(g_config.inconf, int, nconf);
+  CACHE_ARRAY(g_config.cnfstart, int, nconf);
+  CACHE_ARRAY(g_config.useforce, int, nconf);
+  CACHE_ARRAY(g_config.coheng, double, nconf);
+  CACHE_ARRAY(g_config.conf_weight, double, nconf);
+  CACHE_ARRAY(g_config.volume, double, nconf);
+#if defined(STRESS)
+  CACHE_ARRAY(g_config.usestress, int, nconf);
+  CACHE_ARRAY(g_config.stress, sym_tens, nconf);
+#endif  // STRESS
+
+  g_config.na_type = (int**)Malloc((nconf + 1) * sizeof(int*));
+  for (int i = 0; i < nconf; i++) {
+    CACHE_ARRAY(g_config.na_type[i], int, n);
+  }
+
+  CACHE_ARRAY(g_config.atoms, atom_t, natoms);
+
+#undef CACHE_ARRAY
+
+  char* neigh =
+      base + cache_section(&offset, header.num_neigh * sizeof(neigh_t));
+  char* angle = NULL;
+#if defined(THREEBODY)
+  angle = base + cache_section(&offset, header.num_angles * sizeof(angle_t));
+#endif  // THREEBODY
+
+  set_table_pointers(neigh, angle);
+
+  *max_atom_type = header.max_atom_type;
+  *with_forces = header.with_forces;
+  *with_stresses = header.with_stresses;
+
+  printf("Reading configurations and neighbor lists from cache >> %s << ... "
+         "done\n", name);
+
+  free(name);
+
+  return 1;
+}
+
+/****************************************************************
+  write_config_cache
+    failures are not fatal, the cache is simply not written
+****************************************************************/
+
+void write_config_cache(const char* filename, uint64_t key,
+                        const double* mindist, int max_atom_type,
+                        int with_forces, int with_stresses)
+{
+  cache_header_t header;
+  int n = g_param.ntypes;
+  int nconf = g_config.nconf;
+  int natoms = g_config.natoms;
+
+  if (key == 0)
+    return;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CACHE_MAGIC, 8);
+  header.key = key;
+  header.version = CACHE_VERSION;
+  header.ntypes = n;
+  header.nconf = nconf;
+  header.natoms = natoms;
+  header.max_atom_type = max_atom_type;
+  header.with_forces = with_forces;
+  header.with_stresses = with_stresses;
+  header.size_atom = sizeof(atom_t);
+  header.size_neigh = sizeof(neigh_t);
+#if defined(THREEBODY)
+  header.size_angle = sizeof(angle_t);
+#endif  // THREEBODY
+
+  for (int i = 0; i < natoms; i++) {
+    header.num_neigh += g_config.atoms[i].num_neigh;
+#if defined(THREEBODY)
+    header.num_angles += g_config.atoms[i].num_angles;
+#endif  // THREEBODY
+  }
+
+  // the sections are written in the same order as they are read
+  const void* data[32];
+  long len[32];
+  int count = 0;
+
+  char* elements = (char*)calloc(n, CACHE_ELEMENT_LEN);
+  if (elements == NULL)
+    error(1, "Cannot allocate memory for neighbor cache\n");
+  for (int i = 0; i < n; i++)
+    strncpy(elements + i * CACHE_ELEMENT_LEN, g_config.elements[i],
+            CACHE_ELEMENT_LEN - 1);
+
+#define CACHE_SECTION(ptr, size) \
+  data[count] = (ptr);           \
+  len[count++] = (size);
+
+  CACHE_SECTION(elements, n * CACHE_ELEMENT_LEN);
+  CACHE_SECTION(mindist, n * n * sizeof(double));
+  CACHE_SECTION(g_config.inconf, nconf * sizeof(int));
+  CACHE_SECTION(g_config.cnfstart, nconf * sizeof(int));
+  CACHE_SECTION(g_config.useforce, nconf * sizeof(int));
+  CACHE_SECTION(g_config.coheng, nconf * sizeof(double));
+  CACHE_SECTION(g_config.conf_weight, nconf * sizeof(double));
+  CACHE_SECTION(g_config.volume, nconf * sizeof(double));
+#if defined(STRESS)
+  CACHE_SECTION(g_config.usestress, nconf * sizeof(int));
+  CACHE_SECTION(g_config.stress, nconf * sizeof(sym_tens));
+#endif  // STRESS
+
+#undef CACHE_SECTION
+
+  long offset = sizeof(header);
+  for (int i = 0; i < count; i++)
+    cache_section(&offset, len[i]);
+  for (int i = 0; i < nconf; i++)
+    cache_section(&offset, n * sizeof(int));
+  long atoms_offset = cache_section(&offset, natoms * sizeof(atom_t));
+  long neigh_offset =
+      cache_section(&offset, header.num_neigh * sizeof(neigh_t));
+#if defined(THREEBODY)
+  long angle_offset =
+      cache_section(&offset, header.num_angles * sizeof(angle_t));
+#endif  // THREEBODY
+  header.size = offset;
+
+  // write to a temporary file first, concurrent runs never see partial files
+  char* name = cache_filename(filename);
+  char* tmpname = (char*)malloc(strlen(name) + 32);
+  if (tmpname == NULL)
+    error(1, "Cannot allocate memory for neighbor cache\n");
+  sprintf(tmpname, "%s.%d", name, (int)getpid());
+
+  char* buffer = (char*)calloc(1, header.size);
+  if (buffer == NULL) {
+    warning("Not enough memory to write neighbor cache %s\n", name);
+    free(elements);
+    free(tmpname);
+    free(name);
+    return;
+  }
+
+  memcpy(buffer, &header, sizeof(header));
+
+  offset = sizeof(header);
+  for (int i = 0; i < count; i++)
+    memcpy(buffer + cache_section(&offset, len[i]), data[i], len[i]);
+  for (int i = 0; i < nconf; i++)
+    memcpy(buffer + cache_section(&offset, n * sizeof(int)),
+           g_config.na_type[i], n * sizeof(int));
+
+  atom_t* atoms = (atom_t*)(buffer + atoms_offset);
+  neigh_t* neigh = (neigh_t*)(buffer + neigh_offset);
+#if defined(THREEBODY)
+  angle_t* angle = (angle_t*)(buffer + angle_offset);
+#endif  // THREEBODY
+
+  for (int i = 0; i < natoms; i++) {
+    atom_t* atom = g_config.atoms + i;
+    memcpy(atoms + i, atom, sizeof(atom_t));
+    atoms[i].neigh = NULL;
+    if (atom->num_neigh > 0)
+      memcpy(neigh, atom->neigh, atom->num_neigh * sizeof(neigh_t));
+    neigh += atom->num_neigh;
+#if defined(THREEBODY)
+    atoms[i].angle_part = NULL;
+    if (atom->num_angles > 0)
+      memcpy(angle, atom->angle_part, atom->num_angles * sizeof(angle_t));
+    angle += atom->num_angles;
+#endif  // THREEBODY
+  }
+
+  int written = 0;
+  FILE* outfile = fopen(tmpname, "wb");
+
+  if (outfile != NULL) {
+    written = fwrite(buffer, 1, header.size, outfile) == (size_t)header.size;
+    written = (fclose(outfile) == 0) && written;
+    written = written && (rename(tmpname, name) == 0);
+  }
+
+  if (written)
+    printf("Neighbor lists written to cache >> %s <<\n", name);
+  else {
+    warning("Could not write neighbor cache %s\n", name);
+    remove(tmpname);
+  }
+
+  free(buffer);
+  free(elements);
+  free(tmpname);
+  free(name);
+}
@@ -49,12 +49,34 @@
 #define APOT_PUNISH 10e6  // general value for apot punishments
 #endif                    // APOT
 
+// force routines providing calc_jacobian() for analytic potentials
+#if defined(APOT) && !defined(KIM) && !defined(MPI) && !defined(COULOMB)
+#if defined(PAIR) || (defined(EAM) && !defined(TBEAM) && !defined(RESCALE))
+#define APOT_JACOBIAN
+#endif  // PAIR || (EAM && !TBEAM && !RESCALE)
+#endif  // APOT && !KIM && !MPI && !COULOMB
+
+// exact derivatives of the force vector for the powell_lsq algorithm
+#if defined(APOT_JACOBIAN) || (defined(PAIR) && !defined(APOT) && !defined(MPI))
+#define EXACT_JACOBIAN
+#endif  // APOT_JACOBIAN || (PAIR && !APOT && !MPI)
+
+// force routines providing calc_gradient() for tabulated potentials
+#if !defined(APOT) && !defined(MPI)
+#if defined(PAIR) || (defined(EAM) && !defined(TBEAM) && !defined(RESCALE))
+#define ADJOINT_GRADIENT
+#endif  // PAIR || (EAM && !TBEAM && !RESCALE)
+#endif  // !APOT && !MPI
+
 #if defined(EAM) || defined(ADP) || defined(MEAM)
 #define DUMMY_WEIGHT 100.0
 #endif  // EAM || ADP || MEAM
 
 #define FORCE_EPS 0.1
 
+// configurations with at least this many atoms use linked cells
+#define NEIGH_CELL_ATOMS 256
+
 #if defined(COULOMB) || defined(DIPOLE)
 #define DP_EPS 14.40  // this is e^2/(4*pi*epsilon_0) in eV A
 #endif                // COULOMB || DIPOLE
@@ -0,0 +1,483 @@
+/****************************************************************
+ *
+ * design_matrix.c: linear residual model for tabulated pair potentials
+ *
+ ****************************************************************
+ *
+ * Copyright 2002-2017 - the potfit development team
+ *
+ * https://www.potfit.net/
+ *
+ ****************************************************************
+ *
+ * This file is part of potfit.
+ *
+ * potfit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * potfit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with potfit; if not, see <http://www.gnu.org/licenses/>.
+ *
+ ****************************************************************/
+
+/****************************************************************
+ *
+ *  For tabulated pair potentials every entry of the force vector
+ *  (forces, energies and stresses) is a linear function of the
+ *  sampling points xi and of the second derivatives d2tab of the
+ *  interpolating splines. The coefficients only depend on the
+ *  neighbor lists, so they are compiled once into a sparse design
+ *  matrix A acting on the extended vector z = [ xi, d2tab ]:
+ *
+ *    forces[row_idx[r]] = c[r] + sum_k val[k] * z[col[k]]
+ *                         k = row_ptr[r] ... row_ptr[r + 1] - 1
+ *
+ *  Each process only stores the rows of its own configurations.
+ *
+ ****************************************************************/
+
+#include "potfit.h"
+
+#include "design_matrix.h"
+#include "memory.h"
+#include "splines.h"
+
+#if defined(PAIR) && !defined(APOT)
+
+// one coefficient of the design matrix before compression
+typedef struct {
+  int row;
+  int col;
+  double val;
+} dm_entry_t;
+
+typedef struct {
+  int init;
+
+  int nrows;     /* number of local rows */
+  int nnz;       /* number of non-zero coefficients */
+  int* row_idx;  /* position of the rows in the force vector */
+  int* row_ptr;  /* start of the rows in col and val */
+  int* col;      /* column index into [ xi, d2tab ] */
+  double* val;   /* coefficients */
+  double* c;     /* constant part of each row (reference data) */
+  double* w;     /* weight of each row in the error sum */
+  double* z;     /* work vector [ xi, d2tab ] */
+
+  dm_entry_t* entries; /* scratch space for one configuration */
+  int num_entries;
+
+  /* spline derivatives, only used for the jacobian */
+  int* pos;       /* index of each table entry in the free parameters */
+  int* tab_col;   /* potential column of each table entry */
+  int* dd2_start; /* start of the block of each column in dd2 */
+  double* dd2;    /* d(d2tab)/d(xi), one dense block per column */
+} design_matrix_t;
+
+static design_matrix_t g_dmat;
+
+/****************************************************************
+  compare_entries
+****************************************************************/
+
+static int compare_entries(const void* a, const void* b)
+{
+  const dm_entry_t* e1 = (const dm_entry_t*)a;
+  const dm_entry_t* e2 = (const dm_entry_t*)b;
+
+  if (e1->row != e2->row)
+    return e1->row < e2->row ? -1 : 1;
+  if (e1->col != e2->col)
+    return e1->col < e2->col ? -1 : 1;
+
+  return 0;
+}
+
+/****************************************************************
+  add_entry
+****************************************************************/
+
+static void add_entry(int* n, int row, int col, double val)
+{
+  g_dmat.entries[*n].row = row;
+  g_dmat.entries[*n].col = col;
+  g_dmat.entries[*n].val = val;
+  (*n)++;
+}
+
+/****************************************************************
+  build_design_matrix
+    compile the neighbor lists of all local configurations
+****************************************************************/
+
+void build_design_matrix(void)
+{
+  const int len = g_pot.calc_pot.len;
+#if defined(STRESS)
+  const int nstress = 6;
+#else
+  const int nstress = 0;
+#endif  // STRESS
+
+  int nrows = 0;
+
+  for (int c = g_mpi.firstconf; c < g_mpi.firstconf + g_mpi.myconf; c++)
+    nrows += 3 * g_config.inconf[c] + 1 + nstress;
+
+  g_dmat.nrows = nrows;
+  g_dmat.row_idx = (int*)Realloc(g_dmat.row_idx, (nrows + 1) * sizeof(int));
+  g_dmat.row_ptr = (int*)Realloc(g_dmat.row_ptr, (nrows + 1) * sizeof(int));
+  g_dmat.c = (double*)Realloc(g_dmat.c, (nrows + 1) * sizeof(double));
+  g_dmat.w = (double*)Realloc(g_dmat.w, (nrows + 1) * sizeof(double));
+  g_dmat.z = (double*)Realloc(g_dmat.z, 2 * len * sizeof(double));
+
+  g_dmat.nnz = 0;
+  g_dmat.row_ptr[0] = 0;
+
+  int row = 0;
+
+  for (int c = g_mpi.firstconf; c < g_mpi.firstconf + g_mpi.myconf; c++) {
+    const int natoms = g_config.inconf[c];
+    const int uf = g_config.conf_uf[c - g_mpi.firstconf];
+#if defined(STRESS)
+    const int us = g_config.conf_us[c - g_mpi.firstconf];
+    const double vol = g_config.conf_vol[c - g_mpi.firstconf];
+#endif  // STRESS
+    atom_t* atoms = g_config.conf_atoms + g_config.cnfstart[c] - g_mpi.firstatom;
+
+    // local row numbers: 3 * natoms forces, 1 energy, 6 stresses
+    const int e_row = 3 * natoms;
+    const int s_row = e_row + 1;
+
+    // every neighbor contributes to at most 13 rows with 4 coefficients
+    int max_entries = 1;
+    for (int i = 0; i < natoms; i++)
+      max_entries += 52 * atoms[i].num_neigh;
+
+    if (max_entries > g_dmat.num_entries) {
+      g_dmat.entries = (dm_entry_t*)Realloc(g_dmat.entries,
+                                            max_entries * sizeof(dm_entry_t));
+      g_dmat.num_entries = max_entries;
+    }
+
+    int n = 0;
+
+    for (int i = 0; i < natoms; i++) {
+      atom_t* atom = atoms + i;
+#if defined(FWEIGHT)
+      const double fw_i = 1.0 / (FORCE_EPS + atom->absforce);
+#else
+      const double fw_i = 1.0;
+#endif  // FWEIGHT
+
+      for (int j = 0; j < atom->num_neigh; j++) {
+        neigh_t* neigh = atom->neigh + j;
+
+        if (neigh->r >= g_pot.calc_pot.end[neigh->col[0]])
+          continue;
+
+        const int k = neigh->slot[0];
+        const double b = neigh->shift[0];
+        const double a = 1.0 - b;
+        const double h = neigh->step[0];
+        // In small cells, an atom might interact with itself
+        const double scale =
+            (neigh->nr == i + g_config.cnfstart[c]) ? 0.5 : 1.0;
+
+        // coefficients of phi(r) and phi'(r) for y_k, y_k+1, y''_k, y''_k+1
+        const int cols[4] = {k, k + 1, len + k, len + k + 1};
+        const double cv[4] = {scale * a, scale * b,
+                              scale * (a * a * a - a) * h * h / 6.0,
+                              scale * (b * b * b - b) * h * h / 6.0};
+        const double cg[4] = {-scale / h, scale / h,
+                              -scale * (3 * a * a - 1) * h / 6.0,
+                              scale * (3 * b * b - 1) * h / 6.0};
+
+        const int nj = neigh->nr - g_config.cnfstart[c];
+#if defined(FWEIGHT)
+        const double fw_j = 1.0 / (FORCE_EPS + atoms[nj].absforce);
+#else
+        const double fw_j = 1.0;
+#endif  // FWEIGHT
+
+        for (int m = 0; m < 4; m++) {
+          add_entry(&n, e_row, cols[m], cv[m] / natoms);
+
+          if (!uf)
+            continue;
+
+          // actio = reactio
+          add_entry(&n, 3 * i + 0, cols[m], fw_i * neigh->dist_r.x * cg[m]);
+          add_entry(&n, 3 * i + 1, cols[m], fw_i * neigh->dist_r.y * cg[m]);
+          add_entry(&n, 3 * i + 2, cols[m], fw_i * neigh->dist_r.z * cg[m]);
+          add_entry(&n, 3 * nj + 0, cols[m], -fw_j * neigh->dist_r.x * cg[m]);
+          add_entry(&n, 3 * nj + 1, cols[m], -fw_j * neigh->dist_r.y * cg[m]);
+          add_entry(&n, 3 * nj + 2, cols[m], -fw_j * neigh->dist_r.z * cg[m]);
+
+#if defined(STRESS)
+          if (us) {
+            const double s = -cg[m] / vol;
+            add_entry(&n, s_row + 0, cols[m], s * neigh->dist.x * neigh->dist_r.x);
+            add_entry(&n, s_row + 1, cols[m], s * neigh->dist.y * neigh->dist_r.y);
+            add_entry(&n, s_row + 2, cols[m], s * neigh->dist.z * neigh->dist_r.z);
+            add_entry(&n, s_row + 3, cols[m], s * neigh->dist.x * neigh->dist_r.y);
+            add_entry(&n, s_row + 4, cols[m], s * neigh->dist.y * neigh->dist_r.z);
+            add_entry(&n, s_row + 5, cols[m], s * neigh->dist.z * neigh->dist_r.x);
+          }
+#endif  // STRESS
+        }
+      }
+    }
+
+    qsort(g_dmat.entries, n, sizeof(dm_entry_t), compare_entries);
+
+    // merge duplicate coefficients
+    int nnz = 0;
+    for (int i = 0; i < n; i++) {
+      if (nnz > 0 && g_dmat.entries[i].row == g_dmat.entries[nnz - 1].row &&
+          g_dmat.entries[i].col == g_dmat.entries[nnz - 1].col)
+        g_dmat.entries[nnz - 1].val += g_dmat.entries[i].val;
+      else
+        g_dmat.entries[nnz++] = g_dmat.entries[i];
+    }
+
+    g_dmat.col = (int*)Realloc(g_dmat.col, (g_dmat.nnz + nnz + 1) * sizeof(int));
+    g_dmat.val =
+        (double*)Realloc(g_dmat.val, (g_dmat.nnz + nnz + 1) * sizeof(double));
+
+    // append the rows of this configuration
+    int e = 0;
+    for (int r = 0; r < s_row + nstress; r++) {
+      while (e < nnz && g_dmat.entries[e].row == r) {
+        g_dmat.col[g_dmat.nnz] = g_dmat.entries[e].col;
+        g_dmat.val[g_dmat.nnz] = g_dmat.entries[e].val;
+        g_dmat.nnz++;
+        e++;
+      }
+
+      if (r < e_row) {
+        g_dmat.row_idx[row] = 3 * g_config.cnfstart[c] + r;
+        g_dmat.c[row] = uf ? -g_config.force_0[g_dmat.row_idx[row]] : 0.0;
+        g_dmat.w[row] = uf ? g_config.conf_weight[c] : 0.0;
+#if defined(FWEIGHT)
+        g_dmat.c[row] /= FORCE_EPS + atoms[r / 3].absforce;
+#endif  // FWEIGHT
+#if defined(CONTRIB)
+        if (!atoms[r / 3].contrib)
+          g_dmat.w[row] = 0.0;
+#endif  // CONTRIB
+      } else if (r == e_row) {
+        g_dmat.row_idx[row] = g_calc.energy_p + c;
+        g_dmat.c[row] = -g_config.force_0[g_dmat.row_idx[row]];
+        g_dmat.w[row] = g_config.conf_weight[c] * g_param.eweight;
+      }
+#if defined(STRESS)
+      else {
+        g_dmat.row_idx[row] = g_calc.stress_p + 6 * c + r - s_row;
+        g_dmat.c[row] = (uf && us) ? -g_config.force_0[g_dmat.row_idx[row]] : 0.0;
+        g_dmat.w[row] = (uf && us) ? g_config.conf_weight[c] * g_param.sweight : 0.0;
+      }
+#endif  // STRESS
+
+      g_dmat.row_ptr[++row] = g_dmat.nnz;
+    }
+  }
+
+  g_dmat.init = 1;
+
+  if (g_mpi.myid == 0) {
+    printf("Compiled design matrix with %d rows and %d non-zero elements (%.2f MB).\n",
+           g_dmat.nrows, g_dmat.nnz,
+           (g_dmat.nnz * (sizeof(int) + sizeof(double))) / (1024.0 * 1024.0));
+    fflush(stdout);
+  }
+}
+
+/****************************************************************
+  invalidate_design_matrix
+    force a rebuild before the next evaluation, e.g. after the
+    sampling points of the potential have been changed
+****************************************************************/
+
+void invalidate_design_matrix(void) { g_dmat.init = 0; }
+
+/****************************************************************
+  calc_forces_design_matrix
+    evaluate the force vector of the local configurations by a
+    single sparse matrix-vector product; d2tab has to be up to date
+
+    returns the local sum of squares
+****************************************************************/
+
+double calc_forces_design_matrix(double* xi, double* forces)
+{
+  const int len = g_pot.calc_pot.len;
+  double error_sum = 0.0;
+
+  if (!g_dmat.init)
+    build_design_matrix();
+
+  memcpy(g_dmat.z, xi, len * sizeof(double));
+  memcpy(g_dmat.z + len, g_pot.calc_pot.d2tab, len * sizeof(double));
+
+  for (int r = 0; r < g_dmat.nrows; r++) {
+    double res = g_dmat.c[r];
+
+    for (int k = g_dmat.row_ptr[r]; k < g_dmat.row_ptr[r + 1]; k++)
+      res += g_dmat.val[k] * g_dmat.z[g_dmat.col[k]];
+
+    forces[g_dmat.row_idx[r]] = res;
+    error_sum += g_dmat.w[r] * res * res;
+  }
+
+  return error_sum;
+}
+
+/****************************************************************
+  init_spline_derivatives
+    derivatives of d2tab with respect to all table entries of a
+    column; the splines are linear in xi, so they are obtained by
+    interpolating unit vectors with the boundary conditions used
+    in update_splines()
+****************************************************************/
+
+static void init_spline_derivatives(double* xi)
+{
+  const int len = g_pot.calc_pot.len;
+  const int ncols = g_calc.paircol;
+
+  if (g_dmat.dd2 == NULL) {
+    int size = 0;
+
+    g_dmat.pos = (int*)Malloc(len * sizeof(int));
+    g_dmat.tab_col = (int*)Malloc(len * sizeof(int));
+    g_dmat.dd2_start = (int*)Malloc(ncols * sizeof(int));
+
+    for (int col = 0; col < ncols; col++) {
+      int n = g_pot.calc_pot.last[col] - g_pot.calc_pot.first[col] + 1;
+      g_dmat.dd2_start[col] = size;
+      size += n * (n + 2);
+      for (int k = g_pot.calc_pot.first[col]; k <= g_pot.calc_pot.last[col]; k++)
+        g_dmat.tab_col[k] = col;
+    }
+
+    g_dmat.dd2 = (double*)Malloc(size * sizeof(double));
+  }
+
+  for (int i = 0; i < len; i++)
+    g_dmat.pos[i] = -1;
+  for (int i = 0; i < g_calc.ndim; i++)
+    g_dmat.pos[g_pot.opt_pot.idx[i]] = i;
+
+  for (int col = 0; col < ncols; col++) {
+    const int first = g_pot.calc_pot.first[col];
+    const int n = g_pot.calc_pot.last[col] - first + 1;
+    // natural boundary condition if the gradient is not specified
+    const int natural = (xi[first - 2] > 0.99e30);
+    double* block = g_dmat.dd2 + g_dmat.dd2_start[col];
+    double y[n];
+    double d2[n];
+
+    // block[k * (n + 2) + l]: d(d2tab[first + k]) / d(xi[first - 2 + l])
+    for (int l = 0; l < n + 2; l++) {
+      double yp1 = natural ? 1e30 : 0.0;
+
+      memset(y, 0, n * sizeof(double));
+
+      if (l == 0) {
+        // left gradient
+        if (natural) {
+          for (int k = 0; k < n; k++)
+            block[k * (n + 2) + l] = 0.0;
+          continue;
+        }
+        yp1 = 1.0;
+      } else if (l == 1) {
+        // the right gradient is fixed to 0 for pair potentials
+        for (int k = 0; k < n; k++)
+          block[k * (n + 2) + l] = 0.0;
+        continue;
+      } else
+        y[l - 2] = 1.0;
+
+      if (g_pot.format_type == POTENTIAL_FORMAT_TABULATED_EQ_DIST)
+        spline_ed(g_pot.calc_pot.step[col], y, n, yp1, 0.0, d2);
+      else
+        spline_ne(g_pot.calc_pot.xcoord + first, y, n, yp1, 0.0, d2);
+
+      for (int k = 0; k < n; k++)
+        block[k * (n + 2) + l] = d2[k];
+    }
+  }
+}
+
+/****************************************************************
+  design_matrix_jacobian
+    exact derivatives of the force vector with respect to the free
+    parameters: gamma[j][i] = d(forces[j]) / d(xi[idx[i]])
+    only the rows of the configurations first ... last - 1 are
+    added, they have to be zero on entry; the call with first ==
+    g_mpi.firstconf prepares the spline derivatives for xi
+****************************************************************/
+
+void design_matrix_jacobian(double* xi, double** gamma, int first, int last)
+{
+  const int len = g_pot.calc_pot.len;
+#if defined(STRESS)
+  const int nstress = 6;
+#else
+  const int nstress = 0;
+#endif  // STRESS
+
+  const int c0 = g_mpi.firstconf;
+
+  if (!g_dmat.init)
+    build_design_matrix();
+
+  if (first == c0)
+    init_spline_derivatives(xi);
+
+  // every configuration has 3 * inconf + 1 + nstress consecutive rows
+  const int r0 = 3 * (g_config.cnfstart[first] - g_config.cnfstart[c0]) +
+                 (first - c0) * (1 + nstress);
+  const int r1 = (last == c0 + g_mpi.myconf)
+                     ? g_dmat.nrows
+                     : 3 * (g_config.cnfstart[last] - g_config.cnfstart[c0]) +
+                           (last - c0) * (1 + nstress);
+
+  for (int r = r0; r < r1; r++) {
+    double* g = gamma[g_dmat.row_idx[r]];
+
+    for (int k = g_dmat.row_ptr[r]; k < g_dmat.row_ptr[r + 1]; k++) {
+      const int col = g_dmat.col[k];
+
+      if (col < len) {
+        // direct dependence on the sampling points
+        if (g_dmat.pos[col] >= 0)
+          g[g_dmat.pos[col]] += g_dmat.val[k];
+      } else {
+        // dependence through the second derivatives of the spline
+        const int t = col - len;
+        const int pcol = g_dmat.tab_col[t];
+        const int first = g_pot.calc_pot.first[pcol];
+        const int n = g_pot.calc_pot.last[pcol] - first + 1;
+        const double* s =
+            g_dmat.dd2 + g_dmat.dd2_start[pcol] + (t - first) * (n + 2);
+        const int* pos = g_dmat.pos + first - 2;
+
+        for (int l = 0; l < n + 2; l++)
+          if (pos[l] >= 0)
+            g[pos[l]] += g_dmat.val[k] * s[l];
+      }
+    }
+  }
+}
+
+#endif  // PAIR && !APOT
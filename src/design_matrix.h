@@ -0,0 +1,43 @@
+/****************************************************************
+ *
+ * design_matrix.h: linear residual model for tabulated pair potentials
+ *
+ ****************************************************************
+ *
+ * Copyright 2002-2017 - the potfit development team
+ *
+ * https://www.potfit.net/
+ *
+ ****************************************************************
+ *
+ * This file is part of potfit.
+ *
+ * potfit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * potfit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with potfit; if not, see <http://www.gnu.org/licenses/>.
+ *
+ ****************************************************************/
+
+#ifndef DESIGN_MATRIX_H_INCLUDED
+#define DESIGN_MATRIX_H_INCLUDED
+
+#if defined(PAIR) && !defined(APOT)
+
+void build_design_matrix(void);
+void invalidate_design_matrix(void);
+
+double calc_forces_design_matrix(double* xi, double* forces);
+void design_matrix_jacobian(double* xi, double** gamma, int first, int last);
+
+#endif  // PAIR && !APOT
+
+#endif  // DESIGN_MATRIX_H_INCLUDED
@@ -102,10 +102,7 @@ void init_population(double** pop, double* xi, double* cost)
     }
   }
 
-  double forces[g_calc.mdim];
-
-  for (int i = 0; i < NP; i++)
-    cost[i] = calc_forces(pop[i], forces, 0);
+  calc_errors(pop, cost, NP, D);
 
 #if defined(APOT)
   opposite_check(pop, cost, 1);
@@ -122,7 +119,6 @@ void init_population(double** pop, double* xi, double* cost)
 
 void opposite_check(double** population, double* cost, int do_init)
 {
-  double fxi[g_calc.mdim];
   double min = 0.0;
   double max = 0.0;
   double minp[g_calc.ndim];
@@ -188,8 +184,7 @@ void opposite_check(double** population, double* cost, int do_init)
   for (int i = 0; i < NP; i++)
     tot_cost[i] = cost[i];
 
-  for (int i = NP; i < 2 * NP; i++)
-    tot_cost[i] = calc_forces(tot_P[i], fxi, 0);
+  calc_errors(tot_P + NP, tot_cost + NP, NP, D);
 
   // evaluate the NP best individuals from both populations
   // sort with quicksort and return NP best indivuals
@@ -294,12 +289,22 @@ void run_differential_evolution(double* xi)
   if (g_param.evo_threshold == 0.0)
     return;
 
-  // vector for force calculation
-  double* forces = (double*)Malloc(g_calc.mdim * sizeof(double));
-
-  // vector with new configuration
-  double* trial = (double*)Malloc(D * sizeof(double));
-  memcpy(trial, xi, (D - 2) * sizeof(double));
+  // number of trial vectors evaluated together, several groups of
+  // processes share the trial vectors of a whole generation
+  int batch = MIN(g_param.batch_size, NP);
+#if defined(MPI)
+  if (g_mpi.num_groups > 1)
+    batch = NP;
+#endif  // MPI
+
+  // vectors with new configurations and their costs
+  double** trials = (double**)Malloc(batch * sizeof(double*));
+  double* trial_cost = (double*)Malloc(batch * sizeof(double));
+
+  for (int n = 0; n < batch; n++) {
+    trials[n] = (double*)Malloc(D * sizeof(double));
+    memcpy(trials[n], xi, (D - 2) * sizeof(double));
+  }
 
   // allocate memory for all configurations
   double** pop_1 = (double**)Malloc(NP * sizeof(double*));
@@ -340,55 +345,62 @@ void run_differential_evolution(double* xi)
   while (crit >= g_param.evo_threshold && min_cost >= g_param.evo_threshold) {
     max_cost = 0.0;
 
-    // randomly create new populations
-    for (int i = 0; i < NP; i++) {
-      // generate random numbers
-      do
-        a = (int)floor(eqdist() * NP);
-      while (a == i);
-
-      do
-        b = (int)floor(eqdist() * NP);
-      while (b == i || b == a);
-
-      //       do
-      //         c = (int)floor(eqdist() * NP);
-      //       while (c == i || c == a || c == b);
-      //
-      //       do
-      //         d = (int)floor(eqdist() * NP);
-      //       while (d == i || d == a || d == b || d == c);
-      //
-      //       do
-      //         e = (int)floor(eqdist() * NP);
-      //       while (e == i || e == a || e == b || e == c || e == d);
-
-      int j = (int)floor(eqdist() * g_calc.ndim);
-
-      // self-adaptive parameters
-      if (eqdist() < TAU_1)
-        trial[D - 2] = F_LOWER + eqdist() * F_UPPER;
-      else
-        trial[D - 2] = pop_1[i][D - 2];
-
-      if (eqdist() < TAU_2)
-        trial[D - 1] = eqdist();
-      else
-        trial[D - 1] = pop_1[i][D - 1];
-
-      double temp = 0.0;
-
-      // create trail vectors with different methods
-      for (int k = 1; k <= g_calc.ndim; k++) {
-        if (eqdist() < trial[D - 1] || k == j) {
-          /* DE/rand/1/exp */
-          //           temp = pop_1[c][g_pot.opt_pot.idx[j]] + trial[D - 2] *
-          //           (pop_1[a][g_pot.opt_pot.idx[j]] -
-          //           pop_1[b][g_pot.opt_pot.idx[j]]);
-          /* DE/best/1/exp */
-          temp = best[g_pot.opt_pot.idx[j]] +
-                 trial[D - 2] * (pop_1[a][g_pot.opt_pot.idx[j]] -
-                                 pop_1[b][g_pot.opt_pot.idx[j]]);
+    // randomly create new populations, batch trial vectors are
+    // evaluated together and then selected in order
+    for (int i0 = 0; i0 < NP; i0 += batch) {
+      const int num = MIN(batch, NP - i0);
+
+      for (int n = 0; n < num; n++) {
+        const int i = i0 + n;
+        double* trial = trials[n];
+
+        // generate random numbers
+        do
+          a = (int)floor(eqdist() * NP);
+        while (a == i);
+
+        do
+          b = (int)floor(eqdist() * NP);
+        while (b == i || b == a);
+
+        //       do
+        //         c = (int)floor(eqdist() * NP);
+        //       while (c == i || c == a || c == b);
+        //
+        //       do
+        //         d = (int)floor(eqdist() * NP);
+        //       while (d == i || d == a || d == b || d == c);
+        //
+        //       do
+        //         e = (int)floor(eqdist() * NP);
+        //       while (e == i || e == a || e == b || e == c || e == d);
+
+        int j = (int)floor(eqdist() * g_calc.ndim);
+
+        // self-adaptive parameters
+        if (eqdist() < TAU_1)
+          trial[D - 2] = F_LOWER + eqdist() * F_UPPER;
+        else
+          trial[D - 2] = pop_1[i][D - 2];
+
+        if (eqdist() < TAU_2)
+          trial[D - 1] = eqdist();
+        else
+          trial[D - 1] = pop_1[i][D - 1];
+
+        double temp = 0.0;
+
+        // create trail vectors with different methods
+        for (int k = 1; k <= g_calc.ndim; k++) {
+          if (eqdist() < trial[D - 1] || k == j) {
+            /* DE/rand/1/exp */
+            //           temp = pop_1[c][g_pot.opt_pot.idx[j]] + trial[D - 2] *
+            //           (pop_1[a][g_pot.opt_pot.idx[j]] -
+            //           pop_1[b][g_pot.opt_pot.idx[j]]);
+            /* DE/best/1/exp */
+            temp = best[g_pot.opt_pot.idx[j]] +
+                   trial[D - 2] * (pop_1[a][g_pot.opt_pot.idx[j]] -
+                                   pop_1[b][g_pot.opt_pot.idx[j]]);
 /* DE/rand/2/exp */
 //           temp = pop_1[e][j] + trial[D-2] * (pop_1[a][j] + pop_1[b][j] -
 //           pop_1[c][j] -
@@ -406,58 +418,65 @@ void run_differential_evolution(double* xi)
 //           trial[D-2]
 //           * (pop_1[a][j] + pop_1[b][j] - pop_1[c][j] - pop_1[d][j]);
 #if defined(APOT)
-          double pmin = g_pot.apot_table.pmin[g_pot.apot_table.idxpot[j]]
-                                             [g_pot.apot_table.idxparam[j]];
-          double pmax = g_pot.apot_table.pmax[g_pot.apot_table.idxpot[j]]
-                                             [g_pot.apot_table.idxparam[j]];
-
-          if (temp > pmax) {
-            trial[g_pot.opt_pot.idx[j]] = pmax;
-          } else if (temp < pmin) {
-            trial[g_pot.opt_pot.idx[j]] = pmin;
-          } else
-            trial[g_pot.opt_pot.idx[j]] = temp;
+            double pmin = g_pot.apot_table.pmin[g_pot.apot_table.idxpot[j]]
+                                               [g_pot.apot_table.idxparam[j]];
+            double pmax = g_pot.apot_table.pmax[g_pot.apot_table.idxpot[j]]
+                                               [g_pot.apot_table.idxparam[j]];
+
+            if (temp > pmax) {
+              trial[g_pot.opt_pot.idx[j]] = pmax;
+            } else if (temp < pmin) {
+              trial[g_pot.opt_pot.idx[j]] = pmin;
+            } else
+              trial[g_pot.opt_pot.idx[j]] = temp;
 #else
-          trial[g_pot.opt_pot.idx[j]] = temp;
+            trial[g_pot.opt_pot.idx[j]] = temp;
 #endif  // APOT
-        } else {
-          trial[g_pot.opt_pot.idx[j]] = pop_1[i][g_pot.opt_pot.idx[j]];
-        }
+          } else {
+            trial[g_pot.opt_pot.idx[j]] = pop_1[i][g_pot.opt_pot.idx[j]];
+          }
 
-        j = (j + 1) % g_calc.ndim;
+          j = (j + 1) % g_calc.ndim;
+        }
       }
 
-      double force = calc_forces(trial, forces, 0);
+      calc_errors(trials, trial_cost, num, D);
 
-      if (force < min_cost) {
-        memcpy(best, trial, D * sizeof(double));
+      for (int n = 0; n < num; n++) {
+        const int i = i0 + n;
+        double* trial = trials[n];
+        double force = trial_cost[n];
 
-        if (*g_files.tempfile != '\0') {
-          for (j = 0; j < g_calc.ndim; j++)
+        if (force < min_cost) {
+          memcpy(best, trial, D * sizeof(double));
+
+          if (*g_files.tempfile != '\0') {
+            for (int j = 0; j < g_calc.ndim; j++)
 #if defined(APOT)
-            g_pot.apot_table.values[g_pot.apot_table.idxpot[j]]
-                                   [g_pot.apot_table.idxparam[j]] =
-                trial[g_pot.opt_pot.idx[j]];
+              g_pot.apot_table.values[g_pot.apot_table.idxpot[j]]
+                                     [g_pot.apot_table.idxparam[j]] =
+                  trial[g_pot.opt_pot.idx[j]];
 #else
-            xi[g_pot.opt_pot.idx[j]] = trial[g_pot.opt_pot.idx[j]];
+              xi[g_pot.opt_pot.idx[j]] = trial[g_pot.opt_pot.idx[j]];
 #endif  // APOT
-          write_pot_table_potfit(g_files.tempfile);
+            write_pot_table_potfit(g_files.tempfile);
+          }
+          min_cost = force;
         }
-        min_cost = force;
-      }
 
-      if (force <= cost[i]) {
-        memcpy(pop_2[i], trial, D * sizeof(double));
+        if (force <= cost[i]) {
+          memcpy(pop_2[i], trial, D * sizeof(double));
 
-        cost[i] = force;
+          cost[i] = force;
 
-        if (force > max_cost)
-          max_cost = force;
-      } else {
-        memcpy(pop_2[i], pop_1[i], D * sizeof(double));
+          if (force > max_cost)
+            max_cost = force;
+        } else {
+          memcpy(pop_2[i], pop_1[i], D * sizeof(double));
 
-        if (cost[i] > max_cost)
-          max_cost = cost[i];
+          if (cost[i] > max_cost)
+            max_cost = cost[i];
+        }
       }
     }
 
@@ -488,7 +507,7 @@ void run_differential_evolution(double* xi)
     count++;
 
     /* End optimization if break flagfile exists */
-    if (*g_files.flagfile != '\0') {
+    if (g_files.flagfile && *g_files.flagfile != '\0') {
       FILE* ff = fopen(g_files.flagfile, "r");
 
       if (NULL != ff) {
@@ -506,6 +525,13 @@ void run_differential_evolution(double* xi)
   printf("Finished differential evolution.\n");
   fflush(stdout);
 
+#if defined(MPI)
+  // only the first group takes part in the following optimization, unless
+  // its line search evaluates several points
+  if (g_param.linmin_points == 1)
+    stop_groups();
+#endif  // MPI
+
   memcpy(xi, best, g_calc.ndimtot * sizeof(double));
 }
 
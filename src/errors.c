@@ -159,7 +159,7 @@ void write_errors(double* force, double tot)
       fprintf(outfile, "sum of stress-errors = %e\t\t( %.3f%% )\n", s_sum,
               s_sum / tot * 100);
 #endif  // STRESS
-    if ((tot - f_sum - e_sum - s_sum) > 0.01 && g_param.opt == 1) {
+    if ((tot - f_sum - e_sum - s_sum) > 0.01 && g_param.opt) {
       fprintf(outfile,
               "\n --> Warning <--\nThis sum contains punishments! Please check "
               "your results.\n");
@@ -194,7 +194,7 @@ void write_errors(double* force, double tot)
            s_sum / tot * 100);
 #endif  // STRESS
 
-  if ((tot - f_sum - e_sum - s_sum) > 0.01 && g_param.opt == 1) {
+  if ((tot - f_sum - e_sum - s_sum) > 0.01 && g_param.opt) {
     printf(
         "\n --> Warning <--\nThis sum contains punishments! Check your "
         "results.\n");
@@ -31,6 +31,18 @@
 #define FORCE_H_INCLUDED
 
 double calc_forces(double* xi_opt, double* forces, int shutdown_flag);
+// errors[i] = calc_forces(xi_opt[i], forces[i], flag) for num vectors
+void calc_forces_batch(double** xi_opt, double** forces, double* errors,
+                       int num, int flag);
+// errors[i] = calc_forces(xi_opt[i], forces, 3), shared by all groups
+void calc_errors(double** xi_opt, double* errors, int num, int len);
+#if defined(MPI)
+void run_group_root();
+void stop_groups();
+// residuals kept on their process by powell_lsq (distributed_lsq)
+void powell_lsq_store(double* forces);
+void powell_lsq_worker();
+#endif  // MPI
 extern double (*g_splint)(pot_table_t*, double*, int, double);
 extern double (*g_splint_grad)(pot_table_t*, double*, int, double);
 extern double (*g_splint_comb)(pot_table_t*, double*, int, double, double*);
@@ -42,9 +54,33 @@ void init_force(int is_worker);
 
 void set_force_vector_pointers();
 void gather_variable(double* var);
-void gather_forces(double* error_sum, double* forces);
+void gather_forces(double* error_sum, double* forces, int flag);
 
 void update_splines(double* xi, int start_col, int num_col, int grad_flag);
+void update_splines_d2tab(double* xi, double* d2tab, int start_col,
+                          int num_col, int grad_flag);
+
+conf_sum_t sum_conf_partials(void);
+
+#if defined(PAIR) || defined(EAM)
+void init_neigh_lists(void);
+#endif  // PAIR || EAM
+
+#if defined(APOT_JACOBIAN)
+// exact derivatives of the force vector (force_pair.c, force_eam.c)
+void calc_jacobian(double* xi_opt, double** gamma, int first, int last);
+#endif  // APOT_JACOBIAN
+
+#if defined(ADJOINT_GRADIENT)
+// gradient of the error sum with respect to the table by a reverse
+// sweep over the neighbor lists (force_pair.c, force_eam.c)
+double calc_gradient(double* xi_opt, double* forces, double* grad);
+void update_splines_adjoint(double* xi, double* d2_bar, double* grad,
+                            int start_col, int num_col, int grad_flag);
+void adjoint_residuals(double* forces, double* r_bar);
+double adjoint_pair_force(neigh_list_t* nl, int k, int n_i, int stress_idx,
+                          double* r_bar);
+#endif  // ADJOINT_GRADIENT
 
 #if defined(STIWEB)
 void update_stiweb_pointers(double*);
@@ -102,6 +102,11 @@ void init_force(int is_worker)
  *    flag == 2 will cause all processes to perform a potsync (i.e. broadcast
  *             any changed potential parameters from process 0 to the others)
  *             before calculation of forces
+ *    flag == 3 will only sum up the errors, the forces, energies and
+ *             stresses of the other processes are not collected on the
+ *             root process
+ *    flag == 4 takes part in a step of the distributed powell_lsq
+ *             (see powell_lsq_worker), no forces are calculated
  *    all other values will cause a set of forces to be calculated. The root
  *             process will return with the sum of squares of the forces,
  *             while all other processes remain in the function, waiting for
@@ -149,19 +154,28 @@ double calc_forces(double* xi_opt, double* forces, int flag)
 #endif  // APOT && !MPI
 
 #if defined(MPI)
-#if !defined(APOT)
-    // exchange potential and flag value
-    MPI_Bcast(xi, g_pot.calc_pot.len, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-#endif  // APOT
-    MPI_Bcast(&flag, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&flag, 1, MPI_INT, 0, g_mpi.comm);
 
     if (flag == 1)
       break; // Exception: flag 1 means clean up
 
+    // flag 4: the residuals stay distributed, see powell_lsq_worker()
+    if (flag == 4) {
+      powell_lsq_worker();
+      continue;
+    }
+
+#if !defined(APOT)
+    // exchange potential
+    MPI_Bcast(xi, g_pot.calc_pot.len, MPI_DOUBLE, 0, g_mpi.comm);
+#endif  // !APOT
+
+    g_mpi.eval_start = MPI_Wtime();
+
 #if defined(APOT)
     if (g_mpi.myid == 0)
       apot_check_params(xi_opt);
-    MPI_Bcast(xi_opt, g_calc.ndimtot, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(xi_opt, g_calc.ndimtot, MPI_DOUBLE, 0, g_mpi.comm);
     update_calc_table(xi_opt, xi, 0);
 #else
     // if flag==2 then the potential parameters have changed -> sync
@@ -189,7 +203,13 @@ double calc_forces(double* xi_opt, double* forces, int flag)
     update_splines(xi, g_calc.paircol + 2 * g_param.ntypes, 2 * g_calc.paircol, 1);
 
     // loop over configurations
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic)
+#endif  // _OPENMP
     for (int config_idx = g_mpi.firstconf; config_idx < g_mpi.firstconf + g_mpi.myconf; config_idx++) {
+      // partial sums of this configuration, see sum_conf_partials()
+      conf_sum_t* csum = g_calc.conf_sum + config_idx;
+      memset(csum, 0, sizeof(conf_sum_t));
       int uf = g_config.conf_uf[config_idx - g_mpi.firstconf];
 #if defined(STRESS)
       int us = g_config.conf_us[config_idx - g_mpi.firstconf];
@@ -414,7 +434,7 @@ double calc_forces(double* xi_opt, double* forces, int flag)
 #endif  // !RESCALE
 
         // sum up rho
-        rho_sum += atom->rho;
+        csum->rho += atom->rho;
 
         double eng_store = 0.0;
         /* calculate ADP energy for atom i */
@@ -587,14 +607,14 @@ double calc_forces(double* xi_opt, double* forces, int flag)
 #if defined(CONTRIB)
           if (atom->contrib)
 #endif  // CONTRIB
-            error_sum += g_config.conf_weight[config_idx] * (dsquare(forces[n_i + 0]) + dsquare(forces[n_i + 1]) + dsquare(forces[n_i + 2]));
+            csum->error += g_config.conf_weight[config_idx] * (dsquare(forces[n_i + 0]) + dsquare(forces[n_i + 1]) + dsquare(forces[n_i + 2]));
         } // third loop over atoms
       } // uf
 
       // energy contributions
       forces[g_calc.energy_p + config_idx] /= (double)g_config.inconf[config_idx];
       forces[g_calc.energy_p + config_idx] -= g_config.force_0[g_calc.energy_p + config_idx];
-      error_sum += g_config.conf_weight[config_idx] * g_param.eweight * dsquare(forces[g_calc.energy_p + config_idx]);
+      csum->error += g_config.conf_weight[config_idx] * g_param.eweight * dsquare(forces[g_calc.energy_p + config_idx]);
 
 #if defined(STRESS)
       // stress contributions
@@ -602,16 +622,20 @@ double calc_forces(double* xi_opt, double* forces, int flag)
         for (int i = 0; i < 6; i++) {
           forces[stress_idx + i] /= g_config.conf_vol[config_idx - g_mpi.firstconf];
           forces[stress_idx + i] -= g_config.force_0[stress_idx + i];
-          error_sum += g_config.conf_weight[config_idx] * g_param.sweight * dsquare(forces[stress_idx + i]);
+          csum->error += g_config.conf_weight[config_idx] * g_param.sweight * dsquare(forces[stress_idx + i]);
         }
       }
 #endif  // STRESS
 
       // limiting constraints per configuration
-      error_sum += g_config.conf_weight[config_idx] * dsquare(forces[g_calc.limit_p + config_idx]);
+      csum->error += g_config.conf_weight[config_idx] * dsquare(forces[g_calc.limit_p + config_idx]);
 
     } // loop over configurations
 
+    conf_sum_t conf_total = sum_conf_partials();
+    error_sum += conf_total.error;
+    rho_sum += conf_total.rho;
+
     gather_variable(&rho_sum);
 
 // dummy constraints (global)
@@ -652,7 +676,7 @@ double calc_forces(double* xi_opt, double* forces, int flag)
     }   // only root process
 #endif  // !NOPUNISH
 
-    gather_forces(&error_sum, forces);
+    gather_forces(&error_sum, forces, flag);
 
     // root process exits this function now
     if (g_mpi.myid == 0) {
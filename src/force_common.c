@@ -31,6 +31,7 @@
 
 #include "force.h"
 #include "memory.h"
+#include "mpi_utils.h"
 #include "splines.h"
 #include "utils.h"
 
@@ -65,10 +66,41 @@ void init_force_common(int is_worker)
     case POTENTIAL_FORMAT_KIM:
       break;
   }
+
+  // partial sums of the configurations, see sum_conf_partials()
+  g_calc.conf_sum =
+      (conf_sum_t*)Malloc(MAX(1, g_config.nconf) * sizeof(conf_sum_t));
+
   // for force-specific initializations please use the
   // init_force function local to the force_xxx.c file
 }
 
+/****************************************************************
+  sum_conf_partials
+    adds up the partial sums of the local configurations in the
+    order of the configurations, so the result does not depend
+    on how the configurations were distributed over the threads
+****************************************************************/
+
+conf_sum_t sum_conf_partials(void)
+{
+  conf_sum_t total;
+
+  memset(&total, 0, sizeof(conf_sum_t));
+
+  for (int i = g_mpi.firstconf; i < g_mpi.firstconf + g_mpi.myconf; i++) {
+    total.error += g_calc.conf_sum[i].error;
+#if defined(EAM) || defined(ADP) || defined(MEAM)
+    total.rho += g_calc.conf_sum[i].rho;
+#if defined(TBEAM)
+    total.rho_s += g_calc.conf_sum[i].rho_s;
+#endif  // TBEAM
+#endif  // EAM || ADP || MEAM
+  }
+
+  return total;
+}
+
 /****************************************************************
   set_force_vector_pointers() assigns the correct positions to the
     pointers for the force vector
@@ -149,7 +181,7 @@ void gather_variable(double* var)
 #if defined(MPI)
   // Reduce variable
   double tmpvar = 0.0;
-  MPI_Reduce(&var, &tmpvar, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+  MPI_Reduce(&var, &tmpvar, 1, MPI_DOUBLE, MPI_SUM, 0, g_mpi.comm);
   if (g_mpi.myid == 0)
     *var = tmpvar;
 #endif  // MPI
@@ -157,64 +189,77 @@ void gather_variable(double* var)
 
 /****************************************************************
   gather_forces
-    called after all parameters and potentials are read
-    additional assignments and initializations can be made here
+    sums up the error of all processes on root and collects the
+    forces, energies and stresses there, with flag 3 only the
+    error sum is needed and the residuals stay on their process,
+    with distributed_lsq they are kept for powell_lsq instead
 ****************************************************************/
 
-void gather_forces(double* error_sum, double* forces)
+void gather_forces(double* error_sum, double* forces, int flag)
 {
 #if defined(MPI)
   double tmpsum = 0.0;
 
-  MPI_Reduce(error_sum, &tmpsum, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-
-  // gather forces, energies, stresses
-  if (g_mpi.myid == 0) {
-    // root node already has data in place
-    // forces
-    MPI_Gatherv(MPI_IN_PLACE, g_mpi.myatoms, g_mpi.MPI_VECTOR, forces,
-                g_mpi.atom_len, g_mpi.atom_dist, g_mpi.MPI_VECTOR, 0,
-                MPI_COMM_WORLD);
-    // energies
-    MPI_Gatherv(MPI_IN_PLACE, g_mpi.myconf, MPI_DOUBLE,
-                forces + g_calc.energy_p, g_mpi.conf_len, g_mpi.conf_dist,
-                MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  // local work only, the collectives below wait for the slowest process
+  g_mpi.eval_time += MPI_Wtime() - g_mpi.eval_start;
+
+  MPI_Reduce(error_sum, &tmpsum, 1, MPI_DOUBLE, MPI_SUM, 0, g_mpi.comm);
+
+  // gather forces, energies, stresses unless only the error sum is needed
+  if (flag != 3 && g_mpi.distributed_lsq) {
+    // powell_lsq works on the residuals where they were calculated
+    powell_lsq_store(forces);
+  } else if (flag != 3) {
+    if (g_mpi.myid == 0) {
+      // root node already has data in place
+      // forces
+      MPI_Gatherv(MPI_IN_PLACE, g_mpi.myatoms, g_mpi.MPI_VECTOR, forces,
+                  g_mpi.atom_len, g_mpi.atom_dist, g_mpi.MPI_VECTOR, 0,
+                  g_mpi.comm);
+      // energies
+      MPI_Gatherv(MPI_IN_PLACE, g_mpi.myconf, MPI_DOUBLE,
+                  forces + g_calc.energy_p, g_mpi.conf_len, g_mpi.conf_dist,
+                  MPI_DOUBLE, 0, g_mpi.comm);
 #if defined(STRESS)
-    // stresses
-    MPI_Gatherv(MPI_IN_PLACE, g_mpi.myconf, g_mpi.MPI_STENS,
-                forces + g_calc.stress_p, g_mpi.conf_len, g_mpi.conf_dist,
-                g_mpi.MPI_STENS, 0, MPI_COMM_WORLD);
+      // stresses
+      MPI_Gatherv(MPI_IN_PLACE, g_mpi.myconf, g_mpi.MPI_STENS,
+                  forces + g_calc.stress_p, g_mpi.conf_len, g_mpi.conf_dist,
+                  g_mpi.MPI_STENS, 0, g_mpi.comm);
 #endif  // STRESS
 #if defined(RESCALE) && (defined(EAM) || defined(ADP) || defined(MEAM))
-    // punishment constraints
-    MPI_Gatherv(MPI_IN_PLACE, g_mpi.myconf, MPI_DOUBLE, forces + g_calc.limit_p,
-                g_mpi.conf_len, g_mpi.conf_dist, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+      // punishment constraints
+      MPI_Gatherv(MPI_IN_PLACE, g_mpi.myconf, MPI_DOUBLE,
+                  forces + g_calc.limit_p, g_mpi.conf_len, g_mpi.conf_dist,
+                  MPI_DOUBLE, 0, g_mpi.comm);
 #endif  // RESCALE && (EAM || ADP || MEAM)
-  } else {
-    // forces
-    MPI_Gatherv(forces + g_mpi.firstatom * 3, g_mpi.myatoms, g_mpi.MPI_VECTOR,
-                forces, g_mpi.atom_len, g_mpi.atom_dist, g_mpi.MPI_VECTOR, 0,
-                MPI_COMM_WORLD);
-    // energies
-    MPI_Gatherv(forces + g_calc.energy_p + g_mpi.firstconf, g_mpi.myconf,
-                MPI_DOUBLE, forces + g_calc.energy_p, g_mpi.conf_len,
-                g_mpi.conf_dist, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    } else {
+      // forces
+      MPI_Gatherv(forces + g_mpi.firstatom * 3, g_mpi.myatoms, g_mpi.MPI_VECTOR,
+                  forces, g_mpi.atom_len, g_mpi.atom_dist, g_mpi.MPI_VECTOR, 0,
+                  g_mpi.comm);
+      // energies
+      MPI_Gatherv(forces + g_calc.energy_p + g_mpi.firstconf, g_mpi.myconf,
+                  MPI_DOUBLE, forces + g_calc.energy_p, g_mpi.conf_len,
+                  g_mpi.conf_dist, MPI_DOUBLE, 0, g_mpi.comm);
 #if defined(STRESS)
-    // stresses
-    MPI_Gatherv(forces + g_calc.stress_p + 6 * g_mpi.firstconf, g_mpi.myconf,
-                g_mpi.MPI_STENS, forces + g_calc.stress_p, g_mpi.conf_len,
-                g_mpi.conf_dist, g_mpi.MPI_STENS, 0, MPI_COMM_WORLD);
+      // stresses
+      MPI_Gatherv(forces + g_calc.stress_p + 6 * g_mpi.firstconf, g_mpi.myconf,
+                  g_mpi.MPI_STENS, forces + g_calc.stress_p, g_mpi.conf_len,
+                  g_mpi.conf_dist, g_mpi.MPI_STENS, 0, g_mpi.comm);
 #endif  // STRESS
 #if defined(RESCALE) && (defined(EAM) || defined(ADP) || defined(MEAM))
-    // punishment constraints
-    MPI_Gatherv(forces + g_calc.limit_p + g_mpi.firstconf, g_mpi.myconf,
-                MPI_DOUBLE, forces + g_calc.limit_p, g_mpi.conf_len,
-                g_mpi.conf_dist, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+      // punishment constraints
+      MPI_Gatherv(forces + g_calc.limit_p + g_mpi.firstconf, g_mpi.myconf,
+                  MPI_DOUBLE, forces + g_calc.limit_p, g_mpi.conf_len,
+                  g_mpi.conf_dist, MPI_DOUBLE, 0, g_mpi.comm);
 #endif  // RESCALE && (EAM || ADP || MEAM)
+    }
   }
 
   *error_sum = tmpsum;
 
+  if (rebalance_configurations() != MPI_SUCCESS)
+    error(1, "Could not redistribute the configurations\n");
 #endif  // MPI
 }
 
@@ -223,6 +268,19 @@ void gather_forces(double* error_sum, double* forces)
 ****************************************************************/
 
 void update_splines(double* xi, int start_col, int num_col, int grad_flag)
+{
+  update_splines_d2tab(xi, g_pot.calc_pot.d2tab, start_col, num_col,
+                       grad_flag);
+}
+
+/****************************************************************
+  update_splines_d2tab
+    second derivatives of the table xi are written to d2tab,
+    which has the layout of g_pot.calc_pot.d2tab
+****************************************************************/
+
+void update_splines_d2tab(double* xi, double* d2tab, int start_col,
+                          int num_col, int grad_flag)
 {
   for (int col = start_col; col < start_col + num_col; col++) {
     int first = g_pot.calc_pot.first[col];
@@ -235,13 +293,13 @@ void update_splines(double* xi, int start_col, int num_col, int grad_flag)
       case POTENTIAL_FORMAT_TABULATED_EQ_DIST: {
         spline_ed(g_pot.calc_pot.step[col], xi + first,
                   g_pot.calc_pot.last[col] - first + 1,
-                  grad_left, grad_right, g_pot.calc_pot.d2tab + first);
+                  grad_left, grad_right, d2tab + first);
         break;
       }
       case POTENTIAL_FORMAT_TABULATED_NON_EQ_DIST: {
         spline_ne(g_pot.calc_pot.xcoord + first, xi + first,
                   g_pot.calc_pot.last[col] - first + 1,
-                  grad_left, grad_right, g_pot.calc_pot.d2tab + first);
+                  grad_left, grad_right, d2tab + first);
         break;
       }
       case POTENTIAL_FORMAT_KIM:
@@ -250,3 +308,357 @@ void update_splines(double* xi, int start_col, int num_col, int grad_flag)
     }
   }
 }
+
+#if defined(ADJOINT_GRADIENT)
+
+/****************************************************************
+  update_splines_adjoint
+    reverse of update_splines: adds the derivatives with respect to
+    the table xi (including the boundary gradients) of a function of
+    the second derivatives to grad, d2_bar holds the derivatives with
+    respect to the second derivatives and is overwritten
+****************************************************************/
+
+void update_splines_adjoint(double* xi, double* d2_bar, double* grad,
+                            int start_col, int num_col, int grad_flag)
+{
+  for (int col = start_col; col < start_col + num_col; col++) {
+    int first = g_pot.calc_pot.first[col];
+    int n = g_pot.calc_pot.last[col] - first + 1;
+    double grad_left = (grad_flag & 1) ? *(xi + first - 2) : 0.0;
+    double grad_right = (grad_flag & 2) ? *(xi + first - 1) : 0.0;
+    double yp_bar[2] = {0.0, 0.0};
+
+    if (g_pot.format_type == POTENTIAL_FORMAT_TABULATED_NON_EQ_DIST)
+      spline_ne_adjoint(g_pot.calc_pot.xcoord + first, n, grad_left,
+                        grad_right, d2_bar + first, grad + first, yp_bar);
+    else
+      spline_ed_adjoint(g_pot.calc_pot.step[col], n, grad_left, grad_right,
+                        d2_bar + first, grad + first, yp_bar);
+
+    if (grad_flag & 1)
+      grad[first - 2] += yp_bar[0];
+    if (grad_flag & 2)
+      grad[first - 1] += yp_bar[1];
+  }
+}
+
+/****************************************************************
+  adjoint_residuals
+    derivatives of the error sum with respect to the forces, energies
+    and stresses as they are summed up in calc_forces, i.e. before
+    the division by the number of atoms or the volume
+****************************************************************/
+
+void adjoint_residuals(double* forces, double* r_bar)
+{
+  for (int c = 0; c < g_config.nconf; c++) {
+    const double weight = g_config.conf_weight[c];
+    const int uf = g_config.conf_uf[c];
+
+    for (int i = g_config.cnfstart[c];
+         i < g_config.cnfstart[c] + g_config.inconf[c]; i++) {
+      double w = uf ? 2.0 * weight : 0.0;
+#if defined(FWEIGHT)
+      w /= FORCE_EPS + g_config.conf_atoms[i].absforce;
+#endif  // FWEIGHT
+#if defined(CONTRIB)
+      if (!g_config.conf_atoms[i].contrib)
+        w = 0.0;
+#endif  // CONTRIB
+      for (int d = 0; d < 3; d++)
+        r_bar[3 * i + d] = w * forces[3 * i + d];
+    }
+
+    r_bar[g_calc.energy_p + c] = 2.0 * weight * g_param.eweight *
+                                 forces[g_calc.energy_p + c] /
+                                 (double)g_config.inconf[c];
+
+#if defined(STRESS)
+    const int us = uf && g_config.conf_us[c];
+
+    for (int i = g_calc.stress_p + 6 * c; i < g_calc.stress_p + 6 * c + 6; i++)
+      r_bar[i] = us ? 2.0 * weight * g_param.sweight * forces[i] /
+                          g_config.conf_vol[c]
+                    : 0.0;
+#endif  // STRESS
+  }
+}
+
+/****************************************************************
+  adjoint_pair_force
+    derivative of the error sum with respect to the magnitude of a
+    force along dist_r[k] that is added to atom n_i / 3, subtracted
+    from its neighbor and added to the stresses at stress_idx
+****************************************************************/
+
+double adjoint_pair_force(neigh_list_t* nl, int k, int n_i, int stress_idx,
+                          double* r_bar)
+{
+  const int n_j = 3 * nl->nr[k];
+  double t = nl->dist_r[k].x * (r_bar[n_i + 0] - r_bar[n_j + 0]) +
+             nl->dist_r[k].y * (r_bar[n_i + 1] - r_bar[n_j + 1]) +
+             nl->dist_r[k].z * (r_bar[n_i + 2] - r_bar[n_j + 2]);
+
+#if defined(STRESS)
+  t -= r_bar[stress_idx + 0] * nl->dist[k].x * nl->dist_r[k].x +
+       r_bar[stress_idx + 1] * nl->dist[k].y * nl->dist_r[k].y +
+       r_bar[stress_idx + 2] * nl->dist[k].z * nl->dist_r[k].z +
+       r_bar[stress_idx + 3] * nl->dist[k].x * nl->dist_r[k].y +
+       r_bar[stress_idx + 4] * nl->dist[k].y * nl->dist_r[k].z +
+       r_bar[stress_idx + 5] * nl->dist[k].z * nl->dist_r[k].x;
+#endif  // STRESS
+
+  return t;
+}
+
+#endif  // ADJOINT_GRADIENT
+
+#if !defined(PAIR) || defined(MPI)
+
+/****************************************************************
+  calc_forces_batch
+    evaluate num parameter vectors one after another; the pair
+    interaction without MPI has its own version in force_pair.c
+****************************************************************/
+
+void calc_forces_batch(double** xi_opt, double** forces, double* errors,
+                       int num, int flag)
+{
+  for (int i = 0; i < num; i++)
+    errors[i] = calc_forces(xi_opt[i], forces[i], flag);
+}
+
+#endif  // !PAIR || MPI
+
+/****************************************************************
+  calc_errors_local
+    error sums of num parameter vectors, batch_size at a time
+****************************************************************/
+
+static void calc_errors_local(double** xi_opt, double* errors, int num)
+{
+  static double** forces = NULL;
+  static int num_forces = 0;
+
+  const int batch = MIN(g_param.batch_size, num);
+
+  if (batch > num_forces) {
+    forces = (double**)Realloc(forces, batch * sizeof(double*));
+    for (int i = num_forces; i < batch; i++)
+      forces[i] = (double*)Malloc(g_calc.mdim * sizeof(double));
+    num_forces = batch;
+  }
+
+  // only the error sums are needed, flag 3 skips collecting the forces
+  for (int i = 0; i < num; i += batch)
+    calc_forces_batch(xi_opt + i, forces, errors + i, MIN(batch, num - i), 3);
+}
+
+#if defined(MPI)
+
+/****************************************************************
+  calc_errors_groups
+    every group of processes evaluates its part of the vectors,
+    the error sums are collected on the root of the first group
+****************************************************************/
+
+static void calc_errors_groups(double** xi_opt, double* errors, int num,
+                               int len)
+{
+  int count[g_mpi.num_groups];
+  int displ[g_mpi.num_groups];
+
+  for (int i = 0; i < num; i++)
+    MPI_Bcast(xi_opt[i], len, MPI_DOUBLE, 0, g_mpi.leader_comm);
+
+  for (int g = 0; g < g_mpi.num_groups; g++) {
+    displ[g] = num * g / g_mpi.num_groups;
+    count[g] = num * (g + 1) / g_mpi.num_groups - displ[g];
+  }
+
+  const int g = g_mpi.group;
+
+  calc_errors_local(xi_opt + displ[g], errors + displ[g], count[g]);
+
+  if (g == 0)
+    MPI_Gatherv(MPI_IN_PLACE, count[g], MPI_DOUBLE, errors, count, displ,
+                MPI_DOUBLE, 0, g_mpi.leader_comm);
+  else
+    MPI_Gatherv(errors + displ[g], count[g], MPI_DOUBLE, NULL, count, displ,
+                MPI_DOUBLE, 0, g_mpi.leader_comm);
+}
+
+/****************************************************************
+  run_group_root
+    root process of every group but the first, evaluates its part
+    of the vectors sent by the first group until stop_groups()
+****************************************************************/
+
+void run_group_root()
+{
+  double** xi_opt = NULL;
+  double* errors = NULL;
+  int size = 0;
+  int len = 0;
+
+  // number and length of the vectors, 0 vectors end the loop
+  int msg[2] = {0, 0};
+
+  MPI_Bcast(msg, 2, MPI_INT, 0, g_mpi.leader_comm);
+
+  while (msg[0] > 0) {
+    if (msg[0] > size || msg[1] != len) {
+      xi_opt = (double**)Realloc(xi_opt, msg[0] * sizeof(double*));
+      errors = (double*)Realloc(errors, msg[0] * sizeof(double));
+      for (int i = 0; i < msg[0]; i++)
+        xi_opt[i] = (double*)Realloc(i < size ? xi_opt[i] : NULL,
+                                     msg[1] * sizeof(double));
+      size = MAX(size, msg[0]);
+      len = msg[1];
+    }
+
+    calc_errors_groups(xi_opt, errors, msg[0], msg[1]);
+
+    MPI_Bcast(msg, 2, MPI_INT, 0, g_mpi.leader_comm);
+  }
+
+  // the force calculations of all groups are counted on the first one
+  MPI_Reduce(&g_calc.fcalls, NULL, 1, MPI_INT, MPI_SUM, 0, g_mpi.leader_comm);
+
+  // release the other processes of this group
+  calc_forces(NULL, NULL, 1);
+}
+
+/****************************************************************
+  stop_groups
+    releases the roots of the other groups, only once
+****************************************************************/
+
+void stop_groups()
+{
+  static int stopped = 0;
+  int msg[2] = {0, 0};
+
+  if (g_mpi.num_groups == 1 || g_mpi.group > 0 || g_mpi.myid > 0 || stopped)
+    return;
+
+  MPI_Bcast(msg, 2, MPI_INT, 0, g_mpi.leader_comm);
+  MPI_Reduce(MPI_IN_PLACE, &g_calc.fcalls, 1, MPI_INT, MPI_SUM, 0,
+             g_mpi.leader_comm);
+
+  stopped = 1;
+}
+
+#endif  // MPI
+
+/****************************************************************
+  calc_errors
+    error sums of num parameter vectors of length len, with
+    several groups of MPI processes every group evaluates a part
+****************************************************************/
+
+void calc_errors(double** xi_opt, double* errors, int num, int len)
+{
+#if defined(MPI)
+  if (g_mpi.num_groups > 1) {
+    // wake up the roots of the other groups waiting in run_group_root()
+    int msg[2] = {num, len};
+
+    MPI_Bcast(msg, 2, MPI_INT, 0, g_mpi.leader_comm);
+    calc_errors_groups(xi_opt, errors, num, len);
+    return;
+  }
+#endif  // MPI
+
+  calc_errors_local(xi_opt, errors, num);
+}
+
+#if defined(PAIR) || defined(EAM)
+
+/****************************************************************
+  init_neigh_lists
+    copy the neighbor tables of the local configurations into
+    contiguous arrays, the force kernels only need a few fields
+    of neigh_t and should not load the whole structure;
+    calling it again after the configurations were redistributed
+    reuses the arrays of the previous lists
+****************************************************************/
+
+void init_neigh_lists(void)
+{
+  static int num_lists = 0;
+
+  // release the lists of configurations that moved to other processes
+  for (int c = g_mpi.myconf; c < num_lists; c++) {
+    neigh_list_t* nl = g_config.conf_neigh + c;
+    Free(nl->start);
+    Free(nl->nr);
+    Free(nl->type);
+    Free(nl->r);
+    Free(nl->dist);
+    Free(nl->dist_r);
+    for (int s = 0; s < SLOTS; s++) {
+      Free(nl->slot[s]);
+      Free(nl->shift[s]);
+      Free(nl->step[s]);
+      Free(nl->col[s]);
+    }
+  }
+
+  g_config.conf_neigh = (neigh_list_t*)Realloc(
+      g_config.conf_neigh, MAX(1, g_mpi.myconf) * sizeof(neigh_list_t));
+  if (g_mpi.myconf > num_lists)
+    memset(g_config.conf_neigh + num_lists, 0,
+           (g_mpi.myconf - num_lists) * sizeof(neigh_list_t));
+  num_lists = g_mpi.myconf;
+
+  for (int c = 0; c < g_mpi.myconf; c++) {
+    int config_idx = g_mpi.firstconf + c;
+    int natoms = g_config.inconf[config_idx];
+    atom_t* atoms = g_config.conf_atoms + g_config.cnfstart[config_idx] - g_mpi.firstatom;
+    neigh_list_t* nl = g_config.conf_neigh + c;
+
+    nl->start = (int*)Realloc(nl->start, (natoms + 1) * sizeof(int));
+    nl->len = 0;
+    for (int i = 0; i < natoms; i++) {
+      nl->start[i] = nl->len;
+      nl->len += atoms[i].num_neigh;
+    }
+    nl->start[natoms] = nl->len;
+
+    int len = MAX(1, nl->len);
+
+    nl->nr = (int*)Realloc(nl->nr, len * sizeof(int));
+    nl->type = (int*)Realloc(nl->type, len * sizeof(int));
+    nl->r = (double*)Realloc(nl->r, len * sizeof(double));
+    nl->dist = (vector*)Realloc(nl->dist, len * sizeof(vector));
+    nl->dist_r = (vector*)Realloc(nl->dist_r, len * sizeof(vector));
+    for (int s = 0; s < SLOTS; s++) {
+      nl->slot[s] = (int*)Realloc(nl->slot[s], len * sizeof(int));
+      nl->shift[s] = (double*)Realloc(nl->shift[s], len * sizeof(double));
+      nl->step[s] = (double*)Realloc(nl->step[s], len * sizeof(double));
+      nl->col[s] = (int*)Realloc(nl->col[s], len * sizeof(int));
+    }
+
+    for (int i = 0; i < natoms; i++) {
+      for (int j = 0; j < atoms[i].num_neigh; j++) {
+        neigh_t* neigh = atoms[i].neigh + j;
+        int k = nl->start[i] + j;
+        nl->nr[k] = neigh->nr;
+        nl->type[k] = neigh->type;
+        nl->r[k] = neigh->r;
+        nl->dist[k] = neigh->dist;
+        nl->dist_r[k] = neigh->dist_r;
+        for (int s = 0; s < SLOTS; s++) {
+          nl->slot[s][k] = neigh->slot[s];
+          nl->shift[s][k] = neigh->shift[s];
+          nl->step[s][k] = neigh->step[s];
+          nl->col[s][k] = neigh->col[s];
+        }
+      }
+    }
+  }
+}
+
+#endif  // PAIR || EAM
@@ -102,6 +102,11 @@ void init_force(int is_worker)
  *    flag == 2 will cause all processes to perform a potsync (i.e. broadcast
  *             any changed potential parameters from process 0 to the others)
  *             before calculation of forces
+ *    flag == 3 will only sum up the errors, the forces, energies and
+ *             stresses of the other processes are not collected on the
+ *             root process
+ *    flag == 4 takes part in a step of the distributed powell_lsq
+ *             (see powell_lsq_worker), no forces are calculated
  *    all other values will cause a set of forces to be calculated. The root
  *             process will return with the sum of squares of the forces,
  *             while all other processes remain in the function, waiting for
@@ -133,6 +138,9 @@ double calc_forces(double* xi_opt, double* forces, int flag)
   g_mpi.myconf = g_config.nconf;
 #endif  // MPI
 
+  if (g_config.conf_neigh == NULL)
+    init_neigh_lists();
+
   // This is the start of an infinite loop
   while (1) {
     // sum of squares of local process
@@ -150,19 +158,28 @@ double calc_forces(double* xi_opt, double* forces, int flag)
 #endif  // APOT && !MPI
 
 #if defined(MPI)
-#if !defined(APOT)
-    // exchange potential and flag value
-    MPI_Bcast(xi, g_pot.calc_pot.len, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-#endif  // APOT
-    MPI_Bcast(&flag, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&flag, 1, MPI_INT, 0, g_mpi.comm);
 
     if (flag == 1)
       break; // Exception: flag 1 means clean up
 
+    // flag 4: the residuals stay distributed, see powell_lsq_worker()
+    if (flag == 4) {
+      powell_lsq_worker();
+      continue;
+    }
+
+#if !defined(APOT)
+    // exchange potential
+    MPI_Bcast(xi, g_pot.calc_pot.len, MPI_DOUBLE, 0, g_mpi.comm);
+#endif  // !APOT
+
+    g_mpi.eval_start = MPI_Wtime();
+
 #if defined(APOT)
     if (g_mpi.myid == 0)
       apot_check_params(xi_opt);
-    MPI_Bcast(xi_opt, g_calc.ndimtot, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(xi_opt, g_calc.ndimtot, MPI_DOUBLE, 0, g_mpi.comm);
     update_calc_table(xi_opt, xi, 0);
 #else   // APOT
     // if flag == 2 then the potential parameters have changed -> sync
@@ -194,7 +211,13 @@ double calc_forces(double* xi_opt, double* forces, int flag)
 #endif  // TBEAM
 
     // loop over configurations
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic)
+#endif  // _OPENMP
     for (int config_idx = g_mpi.firstconf; config_idx < g_mpi.firstconf + g_mpi.myconf; config_idx++) {
+      // partial sums of this configuration, see sum_conf_partials()
+      conf_sum_t* csum = g_calc.conf_sum + config_idx;
+      memset(csum, 0, sizeof(conf_sum_t));
       int uf = g_config.conf_uf[config_idx - g_mpi.firstconf];
 #if defined(STRESS)
       int us = g_config.conf_us[config_idx - g_mpi.firstconf];
@@ -222,31 +245,33 @@ double calc_forces(double* xi_opt, double* forces, int flag)
           memset(forces + n_i, 0, 3 * sizeof(double));
         }
         // reset atomic density
-        g_config.conf_atoms[n_i - g_mpi.firstatom].rho = 0.0;
+        g_config.conf_atoms[n_i / 3 - g_mpi.firstatom].rho = 0.0;
 #if defined(TBEAM)
-        g_config.conf_atoms[n_i - g_mpi.firstatom].rho_s = 0.0;
+        g_config.conf_atoms[n_i / 3 - g_mpi.firstatom].rho_s = 0.0;
 #endif  // TBEAM
       }
 
+      // neighbor table of this configuration
+      neigh_list_t* nl = g_config.conf_neigh + config_idx - g_mpi.firstconf;
+
       // second loop: calculate pair forces, energies and atomic densities
       for (int atom_idx = 0; atom_idx < g_config.inconf[config_idx]; atom_idx++) {
         atom_t* atom = g_config.conf_atoms + atom_idx + g_config.cnfstart[config_idx] - g_mpi.firstatom;
         int n_i = 3 * (g_config.cnfstart[config_idx] + atom_idx);
         // loop over all neighbors
-        for (int neigh_idx = 0; neigh_idx < atom->num_neigh; neigh_idx++) {
-          neigh_t* neigh = atom->neigh + neigh_idx;
+        for (int k = nl->start[atom_idx]; k < nl->start[atom_idx + 1]; k++) {
           // In small cells, an atom might interact with itself
-          int self = (neigh->nr == atom_idx + g_config.cnfstart[config_idx]) ? 1 : 0;
+          int self = (nl->nr[k] == atom_idx + g_config.cnfstart[config_idx]) ? 1 : 0;
 
           // pair potential part
-          if (neigh->r < g_pot.calc_pot.end[neigh->col[0]]) {
+          if (nl->r[k] < g_pot.calc_pot.end[nl->col[0][k]]) {
             double phi_val = 0.0;
             double phi_grad = 0.0;
             // potential value and gradient are calculated in the same step
             if (uf)
-              phi_val = splint_comb_dir(&g_pot.calc_pot, xi, neigh->slot[0], neigh->shift[0], neigh->step[0], &phi_grad);
+              phi_val = splint_comb_dir(&g_pot.calc_pot, xi, nl->slot[0][k], nl->shift[0][k], nl->step[0][k], &phi_grad);
             else
-              phi_val = splint_dir(&g_pot.calc_pot, xi, neigh->slot[0], neigh->shift[0], neigh->step[0]);
+              phi_val = splint_dir(&g_pot.calc_pot, xi, nl->slot[0][k], nl->shift[0][k], nl->step[0][k]);
 
             // avoid double counting if atom is interacting with itself
             if (self) {
@@ -260,62 +285,62 @@ double calc_forces(double* xi_opt, double* forces, int flag)
             // calculate forces
             if (uf) {
               vector tmp_force;
-              tmp_force.x = neigh->dist_r.x * phi_grad;
-              tmp_force.y = neigh->dist_r.y * phi_grad;
-              tmp_force.z = neigh->dist_r.z * phi_grad;
+              tmp_force.x = nl->dist_r[k].x * phi_grad;
+              tmp_force.y = nl->dist_r[k].y * phi_grad;
+              tmp_force.z = nl->dist_r[k].z * phi_grad;
               forces[n_i + 0] += tmp_force.x;
               forces[n_i + 1] += tmp_force.y;
               forces[n_i + 2] += tmp_force.z;
               // actio = reactio
-              forces[3 * neigh->nr + 0] -= tmp_force.x;
-              forces[3 * neigh->nr + 1] -= tmp_force.y;
-              forces[3 * neigh->nr + 2] -= tmp_force.z;
+              forces[3 * nl->nr[k] + 0] -= tmp_force.x;
+              forces[3 * nl->nr[k] + 1] -= tmp_force.y;
+              forces[3 * nl->nr[k] + 2] -= tmp_force.z;
 #if defined(STRESS)
               // also calculate pair stresses
               if (us) {
-                forces[stress_idx + 0] -= neigh->dist.x * tmp_force.x;
-                forces[stress_idx + 1] -= neigh->dist.y * tmp_force.y;
-                forces[stress_idx + 2] -= neigh->dist.z * tmp_force.z;
-                forces[stress_idx + 3] -= neigh->dist.x * tmp_force.y;
-                forces[stress_idx + 4] -= neigh->dist.y * tmp_force.z;
-                forces[stress_idx + 5] -= neigh->dist.z * tmp_force.x;
+                forces[stress_idx + 0] -= nl->dist[k].x * tmp_force.x;
+                forces[stress_idx + 1] -= nl->dist[k].y * tmp_force.y;
+                forces[stress_idx + 2] -= nl->dist[k].z * tmp_force.z;
+                forces[stress_idx + 3] -= nl->dist[k].x * tmp_force.y;
+                forces[stress_idx + 4] -= nl->dist[k].y * tmp_force.z;
+                forces[stress_idx + 5] -= nl->dist[k].z * tmp_force.x;
               }
 #endif // STRESS
             } // uf
           } // neighbor in range
 
           // calculate atomic densities
-          if (atom->type == neigh->type) {
+          if (atom->type == nl->type[k]) {
             // then transfer(a->b)==transfer(b->a)
-            if (neigh->r < g_pot.calc_pot.end[neigh->col[1]]) {
-              double rho_val = splint_dir(&g_pot.calc_pot, xi, neigh->slot[1], neigh->shift[1], neigh->step[1]);
+            if (nl->r[k] < g_pot.calc_pot.end[nl->col[1][k]]) {
+              double rho_val = splint_dir(&g_pot.calc_pot, xi, nl->slot[1][k], nl->shift[1][k], nl->step[1][k]);
               atom->rho += rho_val;
               // avoid double counting if atom is interacting with itself
               if (!self)
-                g_config.conf_atoms[neigh->nr - g_mpi.firstatom].rho += rho_val;
+                g_config.conf_atoms[nl->nr[k] - g_mpi.firstatom].rho += rho_val;
             }
 #if defined(TBEAM)
-            if (neigh->r < g_pot.calc_pot.end[neigh->col[2]]) {
-              double rho_s_val = splint_dir(&g_pot.calc_pot, xi, neigh->slot[2], neigh->shift[2], neigh->step[2]);
+            if (nl->r[k] < g_pot.calc_pot.end[nl->col[2][k]]) {
+              double rho_s_val = splint_dir(&g_pot.calc_pot, xi, nl->slot[2][k], nl->shift[2][k], nl->step[2][k]);
               atom->rho_s += rho_s_val;
               // avoid double counting if atom is interacting with itself
               if (!self)
-                g_config.conf_atoms[neigh->nr - g_mpi.firstatom].rho_s += rho_s_val;
+                g_config.conf_atoms[nl->nr[k] - g_mpi.firstatom].rho_s += rho_s_val;
             }
 #endif  // TBEAM
           } else {
             // transfer(a->b)!=transfer(b->a)
-            if (neigh->r < g_pot.calc_pot.end[neigh->col[1]])
-              atom->rho += splint_dir(&g_pot.calc_pot, xi, neigh->slot[1], neigh->shift[1], neigh->step[1]);
+            if (nl->r[k] < g_pot.calc_pot.end[nl->col[1][k]])
+              atom->rho += splint_dir(&g_pot.calc_pot, xi, nl->slot[1][k], nl->shift[1][k], nl->step[1][k]);
             // cannot use slot/shift to access splines
-            if (neigh->r < g_pot.calc_pot.end[g_calc.paircol + atom->type])
-              g_config.conf_atoms[neigh->nr - g_mpi.firstatom].rho +=
-                g_splint(&g_pot.calc_pot, xi, g_calc.paircol + atom->type, neigh->r);
+            if (nl->r[k] < g_pot.calc_pot.end[g_calc.paircol + atom->type])
+              g_config.conf_atoms[nl->nr[k] - g_mpi.firstatom].rho +=
+                g_splint(&g_pot.calc_pot, xi, g_calc.paircol + atom->type, nl->r[k]);
 #if defined(TBEAM)
-            if (neigh->r < g_pot.calc_pot.end[neigh->col[2]])
-              atom->rho_s += splint_dir(&g_pot.calc_pot, xi, neigh->slot[2], neigh->shift[2], neigh->step[2]);
-            if (neigh->r < g_pot.calc_pot .end[g_calc.paircol + 2 * g_param.ntypes + atom->type])
-              g_config.conf_atoms[neigh->nr - g_mpi.firstatom].rho_s += g_splint(&g_pot.calc_pot, xi, g_calc.paircol + 2 * g_param.ntypes + atom->type, neigh->r);
+            if (nl->r[k] < g_pot.calc_pot.end[nl->col[2][k]])
+              atom->rho_s += splint_dir(&g_pot.calc_pot, xi, nl->slot[2][k], nl->shift[2][k], nl->step[2][k]);
+            if (nl->r[k] < g_pot.calc_pot .end[g_calc.paircol + 2 * g_param.ntypes + atom->type])
+              g_config.conf_atoms[nl->nr[k] - g_mpi.firstatom].rho_s += g_splint(&g_pot.calc_pot, xi, g_calc.paircol + 2 * g_param.ntypes + atom->type, nl->r[k]);
 #endif  // TBEAM
           }
         } // loop over all neighbors
@@ -388,7 +413,7 @@ double calc_forces(double* xi_opt, double* forces, int flag)
 #endif  // !RESCALE
 
         // sum up rho
-        rho_sum += atom->rho;
+        csum->rho += atom->rho;
 
 #if defined(TBEAM)
 #if !defined(RESCALE)
@@ -418,7 +443,7 @@ double calc_forces(double* xi_opt, double* forces, int flag)
 #endif // RESCALE
 
         // sum up rho_s
-        rho_s_sum += atom->rho_s;
+        csum->rho_s += atom->rho_s;
 #endif // TBEAM
 
       } // second loop
@@ -431,44 +456,43 @@ double calc_forces(double* xi_opt, double* forces, int flag)
                   g_mpi.firstatom;
           int n_i = 3 * (g_config.cnfstart[config_idx] + atom_idx);
           // loop over all neighbors
-          for (int neigh_idx = 0; neigh_idx < atom->num_neigh; neigh_idx++) {
-            neigh_t* neigh = atom->neigh + neigh_idx;
+          for (int k = nl->start[atom_idx]; k < nl->start[atom_idx + 1]; k++) {
             // In small cells, an atom might interact with itself
-            int self = (neigh->nr == atom_idx + g_config.cnfstart[config_idx]) ? 1 : 0;
+            int self = (nl->nr[k] == atom_idx + g_config.cnfstart[config_idx]) ? 1 : 0;
             // column of F
             int col_F = g_calc.paircol + g_param.ntypes + atom->type;
 #if defined(TBEAM)
             int col_F_s = col_F + 2 * g_param.ntypes;
 #endif  // TBEAM
-            double r = neigh->r;
+            double r = nl->r[k];
             // are we within reach?
-            if ((r < g_pot.calc_pot.end[neigh->col[1]]) || (r < g_pot.calc_pot.end[col_F - g_param.ntypes])) {
+            if ((r < g_pot.calc_pot.end[nl->col[1][k]]) || (r < g_pot.calc_pot.end[col_F - g_param.ntypes])) {
               double rho_grad = 0.0;
-              if (r < g_pot.calc_pot.end[neigh->col[1]])
-                rho_grad = splint_grad_dir(&g_pot.calc_pot, xi, neigh->slot[1], neigh->shift[1], neigh->step[1]);
+              if (r < g_pot.calc_pot.end[nl->col[1][k]])
+                rho_grad = splint_grad_dir(&g_pot.calc_pot, xi, nl->slot[1][k], nl->shift[1][k], nl->step[1][k]);
               // use actio = reactio
               double rho_grad_j = 0.0;
-              if (atom->type == neigh->type)
+              if (atom->type == nl->type[k])
                 rho_grad_j = rho_grad;
               else if (r < g_pot.calc_pot.end[col_F - g_param.ntypes])
                 rho_grad_j =  g_splint_grad(&g_pot.calc_pot, xi, col_F - g_param.ntypes, r);
               // now we know everything - calculate forces
-              double eam_force = (rho_grad * atom->gradF + rho_grad_j * g_config.conf_atoms[(neigh->nr) - g_mpi.firstatom] .gradF);
+              double eam_force = (rho_grad * atom->gradF + rho_grad_j * g_config.conf_atoms[(nl->nr[k]) - g_mpi.firstatom] .gradF);
 
 #if defined(TBEAM)
               // s-band contribution to force for TBEAM
-              if ((r < g_pot.calc_pot.end[neigh->col[2]]) || (r < g_pot.calc_pot.end[col_F_s - g_param.ntypes])) {
+              if ((r < g_pot.calc_pot.end[nl->col[2][k]]) || (r < g_pot.calc_pot.end[col_F_s - g_param.ntypes])) {
                 double rho_s_grad = 0.0;
-                if (r < g_pot.calc_pot.end[neigh->col[2]])
-                  rho_s_grad = splint_grad_dir(&g_pot.calc_pot, xi, neigh->slot[2], neigh->shift[2], neigh->step[2]);
+                if (r < g_pot.calc_pot.end[nl->col[2][k]])
+                  rho_s_grad = splint_grad_dir(&g_pot.calc_pot, xi, nl->slot[2][k], nl->shift[2][k], nl->step[2][k]);
                 // use actio = reactio
                 double rho_s_grad_j = 0.0;
-                if (atom->type == neigh->type)
+                if (atom->type == nl->type[k])
                   rho_s_grad_j = rho_s_grad;
                 else if (r < g_pot.calc_pot.end[col_F_s - g_param.ntypes])
                   rho_s_grad_j = g_splint_grad(&g_pot.calc_pot, xi, col_F_s - g_param.ntypes, r);
                 // now we know everything - calculate forces
-                eam_force += (rho_s_grad * atom->gradF_s + rho_s_grad_j * g_config.conf_atoms[(neigh->nr) - g_mpi.firstatom] .gradF_s);
+                eam_force += (rho_s_grad * atom->gradF_s + rho_s_grad_j * g_config.conf_atoms[(nl->nr[k]) - g_mpi.firstatom] .gradF_s);
               }
 #endif  // TBEAM
 
@@ -476,25 +500,25 @@ double calc_forces(double* xi_opt, double* forces, int flag)
               if (self)
                 eam_force *= 0.5;
               vector tmp_force;
-              tmp_force.x = neigh->dist_r.x * eam_force;
-              tmp_force.y = neigh->dist_r.y * eam_force;
-              tmp_force.z = neigh->dist_r.z * eam_force;
+              tmp_force.x = nl->dist_r[k].x * eam_force;
+              tmp_force.y = nl->dist_r[k].y * eam_force;
+              tmp_force.z = nl->dist_r[k].z * eam_force;
               forces[n_i + 0] += tmp_force.x;
               forces[n_i + 1] += tmp_force.y;
               forces[n_i + 2] += tmp_force.z;
               // actio = reactio
-              forces[3 * neigh->nr + 0] -= tmp_force.x;
-              forces[3 * neigh->nr + 1] -= tmp_force.y;
-              forces[3 * neigh->nr + 2] -= tmp_force.z;
+              forces[3 * nl->nr[k] + 0] -= tmp_force.x;
+              forces[3 * nl->nr[k] + 1] -= tmp_force.y;
+              forces[3 * nl->nr[k] + 2] -= tmp_force.z;
 #if defined(STRESS)
               // and stresses
               if (us) {
-                forces[stress_idx + 0] -= neigh->dist.x * tmp_force.x;
-                forces[stress_idx + 1] -= neigh->dist.y * tmp_force.y;
-                forces[stress_idx + 2] -= neigh->dist.z * tmp_force.z;
-                forces[stress_idx + 3] -= neigh->dist.x * tmp_force.y;
-                forces[stress_idx + 4] -= neigh->dist.y * tmp_force.z;
-                forces[stress_idx + 5] -= neigh->dist.z * tmp_force.x;
+                forces[stress_idx + 0] -= nl->dist[k].x * tmp_force.x;
+                forces[stress_idx + 1] -= nl->dist[k].y * tmp_force.y;
+                forces[stress_idx + 2] -= nl->dist[k].z * tmp_force.z;
+                forces[stress_idx + 3] -= nl->dist[k].x * tmp_force.y;
+                forces[stress_idx + 4] -= nl->dist[k].y * tmp_force.z;
+                forces[stress_idx + 5] -= nl->dist[k].z * tmp_force.x;
               }
 #endif          // STRESS
             } // within reach
@@ -511,32 +535,39 @@ double calc_forces(double* xi_opt, double* forces, int flag)
 #if defined(CONTRIB)
           if (atom->contrib)
 #endif  // CONTRIB
-            error_sum += g_config.conf_weight[config_idx] * (dsquare(forces[n_i + 0]) + dsquare(forces[n_i + 1]) + dsquare(forces[n_i + 2]));
+            csum->error += g_config.conf_weight[config_idx] * (dsquare(forces[n_i + 0]) + dsquare(forces[n_i + 1]) + dsquare(forces[n_i + 2]));
         } // third loop over atoms
       } // use forces
 
       // energy contributions
       forces[g_calc.energy_p + config_idx] /= (double)g_config.inconf[config_idx];
       forces[g_calc.energy_p + config_idx] -= g_config.force_0[g_calc.energy_p + config_idx];
-      error_sum += g_config.conf_weight[config_idx] * g_param.eweight * dsquare(forces[g_calc.energy_p + config_idx]);
+      csum->error += g_config.conf_weight[config_idx] * g_param.eweight * dsquare(forces[g_calc.energy_p + config_idx]);
 #if defined(STRESS)
       // stress contributions
       if (uf && us) {
         for (int i = 0; i < 6; i++) {
           forces[stress_idx + i] /= g_config.conf_vol[config_idx - g_mpi.firstconf];
           forces[stress_idx + i] -= g_config.force_0[stress_idx + i];
-          error_sum += g_config.conf_weight[config_idx] * g_param.sweight *
-                    dsquare(forces[stress_idx + i]);
+          csum->error += g_config.conf_weight[config_idx] * g_param.sweight *
+                      dsquare(forces[stress_idx + i]);
         }
       }
 #endif  // STRESS
 
 #if defined(RESCALE)
       // limiting constraints per configuration
-      error_sum += g_config.conf_weight[config_idx] * dsquare(forces[g_calc.limit_p + config_idx]);
+      csum->error += g_config.conf_weight[config_idx] * dsquare(forces[g_calc.limit_p + config_idx]);
 #endif  // RESCALE
     } // loop over configurations
 
+    conf_sum_t conf_total = sum_conf_partials();
+    error_sum += conf_total.error;
+    rho_sum += conf_total.rho;
+#if defined(TBEAM)
+    rho_s_sum += conf_total.rho_s;
+#endif  // TBEAM
+
     // dummy constraints (global)
 #if defined(APOT)
     // add punishment for out of bounds (mostly for powell_lsq)
@@ -607,7 +638,7 @@ double calc_forces(double* xi_opt, double* forces, int flag)
     }   // only root process
 #endif  // !NOPUNISH
 
-    gather_forces(&error_sum, forces);
+    gather_forces(&error_sum, forces, flag);
 
     // root process exits this function now
     if (g_mpi.myid == 0) {
@@ -626,3 +657,571 @@ double calc_forces(double* xi_opt, double* forces, int flag)
   // once a non-root process arrives here, all is done.
   return -1.0;
 }
+
+#if defined(APOT_JACOBIAN)
+
+/****************************************************************
+ *
+ *  calc_jacobian: exact derivatives of the force vector
+ *
+ *  gamma[j][i] = d forces[j] / d xi_opt[idx[i]]
+ *
+ *  The pair part is linear in the derivative tables of calc_dtab. The
+ *  embedding part is differentiated along with the atomic densities: for
+ *  every parameter of a transfer or embedding function the derivatives
+ *  of rho and F'(rho) of each atom are carried through the calculation.
+ *
+ *  Only the rows of the configurations first ... last - 1 are added,
+ *  they have to be zero on entry. The call with first == firstconf
+ *  updates the tables for xi_opt, the one with last == firstconf +
+ *  myconf adds the dummy constraints and the punishments (see
+ *  design_matrix_jacobian).
+ *
+ ****************************************************************/
+
+void calc_jacobian(double* xi_opt, double** gamma, int first, int last)
+{
+  // parameters acting on the densities, par_q[p] is -1 for all others
+  static int nq = -1;
+  static int* q_par = NULL;
+  static int* par_q = NULL;
+  // drho[i * nq + q] and dgradF[i * nq + q] of the atoms of one configuration
+  static double* drho = NULL;
+  static double* dgradF = NULL;
+  static double* deam = NULL;
+  static double* df = NULL;
+  // sums over all configurations for the constraint on <n>
+  static double* drho_sum = NULL;
+  static double rho_sum = 0.0;
+
+  double* xi = g_pot.calc_pot.table;
+  apot_dtab_t* dtab = &g_pot.calc_dtab;
+  apot_table_t* apt = &g_pot.apot_table;
+  const int col_rho = g_calc.paircol;
+  const int col_emb = g_calc.paircol + g_param.ntypes;
+
+  if (first == g_mpi.firstconf) {
+    apot_check_params(xi_opt);
+    update_calc_table(xi_opt, xi, 0);
+    update_splines(xi, 0, g_calc.paircol + g_param.ntypes, 1);
+    update_splines(xi, g_calc.paircol + g_param.ntypes, g_param.ntypes, 3);
+    update_calc_table_dparam(xi_opt);
+  }
+
+  if (nq < 0) {
+    int maxconf = 0;
+    int maxpar = 0;
+
+    nq = 0;
+    q_par = (int*)Malloc(g_calc.ndim * sizeof(int));
+    par_q = (int*)Malloc(g_calc.ndim * sizeof(int));
+    for (int p = 0; p < g_calc.ndim; p++)
+      par_q[p] = -1;
+    for (int col = col_rho; col < col_emb + g_param.ntypes; col++) {
+      maxpar = MAX(maxpar, apt->n_par[col]);
+      for (int l = 0; l < dtab->num_par[col]; l++) {
+        int p = dtab->par[col][l];
+        if (par_q[p] < 0) {
+          par_q[p] = nq;
+          q_par[nq++] = p;
+        }
+      }
+    }
+    for (int config_idx = 0; config_idx < g_config.nconf; config_idx++)
+      maxconf = MAX(maxconf, g_config.inconf[config_idx]);
+
+    drho = (double*)Malloc(MAX(1, maxconf * nq) * sizeof(double));
+    dgradF = (double*)Malloc(MAX(1, maxconf * nq) * sizeof(double));
+    drho_sum = (double*)Malloc(MAX(1, nq) * sizeof(double));
+    deam = (double*)Malloc(MAX(1, nq) * sizeof(double));
+    df = (double*)Malloc(MAX(1, maxpar) * sizeof(double));
+  }
+
+  if (g_config.conf_neigh == NULL)
+    init_neigh_lists();
+
+  if (first == g_mpi.firstconf) {
+    memset(drho_sum, 0, MAX(1, nq) * sizeof(double));
+    rho_sum = 0.0;
+  }
+
+  for (int config_idx = first; config_idx < last; config_idx++) {
+    int uf = g_config.conf_uf[config_idx];
+#if defined(STRESS)
+    int us = g_config.conf_us[config_idx];
+    int stress_idx = g_calc.stress_p + 6 * config_idx;
+#endif  // STRESS
+    int cnfstart = g_config.cnfstart[config_idx];
+    double* d_energy = gamma[g_calc.energy_p + config_idx];
+    neigh_list_t* nl = g_config.conf_neigh + config_idx;
+
+    memset(drho, 0, MAX(1, g_config.inconf[config_idx] * nq) * sizeof(double));
+    for (int atom_idx = 0; atom_idx < g_config.inconf[config_idx]; atom_idx++)
+      g_config.conf_atoms[cnfstart + atom_idx].rho = 0.0;
+
+    // pair derivatives, densities and their derivatives
+    for (int atom_idx = 0; atom_idx < g_config.inconf[config_idx]; atom_idx++) {
+      atom_t* atom = g_config.conf_atoms + cnfstart + atom_idx;
+      int n_i = 3 * (cnfstart + atom_idx);
+      double* drho_i = drho + atom_idx * nq;
+
+      for (int k = nl->start[atom_idx]; k < nl->start[atom_idx + 1]; k++) {
+        int self = (nl->nr[k] == atom_idx + cnfstart) ? 1 : 0;
+        double* drho_j = drho + (nl->nr[k] - cnfstart) * nq;
+        int col = nl->col[0][k];
+
+        if (nl->r[k] < g_pot.calc_pot.end[col]) {
+          for (int l = 0; l < dtab->num_par[col]; l++) {
+            int p = dtab->par[col][l];
+            pot_table_t* dpot = dtab->dpot + p;
+            double phi_val = 0.0;
+            double phi_grad = 0.0;
+
+            if (uf)
+              phi_val = splint_comb_dir(dpot, dpot->table, nl->slot[0][k], nl->shift[0][k], nl->step[0][k], &phi_grad);
+            else
+              phi_val = splint_dir(dpot, dpot->table, nl->slot[0][k], nl->shift[0][k], nl->step[0][k]);
+
+            if (self) {
+              phi_val *= 0.5;
+              phi_grad *= 0.5;
+            }
+
+            d_energy[p] += phi_val;
+
+            if (uf) {
+              vector tmp_force;
+              tmp_force.x = nl->dist_r[k].x * phi_grad;
+              tmp_force.y = nl->dist_r[k].y * phi_grad;
+              tmp_force.z = nl->dist_r[k].z * phi_grad;
+              gamma[n_i + 0][p] += tmp_force.x;
+              gamma[n_i + 1][p] += tmp_force.y;
+              gamma[n_i + 2][p] += tmp_force.z;
+              gamma[3 * nl->nr[k] + 0][p] -= tmp_force.x;
+              gamma[3 * nl->nr[k] + 1][p] -= tmp_force.y;
+              gamma[3 * nl->nr[k] + 2][p] -= tmp_force.z;
+#if defined(STRESS)
+              if (us) {
+                gamma[stress_idx + 0][p] -= nl->dist[k].x * tmp_force.x;
+                gamma[stress_idx + 1][p] -= nl->dist[k].y * tmp_force.y;
+                gamma[stress_idx + 2][p] -= nl->dist[k].z * tmp_force.z;
+                gamma[stress_idx + 3][p] -= nl->dist[k].x * tmp_force.y;
+                gamma[stress_idx + 4][p] -= nl->dist[k].y * tmp_force.z;
+                gamma[stress_idx + 5][p] -= nl->dist[k].z * tmp_force.x;
+              }
+#endif  // STRESS
+            }
+          }
+        }
+
+        // transfer function of the neighbor type acting on atom
+        col = nl->col[1][k];
+        if (nl->r[k] < g_pot.calc_pot.end[col]) {
+          double rho_val = splint_dir(&g_pot.calc_pot, xi, nl->slot[1][k], nl->shift[1][k], nl->step[1][k]);
+          atom->rho += rho_val;
+          if (atom->type == nl->type[k] && !self)
+            g_config.conf_atoms[nl->nr[k]].rho += rho_val;
+          for (int l = 0; l < dtab->num_par[col]; l++) {
+            int p = dtab->par[col][l];
+            pot_table_t* dpot = dtab->dpot + p;
+            double d = splint_dir(dpot, dpot->table, nl->slot[1][k], nl->shift[1][k], nl->step[1][k]);
+            drho_i[par_q[p]] += d;
+            if (atom->type == nl->type[k] && !self)
+              drho_j[par_q[p]] += d;
+          }
+        }
+
+        // transfer function of the atom type acting on the neighbor
+        col = col_rho + atom->type;
+        if (atom->type != nl->type[k] && nl->r[k] < g_pot.calc_pot.end[col]) {
+          g_config.conf_atoms[nl->nr[k]].rho += g_splint(&g_pot.calc_pot, xi, col, nl->r[k]);
+          for (int l = 0; l < dtab->num_par[col]; l++) {
+            int p = dtab->par[col][l];
+            pot_table_t* dpot = dtab->dpot + p;
+            drho_j[par_q[p]] += g_splint(dpot, dpot->table, col, nl->r[k]);
+          }
+        }
+      }
+
+      // the density of atom is complete, differentiate F(rho)
+      int col_F = col_emb + atom->type;
+      double rho = atom->rho;
+      double grad2F = 0.0;
+      double* dgradF_i = dgradF + atom_idx * nq;
+
+      for (int q = 0; q < nq; q++)
+        deam[q] = 0.0;
+
+      if ((rho < g_pot.calc_pot.begin[col_F]) || (rho > g_pot.calc_pot.end[col_F]) || (rho < 0.1)) {
+        // analytic embedding function, see calc_forces()
+        double* val = xi_opt + g_pot.opt_pot.first[col_F];
+        double h = 0.0001;
+        int npar = apt->n_par[col_F] - (g_pot.smooth_pot[col_F] ? 1 : 0);
+        atom->gradF = apot_gradient(rho, val, apt->fvalue[col_F]);
+        grad2F = (apot_gradient(rho + h, val, apt->fvalue[col_F]) -
+                  apot_gradient(rho - h, val, apt->fvalue[col_F])) / (2.0 * h);
+        apt->fdparam[col_F](rho, val, df);
+        for (int l = 0; l < npar; l++)
+          if (dtab->slot_par[col_F][l] >= 0)
+            d_energy[dtab->slot_par[col_F][l]] += df[l];
+        apot_gradient_dparam(rho, val, apt->fdparam[col_F], npar, df);
+        for (int l = 0; l < npar; l++)
+          if (dtab->slot_par[col_F][l] >= 0)
+            deam[par_q[dtab->slot_par[col_F][l]]] += df[l];
+      } else {
+        g_splint_comb(&g_pot.calc_pot, xi, col_F, rho, &atom->gradF);
+        grad2F = splint_grad2_ed(&g_pot.calc_pot, col_F, rho);
+        for (int l = 0; l < dtab->num_par[col_F]; l++) {
+          int p = dtab->par[col_F][l];
+          pot_table_t* dpot = dtab->dpot + p;
+          d_energy[p] += g_splint_comb(dpot, dpot->table, col_F, rho, deam + par_q[p]);
+        }
+      }
+
+      rho_sum += rho;
+
+      for (int q = 0; q < nq; q++) {
+        d_energy[q_par[q]] += atom->gradF * drho_i[q];
+        dgradF_i[q] = deam[q] + grad2F * drho_i[q];
+        drho_sum[q] += drho_i[q];
+      }
+    }
+
+    // derivatives of the EAM forces
+    if (uf) {
+      for (int atom_idx = 0; atom_idx < g_config.inconf[config_idx]; atom_idx++) {
+        atom_t* atom = g_config.conf_atoms + cnfstart + atom_idx;
+        int n_i = 3 * (cnfstart + atom_idx);
+
+        for (int k = nl->start[atom_idx]; k < nl->start[atom_idx + 1]; k++) {
+          atom_t* atom_j = g_config.conf_atoms + nl->nr[k];
+          int self = (nl->nr[k] == atom_idx + cnfstart) ? 1 : 0;
+          int col_i = nl->col[1][k];
+          int col_j = col_rho + atom->type;
+          double r = nl->r[k];
+
+          if ((r >= g_pot.calc_pot.end[col_i]) && (r >= g_pot.calc_pot.end[col_j]))
+            continue;
+
+          double rho_grad = 0.0;
+          if (r < g_pot.calc_pot.end[col_i])
+            rho_grad = splint_grad_dir(&g_pot.calc_pot, xi, nl->slot[1][k], nl->shift[1][k], nl->step[1][k]);
+          double rho_grad_j = 0.0;
+          if (atom->type == nl->type[k])
+            rho_grad_j = rho_grad;
+          else if (r < g_pot.calc_pot.end[col_j])
+            rho_grad_j = g_splint_grad(&g_pot.calc_pot, xi, col_j, r);
+
+          double* dgradF_i = dgradF + atom_idx * nq;
+          double* dgradF_j = dgradF + (nl->nr[k] - cnfstart) * nq;
+
+          for (int q = 0; q < nq; q++)
+            deam[q] = rho_grad * dgradF_i[q] + rho_grad_j * dgradF_j[q];
+
+          if (r < g_pot.calc_pot.end[col_i]) {
+            for (int l = 0; l < dtab->num_par[col_i]; l++) {
+              int p = dtab->par[col_i][l];
+              pot_table_t* dpot = dtab->dpot + p;
+              double d = splint_grad_dir(dpot, dpot->table, nl->slot[1][k], nl->shift[1][k], nl->step[1][k]);
+              deam[par_q[p]] += d * atom->gradF;
+              if (atom->type == nl->type[k])
+                deam[par_q[p]] += d * atom_j->gradF;
+            }
+          }
+          if (atom->type != nl->type[k] && r < g_pot.calc_pot.end[col_j]) {
+            for (int l = 0; l < dtab->num_par[col_j]; l++) {
+              int p = dtab->par[col_j][l];
+              pot_table_t* dpot = dtab->dpot + p;
+              deam[par_q[p]] += g_splint_grad(dpot, dpot->table, col_j, r) * atom_j->gradF;
+            }
+          }
+
+          for (int q = 0; q < nq; q++) {
+            int p = q_par[q];
+            double eam_force = self ? 0.5 * deam[q] : deam[q];
+            vector tmp_force;
+            tmp_force.x = nl->dist_r[k].x * eam_force;
+            tmp_force.y = nl->dist_r[k].y * eam_force;
+            tmp_force.z = nl->dist_r[k].z * eam_force;
+            gamma[n_i + 0][p] += tmp_force.x;
+            gamma[n_i + 1][p] += tmp_force.y;
+            gamma[n_i + 2][p] += tmp_force.z;
+            gamma[3 * nl->nr[k] + 0][p] -= tmp_force.x;
+            gamma[3 * nl->nr[k] + 1][p] -= tmp_force.y;
+            gamma[3 * nl->nr[k] + 2][p] -= tmp_force.z;
+#if defined(STRESS)
+            if (us) {
+              gamma[stress_idx + 0][p] -= nl->dist[k].x * tmp_force.x;
+              gamma[stress_idx + 1][p] -= nl->dist[k].y * tmp_force.y;
+              gamma[stress_idx + 2][p] -= nl->dist[k].z * tmp_force.z;
+              gamma[stress_idx + 3][p] -= nl->dist[k].x * tmp_force.y;
+              gamma[stress_idx + 4][p] -= nl->dist[k].y * tmp_force.z;
+              gamma[stress_idx + 5][p] -= nl->dist[k].z * tmp_force.x;
+            }
+#endif  // STRESS
+          }
+        }
+      }
+
+#if defined(FWEIGHT)
+      for (int atom_idx = 0; atom_idx < g_config.inconf[config_idx]; atom_idx++) {
+        atom_t* atom = g_config.conf_atoms + cnfstart + atom_idx;
+        int n_i = 3 * (cnfstart + atom_idx);
+        for (int k = 0; k < 3; k++)
+          for (int i = 0; i < g_calc.ndim; i++)
+            gamma[n_i + k][i] /= FORCE_EPS + atom->absforce;
+      }
+#endif  // FWEIGHT
+    }
+
+    for (int i = 0; i < g_calc.ndim; i++)
+      d_energy[i] /= (double)g_config.inconf[config_idx];
+
+#if defined(STRESS)
+    if (uf && us) {
+      for (int k = 0; k < 6; k++)
+        for (int i = 0; i < g_calc.ndim; i++)
+          gamma[stress_idx + k][i] /= g_config.conf_vol[config_idx];
+    }
+#endif  // STRESS
+  }
+
+  if (last < g_mpi.firstconf + g_mpi.myconf)
+    return;
+
+#if !defined(NOPUNISH)
+  // constraint on U'(1.0) and on <n> = 1.0
+  for (int g = 0; g < g_param.ntypes; g++) {
+    int col = col_emb + g;
+    for (int l = 0; l < dtab->num_par[col]; l++) {
+      int p = dtab->par[col][l];
+      pot_table_t* dpot = dtab->dpot + p;
+      gamma[g_calc.dummy_p + g][p] = DUMMY_WEIGHT * g_splint_grad(dpot, dpot->table, col, 1.0);
+    }
+  }
+  if (rho_sum > 0.0) {
+    for (int q = 0; q < nq; q++)
+      gamma[g_calc.dummy_p + g_param.ntypes][q_par[q]] = DUMMY_WEIGHT * drho_sum[q] / (double)g_config.natoms;
+  }
+#endif  // !NOPUNISH
+
+  apot_punish_dparam(xi_opt, gamma);
+}
+
+#endif  // APOT_JACOBIAN
+
+#if defined(ADJOINT_GRADIENT)
+
+/****************************************************************
+ *
+ *  calc_gradient: gradient of the error sum with respect to the
+ *  potential table, returns the error sum like calc_forces
+ *
+ *  grad[k] = d error_sum / d xi_opt[k]
+ *
+ *  The force calculation is run backwards: the EAM forces give the
+ *  derivatives with respect to F'(rho) of every atom, the embedding
+ *  energies turn them into derivatives with respect to rho, which
+ *  the densities pass on to the transfer functions. Every spline
+ *  interpolation adds its share to the four coefficients it was
+ *  evaluated from, and update_splines_adjoint propagates the second
+ *  derivatives to the table values.
+ *
+ ****************************************************************/
+
+double calc_gradient(double* xi_opt, double* forces, double* grad)
+{
+  static double* r_bar = NULL;
+  static double* d2_bar = NULL;
+  static double* rho_bar = NULL;
+  static double* gradF_bar = NULL;
+
+  const int len = g_pot.calc_pot.len;
+  const int col_emb = g_calc.paircol + g_param.ntypes;
+  const double error_sum = calc_forces(xi_opt, forces, 0);
+  double* xi = xi_opt;
+  double rho_bar_0 = 0.0;
+
+  if (r_bar == NULL) {
+    r_bar = (double*)Malloc(g_calc.mdim * sizeof(double));
+    d2_bar = (double*)Malloc(len * sizeof(double));
+    rho_bar = (double*)Malloc(g_config.natoms * sizeof(double));
+    gradF_bar = (double*)Malloc(g_config.natoms * sizeof(double));
+  }
+
+  adjoint_residuals(forces, r_bar);
+
+  memset(grad, 0, len * sizeof(double));
+  memset(d2_bar, 0, len * sizeof(double));
+  memset(gradF_bar, 0, g_config.natoms * sizeof(double));
+
+#if !defined(NOPUNISH)
+  // constraint on U': U'(1.0)=0.0
+  for (int g = 0; g < g_param.ntypes; g++) {
+    int k = 0;
+    double b = 0.0;
+    double step = 0.0;
+    splint_index(&g_pot.calc_pot, col_emb + g, 1.0, &k, &b, &step);
+    splint_dir_adjoint(k, b, step, 0.0,
+                       2.0 * DUMMY_WEIGHT * forces[g_calc.dummy_p + g], grad,
+                       d2_bar);
+  }
+
+  // constraint on <n> = 1.0, every density enters the average
+  double rho_sum = 0.0;
+  for (int i = 0; i < g_config.natoms; i++)
+    rho_sum += g_config.conf_atoms[i].rho;
+  if (rho_sum > 0.0)
+    rho_bar_0 = 2.0 * DUMMY_WEIGHT * forces[g_calc.dummy_p + g_param.ntypes] /
+                (double)g_config.natoms;
+#endif  // !NOPUNISH
+
+  for (int config_idx = 0; config_idx < g_config.nconf; config_idx++) {
+    const int uf = g_config.conf_uf[config_idx];
+    const int first = g_config.cnfstart[config_idx];
+    const double e_bar = r_bar[g_calc.energy_p + config_idx];
+#if defined(STRESS)
+    const int stress_idx = g_calc.stress_p + 6 * config_idx;
+#else
+    const int stress_idx = 0;
+#endif  // STRESS
+
+    neigh_list_t* nl = g_config.conf_neigh + config_idx;
+
+    // third loop backwards: EAM forces, derivatives with respect to F'(rho)
+    for (int atom_idx = 0; atom_idx < g_config.inconf[config_idx] && uf;
+         atom_idx++) {
+      atom_t* atom = g_config.conf_atoms + first + atom_idx;
+      int n_i = 3 * (first + atom_idx);
+      int col_rho_j = g_calc.paircol + atom->type;
+
+      for (int k = nl->start[atom_idx]; k < nl->start[atom_idx + 1]; k++) {
+        double r = nl->r[k];
+        int nr = nl->nr[k];
+
+        if ((r >= g_pot.calc_pot.end[nl->col[1][k]]) &&
+            (r >= g_pot.calc_pot.end[col_rho_j]))
+          continue;
+
+        double t = adjoint_pair_force(nl, k, n_i, stress_idx, r_bar);
+        // avoid double counting if atom is interacting with itself
+        if (nr == first + atom_idx)
+          t *= 0.5;
+
+        double rho_grad = 0.0;
+        if (r < g_pot.calc_pot.end[nl->col[1][k]])
+          rho_grad = splint_grad_dir(&g_pot.calc_pot, xi, nl->slot[1][k],
+                                     nl->shift[1][k], nl->step[1][k]);
+
+        if (atom->type == nl->type[k]) {
+          gradF_bar[first + atom_idx] += t * rho_grad;
+          gradF_bar[nr] += t * rho_grad;
+          if (r < g_pot.calc_pot.end[nl->col[1][k]])
+            splint_dir_adjoint(
+                nl->slot[1][k], nl->shift[1][k], nl->step[1][k], 0.0,
+                t * (atom->gradF + g_config.conf_atoms[nr].gradF), grad,
+                d2_bar);
+        } else {
+          gradF_bar[first + atom_idx] += t * rho_grad;
+          if (r < g_pot.calc_pot.end[nl->col[1][k]])
+            splint_dir_adjoint(nl->slot[1][k], nl->shift[1][k],
+                               nl->step[1][k], 0.0, t * atom->gradF, grad,
+                               d2_bar);
+          if (r < g_pot.calc_pot.end[col_rho_j]) {
+            int kk = 0;
+            double b = 0.0;
+            double step = 0.0;
+            splint_index(&g_pot.calc_pot, col_rho_j, r, &kk, &b, &step);
+            gradF_bar[nr] +=
+                t * g_splint_grad(&g_pot.calc_pot, xi, col_rho_j, r);
+            splint_dir_adjoint(kk, b, step, 0.0,
+                               t * g_config.conf_atoms[nr].gradF, grad, d2_bar);
+          }
+        }
+      }
+    }
+
+    // embedding energies backwards: derivatives with respect to rho
+    for (int atom_idx = 0; atom_idx < g_config.inconf[config_idx]; atom_idx++) {
+      int i = first + atom_idx;
+      atom_t* atom = g_config.conf_atoms + i;
+      int col_F = col_emb + atom->type;
+      double x = atom->rho;
+      double grad_bar_F = gradF_bar[i];
+      int k = 0;
+      double b = 0.0;
+      double step = 0.0;
+
+      rho_bar[i] = rho_bar_0 + e_bar * atom->gradF;
+
+      if (atom->rho < g_pot.calc_pot.begin[col_F]) {
+        // linear extrapolation left
+        x = g_pot.calc_pot.begin[col_F];
+        grad_bar_F += e_bar * (atom->rho - g_pot.calc_pot.begin[col_F]);
+      } else if (atom->rho > g_pot.calc_pot.end[col_F]) {
+        // and right
+        x = g_pot.calc_pot.end[col_F] - 0.5 * g_pot.calc_pot.step[col_F];
+        grad_bar_F += e_bar * (atom->rho - g_pot.calc_pot.end[col_F]);
+      }
+
+      splint_index(&g_pot.calc_pot, col_F, x, &k, &b, &step);
+      splint_dir_adjoint(k, b, step, e_bar, grad_bar_F, grad, d2_bar);
+
+      // F''(rho) in-between
+      if (x == atom->rho)
+        rho_bar[i] += gradF_bar[i] * ((1.0 - b) * g_pot.calc_pot.d2tab[k] +
+                                      b * g_pot.calc_pot.d2tab[k + 1]);
+    }
+
+    // second loop backwards: pair energies and forces, atomic densities
+    for (int atom_idx = 0; atom_idx < g_config.inconf[config_idx]; atom_idx++) {
+      atom_t* atom = g_config.conf_atoms + first + atom_idx;
+      int n_i = 3 * (first + atom_idx);
+      int col_rho_j = g_calc.paircol + atom->type;
+
+      for (int k = nl->start[atom_idx]; k < nl->start[atom_idx + 1]; k++) {
+        double r = nl->r[k];
+        int nr = nl->nr[k];
+        // avoid double counting if atom is interacting with itself
+        int self = (nr == first + atom_idx) ? 1 : 0;
+
+        // pair potential part
+        if (r < g_pot.calc_pot.end[nl->col[0][k]]) {
+          double scale = self ? 0.5 : 1.0;
+          double phi_grad_bar =
+              uf ? adjoint_pair_force(nl, k, n_i, stress_idx, r_bar) : 0.0;
+          splint_dir_adjoint(nl->slot[0][k], nl->shift[0][k], nl->step[0][k],
+                             scale * e_bar, scale * phi_grad_bar, grad, d2_bar);
+        }
+
+        // atomic densities
+        if (atom->type == nl->type[k]) {
+          if (r < g_pot.calc_pot.end[nl->col[1][k]])
+            splint_dir_adjoint(
+                nl->slot[1][k], nl->shift[1][k], nl->step[1][k],
+                rho_bar[first + atom_idx] + (self ? 0.0 : rho_bar[nr]), 0.0,
+                grad, d2_bar);
+        } else {
+          if (r < g_pot.calc_pot.end[nl->col[1][k]])
+            splint_dir_adjoint(nl->slot[1][k], nl->shift[1][k], nl->step[1][k],
+                               rho_bar[first + atom_idx], 0.0, grad, d2_bar);
+          if (r < g_pot.calc_pot.end[col_rho_j]) {
+            int kk = 0;
+            double b = 0.0;
+            double step = 0.0;
+            splint_index(&g_pot.calc_pot, col_rho_j, r, &kk, &b, &step);
+            splint_dir_adjoint(kk, b, step, rho_bar[nr], 0.0, grad, d2_bar);
+          }
+        }
+      }
+    }
+  }
+
+  // pair potentials and transfer functions, embedding functions
+  update_splines_adjoint(xi, d2_bar, grad, 0, col_emb, 1);
+  update_splines_adjoint(xi, d2_bar, grad, col_emb, g_param.ntypes, 3);
+
+  return error_sum;
+}
+
+#endif  // ADJOINT_GRADIENT
@@ -36,6 +36,7 @@
 
 #include "force.h"
 #include "functions.h"
+#include "mpi_utils.h"
 #include "memory.h"
 #include "potential_input.h"
 #include "potential_output.h"
@@ -100,6 +101,9 @@ void init_force(int is_worker)
  *    flag == 2 will cause all processes to perform a potsync (i.e. broadcast
  *             any changed potential parameters from process 0 to the others)
  *             before calculation of forces
+ *    flag == 3 will only sum up the errors, the forces, energies and
+ *             stresses of the other processes are not collected on the
+ *             root process
  *    all other values will cause a set of forces to be calculated. The root
  *             process will return with the sum of squares of the forces,
  *             while all other processes remain in the function, waiting for
@@ -161,17 +165,19 @@ double calc_forces(double* xi_opt, double* forces, int flag)
 #if defined(MPI)
 /* exchange potential and flag value */
 #if !defined(APOT)
-    MPI_Bcast(xi, g_pot.calc_pot.len, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(xi, g_pot.calc_pot.len, MPI_DOUBLE, 0, g_mpi.comm);
 #endif  // !APOT
-    MPI_Bcast(&flag, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&flag, 1, MPI_INT, 0, g_mpi.comm);
 
     if (flag == 1)
       break; /* Exception: flag 1 means clean up */
 
+    g_mpi.eval_start = MPI_Wtime();
+
 #if defined(APOT)
     if (g_mpi.myid == 0)
       apot_check_params(xi_opt);
-    MPI_Bcast(xi_opt, g_calc.ndimtot, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(xi_opt, g_calc.ndimtot, MPI_DOUBLE, 0, g_mpi.comm);
     if (g_pot.format_type == POTENTIAL_FORMAT_ANALYTIC)
       update_calc_table(xi_opt, xi, 0);
 #else   // APOT
@@ -251,7 +257,12 @@ double calc_forces(double* xi_opt, double* forces, int flag)
 
     /* region containing loop over configurations,
        also OMP-parallelized region */
+#if defined(_OPENMP)
+#pragma omp parallel private(i, col)
+#endif  // _OPENMP
     {
+      /* partial sums of the configuration, see sum_conf_partials() */
+      conf_sum_t* csum;
       int self;
       vector tmp_force;
       int h, j, type1, type2, uf;
@@ -267,7 +278,12 @@ double calc_forces(double* xi_opt, double* forces, int flag)
       neigh_t* neigh;
 
       /* loop over configurations: M A I N LOOP CONTAINING ALL ATOM-LOOPS */
+#if defined(_OPENMP)
+#pragma omp for schedule(dynamic)
+#endif  // _OPENMP
       for (h = g_mpi.firstconf; h < g_mpi.firstconf + g_mpi.myconf; h++) {
+        csum = g_calc.conf_sum + h;
+        memset(csum, 0, sizeof(conf_sum_t));
         uf = g_config.conf_uf[h - g_mpi.firstconf];
 #if defined(STRESS)
         us = g_config.conf_us[h - g_mpi.firstconf];
@@ -850,17 +866,17 @@ double calc_forces(double* xi_opt, double* forces, int flag)
 #if defined(CONTRIB)
             if (atom->contrib)
 #endif  // CONTRIB
-              tmpsum += g_config.conf_weight[h] *
-                        (dsquare(forces[n_i + 0]) + dsquare(forces[n_i + 1]) +
-                         dsquare(forces[n_i + 2]));
+              csum->error += g_config.conf_weight[h] *
+                          (dsquare(forces[n_i + 0]) + dsquare(forces[n_i + 1]) +
+                           dsquare(forces[n_i + 2]));
           }
         } /* end F I F T H loop over atoms */
 
         /* whole energy contributions flow into tmpsum */
         forces[g_calc.energy_p + h] /= (double)g_config.inconf[h];
         forces[g_calc.energy_p + h] -= g_config.force_0[g_calc.energy_p + h];
-        tmpsum += g_config.conf_weight[h] * g_param.eweight *
-                  dsquare(forces[g_calc.energy_p + h]);
+        csum->error += g_config.conf_weight[h] * g_param.eweight *
+                    dsquare(forces[g_calc.energy_p + h]);
 
 #if defined(STRESS)
         /* whole stress contributions flow into tmpsum */
@@ -868,14 +884,17 @@ double calc_forces(double* xi_opt, double* forces, int flag)
           for (i = 0; i < 6; i++) {
             forces[stresses + i] /= g_config.conf_vol[h - g_mpi.firstconf];
             forces[stresses + i] -= g_config.force_0[stresses + i];
-            tmpsum += g_config.conf_weight[h] * g_param.sweight *
-                      dsquare(forces[stresses + i]);
+            csum->error += g_config.conf_weight[h] * g_param.sweight *
+                        dsquare(forces[stresses + i]);
           }
         }
 #endif  // STRESS
       } /* end M A I N loop over configurations */
     }   /* parallel region */
 
+    /* add up the partial sums of all configurations */
+    tmpsum += sum_conf_partials().error;
+
 /* dummy constraints (global) */
 #if defined(APOT)
     /* add punishment for out of bounds (mostly for powell_lsq) */
@@ -887,39 +906,44 @@ double calc_forces(double* xi_opt, double* forces, int flag)
 #if defined(MPI)
     /* reduce global sum */
     sum = 0.0;
-    MPI_Reduce(&tmpsum, &sum, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
-    /* gather forces, energies, stresses */
-    if (g_mpi.myid == 0) { /* root node already has data in place */
+    g_mpi.eval_time += MPI_Wtime() - g_mpi.eval_start;
+    MPI_Reduce(&tmpsum, &sum, 1, MPI_DOUBLE, MPI_SUM, 0, g_mpi.comm);
+    /* gather forces, energies, stresses unless only the error sum is needed */
+    if (flag == 3) {
+      /* the residuals stay on their process */
+    } else if (g_mpi.myid == 0) { /* root node already has data in place */
       /* forces */
       MPI_Gatherv(MPI_IN_PLACE, g_mpi.myatoms, g_mpi.MPI_VECTOR, forces,
                   g_mpi.atom_len, g_mpi.atom_dist, g_mpi.MPI_VECTOR, 0,
-                  MPI_COMM_WORLD);
+                  g_mpi.comm);
       /* energies */
       MPI_Gatherv(MPI_IN_PLACE, g_mpi.myconf, MPI_DOUBLE,
                   forces + g_calc.energy_p, g_mpi.conf_len, g_mpi.conf_dist,
-                  MPI_DOUBLE, 0, MPI_COMM_WORLD);
+                  MPI_DOUBLE, 0, g_mpi.comm);
 #if defined(STRESS)
       /* stresses */
       MPI_Gatherv(MPI_IN_PLACE, g_mpi.myconf, g_mpi.MPI_STENS,
                   forces + g_calc.stress_p, g_mpi.conf_len, g_mpi.conf_dist,
-                  g_mpi.MPI_STENS, 0, MPI_COMM_WORLD);
+                  g_mpi.MPI_STENS, 0, g_mpi.comm);
 #endif  // STRESS
     } else {
       /* forces */
       MPI_Gatherv(forces + g_mpi.firstatom * 3, g_mpi.myatoms, g_mpi.MPI_VECTOR,
                   forces, g_mpi.atom_len, g_mpi.atom_dist, g_mpi.MPI_VECTOR, 0,
-                  MPI_COMM_WORLD);
+                  g_mpi.comm);
       /* energies */
       MPI_Gatherv(forces + g_calc.energy_p + g_mpi.firstconf, g_mpi.myconf,
                   MPI_DOUBLE, forces + g_calc.energy_p, g_mpi.conf_len,
-                  g_mpi.conf_dist, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+                  g_mpi.conf_dist, MPI_DOUBLE, 0, g_mpi.comm);
 #if defined(STRESS)
       /* stresses */
       MPI_Gatherv(forces + g_calc.stress_p + 6 * g_mpi.firstconf, g_mpi.myconf,
                   g_mpi.MPI_STENS, forces + g_calc.stress_p, g_mpi.conf_len,
-                  g_mpi.conf_dist, g_mpi.MPI_STENS, 0, MPI_COMM_WORLD);
+                  g_mpi.conf_dist, g_mpi.MPI_STENS, 0, g_mpi.comm);
 #endif  // STRESS
     }
+    if (rebalance_configurations() != MPI_SUCCESS)
+      error(1, "Could not redistribute the configurations\n");
 #else
     sum = tmpsum; /* global sum = local sum  */
 #endif  // MPI
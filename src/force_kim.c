@@ -216,7 +216,7 @@ double calc_forces(double *xi_opt, double *forces, int flag)
 
     } // loop over configurations
 
-    gather_forces(&error_sum, forces);
+    gather_forces(&error_sum, forces, 0);
 
     // root process exits this function now
     if (g_mpi.myid == 0) {
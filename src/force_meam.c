@@ -105,6 +105,11 @@ void init_force(int is_worker)
  *    flag == 2 will cause all processes to perform a potsync (i.e. broadcast
  *             any changed potential parameters from process 0 to the others)
  *             before calculation of forces
+ *    flag == 3 will only sum up the errors, the forces, energies and
+ *             stresses of the other processes are not collected on the
+ *             root process
+ *    flag == 4 takes part in a step of the distributed powell_lsq
+ *             (see powell_lsq_worker), no forces are calculated
  *    all other values will cause a set of forces to be calculated. The root
  *             process will return with the sum of squares of the forces,
  *             while all other processes remain in the function, waiting for
@@ -115,45 +120,13 @@ void init_force(int is_worker)
 
 double calc_forces(double* xi_opt, double* forces, int flag)
 {
-  int first, col, i = flag;
+  int first, col;
   double* xi = NULL;
 
   /* Some useful temp variables */
   double error_sum = 0.0;
   double rho_sum = 0.0;
 
-  /* Temp variables */
-  atom_t* atom = NULL; /* atom pointer */
-  int h, j, k;
-  int n_i, n_j, n_k;
-  int uf;
-#if defined(APOT)
-  double temp_eng;
-#endif  // APOT
-#if defined(STRESS)
-  int us, stresses;
-#endif  // STRESS
-
-  /* Some useful temp struct variable types */
-  /* neighbor pointers */
-  neigh_t *neigh_j, *neigh_k;
-
-  /* Pair variables */
-  double phi_val, phi_grad;
-  vector tmp_force;
-
-  /* EAM variables */
-  int col_F;
-  double eam_force;
-#if !defined RESCALE && !defined APOT
-  double rho_val;
-#endif  // !RESCALE && !APOT
-
-  /* MEAM variables */
-  double dV3j, dV3k, V3, vlj, vlk, vv3j, vv3k;
-  vector dfj, dfk;
-  angle_t* angle;
-
   switch (g_pot.format_type) {
     case POTENTIAL_FORMAT_UNKNOWN:
       break;
@@ -185,19 +158,28 @@ double calc_forces(double* xi_opt, double* forces, int flag)
 #endif  // APOT && !MPI
 
 #if defined(MPI)
-/* exchange potential and flag value */
-#if !defined(APOT)
-    MPI_Bcast(xi, g_pot.calc_pot.len, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-#endif  // APOT
-    MPI_Bcast(&flag, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&flag, 1, MPI_INT, 0, g_mpi.comm);
 
     if (1 == flag)
       break; /* Exception: flag 1 means clean up */
 
+    // flag 4: the residuals stay distributed, see powell_lsq_worker()
+    if (flag == 4) {
+      powell_lsq_worker();
+      continue;
+    }
+
+#if !defined(APOT)
+    // exchange potential
+    MPI_Bcast(xi, g_pot.calc_pot.len, MPI_DOUBLE, 0, g_mpi.comm);
+#endif  // !APOT
+
+    g_mpi.eval_start = MPI_Wtime();
+
 #if defined(APOT)
     if (g_mpi.myid == 0)
       apot_check_params(xi_opt);
-    MPI_Bcast(xi_opt, g_calc.ndimtot, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(xi_opt, g_calc.ndimtot, MPI_DOUBLE, 0, g_mpi.comm);
     update_calc_table(xi_opt, xi, 0);
 #else
     /* if flag==2 then the potential parameters have changed -> sync */
@@ -233,10 +215,54 @@ double calc_forces(double* xi_opt, double* forces, int flag)
     g_mpi.myconf = g_config.nconf;
 #endif  // !MPI
 
-    /* region containing loop over configurations */
+    /* region containing loop over configurations,
+       also OMP-parallelized region */
+#if defined(_OPENMP)
+#pragma omp parallel
+#endif  // _OPENMP
     {
+      /* Temp variables */
+      atom_t* atom = NULL; /* atom pointer */
+      int h, i, j, k;
+      int n_i, n_j, n_k;
+      int uf;
+#if defined(APOT)
+      double temp_eng;
+#endif  // APOT
+#if defined(STRESS)
+      int us, stresses;
+#endif  // STRESS
+
+      /* Some useful temp struct variable types */
+      /* neighbor pointers */
+      neigh_t *neigh_j, *neigh_k;
+
+      /* Pair variables */
+      double phi_val, phi_grad;
+      vector tmp_force;
+
+      /* EAM variables */
+      int col_F;
+      double eam_force;
+#if !defined RESCALE && !defined APOT
+      double rho_val;
+#endif  // !RESCALE && !APOT
+
+      /* MEAM variables */
+      double dV3j, dV3k, V3, vlj, vlk, vv3j, vv3k;
+      vector dfj, dfk;
+      angle_t* angle;
+
+      /* partial sums of the configuration, see sum_conf_partials() */
+      conf_sum_t* csum;
+
       /* Loop over configurations */
+#if defined(_OPENMP)
+#pragma omp for schedule(dynamic)
+#endif  // _OPENMP
       for (h = g_mpi.firstconf; h < g_mpi.firstconf + g_mpi.myconf; h++) {
+        csum = g_calc.conf_sum + h;
+        memset(csum, 0, sizeof(conf_sum_t));
         uf = g_config.conf_uf[h - g_mpi.firstconf];
 #if defined(STRESS)
         us = g_config.conf_us[h - g_mpi.firstconf];
@@ -520,7 +546,7 @@ double calc_forces(double* xi_opt, double* forces, int flag)
 #endif  // RESCALE
 
           /* Sum up rho for future MPI use */
-          rho_sum += atom->rho;
+          csum->rho += atom->rho;
 
           /* Calculate remaining forces from embedding function */
 
@@ -673,9 +699,9 @@ double calc_forces(double* xi_opt, double* forces, int flag)
 #if defined(CONTRIB)
           if (atom->contrib)
 #endif  // CONTRIB
-            error_sum += g_config.conf_weight[h] *
-                         (dsquare(forces[n_i + 0]) + dsquare(forces[n_i + 1]) +
-                          dsquare(forces[n_i + 2]));
+            csum->error += g_config.conf_weight[h] *
+                           (dsquare(forces[n_i + 0]) + dsquare(forces[n_i + 1]) +
+                            dsquare(forces[n_i + 2]));
         } /* END OF THIRD LOOP OVER ATOM i */
 
         /* Add in the energy per atom and its weight to the sum */
@@ -687,8 +713,8 @@ double calc_forces(double* xi_opt, double* forces, int flag)
 
         /* Sum up square of this new energy term for each config
            multiplied by its respective weight */
-        error_sum += g_config.conf_weight[h] * g_param.eweight *
-                     dsquare(forces[g_calc.energy_p + h]);
+        csum->error += g_config.conf_weight[h] * g_param.eweight *
+                       dsquare(forces[g_calc.energy_p + h]);
 
 #if defined(STRESS)
         /* LOOP OVER STRESSES */
@@ -698,8 +724,8 @@ double calc_forces(double* xi_opt, double* forces, int flag)
           /* Subtract off user supplied stresses */
           forces[stresses + i] -= g_config.force_0[stresses + i];
           /* Sum in the square of each stress component with config weight */
-          error_sum += g_config.conf_weight[h] * g_param.sweight *
-                       dsquare(forces[stresses + i]);
+          csum->error += g_config.conf_weight[h] * g_param.sweight *
+                         dsquare(forces[stresses + i]);
         }
 #endif  // STRESS
 
@@ -707,11 +733,16 @@ double calc_forces(double* xi_opt, double* forces, int flag)
         /* Add in the square of the limiting constraints for each config */
         /* This is punishment from going out of bounds for F(rho) */
         forces[g_calc.limit_p + h] *= g_config.conf_weight[h];
-        error_sum += dsquare(forces[g_calc.limit_p + h]);
+        csum->error += dsquare(forces[g_calc.limit_p + h]);
 #endif  // RESCALE
       } /* END MAIN LOOP OVER CONFIGURATIONS */
     }
 
+    /* add up the partial sums of all configurations */
+    conf_sum_t conf_total = sum_conf_partials();
+    error_sum += conf_total.error;
+    rho_sum += conf_total.rho;
+
 /* dummy constraints (global) */
 #if defined(APOT)
     /* add punishment for out of bounds (mostly for powell_lsq) */
@@ -724,7 +755,7 @@ double calc_forces(double* xi_opt, double* forces, int flag)
     /* Reduce the rho_sum into root node */
     double rho_sum_temp = 0.0;
     MPI_Reduce(&rho_sum, &rho_sum_temp, 1, MPI_DOUBLE, MPI_SUM, 0,
-               MPI_COMM_WORLD);
+               g_mpi.comm);
     if (g_mpi.myid == 0)
       rho_sum = rho_sum_temp;
 #endif  // MPI
@@ -744,7 +775,7 @@ double calc_forces(double* xi_opt, double* forces, int flag)
     }
 #endif  // !RESCALE
 
-    gather_forces(&error_sum, forces);
+    gather_forces(&error_sum, forces, flag);
 
     /* Root process only */
     if (g_mpi.myid == 0) {
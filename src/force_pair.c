@@ -34,11 +34,14 @@
 #include "potfit.h"
 
 #include "chempot.h"
+#include "column_cache.h"
 #if defined(MPI)
 #include "mpi_utils.h"
 #endif
+#include "design_matrix.h"
 #include "force.h"
 #include "functions.h"
+#include "memory.h"
 #include "potential_input.h"
 #include "splines.h"
 #include "utils.h"
@@ -95,6 +98,11 @@ void init_force(int is_worker)
  *    flag == 2 will cause all processes to perform a potsync (i.e. broadcast
  *             any changed potential parameters from process 0 to the others)
  *             before calculation of forces
+ *    flag == 3 will only sum up the errors, the forces, energies and
+ *             stresses of the other processes are not collected on the
+ *             root process
+ *    flag == 4 takes part in a step of the distributed powell_lsq
+ *             (see powell_lsq_worker), no forces are calculated
  *    all other values will cause a set of forces to be calculated. The root
  *             process will return with the sum of squares of the forces,
  *             while all other processes remain in the function, waiting for
@@ -126,6 +134,9 @@ double calc_forces(double* xi_opt, double* forces, int flag)
   g_mpi.myconf = g_config.nconf;
 #endif  // !MPI
 
+  if (g_config.conf_neigh == NULL)
+    init_neigh_lists();
+
   // This is the start of an infinite loop
 
   while (1) {
@@ -140,24 +151,38 @@ double calc_forces(double* xi_opt, double* forces, int flag)
 #endif  // APOT && !MPI
 
 #if defined(MPI)
-#if !defined(APOT)
-    // exchange potential and flag value
-    MPI_Bcast(xi, g_pot.calc_pot.len, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-#endif  // !APOT
-    MPI_Bcast(&flag, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&flag, 1, MPI_INT, 0, g_mpi.comm);
 
     if (flag == 1)
       break; // Exception: flag 1 means clean up
 
+    // flag 4: the residuals stay distributed, see powell_lsq_worker()
+    if (flag == 4) {
+      powell_lsq_worker();
+      continue;
+    }
+
+#if !defined(APOT)
+    // exchange potential
+    MPI_Bcast(xi, g_pot.calc_pot.len, MPI_DOUBLE, 0, g_mpi.comm);
+#endif  // !APOT
+
+    g_mpi.eval_start = MPI_Wtime();
+
 #if defined(APOT)
     if (g_mpi.myid == 0)
       apot_check_params(xi_opt);
-    MPI_Bcast(xi_opt, g_calc.ndimtot, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(xi_opt, g_calc.ndimtot, MPI_DOUBLE, 0, g_mpi.comm);
     update_calc_table(xi_opt, xi, 0);
 #else   // APOT
     // if flag == 2 then the potential parameters have changed -> sync
-    if (flag == 2)
+    if (flag == 2) {
       potsync();
+      if (g_param.design_matrix)
+        invalidate_design_matrix();
+      if (g_param.column_cache)
+        invalidate_column_cache();
+    }
 #endif  // APOT
 #endif  // MPI
 
@@ -165,10 +190,27 @@ double calc_forces(double* xi_opt, double* forces, int flag)
 
     // pair potential
     //   [0, ...,  paircol - 1]
-    update_splines(xi, 0, g_calc.paircol, 1);
+    if (!g_param.column_cache)
+      update_splines(xi, 0, g_calc.paircol, 1);
 
+    // only the columns that have changed are evaluated again
+    if (g_param.column_cache)
+      calc_forces_column_cache(xi, xi_opt, forces);
+    else
+#if !defined(APOT)
+    // all residuals are linear in xi and d2tab: one sparse matrix product
+    if (g_param.design_matrix)
+      error_sum = calc_forces_design_matrix(xi, forces);
+    else
+#endif  // !APOT
     // loop over configurations
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic)
+#endif  // _OPENMP
     for (int config_idx = g_mpi.firstconf; config_idx < g_mpi.firstconf + g_mpi.myconf; config_idx++) {
+      // partial sums of this configuration, see sum_conf_partials()
+      conf_sum_t* csum = g_calc.conf_sum + config_idx;
+      csum->error = 0.0;
       int uf = g_config.conf_uf[config_idx - g_mpi.firstconf];
 #if defined(STRESS)
       int us = g_config.conf_us[config_idx - g_mpi.firstconf];
@@ -198,25 +240,29 @@ double calc_forces(double* xi_opt, double* forces, int flag)
         }
       }
 
+      // neighbor table of this configuration
+      neigh_list_t* nl = g_config.conf_neigh + config_idx - g_mpi.firstconf;
+
       // second loop: calculate pair forces and energies
       for (int atom_idx = 0; atom_idx < g_config.inconf[config_idx]; atom_idx++) {
+#if defined(FWEIGHT) || defined(CONTRIB)
         atom_t* atom = g_config.conf_atoms + atom_idx + g_config.cnfstart[config_idx] - g_mpi.firstatom;
+#endif  // FWEIGHT || CONTRIB
         int n_i = 3 * (g_config.cnfstart[config_idx] + atom_idx);
         // loop over all neighbors
-        for (int neigh_idx = 0; neigh_idx < atom->num_neigh; neigh_idx++) {
-          neigh_t* neigh = atom->neigh + neigh_idx;
+        for (int k = nl->start[atom_idx]; k < nl->start[atom_idx + 1]; k++) {
           // In small cells, an atom might interact with itself
-          int self = (neigh->nr == atom_idx + g_config.cnfstart[config_idx]) ? 1 : 0;
+          int self = (nl->nr[k] == atom_idx + g_config.cnfstart[config_idx]) ? 1 : 0;
 
           // pair potential part
-          if (neigh->r < g_pot.calc_pot.end[neigh->col[0]]) {
+          if (nl->r[k] < g_pot.calc_pot.end[nl->col[0][k]]) {
             double phi_val = 0.0;
             double phi_grad = 0.0;
             // potential value and gradient are calculated in the same step
             if (uf)
-              phi_val = splint_comb_dir(&g_pot.calc_pot, xi, neigh->slot[0], neigh->shift[0], neigh->step[0], &phi_grad);
+              phi_val = splint_comb_dir(&g_pot.calc_pot, xi, nl->slot[0][k], nl->shift[0][k], nl->step[0][k], &phi_grad);
             else
-              phi_val = splint_dir(&g_pot.calc_pot, xi, neigh->slot[0], neigh->shift[0], neigh->step[0]);
+              phi_val = splint_dir(&g_pot.calc_pot, xi, nl->slot[0][k], nl->shift[0][k], nl->step[0][k]);
 
             // avoid double counting if atom is interacting with itself
             if (self) {
@@ -230,26 +276,26 @@ double calc_forces(double* xi_opt, double* forces, int flag)
             // calculate forces
             if (uf) {
               vector tmp_force;
-              tmp_force.x = neigh->dist_r.x * phi_grad;
-              tmp_force.y = neigh->dist_r.y * phi_grad;
-              tmp_force.z = neigh->dist_r.z * phi_grad;
+              tmp_force.x = nl->dist_r[k].x * phi_grad;
+              tmp_force.y = nl->dist_r[k].y * phi_grad;
+              tmp_force.z = nl->dist_r[k].z * phi_grad;
               forces[n_i + 0] += tmp_force.x;
               forces[n_i + 1] += tmp_force.y;
               forces[n_i + 2] += tmp_force.z;
               // actio = reactio
-              int n_j = 3 * neigh->nr;
+              int n_j = 3 * nl->nr[k];
               forces[n_j + 0] -= tmp_force.x;
               forces[n_j + 1] -= tmp_force.y;
               forces[n_j + 2] -= tmp_force.z;
 #if defined(STRESS)
               /* also calculate pair stresses */
               if (us) {
-                forces[stress_idx + 0] -= neigh->dist.x * tmp_force.x;
-                forces[stress_idx + 1] -= neigh->dist.y * tmp_force.y;
-                forces[stress_idx + 2] -= neigh->dist.z * tmp_force.z;
-                forces[stress_idx + 3] -= neigh->dist.x * tmp_force.y;
-                forces[stress_idx + 4] -= neigh->dist.y * tmp_force.z;
-                forces[stress_idx + 5] -= neigh->dist.z * tmp_force.x;
+                forces[stress_idx + 0] -= nl->dist[k].x * tmp_force.x;
+                forces[stress_idx + 1] -= nl->dist[k].y * tmp_force.y;
+                forces[stress_idx + 2] -= nl->dist[k].z * tmp_force.z;
+                forces[stress_idx + 3] -= nl->dist[k].x * tmp_force.y;
+                forces[stress_idx + 4] -= nl->dist[k].y * tmp_force.z;
+                forces[stress_idx + 5] -= nl->dist[k].z * tmp_force.x;
               }
 #endif  // STRESS
             }
@@ -269,14 +315,14 @@ double calc_forces(double* xi_opt, double* forces, int flag)
 #if defined(CONTRIB)
           if (atom->contrib)
 #endif  // CONTRIB
-            error_sum += g_config.conf_weight[config_idx] * (dsquare(forces[n_i + 0]) + dsquare(forces[n_i + 1]) + dsquare(forces[n_i + 2]));
+            csum->error += g_config.conf_weight[config_idx] * (dsquare(forces[n_i + 0]) + dsquare(forces[n_i + 1]) + dsquare(forces[n_i + 2]));
         }
       } // second loop over atoms
 
       // energy contributions
       forces[g_calc.energy_p + config_idx] /= (double)g_config.inconf[config_idx];
       forces[g_calc.energy_p + config_idx] -= g_config.force_0[g_calc.energy_p + config_idx];
-      error_sum += g_config.conf_weight[config_idx] * g_param.eweight * dsquare(forces[g_calc.energy_p + config_idx]);
+      csum->error += g_config.conf_weight[config_idx] * g_param.eweight * dsquare(forces[g_calc.energy_p + config_idx]);
 
 #if defined(STRESS)
       // stress contributions
@@ -284,13 +330,18 @@ double calc_forces(double* xi_opt, double* forces, int flag)
         for (int i = 0; i < 6; i++) {
           forces[stress_idx + i] /= g_config.conf_vol[config_idx - g_mpi.firstconf];
           forces[stress_idx + i] -= g_config.force_0[stress_idx + i];
-          error_sum += g_config.conf_weight[config_idx] * g_param.sweight * dsquare(forces[stress_idx + i]);
+          csum->error += g_config.conf_weight[config_idx] * g_param.sweight * dsquare(forces[stress_idx + i]);
         }
       }
 #endif  // STRESS
 
     } // loop over configurations
 
+#if !defined(APOT)
+    if (!g_param.design_matrix)
+#endif  // !APOT
+      error_sum += sum_conf_partials().error;
+
     // dummy constraints (global)
 #if defined(APOT)
     // add punishment for out of bounds (mostly for powell_lsq)
@@ -298,7 +349,7 @@ double calc_forces(double* xi_opt, double* forces, int flag)
       error_sum += apot_punish(xi_opt, forces);
 #endif  // APOT
 
-    gather_forces(&error_sum, forces);
+    gather_forces(&error_sum, forces, flag);
 
     // root process exits this function now
     if (g_mpi.myid == 0) {
@@ -317,3 +368,463 @@ double calc_forces(double* xi_opt, double* forces, int flag)
   // once a non-root process arrives here, all is done
   return -1.0;
 }
+
+#if !defined(MPI)
+
+/****************************************************************
+ *
+ *  calc_forces_batch: force calculation for several parameter vectors
+ *
+ *  The neighbor data of every configuration is read once and
+ *  interpolated with the tables of all num parameter vectors, so the
+ *  neighbor lists are streamed from memory once per batch instead of
+ *  once per vector. Each vector gets its own table (APOT) and second
+ *  derivatives; the results are the same as num calls of calc_forces().
+ *
+ *  With column_cache or design_matrix enabled the vectors are passed
+ *  to calc_forces() one after another.
+ *
+ ****************************************************************/
+
+typedef struct {
+  int num;         /* number of allocated vectors */
+  double** table;  /* potential table of each vector */
+  double** d2tab;  /* second derivatives of each table */
+  pot_table_t* pt; /* g_pot.calc_pot with the d2tab of each vector */
+  double* error;   /* error sums, error[i * num + b] for configuration i */
+} batch_data_t;
+
+static batch_data_t g_batch;
+
+static void init_batch(int num)
+{
+  if (num <= g_batch.num)
+    return;
+
+  const size_t len = g_pot.calc_pot.len * sizeof(double);
+
+  g_batch.table = (double**)Realloc(g_batch.table, num * sizeof(double*));
+  g_batch.d2tab = (double**)Realloc(g_batch.d2tab, num * sizeof(double*));
+  g_batch.pt = (pot_table_t*)Realloc(g_batch.pt, num * sizeof(pot_table_t));
+  g_batch.error =
+      (double*)Realloc(g_batch.error, g_config.nconf * num * sizeof(double));
+
+  for (int b = g_batch.num; b < num; b++) {
+    g_batch.table[b] = (double*)Malloc(len);
+    g_batch.d2tab[b] = (double*)Malloc(len);
+  }
+
+  g_batch.num = num;
+}
+
+void calc_forces_batch(double** xi_opt, double** forces, double* errors,
+                       int num, int flag)
+{
+  if (num < 2 || g_param.column_cache
+#if !defined(APOT)
+      || g_param.design_matrix
+#endif  // !APOT
+      ) {
+    for (int b = 0; b < num; b++)
+      errors[b] = calc_forces(xi_opt[b], forces[b], flag);
+    return;
+  }
+
+  init_batch(num);
+
+  g_mpi.myconf = g_config.nconf;
+
+  if (g_config.conf_neigh == NULL)
+    init_neigh_lists();
+
+  double* xi[num];
+  pot_table_t* pt = g_batch.pt;
+
+  for (int b = 0; b < num; b++) {
+#if defined(APOT)
+    // the last vector uses the calc table itself, update_calc_table() keeps
+    // track of the parameters stored there
+    xi[b] = (b == num - 1) ? g_pot.calc_pot.table : g_batch.table[b];
+    if (b < num - 1)
+      memcpy(xi[b], g_pot.calc_pot.table,
+             g_pot.calc_pot.len * sizeof(double));
+    apot_check_params(xi_opt[b]);
+    update_calc_table(xi_opt[b], xi[b], 1);
+#else
+    xi[b] = xi_opt[b];
+#endif  // APOT
+    update_splines_d2tab(xi[b], g_batch.d2tab[b], 0, g_calc.paircol, 1);
+    pt[b] = g_pot.calc_pot;
+    pt[b].d2tab = g_batch.d2tab[b];
+  }
+
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic)
+#endif  // _OPENMP
+  for (int config_idx = 0; config_idx < g_config.nconf; config_idx++) {
+    double* error = g_batch.error + config_idx * num;
+    const int uf = g_config.conf_uf[config_idx];
+    const double weight = g_config.conf_weight[config_idx];
+#if defined(STRESS)
+    const int us = g_config.conf_us[config_idx];
+    const int stress_idx = g_calc.stress_p + 6 * config_idx;
+#endif  // STRESS
+    const int energy_idx = g_calc.energy_p + config_idx;
+
+    for (int b = 0; b < num; b++) {
+      error[b] = 0.0;
+      forces[b][energy_idx] = 0.0;
+#if defined(STRESS)
+      memset(forces[b] + stress_idx, 0, 6 * sizeof(double));
+#endif  // STRESS
+#if defined(APOT)
+      if (g_param.enable_cp)
+        forces[b][energy_idx] +=
+            chemical_potential(g_param.ntypes, g_config.na_type[config_idx],
+                               xi_opt[b] + g_pot.cp_start);
+#endif  // APOT
+
+      for (int atom_idx = 0; atom_idx < g_config.inconf[config_idx]; atom_idx++) {
+        int n_i = 3 * (g_config.cnfstart[config_idx] + atom_idx);
+        if (uf) {
+          forces[b][n_i + 0] = -g_config.force_0[n_i + 0];
+          forces[b][n_i + 1] = -g_config.force_0[n_i + 1];
+          forces[b][n_i + 2] = -g_config.force_0[n_i + 2];
+        } else {
+          memset(forces[b] + n_i, 0, 3 * sizeof(double));
+        }
+      }
+    }
+
+    neigh_list_t* nl = g_config.conf_neigh + config_idx;
+
+    for (int atom_idx = 0; atom_idx < g_config.inconf[config_idx]; atom_idx++) {
+      int n_i = 3 * (g_config.cnfstart[config_idx] + atom_idx);
+
+      for (int k = nl->start[atom_idx]; k < nl->start[atom_idx + 1]; k++) {
+        if (nl->r[k] >= g_pot.calc_pot.end[nl->col[0][k]])
+          continue;
+
+        // the neighbor data is loaded once for all vectors
+        const int slot = nl->slot[0][k];
+        const double shift = nl->shift[0][k];
+        const double step = nl->step[0][k];
+        const double scale = (nl->nr[k] == atom_idx + g_config.cnfstart[config_idx]) ? 0.5 : 1.0;
+        const int n_j = 3 * nl->nr[k];
+
+        for (int b = 0; b < num; b++) {
+          double phi_val = 0.0;
+          double phi_grad = 0.0;
+
+          if (uf)
+            phi_val = splint_comb_dir(pt + b, xi[b], slot, shift, step, &phi_grad);
+          else
+            phi_val = splint_dir(pt + b, xi[b], slot, shift, step);
+
+          // avoid double counting if atom is interacting with itself
+          phi_val *= scale;
+          phi_grad *= scale;
+
+          forces[b][energy_idx] += phi_val;
+
+          if (uf) {
+            double* f = forces[b];
+            vector tmp_force;
+            tmp_force.x = nl->dist_r[k].x * phi_grad;
+            tmp_force.y = nl->dist_r[k].y * phi_grad;
+            tmp_force.z = nl->dist_r[k].z * phi_grad;
+            f[n_i + 0] += tmp_force.x;
+            f[n_i + 1] += tmp_force.y;
+            f[n_i + 2] += tmp_force.z;
+            // actio = reactio
+            f[n_j + 0] -= tmp_force.x;
+            f[n_j + 1] -= tmp_force.y;
+            f[n_j + 2] -= tmp_force.z;
+#if defined(STRESS)
+            if (us) {
+              f[stress_idx + 0] -= nl->dist[k].x * tmp_force.x;
+              f[stress_idx + 1] -= nl->dist[k].y * tmp_force.y;
+              f[stress_idx + 2] -= nl->dist[k].z * tmp_force.z;
+              f[stress_idx + 3] -= nl->dist[k].x * tmp_force.y;
+              f[stress_idx + 4] -= nl->dist[k].y * tmp_force.z;
+              f[stress_idx + 5] -= nl->dist[k].z * tmp_force.x;
+            }
+#endif  // STRESS
+          }
+        }
+      }  // loop over all neighbors
+
+      if (!uf)
+        continue;
+
+#if defined(FWEIGHT) || defined(CONTRIB)
+      atom_t* atom = g_config.conf_atoms + atom_idx + g_config.cnfstart[config_idx];
+#endif  // FWEIGHT || CONTRIB
+
+      for (int b = 0; b < num; b++) {
+#if defined(FWEIGHT)
+        // weigh by absolute value of force
+        forces[b][n_i + 0] /= FORCE_EPS + atom->absforce;
+        forces[b][n_i + 1] /= FORCE_EPS + atom->absforce;
+        forces[b][n_i + 2] /= FORCE_EPS + atom->absforce;
+#endif  // FWEIGHT
+
+#if defined(CONTRIB)
+        if (atom->contrib)
+#endif  // CONTRIB
+          error[b] += weight * (dsquare(forces[b][n_i + 0]) + dsquare(forces[b][n_i + 1]) + dsquare(forces[b][n_i + 2]));
+      }
+    }  // loop over atoms
+
+    for (int b = 0; b < num; b++) {
+      // energy contributions
+      forces[b][energy_idx] /= (double)g_config.inconf[config_idx];
+      forces[b][energy_idx] -= g_config.force_0[energy_idx];
+      error[b] += weight * g_param.eweight * dsquare(forces[b][energy_idx]);
+
+#if defined(STRESS)
+      // stress contributions
+      if (uf && us) {
+        for (int i = 0; i < 6; i++) {
+          forces[b][stress_idx + i] /= g_config.conf_vol[config_idx];
+          forces[b][stress_idx + i] -= g_config.force_0[stress_idx + i];
+          error[b] += weight * g_param.sweight * dsquare(forces[b][stress_idx + i]);
+        }
+      }
+#endif  // STRESS
+    }
+  }  // loop over configurations
+
+  for (int b = 0; b < num; b++) {
+    // same summation order as sum_conf_partials()
+    double error_sum = 0.0;
+
+    for (int config_idx = 0; config_idx < g_config.nconf; config_idx++)
+      error_sum += g_batch.error[config_idx * num + b];
+
+#if defined(APOT)
+    error_sum += apot_punish(xi_opt[b], forces[b]);
+#endif  // APOT
+
+    g_calc.fcalls++;
+    errors[b] = isnan(error_sum) ? 10e10 : error_sum;
+  }
+}
+
+#endif  // !MPI
+
+#if defined(APOT_JACOBIAN)
+
+/****************************************************************
+ *
+ *  calc_jacobian: exact derivatives of the force vector
+ *
+ *  gamma[j][i] = d forces[j] / d xi_opt[idx[i]]
+ *
+ *  All residuals are linear in the pair potential table, so the
+ *  derivative with respect to a parameter is the force calculation
+ *  with the derivative table of that parameter (see calc_dtab).
+ *
+ *  Only the rows of the configurations first ... last - 1 are added,
+ *  they have to be zero on entry. The call with first == firstconf
+ *  updates the tables for xi_opt, the one with last == firstconf +
+ *  myconf adds the punishments (see design_matrix_jacobian).
+ *
+ ****************************************************************/
+
+void calc_jacobian(double* xi_opt, double** gamma, int first, int last)
+{
+  static double* unit_cp = NULL;
+
+  apot_dtab_t* dtab = &g_pot.calc_dtab;
+
+  if (first == g_mpi.firstconf) {
+    apot_check_params(xi_opt);
+    update_calc_table(xi_opt, g_pot.calc_pot.table, 0);
+    update_calc_table_dparam(xi_opt);
+  }
+
+  if (g_config.conf_neigh == NULL)
+    init_neigh_lists();
+
+  if (unit_cp == NULL)
+    unit_cp = (double*)Malloc((g_param.ntypes + g_param.compnodes) * sizeof(double));
+
+  for (int config_idx = first; config_idx < last; config_idx++) {
+    int uf = g_config.conf_uf[config_idx];
+#if defined(STRESS)
+    int us = g_config.conf_us[config_idx];
+    int stress_idx = g_calc.stress_p + 6 * config_idx;
+#endif  // STRESS
+    double* d_energy = gamma[g_calc.energy_p + config_idx];
+
+    // the chemical potential is linear in its values
+    if (g_param.enable_cp) {
+      for (int i = 0; i < g_calc.ndim; i++) {
+        if (g_pot.apot_table.idxpot[i] != g_pot.apot_table.number)
+          continue;
+        unit_cp[g_pot.opt_pot.idx[i] - g_pot.cp_start] = 1.0;
+        d_energy[i] += chemical_potential(g_param.ntypes, g_config.na_type[config_idx], unit_cp);
+        unit_cp[g_pot.opt_pot.idx[i] - g_pot.cp_start] = 0.0;
+      }
+    }
+
+    neigh_list_t* nl = g_config.conf_neigh + config_idx;
+
+    for (int atom_idx = 0; atom_idx < g_config.inconf[config_idx]; atom_idx++) {
+      int n_i = 3 * (g_config.cnfstart[config_idx] + atom_idx);
+
+      for (int k = nl->start[atom_idx]; k < nl->start[atom_idx + 1]; k++) {
+        int self = (nl->nr[k] == atom_idx + g_config.cnfstart[config_idx]) ? 1 : 0;
+        int col = nl->col[0][k];
+
+        if (nl->r[k] >= g_pot.calc_pot.end[col])
+          continue;
+
+        for (int l = 0; l < dtab->num_par[col]; l++) {
+          int p = dtab->par[col][l];
+          pot_table_t* dpot = dtab->dpot + p;
+          double phi_val = 0.0;
+          double phi_grad = 0.0;
+
+          if (uf)
+            phi_val = splint_comb_dir(dpot, dpot->table, nl->slot[0][k], nl->shift[0][k], nl->step[0][k], &phi_grad);
+          else
+            phi_val = splint_dir(dpot, dpot->table, nl->slot[0][k], nl->shift[0][k], nl->step[0][k]);
+
+          if (self) {
+            phi_val *= 0.5;
+            phi_grad *= 0.5;
+          }
+
+          d_energy[p] += phi_val;
+
+          if (uf) {
+            vector tmp_force;
+            tmp_force.x = nl->dist_r[k].x * phi_grad;
+            tmp_force.y = nl->dist_r[k].y * phi_grad;
+            tmp_force.z = nl->dist_r[k].z * phi_grad;
+            int n_j = 3 * nl->nr[k];
+            gamma[n_i + 0][p] += tmp_force.x;
+            gamma[n_i + 1][p] += tmp_force.y;
+            gamma[n_i + 2][p] += tmp_force.z;
+            gamma[n_j + 0][p] -= tmp_force.x;
+            gamma[n_j + 1][p] -= tmp_force.y;
+            gamma[n_j + 2][p] -= tmp_force.z;
+#if defined(STRESS)
+            if (us) {
+              gamma[stress_idx + 0][p] -= nl->dist[k].x * tmp_force.x;
+              gamma[stress_idx + 1][p] -= nl->dist[k].y * tmp_force.y;
+              gamma[stress_idx + 2][p] -= nl->dist[k].z * tmp_force.z;
+              gamma[stress_idx + 3][p] -= nl->dist[k].x * tmp_force.y;
+              gamma[stress_idx + 4][p] -= nl->dist[k].y * tmp_force.z;
+              gamma[stress_idx + 5][p] -= nl->dist[k].z * tmp_force.x;
+            }
+#endif  // STRESS
+          }
+        }
+      }
+    }
+
+#if defined(FWEIGHT)
+    if (uf) {
+      for (int atom_idx = 0; atom_idx < g_config.inconf[config_idx]; atom_idx++) {
+        atom_t* atom = g_config.conf_atoms + atom_idx + g_config.cnfstart[config_idx];
+        int n_i = 3 * (g_config.cnfstart[config_idx] + atom_idx);
+        for (int k = 0; k < 3; k++)
+          for (int i = 0; i < g_calc.ndim; i++)
+            gamma[n_i + k][i] /= FORCE_EPS + atom->absforce;
+      }
+    }
+#endif  // FWEIGHT
+
+    for (int i = 0; i < g_calc.ndim; i++)
+      d_energy[i] /= (double)g_config.inconf[config_idx];
+
+#if defined(STRESS)
+    if (uf && us) {
+      for (int k = 0; k < 6; k++)
+        for (int i = 0; i < g_calc.ndim; i++)
+          gamma[stress_idx + k][i] /= g_config.conf_vol[config_idx];
+    }
+#endif  // STRESS
+  }
+
+  if (last == g_mpi.firstconf + g_mpi.myconf)
+    apot_punish_dparam(xi_opt, gamma);
+}
+
+#endif  // APOT_JACOBIAN
+
+#if defined(ADJOINT_GRADIENT)
+
+/****************************************************************
+ *
+ *  calc_gradient: gradient of the error sum with respect to the
+ *  potential table, returns the error sum like calc_forces
+ *
+ *  grad[k] = d error_sum / d xi_opt[k]
+ *
+ *  After the force calculation every neighbor passes the derivatives
+ *  with respect to its energy and force contributions back to the
+ *  four spline coefficients it was interpolated from, which are then
+ *  propagated through the spline setup to the table values
+ *  (update_splines_adjoint). This costs about as much as one force
+ *  calculation, independent of the number of parameters.
+ *
+ ****************************************************************/
+
+double calc_gradient(double* xi_opt, double* forces, double* grad)
+{
+  static double* r_bar = NULL;
+  static double* d2_bar = NULL;
+
+  const int len = g_pot.calc_pot.len;
+  const double error_sum = calc_forces(xi_opt, forces, 0);
+
+  if (r_bar == NULL) {
+    r_bar = (double*)Malloc(g_calc.mdim * sizeof(double));
+    d2_bar = (double*)Malloc(len * sizeof(double));
+  }
+
+  adjoint_residuals(forces, r_bar);
+
+  memset(grad, 0, len * sizeof(double));
+  memset(d2_bar, 0, len * sizeof(double));
+
+  for (int config_idx = 0; config_idx < g_config.nconf; config_idx++) {
+    const int uf = g_config.conf_uf[config_idx];
+    const double e_bar = r_bar[g_calc.energy_p + config_idx];
+#if defined(STRESS)
+    const int stress_idx = g_calc.stress_p + 6 * config_idx;
+#else
+    const int stress_idx = 0;
+#endif  // STRESS
+
+    neigh_list_t* nl = g_config.conf_neigh + config_idx;
+
+    for (int atom_idx = 0; atom_idx < g_config.inconf[config_idx]; atom_idx++) {
+      int n_i = 3 * (g_config.cnfstart[config_idx] + atom_idx);
+
+      for (int k = nl->start[atom_idx]; k < nl->start[atom_idx + 1]; k++) {
+        if (nl->r[k] >= g_pot.calc_pot.end[nl->col[0][k]])
+          continue;
+
+        // avoid double counting if atom is interacting with itself
+        double scale =
+            (nl->nr[k] == atom_idx + g_config.cnfstart[config_idx]) ? 0.5 : 1.0;
+        double phi_grad_bar =
+            uf ? adjoint_pair_force(nl, k, n_i, stress_idx, r_bar) : 0.0;
+
+        splint_dir_adjoint(nl->slot[0][k], nl->shift[0][k], nl->step[0][k],
+                           scale * e_bar, scale * phi_grad_bar, grad, d2_bar);
+      }
+    }
+  }
+
+  update_splines_adjoint(xi_opt, d2_bar, grad, 0, g_calc.paircol, 1);
+
+  return error_sum;
+}
+
+#endif  // ADJOINT_GRADIENT
@@ -94,6 +94,11 @@ void init_force(int is_worker) {}
  *    flag == 2 will cause all processes to perform a potsync (i.e. broadcast
  *             any changed potential parameters from process 0 to the others)
  *             before calculation of forces
+ *    flag == 3 will only sum up the errors, the forces, energies and
+ *             stresses of the other processes are not collected on the
+ *             root process
+ *    flag == 4 takes part in a step of the distributed powell_lsq
+ *             (see powell_lsq_worker), no forces are calculated
  *    all other values will cause a set of forces to be calculated. The root
  *             process will return with the sum of squares of the forces,
  *             while all other processes remain in the function, waiting for
@@ -117,14 +122,22 @@ double calc_forces(double* xi_opt, double* forces, int flag)
     double error_sum = 0.0;
 
 #if defined(MPI)
-    MPI_Bcast(&flag, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&flag, 1, MPI_INT, 0, g_mpi.comm);
 
     if (flag == 1)
       break; // Exception: flag 1 means clean up
 
+    // flag 4: the residuals stay distributed, see powell_lsq_worker()
+    if (flag == 4) {
+      powell_lsq_worker();
+      continue;
+    }
+
+    g_mpi.eval_start = MPI_Wtime();
+
     if (g_mpi.myid == 0)
       apot_check_params(xi_opt);
-    MPI_Bcast(xi_opt, g_calc.ndimtot, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(xi_opt, g_calc.ndimtot, MPI_DOUBLE, 0, g_mpi.comm);
 #else
     apot_check_params(xi_opt);
 #endif  // MPI
@@ -132,7 +145,13 @@ double calc_forces(double* xi_opt, double* forces, int flag)
     update_stiweb_pointers(xi_opt);
 
     // loop over configurations
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic)
+#endif  // _OPENMP
     for (int config_idx = g_mpi.firstconf; config_idx < g_mpi.firstconf + g_mpi.myconf; config_idx++) {
+      // partial sums of this configuration, see sum_conf_partials()
+      conf_sum_t* csum = g_calc.conf_sum + config_idx;
+      csum->error = 0.0;
       int uf = g_config.conf_uf[config_idx - g_mpi.firstconf];
       // reset energies and stresses
       forces[g_calc.energy_p + config_idx] = 0.0;
@@ -331,9 +350,9 @@ double calc_forces(double* xi_opt, double* forces, int flag)
 #if defined(CONTRIB)
           if (atom->contrib)
 #endif  // CONTRIB
-            error_sum += g_config.conf_weight[config_idx] *
-                      (dsquare(forces[n_i + 0]) + dsquare(forces[n_i + 1]) +
-                        dsquare(forces[n_i + 2]));
+            csum->error += g_config.conf_weight[config_idx] *
+                        (dsquare(forces[n_i + 0]) + dsquare(forces[n_i + 1]) +
+                          dsquare(forces[n_i + 2]));
         }
       }
       // end third loop over all atoms
@@ -341,28 +360,30 @@ double calc_forces(double* xi_opt, double* forces, int flag)
       // energy contributions
       forces[g_calc.energy_p + config_idx] /= (double)g_config.inconf[config_idx];
       forces[g_calc.energy_p + config_idx] -= g_config.force_0[g_calc.energy_p + config_idx];
-      error_sum += g_config.conf_weight[config_idx] * g_param.eweight *
-                dsquare(forces[g_calc.energy_p + config_idx]);
+      csum->error += g_config.conf_weight[config_idx] * g_param.eweight *
+                  dsquare(forces[g_calc.energy_p + config_idx]);
 #if defined(STRESS)
       // stress contributions
       if (uf && us) {
         for (int i = 0; i < 6; i++) {
           forces[stress_idx + i] /= g_config.conf_vol[config_idx - g_mpi.firstconf];
           forces[stress_idx + i] -= g_config.force_0[stress_idx + i];
-          error_sum += g_config.conf_weight[config_idx] * g_param.sweight *
-                    dsquare(forces[stress_idx + i]);
+          csum->error += g_config.conf_weight[config_idx] * g_param.sweight *
+                      dsquare(forces[stress_idx + i]);
         }
       }
 #endif  // STRESS
       // limiting constraints per configuration
     } // loop over configurations
 
+    error_sum += sum_conf_partials().error;
+
     // dummy constraints (global)
     // add punishment for out of bounds (mostly for powell_lsq)
     if (g_mpi.myid == 0)
       error_sum += apot_punish(xi_opt, forces);
 
-    gather_forces(&error_sum, forces);
+    gather_forces(&error_sum, forces, flag);
 
     // root process exits this function now
     if (g_mpi.myid == 0) {
@@ -43,11 +43,12 @@
 ****************************************************************/
 
 struct {
-  char** name;             // identifier of the potential
-  int* num_params;         // number of parameters
-  fvalue_pointer* fvalue;  // function pointer
-  int num_functions;       // number of analytic function prototypes
-  int** punish_index;      // array to index which functions may be punished
+  char** name;              // identifier of the potential
+  int* num_params;          // number of parameters
+  fvalue_pointer* fvalue;   // function pointer
+  fdparam_pointer* fdparam; // parameter derivatives (optional)
+  int num_functions;        // number of analytic function prototypes
+  int** punish_index;       // array to index which functions may be punished
 } function_table;
 
 /****************************************************************
@@ -57,11 +58,15 @@ struct {
 
 void initialize_analytic_potentials(void)
 {
-#define FUNCTION(name, npar) add_potential(#name, npar, &name##_value)
+#define FUNCTION(name, npar) \
+  add_potential(#name, npar, &name##_value, &name##_dparam)
+#define FUNCTION_VALUE(name, npar) \
+  add_potential(#name, npar, &name##_value, NULL)
 
 #include "functions.itm"
 
 #undef FUNCTION
+#undef FUNCTION_VALUE
   function_table.punish_index =
       (int**)Malloc(NUM_PUNISH_FUNCTIONS * sizeof(int*));
   for (int i = 0; i < NUM_PUNISH_FUNCTIONS; ++i)
@@ -73,7 +78,8 @@ void initialize_analytic_potentials(void)
     add analytic function to function_table
 ****************************************************************/
 
-void add_potential(const char* name, int npar, fvalue_pointer function)
+void add_potential(const char* name, int npar, fvalue_pointer function,
+                   fdparam_pointer dparam)
 {
   const int k = function_table.num_functions;
 
@@ -91,12 +97,15 @@ void add_potential(const char* name, int npar, fvalue_pointer function)
       (int*)Realloc(function_table.num_params, (k + 1) * sizeof(int));
   function_table.fvalue = (fvalue_pointer*)Realloc(
       function_table.fvalue, (k + 1) * sizeof(fvalue_pointer));
+  function_table.fdparam = (fdparam_pointer*)Realloc(
+      function_table.fdparam, (k + 1) * sizeof(fdparam_pointer));
 
   // assign values
   strncpy(function_table.name[k], name, strlen(name));
   function_table.name[k][strlen(name)] = '\0';
   function_table.num_params[k] = npar;
   function_table.fvalue[k] = function;
+  function_table.fdparam[k] = dparam;
 
   function_table.num_functions++;
 }
@@ -127,6 +136,7 @@ int apot_assign_function_pointers(apot_table_t* apt)
     for (int j = 0; j < function_table.num_functions; j++) {
       if (strcmp(apt->names[i], function_table.name[j]) == 0) {
         apt->fvalue[i] = function_table.fvalue[j];
+        apt->fdparam[i] = function_table.fdparam[j];
         apot_assign_punish_functions(apt->names[i], i);
         break;
       }
@@ -258,6 +268,21 @@ void check_correct_apot_functions(void)
 #endif  // TERSOFF
 }
 
+/****************************************************************
+  apot_check_dparam
+    returns 1 if all optimized functions provide parameter derivatives
+****************************************************************/
+
+int apot_check_dparam(void)
+{
+  for (int i = 0; i < g_pot.apot_table.number; i++) {
+    if (!g_pot.invar_pot[i] && g_pot.apot_table.fdparam[i] == NULL)
+      return 0;
+  }
+
+  return 1;
+}
+
 /****************************************************************
   check analytic parameters for special conditions
 ****************************************************************/
@@ -315,6 +340,37 @@ int apot_check_params(double* params)
   return 0;
 }
 
+/****************************************************************
+  apot_project
+    move the free parameters back into their bounds [pmin, pmax],
+    returns the number of parameters that were changed
+****************************************************************/
+
+int apot_project(double* params)
+{
+  int n = 0;
+
+  for (int i = 0; i < g_calc.ndim; i++) {
+    double min =
+        g_pot.apot_table
+            .pmin[g_pot.apot_table.idxpot[i]][g_pot.apot_table.idxparam[i]];
+    double max =
+        g_pot.apot_table
+            .pmax[g_pot.apot_table.idxpot[i]][g_pot.apot_table.idxparam[i]];
+    double* x = params + g_pot.opt_pot.idx[i];
+
+    if (*x < min) {
+      *x = min;
+      n++;
+    } else if (*x > max) {
+      *x = max;
+      n++;
+    }
+  }
+
+  return n;
+}
+
 /****************************************************************
   apot_cutoff
     function for smooth cutoff radius
@@ -332,6 +388,23 @@ double apot_cutoff(const double r, const double r0, const double h)
   return val / (1.0 + val);
 }
 
+/****************************************************************
+  apot_cutoff_dh
+    derivative of the smooth cutoff function with respect to h
+****************************************************************/
+
+double apot_cutoff_dh(const double r, const double r0, const double h)
+{
+  if ((r - r0) >= 0)
+    return 0.0;
+
+  double val = (r - r0) / h;
+  val *= val;
+  val *= val;
+
+  return -4.0 * val / (h * (1.0 + val) * (1.0 + val));
+}
+
 /****************************************************************
   apot_gradient
     calculate gradient for analytic potential
@@ -349,6 +422,30 @@ double apot_gradient(const double r, const double* p, fvalue_pointer func)
   return (a - b) / (2.0 * h);
 }
 
+/****************************************************************
+  apot_gradient_dparam
+    derivatives of apot_gradient with respect to the npar parameters
+****************************************************************/
+
+void apot_gradient_dparam(const double r, const double* p,
+                          fdparam_pointer func, int npar, double* dgrad)
+{
+  static double* b = NULL;
+  static int nmax = 0;
+  double h = 0.0001;
+
+  if (npar > nmax) {
+    b = (double*)Realloc(b, npar * sizeof(double));
+    nmax = npar;
+  }
+
+  func(r + h, p, dgrad);
+  func(r - h, p, b);
+
+  for (int i = 0; i < npar; i++)
+    dgrad[i] = (dgrad[i] - b[i]) / (2.0 * h);
+}
+
 /****************************************************************
   apot_punish
     punish analytic potential for bad habits
@@ -366,7 +463,9 @@ double apot_punish(double* params, double* forces)
     double max =
         g_pot.apot_table
             .pmax[g_pot.apot_table.idxpot[i]][g_pot.apot_table.idxparam[i]];
-    // punishment for out of bounds
+    // punishment for out of bounds, the entry is cleared otherwise
+    forces[g_calc.punish_par_p + i] = 0.0;
+
     if (params[g_pot.opt_pot.idx[i]] < min) {
       double x = params[g_pot.opt_pot.idx[i]] - min;
       tmpsum += APOT_PUNISH * x * x;
@@ -383,6 +482,7 @@ double apot_punish(double* params, double* forces)
   for (int i = 1; i <= function_table.punish_index[0][0]; ++i) {
     int idx = g_pot.opt_pot.first[function_table.punish_index[0][i]];
     double x = params[idx + 1] - params[idx + 3];
+    forces[g_calc.punish_pot_p + function_table.punish_index[0][i]] = 0.0;
     if (x < 0) {
       forces[g_calc.punish_pot_p + function_table.punish_index[0][i]] =
           g_param.apot_punish_value * (1 + x) * (1 + x);
@@ -395,6 +495,7 @@ double apot_punish(double* params, double* forces)
   for (int i = 1; i <= function_table.punish_index[1][0]; ++i) {
     int idx = g_pot.opt_pot.first[function_table.punish_index[1][i]];
     double x = fabs(params[idx + 2] - params[idx + 1]);
+    forces[g_calc.punish_pot_p + function_table.punish_index[1][i]] = 0.0;
     if (x < 1e-6) {
       forces[g_calc.punish_pot_p + function_table.punish_index[1][i]] =
           g_param.apot_punish_value / (x * x);
@@ -405,6 +506,72 @@ double apot_punish(double* params, double* forces)
   return tmpsum;
 }
 
+/****************************************************************
+  apot_punish_dparam
+    derivatives of the punishments written by apot_punish,
+    gamma[j][i] = d(forces[j]) / d(params[idx[i]])
+****************************************************************/
+
+void apot_punish_dparam(double* params, double** gamma)
+{
+  // position of an entry of params in the list of free parameters
+  static int* free_idx = NULL;
+
+  if (free_idx == NULL) {
+    free_idx = (int*)Malloc(g_pot.opt_pot.len * sizeof(int));
+    for (int i = 0; i < g_pot.opt_pot.len; i++)
+      free_idx[i] = -1;
+    for (int i = 0; i < g_calc.ndim; i++)
+      free_idx[g_pot.opt_pot.idx[i]] = i;
+  }
+
+  // loop over individual parameters
+  for (int i = 0; i < g_calc.ndim; i++) {
+    double min =
+        g_pot.apot_table
+            .pmin[g_pot.apot_table.idxpot[i]][g_pot.apot_table.idxparam[i]];
+    double max =
+        g_pot.apot_table
+            .pmax[g_pot.apot_table.idxpot[i]][g_pot.apot_table.idxparam[i]];
+    double x = 0.0;
+    if (params[g_pot.opt_pot.idx[i]] < min)
+      x = params[g_pot.opt_pot.idx[i]] - min;
+    else if (params[g_pot.opt_pot.idx[i]] > max)
+      x = params[g_pot.opt_pot.idx[i]] - max;
+    gamma[g_calc.punish_par_p + i][i] += 2.0 * APOT_PUNISH * x;
+  }
+
+  // eopp (index 0)
+  for (int i = 1; i <= function_table.punish_index[0][0]; ++i) {
+    int idx = g_pot.opt_pot.first[function_table.punish_index[0][i]];
+    double x = params[idx + 1] - params[idx + 3];
+    if (x < 0) {
+      double* g = gamma[g_calc.punish_pot_p + function_table.punish_index[0][i]];
+      double dx = 2.0 * g_param.apot_punish_value * (1 + x);
+      if (free_idx[idx + 1] >= 0)
+        g[free_idx[idx + 1]] += dx;
+      if (free_idx[idx + 3] >= 0)
+        g[free_idx[idx + 3]] -= dx;
+    }
+  }
+
+  // universal (index 1)
+  for (int i = 1; i <= function_table.punish_index[1][0]; ++i) {
+    int idx = g_pot.opt_pot.first[function_table.punish_index[1][i]];
+    double x = fabs(params[idx + 2] - params[idx + 1]);
+    if (x < 1e-6) {
+      double* g = gamma[g_calc.punish_pot_p + function_table.punish_index[1][i]];
+      double dx = -2.0 * g_param.apot_punish_value / (x * x * x);
+      if (params[idx + 2] < params[idx + 1])
+        dx = -dx;
+      if (free_idx[idx + 2] >= 0)
+        g[free_idx[idx + 2]] += dx;
+      if (free_idx[idx + 1] >= 0)
+        g[free_idx[idx + 1]] -= dx;
+    }
+  }
+}
+
 #if defined(COULOMB)
 
 /****************************************************************
@@ -466,8 +633,8 @@ void elstat_shift(double r, double dp_kappa, double* fnval_tail,
 void elstat_dsf(double r, double dp_kappa, double* fnval_tail,
                 double* grad_tail, double* ggrad_tail)
 {
-  static double ftail, gtail, ggtail, ftail_cut, gtail_cut, ggtail_cut;
-  static double x[3];
+  double ftail, gtail, ggtail, ftail_cut, gtail_cut, ggtail_cut;
+  double x[3];
 
   x[0] = r * r;
   x[1] = g_config.dp_cut * g_config.dp_cut;
@@ -36,26 +36,37 @@
   actual functions for different potentials
 ****************************************************************/
 
-#define FUNCTION(name, npar) \
+#define FUNCTION(name, npar)                                             \
+  void name##_value(const double r, const double* params, double* fvalue); \
+  void name##_dparam(const double r, const double* params, double* dfvalue)
+#define FUNCTION_VALUE(name, npar) \
   void name##_value(const double r, const double* params, double* fvalue)
 
 #include "functions.itm"
 
 #undef FUNCTION
+#undef FUNCTION_VALUE
 
 // functions for analytic potential initialization
 void initialize_analytic_potentials(void);
-void add_potential(const char* name, int npar, fvalue_pointer function);
+void add_potential(const char* name, int npar, fvalue_pointer function,
+                   fdparam_pointer dparam);
 int apot_get_num_parameters(const char* potential_name);
 int apot_assign_function_pointers(apot_table_t* apot_table);
 void apot_assign_punish_functions(char const* name, int index);
 void check_correct_apot_functions(void);
+int apot_check_dparam(void);
 
 // functions for analytic potential evaluation
 int apot_check_params(double* params);
+int apot_project(double* params);
 double apot_cutoff(const double r, const double r0, const double h);
+double apot_cutoff_dh(const double r, const double r0, const double h);
 double apot_gradient(const double r, const double* params, fvalue_pointer func);
+void apot_gradient_dparam(const double r, const double* params,
+                          fdparam_pointer func, int npar, double* dgrad);
 double apot_punish(double*, double*);
+void apot_punish_dparam(double* params, double** gamma);
 
 #if defined(DEBUG)
 void debug_apot();
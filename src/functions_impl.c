@@ -31,6 +31,16 @@
 
 #include "utils.h"
 
+/****************************************************************
+  dpow
+    derivative of x^y with respect to y, power = x^y
+****************************************************************/
+
+static double dpow(const double power, const double x)
+{
+  return (x > 0.0) ? power * log(x) : 0.0;
+}
+
 /****************************************************************
 
   actual functions representing the analytic potentials
@@ -50,6 +60,15 @@ void lj_value(const double r, const double* p, double* f)
   *f = 4.0 * p[0] * x * (x - 1.0);
 }
 
+void lj_dparam(const double r, const double* p, double* df)
+{
+  double x = (p[1] * p[1]) / (r * r);
+  x = x * x * x;
+
+  df[0] = 4.0 * x * (x - 1.0);
+  df[1] = 24.0 * p[0] * x * (2.0 * x - 1.0) / p[1];
+}
+
 /****************************************************************
   empirical oscillating pair potential (eopp)
     http://arxiv.org/abs/0802.2926v2
@@ -66,6 +85,25 @@ void eopp_value(const double r, const double* p, double* f)
   *f = p[0] / power[0] + (p[2] / power[1]) * cos(p[4] * r + p[5]);
 }
 
+void eopp_dparam(const double r, const double* p, double* df)
+{
+  double x[2] = {r, r};
+  double y[2] = {p[1], p[3]};
+  double power[2] = {0, 0};
+
+  power_m(2, power, x, y);
+
+  double c = cos(p[4] * r + p[5]);
+  double s = sin(p[4] * r + p[5]);
+
+  df[0] = 1.0 / power[0];
+  df[1] = -p[0] * log(r) / power[0];
+  df[2] = c / power[1];
+  df[3] = -p[2] * log(r) * c / power[1];
+  df[4] = -p[2] * r * s / power[1];
+  df[5] = -p[2] * s / power[1];
+}
+
 /****************************************************************
   morse potential
     http://dx.doi.org/doi:10.1103/PhysRev.34.57
@@ -76,6 +114,16 @@ void morse_value(const double r, const double* p, double* f)
   *f = p[0] * (exp(-2.0 * p[1] * (r - p[2])) - 2.0 * exp(-p[1] * (r - p[2])));
 }
 
+void morse_dparam(const double r, const double* p, double* df)
+{
+  double e1 = exp(-p[1] * (r - p[2]));
+  double e2 = exp(-2.0 * p[1] * (r - p[2]));
+
+  df[0] = e2 - 2.0 * e1;
+  df[1] = 2.0 * p[0] * (r - p[2]) * (e1 - e2);
+  df[2] = 2.0 * p[0] * p[1] * (e2 - e1);
+}
+
 /****************************************************************
   morse-stretch potential (without derivative!)
     http://dx.doi.org/doi:10.1063/1.1513312
@@ -109,6 +157,41 @@ void ms_value(const double r, const double* p, double* f)
   *f = pot - pot_cut - (r - g_config.dp_cut) * grad_cut;
 }
 
+void ms_init_dparam(const double r, const double* p, double* dpot,
+                    double* dgrad)
+{
+  double x[4];
+
+  x[0] = 1 - r / p[2];
+  x[1] = exp(p[1] * x[0]);
+  x[2] = exp(p[1] * x[0] / 2);
+  x[3] = p[0] * p[1] / (r * p[2]);
+
+  dpot[0] = x[1] - 2 * x[2];
+  dpot[1] = p[0] * x[0] * (x[1] - x[2]);
+  dpot[2] = p[0] * p[1] * (x[1] - x[2]) * r / (p[2] * p[2]);
+
+  dgrad[0] = p[1] / (r * p[2]) * (x[2] - x[1]);
+  dgrad[1] = p[0] / (r * p[2]) * (x[2] - x[1]) +
+             x[3] * x[0] * (x[2] / 2 - x[1]);
+  dgrad[2] = -x[3] / p[2] * (x[2] - x[1]) +
+             x[3] * p[1] * (x[2] / 2 - x[1]) * r / (p[2] * p[2]);
+}
+
+void ms_dparam(const double r, const double* p, double* df)
+{
+  double dpot[3];
+  double dgrad[3];
+  double dpot_cut[3];
+  double dgrad_cut[3];
+
+  ms_init_dparam(r, p, dpot, dgrad);
+  ms_init_dparam(g_config.dp_cut, p, dpot_cut, dgrad_cut);
+
+  for (int i = 0; i < 3; i++)
+    df[i] = dpot[i] - dpot_cut[i] - (r - g_config.dp_cut) * dgrad_cut[i];
+}
+
 #else
 
 void ms_value(const double r, const double* p, double* f)
@@ -118,6 +201,17 @@ void ms_value(const double r, const double* p, double* f)
   *f = p[0] * (exp(p[1] * x) - 2.0 * exp((p[1] * x) / 2.0));
 }
 
+void ms_dparam(const double r, const double* p, double* df)
+{
+  double x = 1.0 - r / p[2];
+  double a = exp(p[1] * x);
+  double b = exp((p[1] * x) / 2.0);
+
+  df[0] = a - 2.0 * b;
+  df[1] = p[0] * x * (a - b);
+  df[2] = p[0] * p[1] * (a - b) * r / (p[2] * p[2]);
+}
+
 #endif  // COULOMB
 
 /****************************************************************
@@ -152,6 +246,40 @@ void buck_value(const double r, const double* p, double* f)
   *f = pot - pot_cut - r * (r - g_config.dp_cut) * grad_cut;
 }
 
+void buck_init_dparam(const double r, const double* p, double* dpot,
+                      double* dgrad)
+{
+  double x[4];
+
+  x[0] = dsquare(p[1]) / dsquare(r);
+  x[0] = x[0] * x[0] * x[0];
+  x[1] = p[2] * x[0];
+  x[3] = exp(-r / p[1]);
+  x[2] = p[0] * x[3];
+
+  dpot[0] = x[3];
+  dpot[1] = x[2] * r / dsquare(p[1]) - 6 * x[1] / p[1];
+  dpot[2] = -x[0];
+
+  dgrad[0] = -x[3] / p[1];
+  dgrad[1] = x[2] / dsquare(p[1]) * (1 - r / p[1]) + 36 * x[1] / (r * p[1]);
+  dgrad[2] = 6 * x[0] / r;
+}
+
+void buck_dparam(const double r, const double* p, double* df)
+{
+  double dpot[3];
+  double dgrad[3];
+  double dpot_cut[3];
+  double dgrad_cut[3];
+
+  buck_init_dparam(r, p, dpot, dgrad);
+  buck_init_dparam(g_config.dp_cut, p, dpot_cut, dgrad_cut);
+
+  for (int i = 0; i < 3; i++)
+    df[i] = dpot[i] - dpot_cut[i] - r * (r - g_config.dp_cut) * dgrad_cut[i];
+}
+
 #else
 
 void buck_value(const double r, const double* p, double* f)
@@ -162,6 +290,17 @@ void buck_value(const double r, const double* p, double* f)
   *f = p[0] * exp(-r / p[1]) - p[2] * y;
 }
 
+void buck_dparam(const double r, const double* p, double* df)
+{
+  double x = (p[1] * p[1]) / (r * r);
+  double y = x * x * x;
+  double e = exp(-r / p[1]);
+
+  df[0] = e;
+  df[1] = p[0] * e * r / (p[1] * p[1]) - 6.0 * p[2] * y / p[1];
+  df[2] = -y;
+}
+
 #endif  // COULOMB
 
 /****************************************************************
@@ -176,6 +315,18 @@ void softshell_value(const double r, const double* p, double* f)
   power_1(f, &x, &p[1]);
 }
 
+void softshell_dparam(const double r, const double* p, double* df)
+{
+  double x = p[0] / r;
+  double y = p[1] - 1.0;
+  double power = 0.0;
+
+  power_1(&power, &x, &y);
+
+  df[0] = p[1] * power / r;
+  df[1] = dpow(power * x, x);
+}
+
 /****************************************************************
   eopp_exp potential
     http://arxiv.org/abs/0802.2926v2
@@ -190,6 +341,24 @@ void eopp_exp_value(const double r, const double* p, double* f)
   *f = p[0] * exp(-p[1] * r) + (p[2] / power) * cos(p[4] * r + p[5]);
 }
 
+void eopp_exp_dparam(const double r, const double* p, double* df)
+{
+  double power = 0.0;
+
+  power_1(&power, &r, &p[3]);
+
+  double e = exp(-p[1] * r);
+  double c = cos(p[4] * r + p[5]);
+  double s = sin(p[4] * r + p[5]);
+
+  df[0] = e;
+  df[1] = -p[0] * r * e;
+  df[2] = c / power;
+  df[3] = -p[2] * log(r) * c / power;
+  df[4] = -p[2] * r * s / power;
+  df[5] = -p[2] * s / power;
+}
+
 /****************************************************************
   meopp potential
     http://arxiv.org/abs/0802.2926v2
@@ -206,6 +375,26 @@ void meopp_value(const double r, const double* p, double* f)
   *f = p[0] / power[0] + (p[2] / power[1]) * cos(p[4] * r + p[5]);
 }
 
+void meopp_dparam(const double r, const double* p, double* df)
+{
+  double x[2] = {r - p[6], r};
+  double y[2] = {p[1], p[3]};
+  double power[2] = {0, 0};
+
+  power_m(2, power, x, y);
+
+  double c = cos(p[4] * r + p[5]);
+  double s = sin(p[4] * r + p[5]);
+
+  df[0] = 1.0 / power[0];
+  df[1] = -p[0] * log(r - p[6]) / power[0];
+  df[2] = c / power[1];
+  df[3] = -p[2] * log(r) * c / power[1];
+  df[4] = -p[2] * r * s / power[1];
+  df[5] = -p[2] * s / power[1];
+  df[6] = p[0] * p[1] / (power[0] * (r - p[6]));
+}
+
 /****************************************************************
   power potential
     unknown reference
@@ -220,6 +409,16 @@ void power_value(const double r, const double* p, double* f)
   *f = p[0] * power;
 }
 
+void power_dparam(const double r, const double* p, double* df)
+{
+  double power = 0;
+
+  power_1(&power, &r, &p[1]);
+
+  df[0] = power;
+  df[1] = p[0] * dpow(power, r);
+}
+
 /****************************************************************
   power_decay potential
     unknown reference
@@ -234,6 +433,16 @@ void power_decay_value(const double r, const double* p, double* f)
   *f = p[0] / power;
 }
 
+void power_decay_dparam(const double r, const double* p, double* df)
+{
+  double power = 0;
+
+  power_1(&power, &r, &p[1]);
+
+  df[0] = 1.0 / power;
+  df[1] = -p[0] * log(r) / power;
+}
+
 /****************************************************************
   exp_decay potential
     unknown reference
@@ -244,6 +453,14 @@ void exp_decay_value(const double r, const double* p, double* f)
   *f = p[0] * exp(-p[1] * r);
 }
 
+void exp_decay_dparam(const double r, const double* p, double* df)
+{
+  double e = exp(-p[1] * r);
+
+  df[0] = e;
+  df[1] = -p[0] * r * e;
+}
+
 /****************************************************************
   bjs potential
     http://dx.doi.org/doi:10.1103/PhysRevB.37.6632
@@ -262,6 +479,23 @@ void bjs_value(const double r, const double* p, double* f)
   }
 }
 
+void bjs_dparam(const double r, const double* p, double* df)
+{
+  if (r == 0.0) {
+    df[0] = 0.0;
+    df[1] = 0.0;
+    df[2] = 0.0;
+  } else {
+    double power = 0.0;
+
+    power_1(&power, &r, &p[1]);
+
+    df[0] = (1.0 - p[1] * log(r)) * power;
+    df[1] = -p[0] * p[1] * log(r) * dpow(power, r);
+    df[2] = r;
+  }
+}
+
 /****************************************************************
   parabola potential
     unknown reference
@@ -272,6 +506,13 @@ void parabola_value(const double r, const double* p, double* f)
   *f = (r * r) * p[0] + r * p[1] + p[2];
 }
 
+void parabola_dparam(const double r, const double* p, double* df)
+{
+  df[0] = r * r;
+  df[1] = r;
+  df[2] = 1.0;
+}
+
 /****************************************************************
   chantasiriwan (csw) and milstein potential
     http://dx.doi.org/doi:10.1103/PhysRevB.53.14080
@@ -279,13 +520,28 @@ void parabola_value(const double r, const double* p, double* f)
 
 void csw_value(const double r, const double* p, double* f)
 {
-  static double power;
+  double power = 0.0;
 
   power_1(&power, &r, &p[3]);
 
   *f = (1.0 + p[0] * cos(p[2] * r) + p[1] * sin(p[2] * r)) / power;
 }
 
+void csw_dparam(const double r, const double* p, double* df)
+{
+  double power = 0.0;
+
+  power_1(&power, &r, &p[3]);
+
+  double c = cos(p[2] * r);
+  double s = sin(p[2] * r);
+
+  df[0] = c / power;
+  df[1] = s / power;
+  df[2] = (p[1] * c - p[0] * s) * r / power;
+  df[3] = -(1.0 + p[0] * c + p[1] * s) * log(r) / power;
+}
+
 /****************************************************************
   chantasiriwan (csw) and milstein potential - slightly modified
     http://dx.doi.org/doi:10.1103/PhysRevB.53.14080
@@ -293,13 +549,28 @@ void csw_value(const double r, const double* p, double* f)
 
 void csw2_value(const double r, const double* p, double* f)
 {
-  static double power;
+  double power = 0.0;
 
   power_1(&power, &r, &p[3]);
 
   *f = (1.0 + p[0] * cos(p[1] * r + p[2])) / power;
 }
 
+void csw2_dparam(const double r, const double* p, double* df)
+{
+  double power = 0.0;
+
+  power_1(&power, &r, &p[3]);
+
+  double c = cos(p[1] * r + p[2]);
+  double s = sin(p[1] * r + p[2]);
+
+  df[0] = c / power;
+  df[1] = -p[0] * r * s / power;
+  df[2] = -p[0] * s / power;
+  df[3] = -(1.0 + p[0] * c) * log(r) / power;
+}
+
 /****************************************************************
   universal embedding function
     http://dx.doi.org/doi:10.1557/jmr.1989.1195
@@ -318,12 +589,31 @@ void universal_value(const double r, const double* p, double* f)
        p[3] * r;
 }
 
+void universal_dparam(const double r, const double* p, double* df)
+{
+  double x[2] = {r, r};
+  double y[2] = {p[1], p[2]};
+  double power[2] = {0, 0};
+
+  power_m(2, power, x, y);
+
+  double d = p[2] - p[1];
+  double s = p[2] * power[0] - p[1] * power[1];
+
+  df[0] = s / d;
+  df[1] = p[0] * ((p[2] * dpow(power[0], r) - power[1]) * d + s) / (d * d);
+  df[2] = p[0] * ((power[0] - p[1] * dpow(power[1], r)) * d - s) / (d * d);
+  df[3] = r;
+}
+
 /****************************************************************
   constant function
     unknown reference
 ****************************************************************/
 
 void const_value(const double r, const double* p, double* f) { *f = *p; }
+
+void const_dparam(const double r, const double* p, double* df) { *df = 1.0; }
 /****************************************************************
   square root function
     http://dx.doi.org/doi:10.1080/01418618408244210
@@ -334,6 +624,14 @@ void sqrt_value(const double r, const double* p, double* f)
   *f = p[0] * sqrt(r / p[1]);
 }
 
+void sqrt_dparam(const double r, const double* p, double* df)
+{
+  double x = sqrt(r / p[1]);
+
+  df[0] = x;
+  df[1] = -0.5 * p[0] * x / p[1];
+}
+
 /****************************************************************
   mexp_decay potential
     unknown reference
@@ -344,6 +642,15 @@ void mexp_decay_value(const double r, const double* p, double* f)
   *f = p[0] * exp(-p[1] * (r - p[2]));
 }
 
+void mexp_decay_dparam(const double r, const double* p, double* df)
+{
+  double e = exp(-p[1] * (r - p[2]));
+
+  df[0] = e;
+  df[1] = -p[0] * (r - p[2]) * e;
+  df[2] = p[0] * p[1] * e;
+}
+
 /****************************************************************
   streitz-mintmire (strmm) potential
     http://dx.doi.org/doi:10.1103/PhysRevB.50.11996
@@ -357,6 +664,19 @@ void strmm_value(const double r, const double* p, double* f)
        p[2] * (1.0 + p[3] * r_0) * exp(-p[3] * r_0);
 }
 
+void strmm_dparam(const double r, const double* p, double* df)
+{
+  double r_0 = r - p[4];
+  double e1 = exp(-p[1] / 2.0 * r_0);
+  double e2 = exp(-p[3] * r_0);
+
+  df[0] = 2.0 * e1;
+  df[1] = -p[0] * r_0 * e1;
+  df[2] = -(1.0 + p[3] * r_0) * e2;
+  df[3] = p[2] * p[3] * r_0 * r_0 * e2;
+  df[4] = p[0] * p[1] * e1 - p[2] * p[3] * p[3] * r_0 * e2;
+}
+
 /****************************************************************
   double morse potential
     http://dx.doi.org/doi:10.1557/proc-538-535
@@ -370,6 +690,14 @@ void double_morse_value(const double r, const double* p, double* f)
       p[6];
 }
 
+void double_morse_dparam(const double r, const double* p, double* df)
+{
+  morse_dparam(r, p, df);
+  morse_dparam(r, p + 3, df + 3);
+
+  df[6] = 1.0;
+}
+
 /****************************************************************
   double exp potential
     http://dx.doi.org/doi:10.1557/proc-538-535
@@ -380,6 +708,18 @@ void double_exp_value(const double r, const double* p, double* f)
   *f = (p[0] * exp(-p[1] * dsquare(r - p[2])) + exp(-p[3] * (r - p[4])));
 }
 
+void double_exp_dparam(const double r, const double* p, double* df)
+{
+  double g = exp(-p[1] * dsquare(r - p[2]));
+  double h = exp(-p[3] * (r - p[4]));
+
+  df[0] = g;
+  df[1] = -p[0] * dsquare(r - p[2]) * g;
+  df[2] = 2.0 * p[0] * p[1] * (r - p[2]) * g;
+  df[3] = -(r - p[4]) * h;
+  df[4] = p[3] * h;
+}
+
 /****************************************************************
   poly 5 potential
     http://dx.doi.org/doi:10.1557/proc-538-535
@@ -393,6 +733,17 @@ void poly_5_value(const double r, const double* p, double* f)
        p[4] * (dr * dr) * (r - 1.0);
 }
 
+void poly_5_dparam(const double r, const double* p, double* df)
+{
+  double dr = (r - 1.0) * (r - 1.0);
+
+  df[0] = 1.0;
+  df[1] = 0.5 * dr;
+  df[2] = (r - 1.0) * dr;
+  df[3] = dr * dr;
+  df[4] = (dr * dr) * (r - 1.0);
+}
+
 /****************************************************************
   kawamura potential
     http://dx.doi.org/10.1016/S0925-8388(00)00806-9
@@ -409,6 +760,26 @@ void kawamura_value(const double r, const double* p, double* f)
        p[7] * p[8] / r6;
 }
 
+void kawamura_dparam(const double r, const double* p, double* df)
+{
+  double r6 = r * r * r;
+
+  r6 = r6 * r6;
+
+  double s = p[5] + p[6];
+  double e = exp((p[3] + p[4] - r) / s);
+
+  df[0] = p[1] / r;
+  df[1] = p[0] / r;
+  df[2] = s * e;
+  df[3] = p[2] * e;
+  df[4] = p[2] * e;
+  df[5] = p[2] * e * (1.0 - (p[3] + p[4] - r) / s);
+  df[6] = df[5];
+  df[7] = -p[8] / r6;
+  df[8] = -p[7] / r6;
+}
+
 /****************************************************************
   kawamura mixing potential
     http://dx.doi.org/10.1016/S0925-8388(00)00806-9
@@ -427,6 +798,19 @@ void kawamura_mix_value(const double r, const double* p, double* f)
            (exp(-2 * p[10] * (r - p[11])) - 2.0 * exp(-p[10] * (r - p[11])));
 }
 
+void kawamura_mix_dparam(const double r, const double* p, double* df)
+{
+  double e1 = exp(-p[10] * (r - p[11]));
+  double e2 = exp(-2 * p[10] * (r - p[11]));
+
+  kawamura_dparam(r, p, df);
+
+  df[2] += p[9] * (e2 - 2.0 * e1);
+  df[9] = p[2] * (e2 - 2.0 * e1);
+  df[10] = 2.0 * p[2] * p[9] * (r - p[11]) * (e1 - e2);
+  df[11] = 2.0 * p[2] * p[9] * p[10] * (e2 - e1);
+}
+
 /****************************************************************
   exp_plus potential
     unknown reference
@@ -437,6 +821,15 @@ void exp_plus_value(const double r, const double* p, double* f)
   *f = p[0] * exp(-p[1] * r) + p[2];
 }
 
+void exp_plus_dparam(const double r, const double* p, double* df)
+{
+  double e = exp(-p[1] * r);
+
+  df[0] = e;
+  df[1] = -p[0] * r * e;
+  df[2] = 1.0;
+}
+
 /****************************************************************
   mishin potential
     http://dx.doi.org/doi:10.1016/j.actamat.2005.05.001
@@ -453,6 +846,24 @@ void mishin_value(const double r, const double* p, double* f)
   *f = p[0] * power * temp * (1.0 + p[1] * temp) + p[2];
 }
 
+void mishin_dparam(const double r, const double* p, double* df)
+{
+  double z = r - p[3];
+  double y = p[4] - 1.0;
+  double temp = exp(-p[5] * r);
+  double power[2] = {0, 0};
+
+  power_1(&power[0], &z, &p[4]);
+  power_1(&power[1], &z, &y);
+
+  df[0] = power[0] * temp * (1.0 + p[1] * temp);
+  df[1] = p[0] * power[0] * temp * temp;
+  df[2] = 1.0;
+  df[3] = -p[0] * p[4] * power[1] * temp * (1.0 + p[1] * temp);
+  df[4] = p[0] * dpow(power[0], z) * temp * (1.0 + p[1] * temp);
+  df[5] = -p[0] * power[0] * r * temp * (1.0 + 2.0 * p[1] * temp);
+}
+
 /****************************************************************
   gen_lj potential, generalized lennard-jones
     http://dx.doi.org/doi:10.1016/j.actamat.2005.05.001
@@ -469,6 +880,25 @@ void gen_lj_value(const double r, const double* p, double* f)
   *f = p[0] / (p[2] - p[1]) * (p[2] / power[0] - p[1] / power[1]) + p[4];
 }
 
+void gen_lj_dparam(const double r, const double* p, double* df)
+{
+  double x[2] = {r / p[3], r / p[3]};
+  double y[2] = {p[1], p[2]};
+  double power[2] = {0, 0};
+
+  power_m(2, power, x, y);
+
+  double d = p[2] - p[1];
+  double l = log(x[0]);
+  double s = p[2] / power[0] - p[1] / power[1];
+
+  df[0] = s / d;
+  df[1] = p[0] * ((-p[2] * l / power[0] - 1.0 / power[1]) * d + s) / (d * d);
+  df[2] = p[0] * ((1.0 / power[0] + p[1] * l / power[1]) * d - s) / (d * d);
+  df[3] = p[0] / d * p[1] * p[2] / p[3] * (1.0 / power[0] - 1.0 / power[1]);
+  df[4] = 1.0;
+}
+
 /****************************************************************
   gljm potential, generalized lennard-jones + mishin potential
     http://dx.doi.org/doi:10.1016/j.actamat.2005.05.001
@@ -488,6 +918,30 @@ void gljm_value(const double r, const double* p, double* f)
        p[5] * (p[6] * power[2] * temp * (1.0 + p[7] * temp) + p[8]);
 }
 
+void gljm_dparam(const double r, const double* p, double* df)
+{
+  double x[4] = {r / p[3], r / p[3], r - p[9], r - p[9]};
+  double y[4] = {p[1], p[2], p[10], p[10] - 1.0};
+  double power[4] = {0.0, 0.0, 0.0, 0.0};
+
+  power_m(4, power, x, y);
+
+  gen_lj_dparam(r, p, df);
+
+  double temp = exp(-p[11] * power[2]);
+  // derivative of the mishin part with respect to power[2]
+  double dc = p[6] * (temp * (1.0 - p[11] * power[2]) +
+                      p[7] * temp * temp * (1.0 - 2.0 * p[11] * power[2]));
+
+  df[5] = p[6] * power[2] * temp * (1.0 + p[7] * temp) + p[8];
+  df[6] = p[5] * power[2] * temp * (1.0 + p[7] * temp);
+  df[7] = p[5] * p[6] * power[2] * temp * temp;
+  df[8] = p[5];
+  df[9] = -p[5] * dc * p[10] * power[3];
+  df[10] = p[5] * dc * dpow(power[2], x[2]);
+  df[11] = -p[5] * p[6] * power[2] * power[2] * temp * (1.0 + 2.0 * p[7] * temp);
+}
+
 /****************************************************************
   bond-stretching function of vashishta potential (f_c)
     http://dx.doi.org/doi:10.1016/0022-3093(94)90351-4
@@ -498,6 +952,14 @@ void vas_value(const double r, const double* p, double* f)
   *f = exp(p[0] / (r - p[1]));
 }
 
+void vas_dparam(const double r, const double* p, double* df)
+{
+  double f = exp(p[0] / (r - p[1]));
+
+  df[0] = f / (r - p[1]);
+  df[1] = f * p[0] / dsquare(r - p[1]);
+}
+
 /****************************************************************
   original pair contributions of vashishta potential
   (V_2 without second "Coulomb"-term)
@@ -518,6 +980,27 @@ void vpair_value(const double r, const double* p, double* f)
         0.5 * (p[4] * p[3] * p[3] + p[5] * p[2] * p[2] / x) * exp(-r / p[6]));
 }
 
+void vpair_dparam(const double r, const double* p, double* df)
+{
+  double power = 0.0;
+  double x = r * r;
+
+  x *= x;
+
+  power_1(&power, &r, &p[1]);
+
+  double e = exp(-r / p[6]);
+
+  df[0] = 14.4 / power;
+  df[1] = -14.4 * p[0] * log(r) / power;
+  df[2] = -14.4 * p[5] * p[2] / x * e;
+  df[3] = -14.4 * p[4] * p[3] * e;
+  df[4] = -7.2 * p[3] * p[3] * e;
+  df[5] = -7.2 * p[2] * p[2] / x * e;
+  df[6] = -7.2 * (p[4] * p[3] * p[3] + p[5] * p[2] * p[2] / x) * e * r /
+          (p[6] * p[6]);
+}
+
 /****************************************************************
   analytical fits to sheng-aluminum-EAM-potential
     unknown reference
@@ -531,6 +1014,19 @@ void sheng_phi1_value(const double r, const double* p, double* f)
   *f = p[0] * exp(-p[1] * r * r) + p[2] * exp(z);
 }
 
+void sheng_phi1_dparam(const double r, const double* p, double* df)
+{
+  double y = r - p[4];
+  double e1 = exp(-p[1] * r * r);
+  double e2 = exp(-p[3] * y * y);
+
+  df[0] = e1;
+  df[1] = -p[0] * r * r * e1;
+  df[2] = e2;
+  df[3] = -p[2] * y * y * e2;
+  df[4] = 2.0 * p[2] * p[3] * y * e2;
+}
+
 /****************************************************************
   analytical fits to sheng-aluminum-EAM-potential
     unknown reference
@@ -544,6 +1040,18 @@ void sheng_phi2_value(const double r, const double* p, double* f)
   *f = p[0] * exp(-p[1] * r * r) + p[2] / z;
 }
 
+void sheng_phi2_dparam(const double r, const double* p, double* df)
+{
+  double y = r - p[3];
+  double z = p[2] * p[2] + y * y;
+  double e = exp(-p[1] * r * r);
+
+  df[0] = e;
+  df[1] = -p[0] * r * r * e;
+  df[2] = (z - 2.0 * p[2] * p[2]) / (z * z);
+  df[3] = 2.0 * p[2] * y / (z * z);
+}
+
 /****************************************************************
   analytical fits to sheng-aluminum-EAM-potential
     unknown reference
@@ -564,6 +1072,27 @@ void sheng_rho_value(const double r, const double* p, double* f)
     *f = p[0] * power + p[2];
 }
 
+void sheng_rho_dparam(const double r, const double* p, double* df)
+{
+  double power = 0;
+
+  power_1(&power, &r, &p[1]);
+
+  double x = (p[4] * p[4]) / (r * r);
+  x = x * x * x;
+
+  memset(df, 0, 5 * sizeof(double));
+
+  if (r > 1.45) {
+    df[3] = 4.0 * x * (x - 1.0);
+    df[4] = 24.0 * p[3] * x * (2.0 * x - 1.0) / p[4];
+  } else {
+    df[0] = power;
+    df[1] = p[0] * dpow(power, r);
+    df[2] = 1.0;
+  }
+}
+
 /****************************************************************
   analytical fits to sheng-aluminum-EAM-potential
     unknown reference
@@ -578,6 +1107,18 @@ void sheng_F_value(const double r, const double* p, double* f)
   *f = p[0] * power + p[2] * r + p[3];
 }
 
+void sheng_F_dparam(const double r, const double* p, double* df)
+{
+  double power = 0;
+
+  power_1(&power, &r, &p[1]);
+
+  df[0] = power;
+  df[1] = p[0] * dpow(power, r);
+  df[2] = r;
+  df[3] = 1.0;
+}
+
 #if defined(STIWEB)
 
 /****************************************************************
@@ -595,6 +1136,25 @@ void stiweb_2_value(const double r, const double* p, double* f)
   *f = (p[0] * power[0] - p[1] * power[1]) * exp(p[4] / (r - p[5]));
 }
 
+void stiweb_2_dparam(const double r, const double* p, double* df)
+{
+  double x[2] = {r, r};
+  double y[2] = {-p[2], -p[3]};
+  double power[2] = {0, 0};
+
+  power_m(2, power, x, y);
+
+  double e = exp(p[4] / (r - p[5]));
+  double f = (p[0] * power[0] - p[1] * power[1]) * e;
+
+  df[0] = power[0] * e;
+  df[1] = -power[1] * e;
+  df[2] = -p[0] * log(r) * power[0] * e;
+  df[3] = p[1] * log(r) * power[1] * e;
+  df[4] = f / (r - p[5]);
+  df[5] = f * p[4] / dsquare(r - p[5]);
+}
+
 /****************************************************************
   Stillinger-Weber exp functions for threebody potential
  ****************************************************************/
@@ -604,6 +1164,14 @@ void stiweb_3_value(const double r, const double* p, double* f)
   *f = exp(p[0] / (r - p[1]));
 }
 
+void stiweb_3_dparam(const double r, const double* p, double* df)
+{
+  double f = exp(p[0] / (r - p[1]));
+
+  df[0] = f / (r - p[1]);
+  df[1] = f * p[0] / dsquare(r - p[1]);
+}
+
 /****************************************************************
   pseudo Stillinger-Weber potential function to store lamda values
 ****************************************************************/
@@ -0,0 +1,232 @@
+/****************************************************************
+ *
+ * lbfgs.c: Limited-memory BFGS minimization of the error sum
+ *	with the gradient of calc_gradient()
+ *
+ ****************************************************************
+ *
+ * Copyright 2002-2017 - the potfit development team
+ *
+ * https://www.potfit.net/
+ *
+ ****************************************************************
+ *
+ * This file is part of potfit.
+ *
+ * potfit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * potfit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with potfit; if not, see <http://www.gnu.org/licenses/>.
+ *
+ ****************************************************************/
+
+#include "potfit.h"
+
+#if defined(ADJOINT_GRADIENT)
+
+#include "force.h"
+#include "memory.h"
+#include "optimize.h"
+#include "potential_output.h"
+
+#define PRECISION 1.E-7
+#define VERY_SMALL 1.E-12
+#define ARMIJO 1.E-4    /* sufficient decrease of the line search */
+#define MAX_BACKTRACK 30 /* halvings of the step before giving up */
+
+static double dot(const double* a, const double* b, int n)
+{
+  double sum = 0.0;
+
+  for (int i = 0; i < n; i++)
+    sum += a[i] * b[i];
+
+  return sum;
+}
+
+/****************************************************************
+ *
+ * run_lbfgs: quasi-Newton minimization of the error sum
+ *
+ * The search direction comes from the two-loop recursion over the
+ * last lbfgs_memory steps s and gradient changes y, the step length
+ * from a backtracking line search with the Armijo condition. Every
+ * trial point costs one calc_gradient(), the gradient of the
+ * accepted point is then already known.
+ *
+ ****************************************************************/
+
+void run_lbfgs(double* xi)
+{
+  const int n = g_calc.ndim;
+  const int m = g_param.lbfgs_memory;
+  const int* idx = g_pot.opt_pot.idx;
+
+  int iter = 0;
+  int num = 0;  /* stored correction pairs */
+  int newest = -1;
+  int restart = 0;
+
+  /* steps and gradient changes, ring buffers of m rows */
+  double** s = mat_double(m, n);
+  double** y = mat_double(m, n);
+  double* rho = (double*)Malloc(m * sizeof(double));
+  double* alpha = (double*)Malloc(m * sizeof(double));
+
+  /* gradient and search direction in the free parameters */
+  double* g = (double*)Malloc(n * sizeof(double));
+  double* g_new = (double*)Malloc(n * sizeof(double));
+  double* d = (double*)Malloc(n * sizeof(double));
+
+  /* gradient with respect to the whole table and the trial point */
+  double* grad = (double*)Malloc(g_calc.ndimtot * sizeof(double));
+  double* xi_new = (double*)Malloc(g_calc.ndimtot * sizeof(double));
+  double* forces = (double*)Malloc(g_calc.mdim * sizeof(double));
+
+  double F = calc_gradient(xi, forces, grad);
+  double F_old = 0.0;
+
+  if (F < VERY_SMALL) {
+    printf("Error already too small to optimize, aborting ...\n");
+    return;
+  }
+
+  for (int i = 0; i < n; i++)
+    g[i] = grad[idx[i]];
+
+  printf("%d %f %f %f %f %f %f %d\n", 0, F, xi[0], xi[1], xi[2], xi[3], xi[4],
+         g_calc.fcalls);
+  fflush(stdout);
+
+  do {
+    F_old = F;
+    restart = 0;
+
+    /* the scaling of the first step needs a nonzero gradient */
+    if (dot(g, g, n) == 0.0) {
+      printf("Gradient is zero, the parameters are stationary, aborting!\n");
+      break;
+    }
+
+    /* two-loop recursion, d = -H.g */
+    for (int i = 0; i < n; i++)
+      d[i] = -g[i];
+
+    for (int l = 0; l < num; l++) {
+      const int j = (newest - l + m) % m;
+      alpha[j] = rho[j] * dot(s[j], d, n);
+      for (int i = 0; i < n; i++)
+        d[i] -= alpha[j] * y[j][i];
+    }
+
+    /* initial hessian: scaled identity, or a unit step without history */
+    double h0 = 1.0 / sqrt(dot(g, g, n));
+    if (num > 0)
+      h0 = dot(s[newest], y[newest], n) / dot(y[newest], y[newest], n);
+    for (int i = 0; i < n; i++)
+      d[i] *= h0;
+
+    for (int l = num - 1; l >= 0; l--) {
+      const int j = (newest - l + m) % m;
+      const double beta = rho[j] * dot(y[j], d, n);
+      for (int i = 0; i < n; i++)
+        d[i] += (alpha[j] - beta) * s[j][i];
+    }
+
+    double slope = dot(g, d, n);
+
+    /* no descent direction, start over with steepest descent */
+    if (slope >= 0.0) {
+      num = 0;
+      h0 = 1.0 / sqrt(dot(g, g, n));
+      for (int i = 0; i < n; i++)
+        d[i] = -h0 * g[i];
+      slope = dot(g, d, n);
+    }
+
+    /* too large steps are cut to the maximal changes */
+    double step = 1.0;
+    for (int i = 0; i < n && g_param.usemaxch; i++) {
+      const int k = idx[i];
+      if (g_calc.maxchange[k] > 0 && fabs(step * d[i]) > g_calc.maxchange[k])
+        step = g_calc.maxchange[k] / fabs(d[i]);
+    }
+
+    double F_new = 0.0;
+    int l = 0;
+
+    for (l = 0; l < MAX_BACKTRACK; l++) {
+      memcpy(xi_new, xi, g_calc.ndimtot * sizeof(double));
+      for (int i = 0; i < n; i++)
+        xi_new[idx[i]] += step * d[i];
+
+      F_new = calc_gradient(xi_new, forces, grad);
+
+      if (F_new <= F + ARMIJO * step * slope)
+        break;
+
+      step *= 0.5;
+    }
+
+    if (l == MAX_BACKTRACK) {
+      /* the history is useless if even short steps fail */
+      if (num == 0) {
+        printf("Could not find any further improvements, aborting!\n");
+        break;
+      }
+      num = 0;
+      restart = 1;
+      continue;
+    }
+
+    for (int i = 0; i < n; i++)
+      g_new[i] = grad[idx[i]];
+
+    /* store the correction pair if the curvature is positive */
+    double sy = 0.0;
+    double yy = 0.0;
+    for (int i = 0; i < n; i++) {
+      sy += step * d[i] * (g_new[i] - g[i]);
+      yy += (g_new[i] - g[i]) * (g_new[i] - g[i]);
+    }
+    if (sy > VERY_SMALL * yy) {
+      newest = (newest + 1) % m;
+      for (int i = 0; i < n; i++) {
+        s[newest][i] = step * d[i];
+        y[newest][i] = g_new[i] - g[i];
+      }
+      rho[newest] = 1.0 / sy;
+      num = MIN(num + 1, m);
+    }
+
+    memcpy(xi, xi_new, g_calc.ndimtot * sizeof(double));
+    memcpy(g, g_new, n * sizeof(double));
+    F = F_new;
+
+    iter++;
+
+    printf("%d %f %f %f %f %f %f %d\n", iter, F, xi[0], xi[1], xi[2], xi[3],
+           xi[4], g_calc.fcalls);
+    fflush(stdout);
+
+    /* End fit if break flagfile exists */
+    if (break_flagfile())
+      break;
+
+    /* write temp file  */
+    if (*g_files.tempfile != '\0')
+      write_pot_table_potfit(g_files.tempfile);
+
+  } while (restart ||
+           (F_old - F > PRECISION / 10.0 && F_old - F > g_calc.d_eps));
+}
+
+#endif  // ADJOINT_GRADIENT
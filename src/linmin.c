@@ -44,16 +44,23 @@
 
 double *xicom, *delcom;
 
+static double linmin_parallel(double fxi1, double* x1, double* x2,
+                              double** fret1, double** fret2);
+
 /****************************************************************
  *
  *  takes vector del (direction of search), xi (originating point),
  *  n,m (dimensions), x1, x2 (two best locations),
  *  fret1, fret2 (return vectors) as arguments
  *
+ *  the return vectors are exchanged with internal buffers
+ *  instead of being copied, fret1 and fret2 may point to
+ *  different memory afterwards
+ *
  ****************************************************************/
 
 double linmin(double xi[], double del[], double fxi1, double* x1, double* x2,
-              double* fret1, double* fret2)
+              double** fret1, double** fret2)
 {
   static double* vecu = NULL; /* Vector of location u */
   double xx, fx, fb, bx, ax;
@@ -63,21 +70,26 @@ double linmin(double xi[], double del[], double fxi1, double* x1, double* x2,
 
   xicom = xi;
   delcom = del;
-  ax = 0.0; /*do not change without correcting fa, */
-  /*saves 1 fcalc... */
-  bx = 0.1;
 
-  if (vecu == NULL)
-    vecu = (double*)Malloc(g_calc.ndimtot * sizeof(double));
+  if (g_param.linmin_points > 1) {
+    fx = linmin_parallel(fxi1, &xmin, &xmin2, fret1, fret2);
+  } else {
+    ax = 0.0; /*do not change without correcting fa, */
+    /*saves 1 fcalc... */
+    bx = 0.1;
 
-  for (int j = 0; j < g_calc.ndimtot; j++)
-    vecu[j] = xicom[j] + bx * delcom[j]; /*set vecu */
+    if (vecu == NULL)
+      vecu = (double*)Malloc(g_calc.ndimtot * sizeof(double));
 
-  fb = calc_forces(vecu, fret2, 0);
+    for (int j = 0; j < g_calc.ndimtot; j++)
+      vecu[j] = xicom[j] + bx * delcom[j]; /*set vecu */
 
-  bracket(&ax, &xx, &bx, &fa, &fx, &fb, fret1, fret2);
+    fb = calc_forces(vecu, *fret2, 0);
 
-  fx = brent(ax, xx, bx, fx, TOL, &xmin, &xmin2, fret1, fret2);
+    bracket(&ax, &xx, &bx, &fa, &fx, &fb, fret1, fret2);
+
+    fx = brent(ax, xx, bx, fx, TOL, &xmin, &xmin2, fret1, fret2);
+  }
 
   for (int j = 0; j < g_calc.ndimtot; j++) {
     del[j] *= xmin;
@@ -90,4 +102,175 @@ double linmin(double xi[], double del[], double fxi1, double* x1, double* x2,
   return fx;
 }
 
+/****************************************************************
+ *
+ *  linmin_parallel: line search with g_param.linmin_points step
+ *  lengths evaluated together by calc_errors()
+ *
+ *  The points extend geometrically to the side of the lowest
+ *  error until the minimum is bracketed, then the bracket is
+ *  divided evenly until it is narrower than TOL. A parabola
+ *  through the lowest point and its neighbors gives xmin, only
+ *  the two best points get their forces calculated.
+ *
+ ****************************************************************/
+
+static int linmin_num = 0; /* number of evaluated step lengths */
+static double* linmin_x = NULL;
+static double* linmin_f = NULL;
+
+/* insert the step lengths x with the errors f into the sorted list */
+
+static void linmin_insert(const double* x, const double* f, int num)
+{
+  linmin_x = (double*)Realloc(linmin_x, (linmin_num + num) * sizeof(double));
+  linmin_f = (double*)Realloc(linmin_f, (linmin_num + num) * sizeof(double));
+
+  for (int k = 0; k < num; k++) {
+    int i = linmin_num++;
+
+    while (i > 0 && linmin_x[i - 1] > x[k]) {
+      linmin_x[i] = linmin_x[i - 1];
+      linmin_f[i] = linmin_f[i - 1];
+      i--;
+    }
+
+    linmin_x[i] = x[k];
+    linmin_f[i] = f[k];
+  }
+}
+
+/* index of the lowest error in the list */
+
+static int linmin_lowest()
+{
+  int best = 0;
+
+  for (int i = 1; i < linmin_num; i++)
+    if (linmin_f[i] < linmin_f[best])
+      best = i;
+
+  return best;
+}
+
+static double linmin_parallel(double fxi1, double* x1, double* x2,
+                              double** fret1, double** fret2)
+{
+  static double** vecu = NULL; /* Vectors of the step lengths */
+  static double* x = NULL;
+  static double* f = NULL;
+
+  const int K = g_param.linmin_points;
+  const double zero = 0.0;
+  int nb_eval = 0;
+
+  if (vecu == NULL) {
+    vecu = (double**)Malloc(K * sizeof(double*));
+    for (int k = 0; k < K; k++)
+      vecu[k] = (double*)Malloc(g_calc.ndimtot * sizeof(double));
+    x = (double*)Malloc(K * sizeof(double));
+    f = (double*)Malloc(K * sizeof(double));
+  }
+
+  linmin_num = 0;
+  linmin_insert(&zero, &fxi1, 1);
+
+  /* step lengths of the first round, as in the serial bracket */
+  for (int k = 0; k < K; k++)
+    x[k] = 0.1 * pow(1.0 / (1.0 - CGOLD), k);
+
+  int best = 0;
+
+  while (1) {
+    for (int k = 0; k < K; k++)
+      for (int j = 0; j < g_calc.ndimtot; j++)
+        vecu[k][j] = xicom[j] + x[k] * delcom[j];
+
+    calc_errors(vecu, f, K, g_calc.ndimtot);
+    linmin_insert(x, f, K);
+    nb_eval += K;
+
+    best = linmin_lowest();
+
+    const int n = linmin_num;
+
+    if (best > 0 && best < n - 1) {
+      /* SUCCESS: Minimum in bracket! */
+      const double width = linmin_x[best + 1] - linmin_x[best - 1];
+
+      if (width <= TOL * fabs(linmin_x[best]) + ZEPS)
+        break;
+
+      /* divide the bracket evenly */
+      for (int k = 0; k < K; k++)
+        x[k] = linmin_x[best - 1] + width * (k + 1) / (K + 1);
+    } else {
+      /* extend to the side of the lowest error, every step is larger
+         than the one before by the golden ratio as in bracket() */
+      double prev = (best == 0) ? linmin_x[1] : linmin_x[n - 2];
+      double edge = linmin_x[best];
+
+      for (int k = 0; k < K; k++) {
+        x[k] = edge + (edge - prev) / (1.0 - CGOLD);
+        prev = edge;
+        edge = x[k];
+      }
+    }
+
+    if (nb_eval >= MAX_IT + ITMAX)
+      error(1, "Problems with the parallel line search, aborting\n");
+  }
+
+  /* parabola through the lowest point and its neighbors */
+  const double a = linmin_x[best - 1];
+  const double b = linmin_x[best];
+  const double c = linmin_x[best + 1];
+  const double fa = linmin_f[best - 1];
+  const double fb = linmin_f[best];
+  const double fc = linmin_f[best + 1];
+
+  const double r = (b - a) * (fb - fc);
+  const double q = (b - c) * (fb - fa);
+  double u = b;
+
+  if (q != r)
+    u = b - ((b - c) * q - (b - a) * r) / (2.0 * (q - r));
+
+  /* the second point is the vertex or the lower neighbor, at least as
+     far from b as the tolerance of brent() */
+  const double tol = TOL * fabs(b) + ZEPS;
+  double x_other = (fa < fc) ? a : c;
+
+  if (u > a && u < c)
+    x_other = (fabs(u - b) >= tol) ? u : b + ((u > b) ? tol : -tol);
+
+  for (int j = 0; j < g_calc.ndimtot; j++) {
+    vecu[0][j] = xicom[j] + b * delcom[j];
+    vecu[1][j] = xicom[j] + x_other * delcom[j];
+  }
+
+  double* forces[2] = {*fret1, *fret2};
+  double errors[2];
+
+  if (g_param.batch_size > 1) {
+    calc_forces_batch(vecu, forces, errors, 2, 0);
+  } else {
+    for (int k = 0; k < 2; k++)
+      errors[k] = calc_forces(vecu[k], forces[k], 0);
+  }
+
+  if (errors[1] < errors[0]) {
+    *x1 = x_other;
+    *x2 = b;
+    *fret1 = forces[1];
+    *fret2 = forces[0];
+    return errors[1];
+  }
+
+  *x1 = b;
+  *x2 = x_other;
+
+  return errors[0];
+}
+
 #undef TOL
@@ -35,10 +35,6 @@
 
 void init_interaction_name(const char* name);
 void free_atom_table(atom_t* patom, int natoms);
-void free_neigh_table(neigh_t* pneigh, int nneigh);
-#if defined(THREEBODY)
-void free_angle_table(angle_t* pangle, int nangle);
-#endif  // THREEBODY
 void free_pot_table(pot_table_t* ppot);
 #if defined(APOT)
 void free_apot_table(apot_table_t* papot);
@@ -111,6 +107,29 @@ void* Realloc(void* pvoid, size_t size)
   return temp;
 }
 
+/****************************************************************
+ *
+ *  Free:
+ *    release memory of Malloc or Realloc before the end of the run
+ *    and remove it from the freeing array
+ *
+ ****************************************************************/
+
+void Free(void* pvoid)
+{
+  if (pvoid == NULL)
+    return;
+
+  for (int i = 0; i < g_memory.num_pointers; i++) {
+    if (pvoid == g_memory.pointers[i]) {
+      g_memory.pointers[i] = g_memory.pointers[--g_memory.num_pointers];
+      break;
+    }
+  }
+
+  free(pvoid);
+}
+
 /****************************************************************
  *
  *  initialize_global_variables
@@ -141,14 +160,29 @@ void initialize_global_variables()
   g_mpi.atom_len = NULL;
   g_mpi.conf_dist = NULL;
   g_mpi.conf_len = NULL;
+  g_mpi.group = 0;
+  g_mpi.num_groups = 1;
 #endif  // MPI
 
   memset(&g_param, 0, sizeof(g_param));
   g_param.sweight = -1.0;
   g_param.global_cell_scale = 1.0;
+  g_param.batch_size = 1;
+  g_param.num_groups = 1;
+  g_param.linmin_points = 1;
+#if defined(ADJOINT_GRADIENT)
+  g_param.lbfgs_memory = 10;
+#endif  // ADJOINT_GRADIENT
 #if defined(EVO)
   g_param.evo_threshold = 1.0e-6;
-#endif  // EVO
+#elif defined(CMAES)
+  g_param.cmaes_threshold = 1.0e-6;
+  g_param.cmaes_sigma = 0.3;
+#else
+  g_param.anneal_replicas = 1;
+  g_param.anneal_ladder = 0.5;
+  g_param.anneal_speculate = 1;
+#endif  // EVO || CMAES
 
   g_pot.interaction_name = NULL;
   g_pot.gradient = NULL;
@@ -294,41 +328,12 @@ void free_void_pointer(void* pvoid)
 
 void free_atom_table(atom_t* patom, int natoms)
 {
-  if (patom != NULL && natoms > 0) {
-    for (int i = 0; i < natoms; i++) {
-      free_neigh_table(patom[i].neigh, patom[i].num_neigh);
-      free(patom[i].neigh);
-#if defined(THREEBODY)
-      free_angle_table(patom[i].angle_part, patom[i].num_angles);
-      free(patom[i].angle_part);
-#endif  // THREEBODY
-    }
+  // the neighbor and angle tables of all atoms of a configuration are
+  // stored in one array each (see init_neighbors and init_angles)
+  if (patom != NULL && natoms > 0)
     free(patom);
-  }
-}
-
-/****************************************************************
- *  free_neigh_table
- ****************************************************************/
-
-void free_neigh_table(neigh_t* pneigh, int nneigh)
-{
-  // no dynamically allocated memory
 }
 
-#if defined(THREEBODY)
-
-/****************************************************************
- *  free_angle_table
- ****************************************************************/
-
-void free_angle_table(angle_t* pangle, int nangle)
-{
-  // no dynamically allocated memory
-}
-
-#endif  // THREEBODY
-
 /****************************************************************
  *
  *  free_pot_table
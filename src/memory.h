@@ -32,6 +32,7 @@
 
 void* Malloc(size_t size);
 void* Realloc(void* pvoid, size_t size);
+void Free(void* pvoid);
 
 void initialize_global_variables();
 void free_allocated_memory();
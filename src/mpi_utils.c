@@ -29,7 +29,15 @@
 
 #include "potfit.h"
 
+#if defined(_OPENMP)
+#include <omp.h>
+#endif  // _OPENMP
+
+#include "column_cache.h"
 #include "config.h"
+#include "design_matrix.h"
+#include "force.h"
+#include "functions.h"
 #include "memory.h"
 #include "mpi_utils.h"
 #include "utils.h"
@@ -49,6 +57,15 @@ int broadcast_basic_data();
 int broadcast_calcpot_table();
 int broadcast_apot_table();
 int broadcast_configurations();
+int copy_configurations();
+int partition_configurations();
+double* configuration_costs();
+void split_configurations(const double* cost);
+int scatter_partition();
+int read_distributed_configurations();
+int split_groups();
+int broadcast_punishments();
+int broadcast_string(const char** str);
 int broadcast_atoms();
 int broadcast_neighbors();
 int broadcast_angles();
@@ -62,7 +79,13 @@ int initialize_mpi(int* argc, char*** argv)
 {
 #if defined(MPI)
   // initialize the MPI communication
+#if defined(_OPENMP)
+  // only the master thread of each process communicates
+  int provided = 0;
+  int rval = MPI_Init_thread(argc, argv, MPI_THREAD_FUNNELED, &provided);
+#else
   int rval = MPI_Init(argc, argv);
+#endif  // _OPENMP
 
   if (rval != MPI_SUCCESS) {
     printf("Error initializing MPI communication! (Error: %d)\n", rval);
@@ -82,6 +105,9 @@ int initialize_mpi(int* argc, char*** argv)
     printf("Error getting MPI communicator rank! (Error: %d)\n", rval);
     return POTFIT_ERROR;
   }
+
+  // all processes share the force calculation unless split_groups() is used
+  g_mpi.comm = MPI_COMM_WORLD;
 #endif  // MPI
 
   if (g_mpi.myid == 0) {
@@ -90,6 +116,9 @@ int initialize_mpi(int* argc, char*** argv)
 #if defined(MPI)
     printf("Starting up MPI with %d processes.\n", g_mpi.num_cpus);
 #endif  // MPI
+#if defined(_OPENMP)
+    printf("Using %d OpenMP threads per process.\n", omp_get_max_threads());
+#endif  // _OPENMP
     printf("\n");
   }
 
@@ -118,11 +147,6 @@ void shutdown_mpi(void)
 int broadcast_params_mpi()
 {
 #if defined(MPI)
-  if (g_mpi.myid == 0) {
-    printf("Broadcasting data to MPI workers ... ");
-    fflush(stdout);
-  }
-
   // non-root processes will wait here while root is reading input files
   CHECK_RETURN(MPI_Bcast(&g_mpi.init_done, 1, MPI_INT, 0, MPI_COMM_WORLD));
 
@@ -131,18 +155,45 @@ int broadcast_params_mpi()
     return POTFIT_ERROR_MPI_CLEAN_EXIT;
 
   CHECK_RETURN(create_custom_datatypes());
+
+  CHECK_RETURN(
+      MPI_Bcast(&g_param.distributed_input, 1, MPI_INT, 0, MPI_COMM_WORLD));
+
+  CHECK_RETURN(MPI_Bcast(&g_param.num_groups, 1, MPI_INT, 0, MPI_COMM_WORLD));
+  g_mpi.num_groups = g_param.num_groups;
+
+  // root has only indexed the configuration file
+  if (g_param.distributed_input)
+    CHECK_RETURN(read_distributed_configurations());
+
+  if (g_mpi.myid == 0) {
+    printf("Broadcasting data to MPI workers ... ");
+    fflush(stdout);
+  }
+
   CHECK_RETURN(broadcast_basic_data());
   CHECK_RETURN(broadcast_calcpot_table());
   CHECK_RETURN(broadcast_apot_table());
-  CHECK_RETURN(broadcast_configurations());
-  CHECK_RETURN(broadcast_atoms());
-  CHECK_RETURN(broadcast_neighbors());
-  CHECK_RETURN(broadcast_angles());
+
+  if (g_param.distributed_input) {
+#if defined(APOT) && !defined(KIM)
+    // the potential ranges were adjusted to the minimal distances
+    update_slots(g_config.conf_atoms, g_mpi.myatoms);
+#endif  // APOT && !KIM
+  } else {
+    CHECK_RETURN(partition_configurations());
+    CHECK_RETURN(broadcast_configurations());
+    CHECK_RETURN(broadcast_atoms());
+    CHECK_RETURN(broadcast_neighbors());
+    CHECK_RETURN(broadcast_angles());
+  }
 
   if (g_mpi.myid == 0) {
     printf("done\n");
     fflush(stdout);
   }
+
+  CHECK_RETURN(split_groups());
 #else
   // Identify subset of atoms/volumes belonging to individual
   // process with complete set of atoms/volumes
@@ -171,21 +222,21 @@ void potsync()
   /* Memory is allocated - just bcast that changed potential... */
   /* bcast begin/end/step/invstep of embedding energy  */
   MPI_Bcast(g_pot.calc_pot.begin + firstcol, g_param.ntypes, MPI_DOUBLE, 0,
-            MPI_COMM_WORLD);
+            g_mpi.comm);
   MPI_Bcast(g_pot.calc_pot.end + firstcol, g_param.ntypes, MPI_DOUBLE, 0,
-            MPI_COMM_WORLD);
+            g_mpi.comm);
   MPI_Bcast(g_pot.calc_pot.step + firstcol, g_param.ntypes, MPI_DOUBLE, 0,
-            MPI_COMM_WORLD);
+            g_mpi.comm);
   MPI_Bcast(g_pot.calc_pot.invstep + firstcol, g_param.ntypes, MPI_DOUBLE, 0,
-            MPI_COMM_WORLD);
+            g_mpi.comm);
   MPI_Bcast(g_pot.calc_pot.first + firstcol, g_param.ntypes, MPI_INT, 0,
-            MPI_COMM_WORLD);
+            g_mpi.comm);
 
   /* bcast table values of transfer fn. and embedding energy */
   int firstval = g_pot.calc_pot.first[g_calc.paircol];
   int nvals = g_pot.calc_pot.len - firstval;
   MPI_Bcast(g_pot.calc_pot.table + firstval, nvals, MPI_DOUBLE, 0,
-            MPI_COMM_WORLD);
+            g_mpi.comm);
 #endif  // MPI
 }
 
@@ -466,6 +517,11 @@ int broadcast_basic_data()
   CHECK_RETURN(MPI_Bcast(&g_config.nconf, 1, MPI_INT, 0, MPI_COMM_WORLD));
   CHECK_RETURN(MPI_Bcast(&g_calc.paircol, 1, MPI_INT, 0, MPI_COMM_WORLD));
   CHECK_RETURN(MPI_Bcast(&g_param.opt, 1, MPI_INT, 0, MPI_COMM_WORLD));
+  CHECK_RETURN(MPI_Bcast(&g_param.rebalance, 1, MPI_INT, 0, MPI_COMM_WORLD));
+#if defined(PAIR)
+  CHECK_RETURN(
+      MPI_Bcast(&g_param.column_cache, 1, MPI_INT, 0, MPI_COMM_WORLD));
+#endif  // PAIR
 
   // allocate and broadcast config metadata
   if (g_mpi.myid > 0) {
@@ -513,7 +569,8 @@ int broadcast_calcpot_table()
   int ncols = g_pot.calc_pot.ncols;
   int calclen = g_pot.calc_pot.len;
 
-  if (g_mpi.myid > 0) {
+  // distributed input already received the table once
+  if (g_mpi.myid > 0 && g_pot.calc_pot.begin == NULL) {
     g_pot.calc_pot.begin = (double*)Malloc(ncols * sizeof(double));
     g_pot.calc_pot.end = (double*)Malloc(ncols * sizeof(double));
     g_pot.calc_pot.step = (double*)Malloc(ncols * sizeof(double));
@@ -589,12 +646,18 @@ int broadcast_apot_table()
 #endif  // COULOMB
     g_pot.smooth_pot = (int*)Malloc(g_pot.apot_table.number * sizeof(int));
     g_pot.invar_pot = (int*)Malloc(g_pot.apot_table.number * sizeof(int));
-    g_config.rcut =
-        (double*)Malloc(g_param.ntypes * g_param.ntypes * sizeof(double));
-    g_config.rmin =
-        (double*)Malloc(g_param.ntypes * g_param.ntypes * sizeof(double));
+    if (!g_param.distributed_input) {
+      g_config.rcut =
+          (double*)Malloc(g_param.ntypes * g_param.ntypes * sizeof(double));
+      g_config.rmin =
+          (double*)Malloc(g_param.ntypes * g_param.ntypes * sizeof(double));
+    }
+    g_pot.apot_table.names =
+        (char**)Malloc(g_pot.apot_table.number * sizeof(char*));
     g_pot.apot_table.fvalue = (fvalue_pointer*)Malloc(g_pot.apot_table.number *
                                                       sizeof(fvalue_pointer));
+    g_pot.apot_table.fdparam = (fdparam_pointer*)Malloc(
+        g_pot.apot_table.number * sizeof(fdparam_pointer));
     g_pot.opt_pot.table = (double*)Malloc(g_pot.opt_pot.len * sizeof(double));
     g_pot.opt_pot.first = (int*)Malloc(g_pot.apot_table.number * sizeof(int));
   }
@@ -611,8 +674,16 @@ int broadcast_apot_table()
                          MPI_DOUBLE, 0, MPI_COMM_WORLD));
   CHECK_RETURN(MPI_Bcast(g_config.rmin, g_param.ntypes * g_param.ntypes,
                          MPI_DOUBLE, 0, MPI_COMM_WORLD));
-  CHECK_RETURN(MPI_Bcast(g_pot.apot_table.fvalue, g_pot.apot_table.number,
-                         MPI_DOUBLE, 0, MPI_COMM_WORLD));
+
+  // function addresses differ between the processes, look them up by name
+  for (int i = 0; i < g_pot.apot_table.number; i++)
+    CHECK_RETURN(broadcast_string((const char**)g_pot.apot_table.names + i));
+  if (g_mpi.myid > 0) {
+    initialize_analytic_potentials();
+    if (apot_assign_function_pointers(&g_pot.apot_table) == -1)
+      error(1, "Could not assign the function pointers.\n");
+  }
+
   CHECK_RETURN(MPI_Bcast(g_pot.apot_table.end, g_pot.apot_table.number,
                          MPI_DOUBLE, 0, MPI_COMM_WORLD));
   CHECK_RETURN(MPI_Bcast(g_pot.apot_table.begin, g_pot.apot_table.number,
@@ -666,32 +737,175 @@ int broadcast_apot_table()
 
 int broadcast_configurations()
 {
-  // Each node: nconf/num_cpus configurations.
-  // Last nconf%num_cpus nodes: 1 additional config
+  // a rebalance reuses the arrays of the previous partition
+  g_config.conf_vol = (double*)Realloc(
+      g_config.conf_vol, MAX(1, g_mpi.myconf) * sizeof(double));
+  g_config.conf_uf =
+      (int*)Realloc(g_config.conf_uf, MAX(1, g_mpi.myconf) * sizeof(int));
+#if defined(STRESS)
+  g_config.conf_us =
+      (int*)Realloc(g_config.conf_us, MAX(1, g_mpi.myconf) * sizeof(int));
+#endif  // STRESS
 
-  if (g_mpi.myid == 0) {
-    int each = (g_config.nconf / g_mpi.num_cpus);
-    int odd = (g_config.nconf % g_mpi.num_cpus) - g_mpi.num_cpus;
+  // the groups overlap in the configurations, every process takes its part
+  if (g_mpi.num_groups > 1)
+    return copy_configurations();
+
+  CHECK_RETURN(MPI_Scatterv(g_config.volume, g_mpi.conf_len, g_mpi.conf_dist,
+                            MPI_DOUBLE, g_config.conf_vol, g_mpi.myconf,
+                            MPI_DOUBLE, 0, MPI_COMM_WORLD));
+  CHECK_RETURN(MPI_Scatterv(g_config.useforce, g_mpi.conf_len, g_mpi.conf_dist,
+                            MPI_INT, g_config.conf_uf, g_mpi.myconf, MPI_INT, 0,
+                            MPI_COMM_WORLD));
+
+#if defined(STRESS)
+  CHECK_RETURN(MPI_Scatterv(g_config.usestress, g_mpi.conf_len, g_mpi.conf_dist,
+                            MPI_INT, g_config.conf_us, g_mpi.myconf, MPI_INT, 0,
+                            MPI_COMM_WORLD));
+#endif  // STRESS
+
+  return MPI_SUCCESS;
+}
+
+/****************************************************************
+    copy_configurations
+      broadcast_configurations() for overlapping groups, every
+      process receives all configurations and keeps its own
+****************************************************************/
+
+int copy_configurations()
+{
+  if (g_mpi.myid > 0) {
+    g_config.volume = (double*)Malloc(g_config.nconf * sizeof(double));
+    g_config.useforce = (int*)Malloc(g_config.nconf * sizeof(int));
+#if defined(STRESS)
+    g_config.usestress = (int*)Malloc(g_config.nconf * sizeof(int));
+#endif  // STRESS
+  }
+
+  CHECK_RETURN(MPI_Bcast(g_config.volume, g_config.nconf, MPI_DOUBLE, 0,
+                         MPI_COMM_WORLD));
+  CHECK_RETURN(MPI_Bcast(g_config.useforce, g_config.nconf, MPI_INT, 0,
+                         MPI_COMM_WORLD));
+#if defined(STRESS)
+  CHECK_RETURN(MPI_Bcast(g_config.usestress, g_config.nconf, MPI_INT, 0,
+                         MPI_COMM_WORLD));
+#endif  // STRESS
+
+  for (int c = 0; c < g_mpi.myconf; c++) {
+    g_config.conf_vol[c] = g_config.volume[g_mpi.firstconf + c];
+    g_config.conf_uf[c] = g_config.useforce[g_mpi.firstconf + c];
+#if defined(STRESS)
+    g_config.conf_us[c] = g_config.usestress[g_mpi.firstconf + c];
+#endif  // STRESS
+  }
+
+  return MPI_SUCCESS;
+}
+
+/****************************************************************
+    configuration_costs
+      estimated work of the force routines for each configuration:
+      every atom counts once, every neighbor (and every triple of
+      a three-body potential) counts once for the energy and once
+      more for forces and stresses each; with distributed input
+      the neighbors are not known yet and only the atoms count
+****************************************************************/
+
+double* configuration_costs()
+{
+  double* cost = (double*)malloc(g_config.nconf * sizeof(double));
+
+  if (cost == NULL)
+    error(1, "Error in memory allocation for the configuration costs\n");
+
+  for (int c = 0; c < g_config.nconf; c++) {
+    double weight = 1.0 + g_config.useforce[c];
+
+    if (g_param.distributed_input) {
+      cost[c] = weight * g_config.inconf[c];
+      continue;
+    }
 
+#if defined(STRESS)
+    weight += g_config.usestress[c];
+#endif  // STRESS
+
+    long pairs = 0;
+
+    for (int i = 0; i < g_config.inconf[c]; i++) {
+      atom_t* atom = g_config.atoms + g_config.cnfstart[c] + i;
+      pairs += atom->num_neigh;
+#if defined(THREEBODY)
+      pairs += atom->num_angles;
+#endif  // THREEBODY
+    }
+
+    cost[c] = g_config.inconf[c] + weight * pairs;
+  }
+
+  return cost;
+}
+
+/****************************************************************
+    split_configurations
+      contiguous ranges of about equal cost, process i takes all
+      configurations whose cost midpoint lies below (i + 1) / num_cpus
+      of the total cost; with several groups the partition of the
+      first group is repeated for all others
+****************************************************************/
+
+void split_configurations(const double* cost)
+{
+  double total = 0.0;
+
+  for (int c = 0; c < g_config.nconf; c++)
+    total += cost[c];
+
+  if (g_mpi.conf_dist == NULL) {
     g_mpi.atom_len = (int*)Malloc(g_mpi.num_cpus * sizeof(int));
     g_mpi.atom_dist = (int*)Malloc(g_mpi.num_cpus * sizeof(int));
     g_mpi.conf_len = (int*)Malloc(g_mpi.num_cpus * sizeof(int));
     g_mpi.conf_dist = (int*)Malloc(g_mpi.num_cpus * sizeof(int));
-    for (int i = 0; i < g_mpi.num_cpus; i++)
-      g_mpi.conf_dist[i] = i * each + (((i + odd) > 0) ? (i + odd) : 0);
-    for (int i = 0; i < g_mpi.num_cpus - 1; i++)
-      g_mpi.conf_len[i] = g_mpi.conf_dist[i + 1] - g_mpi.conf_dist[i];
-    g_mpi.conf_len[g_mpi.num_cpus - 1] =
-        g_config.nconf - g_mpi.conf_dist[g_mpi.num_cpus - 1];
-    for (int i = 0; i < g_mpi.num_cpus; i++)
-      g_mpi.atom_dist[i] =
-          g_config.cnfstart[i * each + (((i + odd) > 0) ? (i + odd) : 0)];
-    for (int i = 0; i < g_mpi.num_cpus - 1; i++)
-      g_mpi.atom_len[i] = g_mpi.atom_dist[i + 1] - g_mpi.atom_dist[i];
-    g_mpi.atom_len[g_mpi.num_cpus - 1] =
-        g_config.natoms - g_mpi.atom_dist[g_mpi.num_cpus - 1];
   }
 
+  const int size = g_mpi.num_cpus / g_mpi.num_groups;
+  int c = 0;
+  double sum = 0.0;
+
+  for (int i = 0; i < size; i++) {
+    double target = total * (i + 1) / size;
+
+    g_mpi.conf_dist[i] = c;
+    g_mpi.atom_dist[i] =
+        (c < g_config.nconf) ? g_config.cnfstart[c] : g_config.natoms;
+
+    while (c < g_config.nconf &&
+           (i == size - 1 || sum + 0.5 * cost[c] <= target)) {
+      sum += cost[c];
+      c++;
+    }
+
+    g_mpi.conf_len[i] = c - g_mpi.conf_dist[i];
+    g_mpi.atom_len[i] =
+        ((c < g_config.nconf) ? g_config.cnfstart[c] : g_config.natoms) -
+        g_mpi.atom_dist[i];
+  }
+
+  for (int i = size; i < g_mpi.num_cpus; i++) {
+    g_mpi.conf_dist[i] = g_mpi.conf_dist[i - size];
+    g_mpi.conf_len[i] = g_mpi.conf_len[i - size];
+    g_mpi.atom_dist[i] = g_mpi.atom_dist[i - size];
+    g_mpi.atom_len[i] = g_mpi.atom_len[i - size];
+  }
+}
+
+/****************************************************************
+    scatter_partition
+****************************************************************/
+
+int scatter_partition()
+{
   CHECK_RETURN(MPI_Scatter(g_mpi.atom_len, 1, MPI_INT, &g_mpi.myatoms, 1,
                            MPI_INT, 0, MPI_COMM_WORLD));
   CHECK_RETURN(MPI_Scatter(g_mpi.atom_dist, 1, MPI_INT, &g_mpi.firstatom, 1,
@@ -701,23 +915,234 @@ int broadcast_configurations()
   CHECK_RETURN(MPI_Scatter(g_mpi.conf_dist, 1, MPI_INT, &g_mpi.firstconf, 1,
                            MPI_INT, 0, MPI_COMM_WORLD));
 
-  g_config.conf_vol = (double*)Malloc(g_mpi.myconf * sizeof(double));
-  g_config.conf_uf = (int*)Malloc(g_mpi.myconf * sizeof(int));
+  return MPI_SUCCESS;
+}
 
-  CHECK_RETURN(MPI_Scatterv(g_config.volume, g_mpi.conf_len, g_mpi.conf_dist,
-                            MPI_DOUBLE, g_config.conf_vol, g_mpi.myconf,
-                            MPI_DOUBLE, 0, MPI_COMM_WORLD));
-  CHECK_RETURN(MPI_Scatterv(g_config.useforce, g_mpi.conf_len, g_mpi.conf_dist,
-                            MPI_INT, g_config.conf_uf, g_mpi.myconf, MPI_INT, 0,
-                            MPI_COMM_WORLD));
+/****************************************************************
+    partition_configurations
+      every process gets a contiguous range of configurations
+      with about the same estimated cost
+****************************************************************/
 
-#if defined(STRESS)
-  g_config.conf_us = (int*)Malloc(g_mpi.myconf * sizeof(double));
+int partition_configurations()
+{
+  if (g_mpi.myid == 0) {
+    double* cost = configuration_costs();
+    split_configurations(cost);
+    free(cost);
+  }
 
-  CHECK_RETURN(MPI_Scatterv(g_config.usestress, g_mpi.conf_len, g_mpi.conf_dist,
-                            MPI_INT, g_config.conf_us, g_mpi.myconf, MPI_INT, 0,
-                            MPI_COMM_WORLD));
-#endif  // STRESS
+  return scatter_partition();
+}
+
+/****************************************************************
+    split_groups
+      g_mpi.num_groups groups of consecutive processes, each of
+      them with a copy of all configurations; the force routines
+      only communicate within g_mpi.comm, the roots of the groups
+      share g_mpi.leader_comm
+****************************************************************/
+
+int split_groups()
+{
+  if (g_mpi.num_groups == 1)
+    return MPI_SUCCESS;
+
+  const int size = g_mpi.num_cpus / g_mpi.num_groups;
+  const int rank = g_mpi.myid;
+
+  g_mpi.group = rank / size;
+
+  CHECK_RETURN(MPI_Comm_split(MPI_COMM_WORLD, g_mpi.group, rank, &g_mpi.comm));
+  CHECK_RETURN(MPI_Comm_split(MPI_COMM_WORLD,
+                              (rank % size == 0) ? 0 : MPI_UNDEFINED, rank,
+                              &g_mpi.leader_comm));
+
+  g_mpi.myid = rank % size;
+  g_mpi.num_cpus = size;
+
+  if (g_mpi.myid > 0)
+    return MPI_SUCCESS;
+
+  // the group roots need the partition to collect the forces
+  if (g_mpi.group > 0) {
+    g_mpi.atom_len = (int*)Malloc(size * sizeof(int));
+    g_mpi.atom_dist = (int*)Malloc(size * sizeof(int));
+    g_mpi.conf_len = (int*)Malloc(size * sizeof(int));
+    g_mpi.conf_dist = (int*)Malloc(size * sizeof(int));
+  }
+
+  CHECK_RETURN(
+      MPI_Bcast(g_mpi.atom_len, size, MPI_INT, 0, g_mpi.leader_comm));
+  CHECK_RETURN(
+      MPI_Bcast(g_mpi.atom_dist, size, MPI_INT, 0, g_mpi.leader_comm));
+  CHECK_RETURN(
+      MPI_Bcast(g_mpi.conf_len, size, MPI_INT, 0, g_mpi.leader_comm));
+  CHECK_RETURN(
+      MPI_Bcast(g_mpi.conf_dist, size, MPI_INT, 0, g_mpi.leader_comm));
+
+  return broadcast_punishments();
+}
+
+/****************************************************************
+    broadcast_punishments
+      the group roots add apot_punish() to their error sums,
+      they need the free parameters and their bounds; every row
+      of pmin/pmax is sent up to its last free parameter
+****************************************************************/
+
+int broadcast_punishments()
+{
+#if defined(APOT)
+  apot_table_t* apt = &g_pot.apot_table;
+
+  // g_calc.ndim is set from idxlen once broadcast_params_mpi() is done
+  CHECK_RETURN(MPI_Bcast(&g_pot.opt_pot.idxlen, 1, MPI_INT, 0,
+                         g_mpi.leader_comm));
+  CHECK_RETURN(MPI_Bcast(&apt->total_par, 1, MPI_INT, 0, g_mpi.leader_comm));
+  CHECK_RETURN(MPI_Bcast(&apt->invar_pots, 1, MPI_INT, 0, g_mpi.leader_comm));
+  CHECK_RETURN(MPI_Bcast(&g_param.apot_punish_value, 1, MPI_DOUBLE, 0,
+                         g_mpi.leader_comm));
+
+  const int n = g_pot.opt_pot.idxlen;
+
+  if (n == 0)
+    return MPI_SUCCESS;
+
+  if (g_mpi.group > 0) {
+    g_pot.opt_pot.idx = (int*)Malloc(n * sizeof(int));
+    apt->idxpot = (int*)Realloc(apt->idxpot, n * sizeof(int));
+    apt->idxparam = (int*)Malloc(n * sizeof(int));
+  }
+
+  CHECK_RETURN(
+      MPI_Bcast(g_pot.opt_pot.idx, n, MPI_INT, 0, g_mpi.leader_comm));
+  CHECK_RETURN(MPI_Bcast(apt->idxpot, n, MPI_INT, 0, g_mpi.leader_comm));
+  CHECK_RETURN(MPI_Bcast(apt->idxparam, n, MPI_INT, 0, g_mpi.leader_comm));
+
+  int rows = 0;
+
+  for (int i = 0; i < n; i++)
+    rows = MAX(rows, apt->idxpot[i] + 1);
+
+  int len[rows];
+
+  for (int i = 0; i < rows; i++)
+    len[i] = 0;
+  for (int i = 0; i < n; i++)
+    len[apt->idxpot[i]] = MAX(len[apt->idxpot[i]], apt->idxparam[i] + 1);
+
+  if (g_mpi.group > 0) {
+    apt->pmin = (double**)Malloc(rows * sizeof(double*));
+    apt->pmax = (double**)Malloc(rows * sizeof(double*));
+    for (int i = 0; i < rows; i++) {
+      if (len[i] > 0) {
+        apt->pmin[i] = (double*)Malloc(len[i] * sizeof(double));
+        apt->pmax[i] = (double*)Malloc(len[i] * sizeof(double));
+      }
+    }
+  }
+
+  for (int i = 0; i < rows; i++) {
+    if (len[i] > 0) {
+      CHECK_RETURN(
+          MPI_Bcast(apt->pmin[i], len[i], MPI_DOUBLE, 0, g_mpi.leader_comm));
+      CHECK_RETURN(
+          MPI_Bcast(apt->pmax[i], len[i], MPI_DOUBLE, 0, g_mpi.leader_comm));
+    }
+  }
+#endif  // APOT
+
+  return MPI_SUCCESS;
+}
+
+/****************************************************************
+    rebalance_configurations
+      after g_param.rebalance force calculations the time each
+      process spent before collecting the results rescales the
+      estimated cost of its configurations, which are then
+      partitioned and sent anew
+****************************************************************/
+
+int rebalance_configurations()
+{
+  if (g_param.rebalance == 0 || ++g_mpi.num_evals != g_param.rebalance)
+    return MPI_SUCCESS;
+
+  double* times = NULL;
+  int changed = 0;
+
+  if (g_mpi.myid == 0)
+    times = (double*)Malloc(g_mpi.num_cpus * sizeof(double));
+
+  CHECK_RETURN(MPI_Gather(&g_mpi.eval_time, 1, MPI_DOUBLE, times, 1,
+                          MPI_DOUBLE, 0, MPI_COMM_WORLD));
+
+  if (g_mpi.myid == 0) {
+    double* cost = configuration_costs();
+    int* old_dist = (int*)malloc(g_mpi.num_cpus * sizeof(int));
+    double max_time = 0.0;
+    double sum_time = 0.0;
+
+    if (old_dist == NULL)
+      error(1, "Error in memory allocation for the configuration costs\n");
+
+    for (int i = 0; i < g_mpi.num_cpus; i++) {
+      int first = g_mpi.conf_dist[i];
+      int last = first + g_mpi.conf_len[i];
+      double model = 0.0;
+
+      for (int c = first; c < last; c++)
+        model += cost[c];
+      if (model > 0.0)
+        for (int c = first; c < last; c++)
+          cost[c] *= times[i] / model;
+
+      old_dist[i] = g_mpi.conf_dist[i];
+      max_time = MAX(max_time, times[i]);
+      sum_time += times[i];
+    }
+
+    split_configurations(cost);
+
+    for (int i = 0; i < g_mpi.num_cpus; i++)
+      if (g_mpi.conf_dist[i] != old_dist[i])
+        changed = 1;
+
+    printf("\nLoad imbalance after %d force calculations: %.1f%%",
+           g_mpi.num_evals,
+           100.0 * (max_time * g_mpi.num_cpus / sum_time - 1.0));
+    printf(changed ? ", redistributing the configurations.\n" : ".\n");
+
+    free(old_dist);
+    free(cost);
+  }
+
+  CHECK_RETURN(MPI_Bcast(&changed, 1, MPI_INT, 0, MPI_COMM_WORLD));
+
+  if (!changed)
+    return MPI_SUCCESS;
+
+  CHECK_RETURN(scatter_partition());
+  CHECK_RETURN(broadcast_configurations());
+  CHECK_RETURN(broadcast_atoms());
+  CHECK_RETURN(broadcast_neighbors());
+  CHECK_RETURN(broadcast_angles());
+
+#if defined(PAIR) || defined(EAM)
+  // the neighbor lists of the tabulated force routines are per configuration
+  if (g_config.conf_neigh != NULL)
+    init_neigh_lists();
+#endif  // PAIR || EAM
+
+#if defined(PAIR)
+  invalidate_column_cache();
+#endif  // PAIR
+
+#if defined(PAIR) && !defined(APOT)
+  if (g_param.design_matrix)
+    invalidate_design_matrix();
+#endif  // PAIR && !APOT
 
   return MPI_SUCCESS;
 }
@@ -730,7 +1155,8 @@ int broadcast_atoms()
 {
   atom_t atom;
 
-  g_config.conf_atoms = (atom_t*)Malloc(g_mpi.myatoms * sizeof(atom_t));
+  g_config.conf_atoms = (atom_t*)Realloc(
+      g_config.conf_atoms, MAX(1, g_mpi.myatoms) * sizeof(atom_t));
 
   for (int i = 0; i < g_config.natoms; i++) {
     if (g_mpi.myid == 0)
@@ -749,24 +1175,35 @@ int broadcast_atoms()
 
 int broadcast_neighbors()
 {
-  int num_neighs = 0;
+  int* num_neighs = (int*)Malloc(g_config.natoms * sizeof(int));
+  int my_neighs = 0;
   neigh_t neigh;
   atom_t* atom = NULL;
 
   memset(&neigh, 0, sizeof(neigh));
 
+  if (g_mpi.myid == 0)
+    for (int i = 0; i < g_config.natoms; ++i)
+      num_neighs[i] = g_config.atoms[i].num_neigh;
+  CHECK_RETURN(MPI_Bcast(num_neighs, g_config.natoms, MPI_INT, 0, MPI_COMM_WORLD));
+
+  // one array for the neighbors of all local atoms
+  for (int i = g_mpi.firstatom; i < g_mpi.firstatom + g_mpi.myatoms; ++i)
+    my_neighs += num_neighs[i];
+
+  if (my_neighs > 0) {
+    static neigh_t* neighs = NULL;
+    neighs = (neigh_t*)Realloc(neighs, my_neighs * sizeof(neigh_t));
+    neigh_t* arena = neighs;
+    for (int i = g_mpi.firstatom; i < g_mpi.firstatom + g_mpi.myatoms; ++i) {
+      g_config.conf_atoms[i - g_mpi.firstatom].neigh = arena;
+      arena += num_neighs[i];
+    }
+  }
+
   for (int i = 0; i < g_config.natoms; ++i) {
     atom = g_config.conf_atoms + i - g_mpi.firstatom;
-    if (g_mpi.myid == 0)
-      num_neighs = g_config.atoms[i].num_neigh;
-    CHECK_RETURN(MPI_Bcast(&num_neighs, 1, MPI_INT, 0, MPI_COMM_WORLD));
-    if (num_neighs > 0 && i >= g_mpi.firstatom &&
-        i < (g_mpi.firstatom + g_mpi.myatoms)) {
-      atom->neigh = (neigh_t*)Malloc(num_neighs * sizeof(neigh_t));
-      for (int j = 0; j < num_neighs; ++j)
-        memset(atom->neigh + j, 0, sizeof(neigh_t));
-    }
-    for (int j = 0; j < num_neighs; ++j) {
+    for (int j = 0; j < num_neighs[i]; ++j) {
       if (g_mpi.myid == 0)
         neigh = g_config.atoms[i].neigh[j];
       CHECK_RETURN(MPI_Bcast(&neigh, 1, g_mpi.MPI_NEIGH, 0, MPI_COMM_WORLD));
@@ -785,23 +1222,34 @@ int broadcast_neighbors()
 int broadcast_angles()
 {
 #if defined(THREEBODY)
-  int num_angles = 0;
+  int* num_angles = (int*)Malloc(g_config.natoms * sizeof(int));
+  int my_angles = 0;
   angle_t angle;
   atom_t* atom = NULL;
 
   memset(&angle, 0, sizeof(angle));
 
+  if (g_mpi.myid == 0)
+    for (int i = 0; i < g_config.natoms; ++i)
+      num_angles[i] = g_config.atoms[i].num_angles;
+  CHECK_RETURN(MPI_Bcast(num_angles, g_config.natoms, MPI_INT, 0, MPI_COMM_WORLD));
+
+  // one array for the angles of all local atoms
+  for (int i = g_mpi.firstatom; i < g_mpi.firstatom + g_mpi.myatoms; ++i)
+    my_angles += num_angles[i];
+
+  static angle_t* angles = NULL;
+  angles = (angle_t*)Realloc(angles, MAX(1, my_angles) * sizeof(angle_t));
+  angle_t* arena = angles;
+
+  for (int i = g_mpi.firstatom; i < g_mpi.firstatom + g_mpi.myatoms; ++i) {
+    g_config.conf_atoms[i - g_mpi.firstatom].angle_part = arena;
+    arena += num_angles[i];
+  }
+
   for (int i = 0; i < g_config.natoms; ++i) {
     atom = g_config.conf_atoms + i - g_mpi.firstatom;
-    if (g_mpi.myid == 0)
-      num_angles = g_config.atoms[i].num_angles;
-    CHECK_RETURN(MPI_Bcast(&num_angles, 1, MPI_INT, 0, MPI_COMM_WORLD));
-    if (i >= g_mpi.firstatom && i < (g_mpi.firstatom + g_mpi.myatoms)) {
-      atom->angle_part = (angle_t*)Malloc(num_angles * sizeof(angle_t));
-      for (int j = 0; j < num_angles; ++j)
-        memset(atom->angle_part + j, 0, sizeof(angle_t));
-    }
-    for (int j = 0; j < num_angles; ++j) {
+    for (int j = 0; j < num_angles[i]; ++j) {
       if (g_mpi.myid == 0)
         angle = g_config.atoms[i].angle_part[j];
       CHECK_RETURN(MPI_Bcast(&angle, 1, g_mpi.MPI_ANGL, 0, MPI_COMM_WORLD));
@@ -814,4 +1262,232 @@ int broadcast_angles()
   return MPI_SUCCESS;
 }
 
+/****************************************************************
+    broadcast_string
+****************************************************************/
+
+int broadcast_string(const char** str)
+{
+  int len = 0;
+
+  if (g_mpi.myid == 0)
+    len = strlen(*str) + 1;
+  CHECK_RETURN(MPI_Bcast(&len, 1, MPI_INT, 0, MPI_COMM_WORLD));
+  if (g_mpi.myid > 0)
+    *str = (const char*)Malloc(len * sizeof(char));
+  CHECK_RETURN(MPI_Bcast((char*)*str, len, MPI_CHAR, 0, MPI_COMM_WORLD));
+
+  return MPI_SUCCESS;
+}
+
+/****************************************************************
+    read_distributed_configurations
+      every process reads and builds its own configurations,
+      root collects the per-configuration data and the atoms
+      without their neighbor tables
+****************************************************************/
+
+int read_distributed_configurations()
+{
+  // everything needed to read the configurations and build the neighbor lists
+  CHECK_RETURN(MPI_Bcast(&g_param.ntypes, 1, MPI_INT, 0, MPI_COMM_WORLD));
+  CHECK_RETURN(MPI_Bcast(&g_config.natoms, 1, MPI_INT, 0, MPI_COMM_WORLD));
+  CHECK_RETURN(MPI_Bcast(&g_config.nconf, 1, MPI_INT, 0, MPI_COMM_WORLD));
+  CHECK_RETURN(MPI_Bcast(&g_calc.paircol, 1, MPI_INT, 0, MPI_COMM_WORLD));
+  CHECK_RETURN(MPI_Bcast(&g_pot.format_type, 1, MPI_INT, 0, MPI_COMM_WORLD));
+  CHECK_RETURN(MPI_Bcast(&g_param.global_cell_scale, 1, MPI_DOUBLE, 0,
+                         MPI_COMM_WORLD));
+  CHECK_RETURN(
+      MPI_Bcast(&g_config.rcutmin, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD));
+  CHECK_RETURN(
+      MPI_Bcast(&g_config.rcutmax, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD));
+
+  int n = g_param.ntypes;
+
+  if (g_mpi.myid > 0) {
+    g_config.rcut = (double*)Malloc(n * n * sizeof(double));
+    g_config.rmin = (double*)Malloc(n * n * sizeof(double));
+    g_config.elements = (const char**)Malloc(n * sizeof(char*));
+  }
+  CHECK_RETURN(
+      MPI_Bcast(g_config.rcut, n * n, MPI_DOUBLE, 0, MPI_COMM_WORLD));
+  CHECK_RETURN(
+      MPI_Bcast(g_config.rmin, n * n, MPI_DOUBLE, 0, MPI_COMM_WORLD));
+  for (int i = 0; i < n; i++)
+    CHECK_RETURN(broadcast_string(g_config.elements + i));
+  CHECK_RETURN(broadcast_string(&g_files.config));
+
+  CHECK_RETURN(broadcast_calcpot_table());
+  CHECK_RETURN(partition_configurations());
+
+  // file position of the first configuration of each process
+  long* offset = NULL;
+  int* line = NULL;
+  long myoffset = 0;
+  int myline = 0;
+
+  if (g_mpi.myid == 0) {
+    offset = (long*)Malloc(g_mpi.num_cpus * sizeof(long));
+    line = (int*)Malloc(g_mpi.num_cpus * sizeof(int));
+    for (int i = 0; i < g_mpi.num_cpus; i++) {
+      int c = MIN(g_mpi.conf_dist[i], g_config.nconf - 1);
+      offset[i] = g_config.conf_offset[c];
+      line[i] = g_config.conf_line[c];
+    }
+  }
+  CHECK_RETURN(MPI_Scatter(offset, 1, MPI_LONG, &myoffset, 1, MPI_LONG, 0,
+                           MPI_COMM_WORLD));
+  CHECK_RETURN(
+      MPI_Scatter(line, 1, MPI_INT, &myline, 1, MPI_INT, 0, MPI_COMM_WORLD));
+
+  // read the local configurations into an empty configuration table
+  potfit_configurations global = g_config;
+  int counts[3];
+  int init_done = g_mpi.init_done;
+
+  g_config.natoms = 0;
+  g_config.nconf = 0;
+  g_config.atoms = NULL;
+  g_config.na_type = NULL;
+  g_config.cnfstart = NULL;
+  g_config.inconf = NULL;
+  g_config.useforce = NULL;
+  g_config.coheng = NULL;
+  g_config.volume = NULL;
+  g_config.conf_weight = NULL;
+#if defined(STRESS)
+  g_config.usestress = NULL;
+  g_config.stress = NULL;
+#endif  // STRESS
+
+  double* mindist = init_mindist();
+
+  // an error in one process aborts the others through the MPI runtime
+  g_mpi.init_done = 0;
+  read_config_part(g_files.config, myoffset, myline, g_mpi.firstconf,
+                   g_mpi.myconf, mindist, counts, counts + 1, counts + 2);
+
+  potfit_configurations local = g_config;
+
+  g_config = global;
+
+  if (local.nconf != g_mpi.myconf || local.natoms != g_mpi.myatoms)
+    error(1, "Process %d read %d configurations with %d atoms instead of %d "
+             "with %d atoms\n",
+          g_mpi.myid, local.nconf, local.natoms, g_mpi.myconf, g_mpi.myatoms);
+
+  g_mpi.init_done = init_done;
+
+  // convert to global atom and configuration indices
+  for (int i = 0; i < g_mpi.myatoms; i++) {
+    local.atoms[i].conf += g_mpi.firstconf;
+    for (int j = 0; j < local.atoms[i].num_neigh; j++)
+      local.atoms[i].neigh[j].nr += g_mpi.firstatom;
+  }
+
+  g_config.conf_atoms = local.atoms;
+  g_config.conf_vol = local.volume;
+  g_config.conf_uf = local.useforce;
+#if defined(STRESS)
+  g_config.conf_us = local.usestress;
+#endif  // STRESS
+
+  // collect minimal distances and statistics on root
+  double* root_mindist = NULL;
+  int root_counts[3];
+
+  if (g_mpi.myid == 0)
+    root_mindist = (double*)Malloc(n * n * sizeof(double));
+  CHECK_RETURN(MPI_Reduce(mindist, root_mindist, n * n, MPI_DOUBLE, MPI_MIN, 0,
+                          MPI_COMM_WORLD));
+  CHECK_RETURN(MPI_Reduce(counts, root_counts, 1, MPI_INT, MPI_MAX, 0,
+                          MPI_COMM_WORLD));
+  CHECK_RETURN(MPI_Reduce(counts + 1, root_counts + 1, 2, MPI_INT, MPI_SUM, 0,
+                          MPI_COMM_WORLD));
+
+  // collect the configuration data on root
+  int nconf = g_config.nconf;
+  int* na_len = NULL;
+  int* na_dist = NULL;
+  int* na_type = NULL;
+  int* my_na_type = (int*)Malloc(MAX(1, g_mpi.myconf * n) * sizeof(int));
+
+  for (int i = 0; i < g_mpi.myconf; i++)
+    memcpy(my_na_type + i * n, local.na_type[i], n * sizeof(int));
+
+  if (g_mpi.myid == 0) {
+    g_config.coheng = (double*)Malloc(nconf * sizeof(double));
+    g_config.conf_weight = (double*)Malloc(nconf * sizeof(double));
+    g_config.volume = (double*)Malloc(nconf * sizeof(double));
+    g_config.useforce = (int*)Malloc(nconf * sizeof(int));
+#if defined(STRESS)
+    g_config.usestress = (int*)Malloc(nconf * sizeof(int));
+    g_config.stress = (sym_tens*)Malloc(nconf * sizeof(sym_tens));
+#endif  // STRESS
+    na_len = (int*)Malloc(g_mpi.num_cpus * sizeof(int));
+    na_dist = (int*)Malloc(g_mpi.num_cpus * sizeof(int));
+    for (int i = 0; i < g_mpi.num_cpus; i++) {
+      na_len[i] = g_mpi.conf_len[i] * n;
+      na_dist[i] = g_mpi.conf_dist[i] * n;
+    }
+    na_type = (int*)Malloc(nconf * n * sizeof(int));
+    g_config.na_type = (int**)Malloc((nconf + 1) * sizeof(int*));
+    for (int i = 0; i < nconf; i++)
+      g_config.na_type[i] = na_type + i * n;
+  }
+
+  CHECK_RETURN(MPI_Gatherv(local.coheng, g_mpi.myconf, MPI_DOUBLE,
+                           g_config.coheng, g_mpi.conf_len, g_mpi.conf_dist,
+                           MPI_DOUBLE, 0, MPI_COMM_WORLD));
+  CHECK_RETURN(MPI_Gatherv(local.conf_weight, g_mpi.myconf, MPI_DOUBLE,
+                           g_config.conf_weight, g_mpi.conf_len,
+                           g_mpi.conf_dist, MPI_DOUBLE, 0, MPI_COMM_WORLD));
+  CHECK_RETURN(MPI_Gatherv(local.volume, g_mpi.myconf, MPI_DOUBLE,
+                           g_config.volume, g_mpi.conf_len, g_mpi.conf_dist,
+                           MPI_DOUBLE, 0, MPI_COMM_WORLD));
+  CHECK_RETURN(MPI_Gatherv(local.useforce, g_mpi.myconf, MPI_INT,
+                           g_config.useforce, g_mpi.conf_len, g_mpi.conf_dist,
+                           MPI_INT, 0, MPI_COMM_WORLD));
+#if defined(STRESS)
+  CHECK_RETURN(MPI_Gatherv(local.usestress, g_mpi.myconf, MPI_INT,
+                           g_config.usestress, g_mpi.conf_len, g_mpi.conf_dist,
+                           MPI_INT, 0, MPI_COMM_WORLD));
+  CHECK_RETURN(MPI_Gatherv(local.stress, g_mpi.myconf, g_mpi.MPI_STENS,
+                           g_config.stress, g_mpi.conf_len, g_mpi.conf_dist,
+                           g_mpi.MPI_STENS, 0, MPI_COMM_WORLD));
+#endif  // STRESS
+  CHECK_RETURN(MPI_Gatherv(my_na_type, g_mpi.myconf * n, MPI_INT, na_type,
+                           na_len, na_dist, MPI_INT, 0, MPI_COMM_WORLD));
+
+  // root keeps the atoms for the error output, but no neighbor tables
+  MPI_Datatype atom_type;
+
+  CHECK_RETURN(MPI_Type_contiguous(sizeof(atom_t), MPI_BYTE, &atom_type));
+  CHECK_RETURN(MPI_Type_commit(&atom_type));
+
+  if (g_mpi.myid == 0)
+    g_config.atoms = (atom_t*)Malloc(g_config.natoms * sizeof(atom_t));
+
+  CHECK_RETURN(MPI_Gatherv(g_config.conf_atoms, g_mpi.myatoms, atom_type,
+                           g_config.atoms, g_mpi.atom_len, g_mpi.atom_dist,
+                           atom_type, 0, MPI_COMM_WORLD));
+  CHECK_RETURN(MPI_Type_free(&atom_type));
+
+  if (g_mpi.myid == 0) {
+    for (int i = 0; i < g_config.natoms; i++) {
+      g_config.atoms[i].num_neigh = 0;
+      g_config.atoms[i].neigh = NULL;
+#if defined(THREEBODY)
+      g_config.atoms[i].num_angles = 0;
+      g_config.atoms[i].angle_part = NULL;
+#endif  // THREEBODY
+    }
+
+    finish_config(root_mindist, root_counts[0], root_counts[1],
+                  root_counts[2]);
+  }
+
+  return MPI_SUCCESS;
+}
+
 #endif  // MPI
@@ -34,5 +34,6 @@ int initialize_mpi(int* argc, char*** argv);
 void shutdown_mpi();
 int broadcast_params_mpi();
 void potsync();
+int rebalance_configurations();
 
 #endif  // MPI_UTILS_H_INCLUDED
@@ -34,7 +34,12 @@
 // individual optimization algorithms
 void run_simulated_annealing(double* const xi);
 void run_differential_evolution(double* const xi);
+void run_cma_es(double* const xi);
 void run_powell_lsq(double* const xi);
+void run_levenberg_marquardt(double* const xi);
+#if defined(ADJOINT_GRADIENT)
+void run_lbfgs(double* const xi);
+#endif  // ADJOINT_GRADIENT
 
 void run_optimization()
 {
@@ -43,15 +48,36 @@ void run_optimization()
 
   double* xi = g_pot.opt_pot.table;
 
-#if !defined(EVO)
-  run_simulated_annealing(xi);
-#else
+#if defined(EVO)
   run_differential_evolution(xi);
-#endif  // !EVO
+#elif defined(CMAES)
+  run_cma_es(xi);
+#else
+  run_simulated_annealing(xi);
+#endif  // EVO
+
+#if defined(ADJOINT_GRADIENT)
+  if (g_param.opt == 3) {
+    printf("\nStarting L-BFGS minimization ...\n");
+
+    run_lbfgs(xi);
+
+    printf("\nFinished L-BFGS minimization, calculating errors ...\n");
+  } else
+#endif  // ADJOINT_GRADIENT
+  if (g_param.opt == 2) {
+    printf("\nStarting Levenberg-Marquardt minimization ...\n");
+
+    run_levenberg_marquardt(xi);
 
-  printf("\nStarting powell minimization ...\n");
+    printf(
+        "\nFinished Levenberg-Marquardt minimization, calculating errors "
+        "...\n");
+  } else {
+    printf("\nStarting powell minimization ...\n");
 
-  run_powell_lsq(xi);
+    run_powell_lsq(xi);
 
-  printf("\nFinished powell minimization, calculating errors ...\n");
+    printf("\nFinished powell minimization, calculating errors ...\n");
+  }
 }
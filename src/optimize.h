@@ -33,4 +33,8 @@
 // main optimization entry point
 void run_optimization();
 
+// helpers of the optimizers, see powell_lsq.c
+double** mat_double(int rowdim, int coldim);
+int break_flagfile(void);
+
 #endif  // OPTIMIZE_H_INCLUDED
@@ -43,6 +43,10 @@ void get_param_int(char const* param_name, int* value, int line,
                    char const* param_file, int min, int max);
 void get_param_string(char const* param_name, const char** value, int line,
                       char const* param_file);
+#if defined(MPI)
+void get_param_groups(char const* param_name, int line,
+                      char const* param_file);
+#endif  // MPI
 void check_parameters_complete(char const* paramfile);
 
 /****************************************************************
@@ -143,9 +147,39 @@ void read_parameter_file(char const* param_file)
     else if (strcasecmp(token, "config") == 0) {
       get_param_string("config", &g_files.config, line, param_file);
     }
-    // Optimization flag
+#if !defined(KIM)
+    // reuse configurations and neighbor lists from <config>.nbcache
+    else if (strcasecmp(token, "neigh_cache") == 0) {
+      get_param_int("neigh_cache", &g_param.neigh_cache, line, param_file, 0,
+                    1);
+    }
+#endif  // KIM
+#if defined(MPI) && !defined(KIM)
+    // every process reads and builds its own configurations
+    else if (strcasecmp(token, "distributed_input") == 0) {
+      get_param_int("distributed_input", &g_param.distributed_input, line,
+                    param_file, 0, 1);
+    }
+    // redistribute the configurations by the measured force calculation times
+    else if (strcasecmp(token, "rebalance") == 0) {
+      get_param_int("rebalance", &g_param.rebalance, line, param_file, 0,
+                    INT_MAX);
+    }
+    // keep the residuals and gamma of powell_lsq on their process
+    else if (strcasecmp(token, "distributed_lsq") == 0) {
+      get_param_int("distributed_lsq", &g_param.distributed_lsq, line,
+                    param_file, 0, 1);
+    }
+#endif  // MPI && !KIM
+    // evaluate this many parameter vectors in one pass over the neighbors
+    else if (strcasecmp(token, "batch_size") == 0) {
+      get_param_int("batch_size", &g_param.batch_size, line, param_file, 1,
+                    INT_MAX);
+    }
+    // Optimization flag: 1 = powell_lsq, 2 = levenberg-marquardt,
+    // 3 = l-bfgs
     else if (strcasecmp(token, "opt") == 0) {
-      get_param_int("opt", &g_param.opt, line, param_file, 0, 1);
+      get_param_int("opt", &g_param.opt, line, param_file, 0, 3);
     }
     // break flagfile
     else if (strcasecmp(token, "flagfile") == 0) {
@@ -178,6 +212,22 @@ void read_parameter_file(char const* param_file)
     else if (strcasecmp(token, "d_eps") == 0) {
       get_param_double("d_eps", &g_calc.d_eps, line, param_file, 0, DBL_MAX);
     }
+    // step lengths evaluated together in the line search
+    else if (strcasecmp(token, "linmin_points") == 0) {
+      get_param_int("linmin_points", &g_param.linmin_points, line, param_file,
+                    1, INT_MAX);
+    }
+    // keep gamma across the outer loops of powell_lsq with secant updates
+    else if (strcasecmp(token, "broyden_age") == 0) {
+      get_param_int("broyden_age", &g_param.broyden_age, line, param_file, 0,
+                    INT_MAX);
+    }
+#if defined(MPI)
+    // split the processes into groups evaluating the step lengths
+    else if (strcasecmp(token, "linmin_groups") == 0) {
+      get_param_groups("linmin_groups", line, param_file);
+    }
+#endif  // MPI
 
     // write final potential in lammps format
     else if (strcasecmp(token, "write_lammps") == 0) {
@@ -195,6 +245,11 @@ void read_parameter_file(char const* param_file)
       get_param_double("apot_punish", &g_param.apot_punish_value, line,
                        param_file, 0, DBL_MAX);
     }
+    // treat the parameter bounds as box constraints of the lm steps
+    else if (strcasecmp(token, "box_constraints") == 0) {
+      get_param_int("box_constraints", &g_param.box_constraints, line,
+                    param_file, 0, 1);
+    }
     // minimum for plotfile
     else if (strcasecmp(token, "plotmin") == 0) {
       get_param_double("plotmin", &g_param.plotmin, line, param_file, DBL_MIN,
@@ -213,7 +268,35 @@ void read_parameter_file(char const* param_file)
       get_param_string("maxchfile", &g_files.maxchfile, line, param_file);
       g_param.usemaxch = 1;
     }
+#if defined(PAIR)
+    // evaluate tabulated pair potentials with a sparse design matrix
+    else if (strcasecmp(token, "design_matrix") == 0) {
+      get_param_int("design_matrix", &g_param.design_matrix, line, param_file,
+                    0, 1);
+    }
+#endif  // PAIR
 #endif  // APOT
+#if defined(EXACT_JACOBIAN)
+    // build the normal equations of levenberg-marquardt block by block
+    else if (strcasecmp(token, "stream_jacobian") == 0) {
+      get_param_int("stream_jacobian", &g_param.stream_jacobian, line,
+                    param_file, 0, 1);
+    }
+#endif  // EXACT_JACOBIAN
+#if defined(ADJOINT_GRADIENT)
+    // number of correction pairs kept by the l-bfgs optimizer
+    else if (strcasecmp(token, "lbfgs_memory") == 0) {
+      get_param_int("lbfgs_memory", &g_param.lbfgs_memory, line, param_file,
+                    1, INT_MAX);
+    }
+#endif  // ADJOINT_GRADIENT
+#if defined(PAIR)
+    // only recompute the pair columns that changed since the last call
+    else if (strcasecmp(token, "column_cache") == 0) {
+      get_param_int("column_cache", &g_param.column_cache, line, param_file, 0,
+                    1);
+    }
+#endif  // PAIR
 
 #if defined(COULOMB)
     // cutoff-radius for long-range interactions
@@ -242,12 +325,61 @@ void read_parameter_file(char const* param_file)
       get_param_double("evo_threshold", &g_param.evo_threshold, line,
                        param_file, 0, DBL_MAX);
     }
+#if defined(MPI)
+    // split the processes into groups evaluating parts of the population
+    else if (strcasecmp(token, "evo_groups") == 0) {
+      get_param_groups("evo_groups", line, param_file);
+    }
+#endif  // MPI
+#elif defined(CMAES)
+    // stopping criterion for cma-es
+    else if (strcasecmp(token, "cmaes_threshold") == 0) {
+      get_param_double("cmaes_threshold", &g_param.cmaes_threshold, line,
+                       param_file, 0, DBL_MAX);
+    }
+    // initial step size of cma-es
+    else if (strcasecmp(token, "cmaes_sigma") == 0) {
+      get_param_double("cmaes_sigma", &g_param.cmaes_sigma, line, param_file,
+                       DBL_MIN, DBL_MAX);
+    }
+    // number of samples per generation
+    else if (strcasecmp(token, "cmaes_lambda") == 0) {
+      get_param_int("cmaes_lambda", &g_param.cmaes_lambda, line, param_file, 0,
+                    INT_MAX);
+    }
+#if defined(MPI)
+    // split the processes into groups evaluating parts of a generation
+    else if (strcasecmp(token, "cmaes_groups") == 0) {
+      get_param_groups("cmaes_groups", line, param_file);
+    }
+#endif  // MPI
 #else
     // starting temperature for annealing
     else if (strcasecmp(token, "anneal_temp") == 0) {
       get_param_string("anneal_temp", &g_param.anneal_temp, line, param_file);
     }
-#endif  // EVO
+    // number of chains for parallel tempering
+    else if (strcasecmp(token, "anneal_replicas") == 0) {
+      get_param_int("anneal_replicas", &g_param.anneal_replicas, line,
+                    param_file, 1, INT_MAX);
+    }
+    // temperature ratio of neighboring replicas, default 0.5
+    else if (strcasecmp(token, "anneal_ladder") == 0) {
+      get_param_double("anneal_ladder", &g_param.anneal_ladder, line,
+                       param_file, DBL_MIN, 1.0);
+    }
+    // number of proposals evaluated speculatively in one step
+    else if (strcasecmp(token, "anneal_speculate") == 0) {
+      get_param_int("anneal_speculate", &g_param.anneal_speculate, line,
+                    param_file, 1, INT_MAX);
+    }
+#if defined(MPI)
+    // split the processes into groups evaluating the replicas
+    else if (strcasecmp(token, "anneal_groups") == 0) {
+      get_param_groups("anneal_groups", line, param_file);
+    }
+#endif  // MPI
+#endif  // EVO || CMAES
 
 #if defined(PDIST)
     // file for pair distribution
@@ -319,6 +451,34 @@ void get_param_double(char const* param_name, double* value, int line,
   }
 }
 
+#if defined(MPI)
+
+/****************************************************************
+  read the number of process groups, the processes are split only
+  once for the whole run, so all *_groups keywords have to agree
+****************************************************************/
+
+void get_param_groups(char const* param_name, int line,
+                      char const* param_file)
+{
+  static char const* first_name = NULL;
+  int num_groups = 1;
+
+  get_param_int(param_name, &num_groups, line, param_file, 1, INT_MAX);
+
+  if (first_name != NULL && num_groups != g_param.num_groups)
+    error(1, "Conflicting values in parameter file %s (line %d): %s is %d, "
+             "but %s already requested %d groups\n",
+          param_file, line, param_name, num_groups, first_name,
+          g_param.num_groups);
+
+  if (first_name == NULL)
+    first_name = param_name;
+  g_param.num_groups = num_groups;
+}
+
+#endif  // MPI
+
 /****************************************************************
   read string value
 ****************************************************************/
@@ -397,10 +557,69 @@ void check_parameters_complete(char const* paramfile)
 #endif  // PAIR
 #endif  // APOT
 
+#if defined(APOT)
+  // the bounds are constraints of the levenberg-marquardt steps only
+  if (g_param.box_constraints && g_param.opt != 2) {
+    warning("box_constraints is only used with opt 2 (levenberg-marquardt)\n");
+    g_param.box_constraints = 0;
+  }
+#endif  // APOT
+
+#if defined(PAIR) && !defined(APOT)
+  if (g_param.design_matrix && g_param.column_cache) {
+    warning("column_cache is not used together with design_matrix\n");
+    g_param.column_cache = 0;
+  }
+#if defined(EXACT_JACOBIAN)
+  // the exact jacobian of tabulated potentials comes from the design matrix
+  if (g_param.stream_jacobian && !g_param.design_matrix) {
+    warning("stream_jacobian requires design_matrix\n");
+    g_param.stream_jacobian = 0;
+  }
+#endif  // EXACT_JACOBIAN
+#endif  // PAIR && !APOT
+
+#if !defined(ADJOINT_GRADIENT)
+  // l-bfgs needs the gradient of the error sum from calc_gradient
+  if (g_param.opt == 3) {
+    warning("opt 3 (l-bfgs) is not available for this interaction, "
+            "using powell_lsq\n");
+    g_param.opt = 1;
+  }
+#endif  // !ADJOINT_GRADIENT
+
+#if defined(EXACT_JACOBIAN)
+  // powell_lsq replaces single columns of the stored gamma, the streamed
+  // system is only solved by the damped steps of levenberg-marquardt
+  if (g_param.stream_jacobian && g_param.opt != 2) {
+    warning("stream_jacobian is only used with opt 2 (levenberg-marquardt)\n");
+    g_param.stream_jacobian = 0;
+  }
+#endif  // EXACT_JACOBIAN
+
+  // the secant updates follow the line searches of powell_lsq
+  if (g_param.broyden_age && g_param.opt != 1) {
+    warning("broyden_age is only used with opt 1 (powell_lsq)\n");
+    g_param.broyden_age = 0;
+  }
+#if defined(RESCALE)
+  // rescaling changes the potential between the line searches
+  if (g_param.broyden_age) {
+    warning("broyden_age is not available with rescale\n");
+    g_param.broyden_age = 0;
+  }
+#endif  // RESCALE
+
 #if defined(EVO)
     if (g_param.evo_threshold < 0)
       error(1, "Missing parameter or invalid value in %s : evo_threshold is"
                 "\"%f\"\n", paramfile, g_param.evo_threshold);
+#elif defined(CMAES)
+    // cma-es needs at least two samples to rank them
+    if (g_param.cmaes_lambda == 1) {
+      warning("cmaes_lambda has to be at least 2, using the default\n");
+      g_param.cmaes_lambda = 0;
+    }
 #else
     if (g_param.anneal_temp == NULL) {
       warning("anneal_temp not provided in %s, setting it to 0!\n", paramfile);
@@ -408,7 +627,20 @@ void check_parameters_complete(char const* paramfile)
       ((char*)g_param.anneal_temp)[0] = '0';
       ((char*)g_param.anneal_temp)[1] = '\0';
     }
-#endif  // EVO
+#if defined(RESCALE) || (defined(MEAM) && !defined(APOT))
+    // the replicas can not share the rescaled potential data
+    if (g_param.anneal_replicas > 1) {
+      warning("anneal_replicas is not available with rescale or tabulated "
+              "meam\n");
+      g_param.anneal_replicas = 1;
+    }
+    if (g_param.anneal_speculate > 1) {
+      warning("anneal_speculate is not available with rescale or tabulated "
+              "meam\n");
+      g_param.anneal_speculate = 1;
+    }
+#endif  // RESCALE || (MEAM && !APOT)
+#endif  // EVO || CMAES
 
 #if defined(PDIST)
   if (g_files.distfile == NULL)
@@ -420,4 +652,60 @@ void check_parameters_complete(char const* paramfile)
   if (g_param.global_cell_scale <= 0)
     error(1, "Missing parameter or invalid value in %s : cell_scale is \"%f\"\n",
           paramfile, g_param.global_cell_scale);
+
+#if defined(MPI)
+  // the root process does not have the neighbor lists of all atoms
+  if (g_param.distributed_input) {
+#if defined(RESCALE) || defined(PDIST)
+    error(1, "distributed_input can not be used with rescale or pdist\n");
+#endif  // RESCALE || PDIST
+    if (g_param.write_pair) {
+      warning("write_pair is not available with distributed_input\n");
+      g_param.write_pair = 0;
+    }
+    if (g_param.neigh_cache) {
+      warning("neigh_cache is not available with distributed_input\n");
+      g_param.neigh_cache = 0;
+    }
+    if (g_param.rebalance) {
+      warning("rebalance is not available with distributed_input\n");
+      g_param.rebalance = 0;
+    }
+  }
+
+  // every group of processes holds a copy of all configurations
+  if (g_param.num_groups > 1) {
+    if (g_mpi.num_cpus % g_param.num_groups != 0)
+      error(1, "The number of processes (%d) is not a multiple of the number "
+               "of groups (%d)\n", g_mpi.num_cpus, g_param.num_groups);
+    if (g_param.distributed_input)
+      error(1, "Groups of processes can not be used with distributed_input\n");
+    if (g_param.rebalance) {
+      warning("rebalance is not available with groups of processes\n");
+      g_param.rebalance = 0;
+    }
+#if !defined(EVO) && !defined(CMAES)
+    if (g_param.anneal_replicas == 1 && g_param.anneal_speculate == 1 &&
+        g_param.linmin_points == 1)
+      warning("The groups are only used with anneal_replicas, "
+              "anneal_speculate or linmin_points > 1\n");
+#endif  // !EVO && !CMAES
+  }
+
+  // the local residual rows are fixed while powell_lsq runs
+  if (g_param.distributed_lsq) {
+#if defined(COULOMB)
+    warning("distributed_lsq is not available with coulomb or dipole\n");
+    g_param.distributed_lsq = 0;
+#endif  // COULOMB
+    if (g_param.rebalance) {
+      warning("rebalance is not available with distributed_lsq\n");
+      g_param.rebalance = 0;
+    }
+    if (g_param.broyden_age) {
+      warning("broyden_age is not available with distributed_lsq\n");
+      g_param.broyden_age = 0;
+    }
+  }
+#endif  // MPI
 }
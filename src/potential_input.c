@@ -34,6 +34,7 @@
 #include "kim.h"
 #include "memory.h"
 #include "potential_input.h"
+#include "splines.h"
 #include "utils.h"
 
 void read_pot_line_F(char const* pbuf, potential_state* pstate);
@@ -54,6 +55,10 @@ void read_pot_table4(char const* potential_filename, FILE* pfile,
                      potential_state* pstate);
 void read_pot_table5(char const* potential_filename, FILE* pfile);
 
+#if defined(APOT)
+void init_calc_dtab(void);
+#endif  // APOT
+
 /****************************************************************
  *
  * read potential tables
@@ -398,6 +403,7 @@ void allocate_memory_for_potentials(potential_state* pstate)
   apt->end = (double*)Malloc(size * sizeof(double));
   apt->param_name = (char***)Malloc(size * sizeof(char**));
   apt->fvalue = (fvalue_pointer*)Malloc(size * sizeof(fvalue_pointer));
+  apt->fdparam = (fdparam_pointer*)Malloc(size * sizeof(fdparam_pointer));
 
 #if !defined(COULOMB)
 
@@ -413,11 +419,12 @@ void allocate_memory_for_potentials(potential_state* pstate)
     apt->pmax[size] = (double*)Malloc(g_param.ntypes * sizeof(double));
   } else
 #endif  // PAIR
-
-  apt->values = (double**)Malloc(size * sizeof(double*));
-  apt->invar_par = (int**)Malloc(size * sizeof(int*));
-  apt->pmin = (double**)Malloc(size * sizeof(double*));
-  apt->pmax = (double**)Malloc(size * sizeof(double*));
+  {
+    apt->values = (double**)Malloc(size * sizeof(double*));
+    apt->invar_par = (int**)Malloc(size * sizeof(int*));
+    apt->pmin = (double**)Malloc(size * sizeof(double*));
+    apt->pmax = (double**)Malloc(size * sizeof(double*));
+  }
 
 #else  // !COULOMB
   apt->ratio = (double*)Malloc(g_param.ntypes * sizeof(double));
@@ -654,4 +661,123 @@ void update_calc_table(double* xi_opt, double* xi_calc, int do_all)
   }
 }
 
+/****************************************************************
+  init_calc_dtab
+    assign the free parameters to the columns of g_pot.calc_pot
+****************************************************************/
+
+void init_calc_dtab(void)
+{
+  apot_dtab_t* dt = &g_pot.calc_dtab;
+  apot_table_t* apt = &g_pot.apot_table;
+  const int ncols = g_pot.calc_pot.ncols;
+
+  dt->slot_par = (int**)Malloc(ncols * sizeof(int*));
+  dt->num_par = (int*)Malloc(ncols * sizeof(int));
+  dt->par = (int**)Malloc(ncols * sizeof(int*));
+
+  for (int i = 0; i < ncols; i++) {
+    dt->slot_par[i] = (int*)Malloc(apt->n_par[i] * sizeof(int));
+    dt->par[i] = (int*)Malloc(g_calc.ndim * sizeof(int));
+    for (int j = 0; j < apt->n_par[i]; j++)
+      dt->slot_par[i][j] = -1;
+  }
+
+  for (int k = 0; k < g_calc.ndim; k++) {
+    int i = apt->idxpot[k];
+    int j = apt->idxparam[k];
+    if (i < ncols)
+      dt->slot_par[i][j] = k;
+    else if (g_pot.have_globals && i == g_pot.global_pot) {
+      for (int l = 0; l < apt->n_glob[j]; l++)
+        dt->slot_par[apt->global_idx[j][l][0]][apt->global_idx[j][l][1]] = k;
+    }
+  }
+
+  // list every free parameter only once per column
+  for (int i = 0; i < ncols; i++) {
+    for (int j = 0; j < apt->n_par[i]; j++) {
+      int k = dt->slot_par[i][j];
+      int l = 0;
+      while (k >= 0 && l < dt->num_par[i] && dt->par[i][l] != k)
+        l++;
+      if (k >= 0 && l == dt->num_par[i])
+        dt->par[i][dt->num_par[i]++] = k;
+    }
+  }
+
+  // derivative tables share the layout of g_pot.calc_pot
+  dt->dpot = (pot_table_t*)Malloc(g_calc.ndim * sizeof(pot_table_t));
+
+  for (int k = 0; k < g_calc.ndim; k++) {
+    dt->dpot[k] = g_pot.calc_pot;
+    dt->dpot[k].table = (double*)Malloc(g_pot.calc_pot.len * sizeof(double));
+    dt->dpot[k].d2tab = (double*)Malloc(g_pot.calc_pot.len * sizeof(double));
+  }
+}
+
+/****************************************************************
+  update_calc_table_dparam
+    derivatives of g_pot.calc_pot with respect to every free parameter,
+    requires a preceding update_calc_table(xi_opt, ...)
+****************************************************************/
+
+void update_calc_table_dparam(double* xi_opt)
+{
+  apot_dtab_t* dt = &g_pot.calc_dtab;
+  apot_table_t* apt = &g_pot.apot_table;
+  pot_table_t* calc = &g_pot.calc_pot;
+  static double* df = NULL;
+
+  if (dt->dpot == NULL) {
+    init_calc_dtab();
+    int nmax = 0;
+    for (int i = 0; i < calc->ncols; i++)
+      nmax = MAX(nmax, apt->n_par[i]);
+    df = (double*)Malloc(nmax * sizeof(double));
+  }
+
+  for (int i = 0; i < calc->ncols; i++) {
+    if (dt->num_par[i] == 0)
+      continue;
+
+    double* val = xi_opt + g_pot.opt_pot.first[i];
+    double h = g_pot.smooth_pot[i] ? val[apt->n_par[i] - 1] : 0.0;
+
+    for (int j = 0; j < APOT_STEPS; j++) {
+      int k = calc->first[i] + j;
+      double r = calc->xcoord[k];
+
+      apt->fdparam[i](r, val, df);
+
+      if (g_pot.smooth_pot[i]) {
+        double f = 0.0;
+        double cutoff = apot_cutoff(r, apt->end[i], h);
+        apt->fvalue[i](r, val, &f);
+        for (int l = 0; l < apt->n_par[i] - 1; l++)
+          df[l] *= cutoff;
+        df[apt->n_par[i] - 1] = f * apot_cutoff_dh(r, apt->end[i], h);
+      }
+
+      for (int l = 0; l < dt->num_par[i]; l++)
+        dt->dpot[dt->par[i][l]].table[k] = 0.0;
+
+      for (int l = 0; l < apt->n_par[i]; l++)
+        if (dt->slot_par[i][l] >= 0)
+          dt->dpot[dt->slot_par[i][l]].table[k] += df[l];
+    }
+
+    // the gradients of calc_pot are constant, which makes their derivatives
+    // vanish unless the spline has natural boundary conditions
+    double grad_left = (calc->table[calc->first[i] - 2] > 0.99e30) ? 1e30 : 0.0;
+    double grad_right = (calc->table[calc->first[i] - 1] > 0.99e30) ? 1e30 : 0.0;
+
+    for (int l = 0; l < dt->num_par[i]; l++) {
+      pot_table_t* dpot = dt->dpot + dt->par[i][l];
+      spline_ed(calc->step[i], dpot->table + calc->first[i], APOT_STEPS,
+                grad_left, grad_right, dpot->d2tab + calc->first[i]);
+    }
+  }
+}
+
 #endif  // APOT
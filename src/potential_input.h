@@ -44,6 +44,7 @@ void read_pot_table(char const* potential_filename);
 #if defined(APOT)
 void update_apot_table(double* xi);
 void update_calc_table(double* xi_opt, double* xi_calc, int do_all);
+void update_calc_table_dparam(double* xi_opt);
 #endif  // APOT
 
 #endif  // POTENTIAL_INPUT_H_INCLUDED
@@ -112,6 +112,13 @@ int main(int argc, char** argv)
 
   if (g_mpi.myid > 0) {
     start_mpi_worker(g_calc.force);
+#if defined(MPI)
+  } else if (g_mpi.group > 0) {
+    // root of another group of processes, see calc_errors()
+    init_force_common(1);
+    init_force(1);
+    run_group_root();
+#endif  // MPI
   } else {
 #if defined(MPI)
     if (g_mpi.num_cpus > g_config.nconf) {
@@ -138,6 +145,11 @@ int main(int argc, char** argv)
 
     time(&end_time);
 
+#if defined(MPI)
+    // the other groups are done, this also collects their force calculations
+    stop_groups();
+#endif  // MPI
+
 #if defined(APOT)
     double tot = calc_forces(g_pot.opt_pot.table, g_calc.force, 0);
 #else
@@ -288,6 +300,7 @@ void error(int done, const char* msg, ...)
   if (done == 1) {
 #if defined(MPI)
     if (g_mpi.init_done == 1) {
+      stop_groups();
       /* go wake up other threads */
       calc_forces(NULL, NULL, 1);
       shutdown_mpi();
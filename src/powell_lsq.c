@@ -1,7 +1,7 @@
 /****************************************************************
  *
- * powell_lsq.c: Contains Powell optimization algorithm
- *               and some small subroutines
+ * powell_lsq.c: Contains Powell and Levenberg-Marquardt optimization
+ *               algorithms and some small subroutines
  *
  ****************************************************************
  *
@@ -40,17 +40,27 @@
 #include "potfit.h"
 
 #if defined(MKL)
+#include <mkl_cblas.h>
 #include <mkl_lapack.h>
 #elif defined(ACML)
 #include <acml.h>
 #elif defined(__ACCELERATE__)
 #include <Accelerate/Accelerate.h>
+#elif defined(LAPACK)
+#include <cblas.h>
+/* Fortran LAPACK (reference or OpenBLAS) comes without a C header */
+void dsysvx_(const char*, const char*, const int*, const int*, const double*,
+             const int*, double*, const int*, int*, const double*, const int*,
+             double*, const int*, double*, double*, double*, double*,
+             const int*, int*, int*);
 #else
 #error No math library defined!
 #endif  // ACML
 
 #include "bracket.h"
+#include "design_matrix.h"
 #include "force.h"
+#include "functions.h"
 #include "memory.h"
 #include "optimize.h"
 #include "potential_input.h"
@@ -63,14 +73,127 @@
 #define VERY_SMALL 1.E-12
 #define INNERLOOPS 801
 #define TOOBIG 10000
+#define STREAM_ROWS 4096 /* rows of gamma per block in lineqsys_stream */
+#define LM_LAMBDA 1.E-3     /* initial damping of run_levenberg_marquardt */
+#define LM_LAMBDA_MIN 1.E-9
+#define LM_LAMBDA_MAX 1.E9
+#define BROYDEN_INFO 0.5 /* secant share that keeps a column of jac */
+#define BROYDEN_COS (1.0 - 1.E-6) /* columns closer to parallel are stale */
 
 int gamma_init(double**, double**, double*, double*);
+int gamma_normalize(double**, double**, int);
 int gamma_update(double**, double, double, double*, double*, double*, int, int,
                  int, double);
-void lineqsys_init(double**, double**, double*, double*, int, int);
+static double param_scale(int);
+static double gamma_step(double*, int);
+static int gamma_broyden(double**, double**, double**, double*, double*,
+                         double*);
+static void broyden_update(double*, double, double*, double*);
+static void broyden_columns(double*, double*, int);
+static void broyden_reset(void);
+static int use_broyden_update(int);
+void lineqsys_init(double**, double**, double*, const double*, double*, int,
+                   int);
 void lineqsys_update(double**, double**, double*, double*, int, int, int);
+static void normal_equations(double*, double*, double, double**, double*, int,
+                             int);
+static void gamma_t_vector(double**, double*, int, double, double*, int, int);
+static int lineqsys_solve(double**, double*, double*, double*, double*,
+                          double*);
+static int use_stream_jacobian(void);
+static double residual_weight(int, int);
+static int lineqsys_normalize(double**, double**, double*, int);
+#if defined(APOT)
+static void apot_limit_step(double*, double*, int);
+static int apot_active(double*, double, int);
+#endif  // APOT
+#if defined(EXACT_JACOBIAN)
+int lineqsys_stream(double*, double**, double**, double*, const double*,
+                    double*);
+static int have_exact_jacobian(void);
+static void exact_jacobian(double*, double**, int, int);
+#endif  // EXACT_JACOBIAN
+#if defined(MPI)
+static double dist_command(int, int, double*, double*, double, double);
+#endif  // MPI
 double normalize_vector(double*, int);
 
+#if defined(MPI)
+
+/****************************************************************
+ *
+ * distributed_lsq: the residuals stay on the process that calculated
+ *            them and every process keeps the rows of gamma for its
+ *            atoms and configurations, root holds the global rows.
+ *            Root sends each step with the calc_forces flag 4, the
+ *            contributions to lineqsys and p of all processes are
+ *            summed up with a single reduction.
+ *
+ *            The force vectors of root are only used as keys, every
+ *            one of them gets a slot with the local rows on each
+ *            process when it is passed to calc_forces.
+ *
+ ****************************************************************/
+
+typedef enum {
+  DIST_START,           /* keep the residuals from now on */
+  DIST_STOP,            /* collect them on root again */
+  DIST_COPY,            /* slot a = slot b */
+  DIST_GAMMA_INIT,      /* column i = (slot a - slot b) / x, normalized */
+  DIST_GAMMA_UPDATE,    /* see gamma_update, x = a - b and y = fmin */
+  DIST_LINEQSYS_INIT,   /* gamma^t.gamma and gamma^t.(slot a), weighted
+                           rows for i = 1 */
+  DIST_LINEQSYS_UPDATE  /* gamma^t.(column i) and gamma^t.(slot a) */
+} dist_task_t;
+
+typedef struct {
+  int task;
+  int i;
+  int a;
+  int b;
+  double x;
+  double y;
+} dist_cmd_t;
+
+static struct {
+  int n;          /* number of free parameters */
+  int nrows;      /* residual rows of this process */
+  int* row;       /* position of these rows in the force vector */
+  double** gamma; /* local rows of gamma */
+  double* weight; /* residual_weight of the local rows */
+  double* wf;     /* weighted residuals of a slot */
+  int nslots;     /* force vectors of root seen so far */
+  double** key;   /* force vector of root for every slot (root only) */
+  double** slot;  /* local rows of the force vector of every slot */
+  double* sum;    /* local contributions to lineqsys and p */
+  double** les;   /* the lineqsys part of sum */
+  double* total;  /* sum of all processes (root only) */
+} g_dist;
+
+#endif  // MPI
+
+/****************************************************************
+ *
+ * broyden_age: the derivatives in coordinate directions are kept
+ *            across the outer loops of powell_lsq and follow every
+ *            line search with a rank-one secant (Broyden) update.
+ *            A new outer loop builds gamma from them and only
+ *            recomputes the columns by finite differences that got
+ *            no secant information in broyden_age outer loops or
+ *            are nearly parallel to another column.
+ *
+ ****************************************************************/
+
+static struct {
+  double** jac;  /* derivatives of the forces in coordinate directions */
+  int* age;      /* outer loops since a column got new information */
+  double* info;  /* secant share of each column in this outer loop */
+  int* stale;    /* columns recomputed by finite differences */
+  double* s;     /* step of the last line search */
+  double* w;     /* s_i / scale_i^2 / |s|^2 in the scaled metric */
+  int reused;    /* columns of gamma taken from jac without recomputing */
+} g_broyden;
+
 double** mat_double(int rowdim, int coldim)
 {
   double** matrix = NULL;
@@ -96,8 +219,6 @@ double** mat_double(int rowdim, int coldim)
 
 void run_powell_lsq(double* xi)
 {
-  char fact[1] = "N";
-  char uplo[1] = "U"; // char used in dsysvx
   int n = 0;
   int breakflag = 0;
   double cond = 0.0;
@@ -113,18 +234,23 @@ void run_powell_lsq(double* xi)
   /* Direction vectors */
   double** d = mat_double(g_calc.ndim, g_calc.ndim);
 
+#if defined(MPI)
+  /* gamma and the residuals stay distributed over the processes */
+  const int dist = g_param.distributed_lsq;
+#else
+  const int dist = 0;
+#endif  // MPI
+
+  /* Keep the derivatives across the outer loops */
+  const int broyden = use_broyden_update(dist);
+  int retry = 0;
+
   /* Matrix of derivatives */
-  double** gamma = mat_double(g_calc.mdim, g_calc.ndim);
+  double** gamma = dist ? NULL : mat_double(g_calc.mdim, g_calc.ndim);
 
   /* Lin.Eq.Sys. Matrix */
   double** lineqsys = mat_double(g_calc.ndim, g_calc.ndim);
 
-  /* LU decomp. of the lineqsys */
-  double** les_inverse = mat_double(g_calc.ndim, g_calc.ndim);
-
-  /* Keeps track of LU pivoting */
-  int* perm_indx = (int*)Malloc(g_calc.ndim * sizeof(int));
-
   /* Normalized vector delta */
   double* delta_norm = (double*)Malloc(g_calc.ndimtot * sizeof(double));
 
@@ -139,22 +265,28 @@ void run_powell_lsq(double* xi)
   /* Vector pointing into correct dir'n */
   double* delta = (double*)Malloc(g_calc.ndimtot * sizeof(double)); /* ==0 */
 
-#if !defined(ACML) // work arrays not needed for ACML
-  int worksize = 64 * g_calc.ndim;
-  // work array to be used by dsysvx
-  double* work = (double*)Malloc(worksize * sizeof(double));
-  int* iwork = (int*)Malloc(g_calc.ndim * sizeof(int));
-#endif  // ACML
+#if defined(MPI)
+  if (dist)
+    dist_command(DIST_START, g_calc.ndim, NULL, NULL, 0.0, 0.0);
+#endif  // MPI
 
   /* calculate the first force */
   F1 = calc_forces(xi, forces_1, 0);
 
   if (F1 < VERY_SMALL) {
     printf("Error already too small to optimize, aborting ...\n");
+#if defined(MPI)
+    if (dist)
+      dist_command(DIST_STOP, 0, NULL, NULL, 0.0, 0.0);
+#endif  // MPI
     return;
   }
 
   memcpy(forces_2, forces_1, g_calc.mdim * sizeof(double));
+#if defined(MPI)
+  if (dist)
+    dist_command(DIST_COPY, 0, forces_2, forces_1, 0.0, 0.0);
+#endif  // MPI
 
 #if defined(APOT)
   printf("loops\t\terror_sum\tforce calculations\n");
@@ -170,7 +302,11 @@ void run_powell_lsq(double* xi)
     int m = 0;
 
     /* Init gamma */
-    int i = gamma_init(gamma, d, xi, forces_2);
+    int i = 0;
+    if (broyden)
+      i = gamma_broyden(gamma, d, lineqsys, p, xi, forces_1);
+    else
+      i = gamma_init(gamma, d, xi, forces_2);
 
     if (i != 0) {
 #if defined(RESCALE) && (defined(EAM) || defined(ADP) || defined(MEAM))
@@ -210,7 +346,9 @@ void run_powell_lsq(double* xi)
     }
 
     /*init LES */
-    lineqsys_init(gamma, lineqsys, forces_1, p, g_calc.ndim, g_calc.mdim);
+    if (!broyden)
+      lineqsys_init(gamma, lineqsys, forces_1, NULL, p, g_calc.ndim,
+                    g_calc.mdim);
 
     F3 = F1;
 
@@ -219,24 +357,9 @@ void run_powell_lsq(double* xi)
     /*inner loop - only calculate changed rows/lines in gamma */
     do {
       /* (a) solve linear equation */
+      int j = 0;
 
-      /* All in one driver routine */
-      int j = 1; /* 1 rhs */
-
-/* Linear Equation Solution (lapack) */
-#if defined(MKL)
-      dsysvx(fact, uplo, &g_calc.ndim, &j, &lineqsys[0][0], &g_calc.ndim,
-             &les_inverse[0][0], &g_calc.ndim, perm_indx, p, &g_calc.ndim, q,
-             &g_calc.ndim, &cond, &ferror, &berror, work, &worksize, iwork, &i);
-#elif defined(ACML)
-      dsysvx(fact[0], uplo[0], g_calc.ndim, j, &lineqsys[0][0], g_calc.ndim,
-             &les_inverse[0][0], g_calc.ndim, perm_indx, p, g_calc.ndim, q,
-             g_calc.ndim, &cond, &ferror, &berror, &i);
-#elif defined(__ACCELERATE__)
-      dsysvx_(fact, uplo, &g_calc.ndim, &j, &lineqsys[0][0], &g_calc.ndim,
-             &les_inverse[0][0], &g_calc.ndim, perm_indx, p, &g_calc.ndim, q,
-             &g_calc.ndim, &cond, &ferror, &berror, work, &worksize, iwork, &i);
-#endif
+      i = lineqsys_solve(lineqsys, p, q, &cond, &ferror, &berror);
 
 #if defined(DEBUG) && !(defined APOT)
       printf("q0: %d %f %f %f %f %f %f %f %f\n", i, q[0], q[1], q[2], q[3],
@@ -270,22 +393,7 @@ void run_powell_lsq(double* xi)
           breakflag = 1;
         }
 #else
-        if ((xi[g_pot.opt_pot.idx[i]] + delta[g_pot.opt_pot.idx[i]]) <
-            g_pot.apot_table.pmin[g_pot.apot_table.idxpot[i]]
-                                 [g_pot.apot_table.idxparam[i]]) {
-          delta[g_pot.opt_pot.idx[i]] =
-              g_pot.apot_table.pmin[g_pot.apot_table.idxpot[i]]
-                                   [g_pot.apot_table.idxparam[i]] -
-              xi[g_pot.opt_pot.idx[i]];
-        }
-        if ((xi[g_pot.opt_pot.idx[i]] + delta[g_pot.opt_pot.idx[i]]) >
-            g_pot.apot_table.pmax[g_pot.apot_table.idxpot[i]]
-                                 [g_pot.apot_table.idxparam[i]]) {
-          delta[g_pot.opt_pot.idx[i]] =
-              g_pot.apot_table.pmax[g_pot.apot_table.idxpot[i]]
-                                   [g_pot.apot_table.idxparam[i]] -
-              xi[g_pot.opt_pot.idx[i]];
-        }
+        apot_limit_step(xi, delta, i);
 #endif  // !APOT
       }
 
@@ -298,12 +406,16 @@ void run_powell_lsq(double* xi)
       F2 = F1; /*shift F */
 
       /* (c) minimize F(xi) along vector delta, return new F */
-      F1 = linmin(xi, delta, F1, &xi1, &xi2, forces_1, forces_2);
+      F1 = linmin(xi, delta, F1, &xi1, &xi2, &forces_1, &forces_2);
 
 #if defined(DEBUG)
       printf("%f %6g %f %f %d\n", F1, cond, ferror, berror, i);
 #endif  // DEBUG
 
+      /* the kept derivatives follow the step of the line search */
+      if (broyden)
+        broyden_update(delta_norm, xi1 - xi2, forces_1, forces_2);
+
       /* (d) if error estimate is too high after minimization
          in 5 directions: restart outer loop */
       if (ferror + berror > 1.0 && m > 5)
@@ -360,18 +472,8 @@ void run_powell_lsq(double* xi)
     fflush(stdout);
 
     /* End fit if break flagfile exists */
-    if (*g_files.flagfile != '\0') {
-      FILE* ff = fopen(g_files.flagfile, "r");
-      if (ff != NULL) {
-        printf(
-            "Fit terminated prematurely in presence of break flagfile "
-            "\"%s\"!\n",
-            g_files.flagfile);
-        fclose(ff);
-        remove(g_files.flagfile);
-        break;
-      }
-    }
+    if (break_flagfile())
+      break;
 
 /* WARNING: This rescaling is not necessary for EAM. Causes more problems. */
 #if defined(RESCALE) && (defined(xEAM) || defined(xMEAM))
@@ -395,11 +497,24 @@ void run_powell_lsq(double* xi)
       write_pot_table_potfit(g_files.tempfile);
     }
 
+    /* a kept gamma must not end the fit, check it with a new one */
+    retry = broyden && g_broyden.reused > 0 &&
+            !(((F3 - F1 > PRECISION / 10.0) || (F3 - F1 < 0)) &&
+              (F3 - F1 > g_calc.d_eps));
+    if (retry)
+      broyden_reset();
+
     /*End fit if whole series didn't improve F */
-  } while (((F3 - F1 > PRECISION / 10.0) || (F3 - F1 < 0)) &&
-           (F3 - F1 > g_calc.d_eps));
+  } while (retry || (((F3 - F1 > PRECISION / 10.0) || (F3 - F1 < 0)) &&
+                     (F3 - F1 > g_calc.d_eps)));
   /* outer loop */
 
+#if defined(MPI)
+  /* the final force calculation collects the residuals again */
+  if (dist)
+    dist_command(DIST_STOP, 0, NULL, NULL, 0.0, 0.0);
+#endif  // MPI
+
   if (fabs(F3 - F1) < PRECISION && F3 != F1)
     printf("Precision reached: %10g\n", F3 - F1);
   else if (F3 == F1)
@@ -416,6 +531,305 @@ void run_powell_lsq(double* xi)
 #endif  // APOT
 }
 
+/****************************************************************
+ *
+ * run_levenberg_marquardt: damped Gauss-Newton steps on the same
+ *            linear equation system as powell_lsq
+ *
+ *  The rows of gamma are weighted like the error sum (residual_weight),
+ *  so the steps minimize the error sum and not the plain sum of squares
+ *  of the force vector. The weighted columns are normalized, so
+ *  gamma^t.gamma has a unit diagonal and adding lambda to it damps
+ *  every parameter relative to its own curvature (Marquardt scaling).
+ *  A step that lowers the error is taken and lambda shrinks, else
+ *  lambda grows by a factor that doubles with every rejected step and
+ *  the system is solved again without recalculating gamma.
+ *
+ *  With box_constraints the parameter bounds are box constraints:
+ *  parameters at a bound whose descent direction points outwards are
+ *  taken out of the damped system (active set) and the step of the
+ *  others is projected onto the bounds, so no punishments arise.
+ *
+ ****************************************************************/
+
+void run_levenberg_marquardt(double* xi)
+{
+  int n = 0;
+  int m = 0;
+  double lambda = LM_LAMBDA;
+  double nu = 2.0;
+  double cond = 0.0;
+  double ferror = 0.0;
+  double berror = 0.0;
+  double F = 0.0;
+  double F_old = 0.0;
+
+  const int stream = use_stream_jacobian();
+
+#if defined(MPI)
+  /* gamma and the residuals stay distributed over the processes */
+  const int dist = g_param.distributed_lsq;
+#else
+  const int dist = 0;
+#endif  // MPI
+
+  /* Direction vectors, only the diagonal is used */
+  double** d = mat_double(g_calc.ndim, g_calc.ndim);
+
+  /* Matrix of derivatives */
+  double** gamma =
+      (stream || dist) ? NULL : mat_double(g_calc.mdim, g_calc.ndim);
+
+  /* gamma^t.gamma and the damped system solved for the step */
+  double** lineqsys = mat_double(g_calc.ndim, g_calc.ndim);
+  double** damped = mat_double(g_calc.ndim, g_calc.ndim);
+
+  double* p = (double*)Malloc(g_calc.ndim * sizeof(double));
+  double* q = (double*)Malloc(g_calc.ndim * sizeof(double));
+  double* delta = (double*)Malloc(g_calc.ndimtot * sizeof(double));
+  double* xi_new = (double*)Malloc(g_calc.ndimtot * sizeof(double));
+
+  /* right-hand side of the damped system and the fixed parameters */
+  double* rhs = (double*)Malloc(g_calc.ndim * sizeof(double));
+  int* fixed = (int*)Malloc(g_calc.ndim * sizeof(int));
+
+  /* calculated forces at xi and at xi_new */
+  double* forces = (double*)Malloc(g_calc.mdim * sizeof(double));
+  double* forces_new = (double*)Malloc(g_calc.mdim * sizeof(double));
+
+  /* rows of gamma are weighted like the error sum, the processes
+     weigh their own rows with distributed_lsq */
+  double* weight = (double*)Malloc(g_calc.mdim * sizeof(double));
+
+  for (int j = 0; j < g_calc.mdim && !dist; j++)
+    weight[j] = residual_weight(j, 0);
+
+#if defined(MPI)
+  if (dist)
+    dist_command(DIST_START, g_calc.ndim, NULL, NULL, 0.0, 0.0);
+#endif  // MPI
+
+#if defined(APOT)
+  /* steps stay inside the bounds, so the fit has to start there */
+  if (g_param.box_constraints && apot_project(xi))
+    printf("Parameters outside of their bounds were moved to the bounds.\n");
+#endif  // APOT
+
+  F = calc_forces(xi, forces, 0);
+
+  if (F < VERY_SMALL) {
+    printf("Error already too small to optimize, aborting ...\n");
+#if defined(MPI)
+    if (dist)
+      dist_command(DIST_STOP, 0, NULL, NULL, 0.0, 0.0);
+#endif  // MPI
+    return;
+  }
+
+#if defined(APOT)
+  printf("steps\t\terror_sum\tforce calculations\tlambda\n");
+  printf("%5d\t%17.6f\t%6d\t%13g\n", 0, F, g_calc.fcalls, lambda);
+#else
+  printf("%d %f %f %f %f %f %f %d\n", 0, F, xi[0], xi[1], xi[2], xi[3], xi[4],
+         g_calc.fcalls);
+#endif  // APOT
+  fflush(stdout);
+
+  do {
+    F_old = F;
+    m = 0; /* rejected steps */
+
+    /* gamma and the linear equation system at xi */
+#if defined(EXACT_JACOBIAN)
+    int i = stream ? lineqsys_stream(xi, d, lineqsys, forces, weight, p)
+                   : gamma_init(gamma, d, xi, forces);
+#else
+    int i = gamma_init(gamma, d, xi, forces);
+#endif  // EXACT_JACOBIAN
+
+    /* the weighted columns are normalized again */
+    if (i == 0 && !stream) {
+      lineqsys_init(gamma, lineqsys, forces, weight, p, g_calc.ndim,
+                    g_calc.mdim);
+      i = lineqsys_normalize(d, lineqsys, p, g_calc.ndim);
+    }
+
+    if (i != 0) {
+#if !defined(APOT)
+      write_pot_table_potfit(g_files.tempfile); /*emergency writeout */
+      warning("F does not depend on xi[%d], fit impossible!\n",
+              g_pot.opt_pot.idx[i - 1]);
+#else
+      update_apot_table(xi);
+      write_pot_table_potfit(g_files.tempfile);
+      warning(
+          "F does not depend on the %d. parameter (%s) of the %d. potential.\n",
+          g_pot.apot_table.idxparam[i - 1] + 1,
+          g_pot.apot_table.param_name[g_pot.apot_table.idxpot[i - 1]]
+                                     [g_pot.apot_table.idxparam[i - 1]],
+          g_pot.apot_table.idxpot[i - 1] + 1);
+      warning("Fit impossible!\n");
+#endif  // !APOT
+      break;
+    }
+
+#if defined(APOT)
+    /* active set: parameters at their bounds with the descent direction
+       pointing outwards keep their value in this step */
+    for (i = 0; i < g_calc.ndim; i++)
+      fixed[i] = g_param.box_constraints && apot_active(xi, d[i][i] * p[i], i);
+#endif  // APOT
+
+    while (lambda <= LM_LAMBDA_MAX) {
+      int reject = 0;
+
+      memcpy(damped[0], lineqsys[0],
+             g_calc.ndim * g_calc.ndim * sizeof(double));
+      memcpy(rhs, p, g_calc.ndim * sizeof(double));
+      for (i = 0; i < g_calc.ndim; i++) {
+        damped[i][i] += lambda;
+        if (fixed[i]) {
+          for (int j = 0; j < g_calc.ndim; j++)
+            damped[i][j] = damped[j][i] = 0.0;
+          damped[i][i] = 1.0;
+          rhs[i] = 0.0;
+        }
+      }
+
+      i = lineqsys_solve(damped, rhs, q, &cond, &ferror, &berror);
+
+      if (i > 0 && i <= g_calc.ndim)
+        reject = 1; /* singular, more damping helps */
+
+      memcpy(xi_new, xi, g_calc.ndimtot * sizeof(double));
+
+      for (i = 0; i < g_calc.ndim && !reject; i++) {
+        const int k = g_pot.opt_pot.idx[i];
+
+        delta[k] = 0.0;
+        for (int j = 0; j < g_calc.ndim; j++)
+          delta[k] += d[i][j] * q[j];
+
+#if !defined(APOT)
+        /* too large steps are rejected instead of restarting */
+        if (g_param.usemaxch && g_calc.maxchange[k] > 0 &&
+            fabs(delta[k]) > g_calc.maxchange[k])
+          reject = 1;
+#else
+        apot_limit_step(xi, delta, i);
+#endif  // !APOT
+
+        xi_new[k] += delta[k];
+      }
+
+      if (!reject) {
+        const double F_new = calc_forces(xi_new, forces_new, 0);
+
+        if (F_new < F) {
+          double* temp = forces;
+
+          memcpy(xi, xi_new, g_calc.ndimtot * sizeof(double));
+          forces = forces_new;
+          forces_new = temp;
+          F = F_new;
+          lambda = MAX(lambda / 3.0, LM_LAMBDA_MIN);
+          nu = 2.0;
+          break;
+        }
+      }
+
+      m++;
+      lambda *= nu;
+      nu *= 2.0;
+    }
+
+    n++;
+
+#if defined(APOT)
+    printf("%5d\t%17.6f\t%6d\t%13g\n", n, F, g_calc.fcalls, lambda);
+#else
+    printf("%d %f %f %f %f %f %f %d\n", n, F, xi[0], xi[1], xi[2], xi[3],
+           xi[4], g_calc.fcalls);
+#endif  // APOT
+    fflush(stdout);
+
+    /* End fit if break flagfile exists */
+    if (break_flagfile())
+      break;
+
+    /* write temp file  */
+    if (*g_files.tempfile != '\0') {
+#if defined(APOT)
+      update_apot_table(xi);
+#endif  // APOT
+      write_pot_table_potfit(g_files.tempfile);
+    }
+
+    /* a small improvement only counts if the step was not damped more */
+  } while (lambda <= LM_LAMBDA_MAX &&
+           ((F_old - F > PRECISION / 10.0 && F_old - F > g_calc.d_eps) ||
+            m > 0));
+
+#if defined(MPI)
+  /* the final force calculation collects the residuals again */
+  if (dist)
+    dist_command(DIST_STOP, 0, NULL, NULL, 0.0, 0.0);
+#endif  // MPI
+
+  if (lambda > LM_LAMBDA_MAX)
+    printf("Could not find any further improvements, aborting!\n");
+  else if (F_old - F > g_calc.d_eps)
+    printf("Precision reached: %10g\n", F_old - F);
+  else
+    printf("Last improvement was smaller than d_eps (%f), aborting!\n",
+           g_calc.d_eps);
+
+#if defined(APOT)
+  update_apot_table(xi);
+#endif  // APOT
+}
+
+/****************************************************************
+ *
+ * param_scale: typical size of the free parameter i, the range of
+ *            analytic parameters and 1 for tabulated potentials
+ *
+ ****************************************************************/
+
+static double param_scale(int i)
+{
+#if defined(APOT)
+  return g_pot.apot_table
+             .pmax[g_pot.apot_table.idxpot[i]][g_pot.apot_table.idxparam[i]] -
+         g_pot.apot_table
+             .pmin[g_pot.apot_table.idxpot[i]][g_pot.apot_table.idxparam[i]];
+#else
+  return 1.0;
+#endif  // APOT
+}
+
+/****************************************************************
+ *
+ * gamma_step: finite difference step of the free parameter i
+ *
+ ****************************************************************/
+
+static double gamma_step(double* xi, int i)
+{
+  double h = EPS * param_scale(i);
+
+#if defined(APOT)
+  /* use a backward difference at the upper bound */
+  if (g_param.box_constraints &&
+      xi[g_pot.opt_pot.idx[i]] + h >
+          g_pot.apot_table
+              .pmax[g_pot.apot_table.idxpot[i]][g_pot.apot_table.idxparam[i]])
+    h = -h;
+#endif  // APOT
+
+  return h;
+}
+
 /****************************************************************
  *
  * gamma_init: (Re-)Initialize gamma[j][i] (Gradient Matrix) after
@@ -427,59 +841,110 @@ void run_powell_lsq(double* xi)
 
 int gamma_init(double** gamma, double** d, double* xi, double* force_xi)
 {
-  static double* force;
-
-  double sum, temp, scale, store; /* Auxiliary var: Sum */
+  static double** force;
+  static double** xi_batch;
+  static double* error_batch;
 
   /* Set direction vectors to coordinate directions d_ij=KroneckerDelta_ij */
   for (int i = 0; i < g_calc.ndim; i++)
     for (int j = 0; j < g_calc.ndim; j++)
       d[i][j] = (i == j) ? 1.0 : 0.0;
 
-  /* Initialize gamma by calculating numerical derivatives */
-  if (force == NULL)
-    force = (double*)Malloc(g_calc.mdim * sizeof(double));
+#if defined(EXACT_JACOBIAN)
+  /* tabulated pair potentials are linear in xi, analytic potentials may
+     provide parameter derivatives for every function */
+  if (have_exact_jacobian()) {
+    memset(gamma[0], 0, g_calc.mdim * g_calc.ndim * sizeof(double));
+    exact_jacobian(xi, gamma, 0, g_config.nconf);
 
-  /*initialize gamma */
-  for (int i = 0; i < g_calc.ndim; i++) {
-    store = xi[g_pot.opt_pot.idx[i]];
-#if defined(APOT)
-    scale =
-        g_pot.apot_table
-            .pmax[g_pot.apot_table.idxpot[i]][g_pot.apot_table.idxparam[i]] -
-        g_pot.apot_table
-            .pmin[g_pot.apot_table.idxpot[i]][g_pot.apot_table.idxparam[i]];
-    xi[g_pot.opt_pot.idx[i]] += (EPS * scale);
-#else
-    scale = 1.0;
-    xi[g_pot.opt_pot.idx[i]] += EPS; /*increase xi[idx[i]]... */
-#endif  // APOT
-
-    sum = 0.0;
+    for (int i = 0; i < g_calc.ndim; i++)
+      if (gamma_normalize(gamma, d, i))
+        return i + 1; /* singular matrix, abort */
 
-    calc_forces(xi, force, 0);
+    return 0;
+  }
+#endif  // EXACT_JACOBIAN
+
+  /* Initialize gamma by calculating numerical derivatives, batch_size
+     columns are evaluated together by calc_forces_batch */
+  const int batch = MIN(g_param.batch_size, g_calc.ndim);
+  double step[batch]; /* finite difference steps */
+
+  if (force == NULL) {
+    force = (double**)Malloc(batch * sizeof(double*));
+    xi_batch = (double**)Malloc(batch * sizeof(double*));
+    error_batch = (double*)Malloc(batch * sizeof(double));
+    for (int b = 0; b < batch; b++) {
+      force[b] = (double*)Malloc(g_calc.mdim * sizeof(double));
+      xi_batch[b] = (double*)Malloc(g_calc.ndimtot * sizeof(double));
+    }
+  }
 
-    for (int j = 0; j < g_calc.mdim; j++) {
-      temp = (force[j] - force_xi[j]) / (EPS * scale);
-      gamma[j][i] = temp;
-      sum += dsquare(temp);
+  /*initialize gamma */
+  for (int i0 = 0; i0 < g_calc.ndim; i0 += batch) {
+    const int num = MIN(batch, g_calc.ndim - i0);
+
+    for (int b = 0; b < num; b++) {
+      const int i = i0 + b;
+      memcpy(xi_batch[b], xi, g_calc.ndimtot * sizeof(double));
+      step[b] = gamma_step(xi, i);
+      /* increase xi[idx[i]] in the copy of vector b */
+      xi_batch[b][g_pot.opt_pot.idx[i]] += step[b];
     }
 
-    temp = sqrt(sum);
+    calc_forces_batch(xi_batch, force, error_batch, num, 0);
 
-    xi[g_pot.opt_pot.idx[i]] = store; /*...and reset [idx[i]] again */
+    for (int b = 0; b < num; b++) {
+      const int i = i0 + b;
+
+#if defined(MPI)
+      if (g_mpi.distributed_lsq) {
+        const double temp = dist_command(DIST_GAMMA_INIT, i, force[b],
+                                         force_xi, step[b], 0.0);
+        if (temp <= VERY_SMALL)
+          return i + 1; /* singular matrix, abort */
+        d[i][i] /= temp; /* rescale d */
+        continue;
+      }
+#endif  // MPI
 
-    /* scale gamma so that sum_j(gamma^2)=1                      */
-    if (temp > VERY_SMALL) {
       for (int j = 0; j < g_calc.mdim; j++)
-        gamma[j][i] /= temp; /*normalize gamma */
-      d[i][i] /= temp;       /* rescale d */
-    } else
-      return i + 1; /* singular matrix, abort */
+        gamma[j][i] = (force[b][j] - force_xi[j]) / step[b];
+
+      if (gamma_normalize(gamma, d, i))
+        return i + 1; /* singular matrix, abort */
+    }
   }
   return 0;
 }
 
+/****************************************************************
+ *
+ * gamma_normalize: scale column i of gamma so that
+ *            sum_j(gamma^2)=1 and rescale the direction vector
+ *            accordingly, returns 1 if the column vanishes
+ *
+ ****************************************************************/
+
+int gamma_normalize(double** gamma, double** d, int i)
+{
+  double sum = 0.0;
+
+  for (int j = 0; j < g_calc.mdim; j++)
+    sum += dsquare(gamma[j][i]);
+
+  double temp = sqrt(sum);
+
+  if (temp <= VERY_SMALL)
+    return 1;
+
+  for (int j = 0; j < g_calc.mdim; j++)
+    gamma[j][i] /= temp; /*normalize gamma */
+  d[i][i] /= temp;       /* rescale d */
+
+  return 0;
+}
+
 /****************************************************************
  *
  * gamma_update: Update column j of gamma ( to newly calculated
@@ -495,6 +960,17 @@ int gamma_update(double** gamma, double a, double b, double* fa, double* fb,
   double sum = 0.0;
   double mu = 0.0;
 
+#if defined(MPI)
+  if (g_mpi.distributed_lsq) {
+    temp = dist_command(DIST_GAMMA_UPDATE, j, fa, fb, a - b, fmin);
+    if (temp <= VERY_SMALL)
+      return 1; /* Matrix will be singular: Restart! */
+    for (int i = 0; i < n; i++)
+      delta[i] /= temp;
+    return 0;
+  }
+#endif  // MPI
+
   for (int i = 0; i < m; i++) {
     temp = ((fa[i] - fb[i]) / (a - b));
     gamma[i][j] = temp;
@@ -524,56 +1000,946 @@ int gamma_update(double** gamma, double a, double b, double* fa, double* fb,
 
 /****************************************************************
  *
- * lineqsys_init: Initialize LinEqSys matrix, vector p in
- *              lineqsys . q == p
+ * gamma_broyden: gamma_init and lineqsys_init from the kept
+ *            derivatives g_broyden.jac, see broyden_age. Columns
+ *            that vanish or are nearly parallel to another one after
+ *            the secant updates are recomputed as well.
  *
  ****************************************************************/
 
-void lineqsys_init(double** gamma, double** lineqsys, double* deltaforce,
-                   double* p, int n, int m)
+static int gamma_broyden(double** gamma, double** d, double** lineqsys,
+                         double* p, double* xi, double* force_xi)
 {
-  /* calculating vector p (lineqsys . q == P in LinEqSys) */
-  for (int i = 0; i < n; i++) {
-    p[i] = 0.0;
-    for (int j = 0; j < m; j++) {
-      p[i] -= gamma[j][i] * deltaforce[j];
-    }
+  const int n = g_calc.ndim;
+  int* age = g_broyden.age;
+  int num = 0;
+
+  if (g_broyden.jac == NULL) {
+    g_broyden.jac = mat_double(g_calc.mdim, n);
+    g_broyden.age = (int*)Malloc(n * sizeof(int));
+    g_broyden.info = (double*)Malloc(n * sizeof(double));
+    g_broyden.stale = (int*)Malloc(n * sizeof(int));
+    g_broyden.s = (double*)Malloc(n * sizeof(double));
+    g_broyden.w = (double*)Malloc(n * sizeof(double));
+    age = g_broyden.age;
+    broyden_reset();
   }
 
-  /* calculating the linear equation system matrix gamma^t.gamma */
+  /* columns with enough secant information in the last outer loop
+     count as new */
   for (int i = 0; i < n; i++) {
-    lineqsys[i][i] = 0;
-    for (int j = 0; j < m; j++)
-      lineqsys[i][i] += dsquare(gamma[j][i]);
-    for (int k = i + 1; k < n; k++) {
-      lineqsys[i][k] = 0.0;
-      for (int j = 0; j < m; j++) {
-        lineqsys[i][k] += gamma[j][i] * gamma[j][k];
+    age[i] = (g_broyden.info[i] >= BROYDEN_INFO) ? 0 : age[i] + 1;
+    g_broyden.info[i] = 0.0;
+    if (age[i] >= g_param.broyden_age)
+      g_broyden.stale[num++] = i;
+  }
+
+  while (1) {
+    broyden_columns(xi, force_xi, num);
+
+    /* Set direction vectors to coordinate directions */
+    for (int i = 0; i < n; i++)
+      for (int j = 0; j < n; j++)
+        d[i][j] = (i == j) ? 1.0 : 0.0;
+
+    memcpy(gamma[0], g_broyden.jac[0], g_calc.mdim * n * sizeof(double));
+
+    num = 0;
+    for (int i = 0; i < n; i++) {
+      if (gamma_normalize(gamma, d, i)) {
+        if (age[i] == 0)
+          return i + 1; /* singular matrix, abort */
+        g_broyden.stale[num++] = i;
+      }
+    }
+
+    if (num > 0)
+      continue;
+
+    lineqsys_init(gamma, lineqsys, force_xi, NULL, p, n, g_calc.mdim);
+
+    /* the columns of gamma are normalized, lineqsys holds the cosines */
+    for (int i = 0; i < n; i++) {
+      for (int k = 0; k < i; k++) {
+        if (fabs(lineqsys[i][k]) > BROYDEN_COS) {
+          const int c = (age[i] > 0) ? i : k;
+          if (age[c] > 0) {
+            g_broyden.stale[num++] = c;
+            age[c] = 0;
+          }
+        }
       }
-      lineqsys[k][i] = lineqsys[i][k];
     }
+
+    if (num == 0)
+      break;
   }
+
+  g_broyden.reused = 0;
+  for (int i = 0; i < n; i++)
+    if (age[i] > 0)
+      g_broyden.reused++;
+
+  return 0;
 }
 
 /****************************************************************
  *
- * lineqsys_update: Update LinEqSys matrix row and column i, vector
- *            p.
+ * broyden_columns: recompute the columns g_broyden.stale[0 ... num-1]
+ *            of g_broyden.jac by finite differences at xi
  *
  ****************************************************************/
 
-void lineqsys_update(double** gamma, double** lineqsys, double* force_xi,
-                     double* p, int i, int n, int m)
+static void broyden_columns(double* xi, double* force_xi, int num)
 {
-  for (int k = 0; k < n; k++) {
-    p[k] = 0.0;
+  static double** force;
+  static double** xi_batch;
+  static double* error_batch;
+
+  const int batch = MIN(g_param.batch_size, g_calc.ndim);
+  double step[batch];
+
+  if (force == NULL) {
+    force = (double**)Malloc(batch * sizeof(double*));
+    xi_batch = (double**)Malloc(batch * sizeof(double*));
+    error_batch = (double*)Malloc(batch * sizeof(double));
+    for (int b = 0; b < batch; b++) {
+      force[b] = (double*)Malloc(g_calc.mdim * sizeof(double));
+      xi_batch[b] = (double*)Malloc(g_calc.ndimtot * sizeof(double));
+    }
+  }
 
-    lineqsys[i][k] = 0.0;
+  for (int c0 = 0; c0 < num; c0 += batch) {
+    const int nb = MIN(batch, num - c0);
 
-    for (int j = 0; j < m; j++) {
-      p[k] -= gamma[j][k] * force_xi[j];
-      lineqsys[i][k] += gamma[j][i] * gamma[j][k];
+    for (int b = 0; b < nb; b++) {
+      const int i = g_broyden.stale[c0 + b];
+      memcpy(xi_batch[b], xi, g_calc.ndimtot * sizeof(double));
+      step[b] = gamma_step(xi, i);
+      xi_batch[b][g_pot.opt_pot.idx[i]] += step[b];
+    }
+
+    calc_forces_batch(xi_batch, force, error_batch, nb, 0);
+
+    for (int b = 0; b < nb; b++) {
+      const int i = g_broyden.stale[c0 + b];
+      for (int j = 0; j < g_calc.mdim; j++)
+        g_broyden.jac[j][i] = (force[b][j] - force_xi[j]) / step[b];
+      g_broyden.age[i] = 0;
     }
-    lineqsys[k][i] = lineqsys[i][k];
   }
 }
+
+/****************************************************************
+ *
+ * broyden_update: rank-one update of g_broyden.jac with the secant
+ *            fa - fb of the step h * delta, in the metric of the
+ *            scaled parameters xi[idx[i]] / param_scale(i)
+ *
+ ****************************************************************/
+
+static void broyden_update(double* delta, double h, double* fa, double* fb)
+{
+  const int n = g_calc.ndim;
+  double* s = g_broyden.s;
+  double* w = g_broyden.w;
+  double norm = 0.0;
+
+  for (int i = 0; i < n; i++) {
+    const double scale = param_scale(i);
+    s[i] = h * delta[g_pot.opt_pot.idx[i]];
+    w[i] = s[i] / (scale * scale);
+    norm += s[i] * w[i];
+  }
+
+  if (norm <= VERY_SMALL * VERY_SMALL)
+    return;
+
+  for (int i = 0; i < n; i++) {
+    w[i] /= norm;
+    g_broyden.info[i] += s[i] * w[i];
+  }
+
+  /* jac += (fa - fb - jac.s) w^t, afterwards jac.s == fa - fb */
+  for (int j = 0; j < g_calc.mdim; j++) {
+    double* row = g_broyden.jac[j];
+    double r = fa[j] - fb[j];
+
+    for (int i = 0; i < n; i++)
+      r -= row[i] * s[i];
+
+    for (int i = 0; i < n; i++)
+      row[i] += r * w[i];
+  }
+}
+
+/****************************************************************
+ *
+ * broyden_reset: recompute all columns in the next gamma_broyden
+ *
+ ****************************************************************/
+
+static void broyden_reset(void)
+{
+  for (int i = 0; i < g_calc.ndim; i++) {
+    g_broyden.age[i] = g_param.broyden_age;
+    g_broyden.info[i] = 0.0;
+  }
+}
+
+/****************************************************************
+ *
+ * lineqsys_init: Initialize LinEqSys matrix, vector p in
+ *              lineqsys . q == p
+ *
+ *              gamma is stored contiguously with m rows of length n,
+ *              BLAS sees it as the column-major n x m matrix gamma^t
+ *
+ *              If weight is given (see residual_weight) the rows of
+ *              gamma are scaled by it in place.
+ *
+ ****************************************************************/
+
+void lineqsys_init(double** gamma, double** lineqsys, double* deltaforce,
+                   const double* weight, double* p, int n, int m)
+{
+  static double* wf; /* weighted deltaforce */
+
+#if defined(MPI)
+  if (g_mpi.distributed_lsq) {
+    /* every process adds the contribution of its rows */
+    dist_command(DIST_LINEQSYS_INIT, weight != NULL, deltaforce, NULL, 0.0,
+                 0.0);
+    memcpy(lineqsys[0], g_dist.total, n * n * sizeof(double));
+    memcpy(p, g_dist.total + n * n, n * sizeof(double));
+  } else
+#endif  // MPI
+  if (weight != NULL) {
+    if (wf == NULL)
+      wf = (double*)Malloc(m * sizeof(double));
+
+    for (int j = 0; j < m; j++) {
+      for (int i = 0; i < n; i++)
+        gamma[j][i] *= weight[j];
+      wf[j] = weight[j] * deltaforce[j];
+    }
+
+    normal_equations(&gamma[0][0], wf, 0.0, lineqsys, p, n, m);
+  } else
+  /* calculating vector p (lineqsys . q == P in LinEqSys) and the
+     linear equation system matrix gamma^t.gamma */
+  normal_equations(&gamma[0][0], deltaforce, 0.0, lineqsys, p, n, m);
+
+  /* only one triangle was set, lineqsys_update needs both */
+  for (int i = 0; i < n; i++)
+    for (int k = i + 1; k < n; k++)
+      lineqsys[i][k] = lineqsys[k][i];
+}
+
+/****************************************************************
+ *
+ * lineqsys_normalize: normalize the columns of gamma in lineqsys and p
+ *            and rescale the diagonal direction vectors d accordingly,
+ *            see gamma_normalize. Only the lower triangle of lineqsys
+ *            is read.
+ *
+ ****************************************************************/
+
+static int lineqsys_normalize(double** d, double** lineqsys, double* p, int n)
+{
+  double scale[n];
+
+  for (int i = 0; i < n; i++) {
+    double temp = sqrt(lineqsys[i][i]);
+
+    if (temp <= VERY_SMALL)
+      return i + 1; /* singular matrix, abort */
+
+    scale[i] = 1.0 / temp;
+    d[i][i] *= scale[i];
+  }
+
+  for (int i = 0; i < n; i++) {
+    p[i] *= scale[i];
+    for (int k = i; k < n; k++) {
+      lineqsys[k][i] *= scale[i] * scale[k];
+      lineqsys[i][k] = lineqsys[k][i];
+    }
+  }
+
+  return 0;
+}
+
+/****************************************************************
+ *
+ * lineqsys_update: Update LinEqSys matrix row and column i, vector
+ *            p.
+ *
+ ****************************************************************/
+
+void lineqsys_update(double** gamma, double** lineqsys, double* force_xi,
+                     double* p, int i, int n, int m)
+{
+#if defined(MPI)
+  if (g_mpi.distributed_lsq) {
+    /* every process adds the contribution of its rows */
+    dist_command(DIST_LINEQSYS_UPDATE, i, force_xi, NULL, 0.0, 0.0);
+    memcpy(lineqsys[i], g_dist.total, n * sizeof(double));
+    memcpy(p, g_dist.total + n, n * sizeof(double));
+  } else
+#endif  // MPI
+  {
+    gamma_t_vector(gamma, force_xi, 1, -1.0, p, n, m);
+
+    /* row i is gamma^t times column i of gamma */
+    gamma_t_vector(gamma, &gamma[0][i], n, 1.0, lineqsys[i], n, m);
+  }
+
+  for (int k = 0; k < n; k++)
+    lineqsys[k][i] = lineqsys[i][k];
+}
+
+#if defined(EXACT_JACOBIAN)
+
+/****************************************************************
+ *
+ * lineqsys_stream: Initialize LinEqSys matrix and vector p from the
+ *            exact derivatives without storing gamma. The rows of
+ *            a few configurations at a time are calculated into a
+ *            block and added to gamma^t.gamma and p, the columns of
+ *            gamma are normalized afterwards as in gamma_init.
+ *            The rows are scaled by weight if given.
+ *
+ ****************************************************************/
+
+int lineqsys_stream(double* xi, double** d, double** lineqsys,
+                    double* force_xi, const double* weight, double* p)
+{
+  static double** rows;  /* rows of gamma, only set for the block */
+  static double* block;  /* derivatives of the rows in the block */
+  static double* block_f; /* force_xi of the rows in the block */
+  static int* block_idx;  /* position of the rows in the force vector */
+  static int size;
+  const int n = g_calc.ndim;
+#if defined(STRESS)
+  const int nstress = 6;
+#else
+  const int nstress = 0;
+#endif  // STRESS
+
+/* rows added with the last configuration (constraints, punishments) */
+#if defined(EAM) || defined(ADP) || defined(MEAM)
+  const int tail = g_calc.dummy_p;
+#elif defined(APOT)
+  const int tail = g_calc.punish_par_p;
+#else
+  const int tail = g_calc.mdim;
+#endif  // EAM || ADP || MEAM
+
+  if (rows == NULL) {
+    size = STREAM_ROWS;
+    for (int c = 0; c < g_config.nconf; c++)
+      size = MAX(size, 3 * g_config.inconf[c] + 1 + nstress);
+    size += g_calc.mdim - tail;
+    rows = (double**)Malloc(g_calc.mdim * sizeof(double*));
+    block = (double*)Malloc(size * n * sizeof(double));
+    block_f = (double*)Malloc(size * sizeof(double));
+    block_idx = (int*)Malloc(size * sizeof(int));
+  }
+
+  /* Set direction vectors to coordinate directions d_ij=KroneckerDelta_ij */
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++)
+      d[i][j] = (i == j) ? 1.0 : 0.0;
+
+  for (int c0 = 0, c1 = 0; c0 < g_config.nconf; c0 = c1) {
+    int num = 0;
+
+    /* collect the rows of as many configurations as fit into the block */
+    for (c1 = c0; c1 < g_config.nconf; c1++) {
+      const int len = 3 * g_config.inconf[c1] + 1 + nstress;
+
+      if (c1 > c0 && num + len > size - (g_calc.mdim - tail))
+        break;
+
+      for (int k = 0; k < 3 * g_config.inconf[c1]; k++)
+        block_idx[num++] = 3 * g_config.cnfstart[c1] + k;
+      block_idx[num++] = g_calc.energy_p + c1;
+#if defined(STRESS)
+      for (int k = 0; k < 6; k++)
+        block_idx[num++] = g_calc.stress_p + 6 * c1 + k;
+#endif  // STRESS
+    }
+
+    if (c1 == g_config.nconf)
+      for (int j = tail; j < g_calc.mdim; j++)
+        block_idx[num++] = j;
+
+    for (int k = 0; k < num; k++) {
+      rows[block_idx[k]] = block + k * n;
+      block_f[k] = force_xi[block_idx[k]];
+    }
+
+    memset(block, 0, num * n * sizeof(double));
+
+    exact_jacobian(xi, rows, c0, c1);
+
+    if (weight != NULL)
+      for (int k = 0; k < num; k++) {
+        for (int i = 0; i < n; i++)
+          block[k * n + i] *= weight[block_idx[k]];
+        block_f[k] *= weight[block_idx[k]];
+      }
+
+    normal_equations(block, block_f, (c0 == 0) ? 0.0 : 1.0, lineqsys, p, n,
+                     num);
+
+    for (int k = 0; k < num; k++)
+      rows[block_idx[k]] = NULL;
+  }
+
+  return lineqsys_normalize(d, lineqsys, p, n);
+}
+
+/****************************************************************
+ *
+ * have_exact_jacobian: check if exact_jacobian can be used
+ *
+ ****************************************************************/
+
+static int have_exact_jacobian(void)
+{
+#if defined(APOT)
+  /* analytic potentials with parameter derivatives for every function */
+  return apot_check_dparam();
+#else
+  return g_param.design_matrix;
+#endif  // APOT
+}
+
+/****************************************************************
+ *
+ * exact_jacobian: add the exact derivatives of the rows of the
+ *            configurations first ... last - 1 to gamma
+ *
+ ****************************************************************/
+
+static void exact_jacobian(double* xi, double** gamma, int first, int last)
+{
+#if defined(APOT)
+  calc_jacobian(xi, gamma, first, last);
+#else
+  design_matrix_jacobian(xi, gamma, first, last);
+#endif  // APOT
+}
+
+#endif  // EXACT_JACOBIAN
+
+/****************************************************************
+ *
+ * normal_equations: lineqsys = beta * lineqsys + a^t.a (only the upper
+ *            triangle for BLAS, see lineqsys_init) and
+ *            p = beta * p - a^t.f for m rows a of gamma
+ *
+ ****************************************************************/
+
+static void normal_equations(double* a, double* f, double beta,
+                             double** lineqsys, double* p, int n, int m)
+{
+#if defined(ACML)
+  dsyrk('U', 'N', n, m, 1.0, a, n, beta, &lineqsys[0][0], n);
+  dgemv('N', n, m, -1.0, a, n, f, 1, beta, p, 1);
+#else
+  cblas_dsyrk(CblasColMajor, CblasUpper, CblasNoTrans, n, m, 1.0, a, n, beta,
+              &lineqsys[0][0], n);
+  cblas_dgemv(CblasColMajor, CblasNoTrans, n, m, -1.0, a, n, f, 1, beta, p, 1);
+#endif  // ACML
+}
+
+/****************************************************************
+ *
+ * gamma_t_vector: y = alpha * gamma^t . x, x has m elements with
+ *            stride incx
+ *
+ ****************************************************************/
+
+static void gamma_t_vector(double** gamma, double* x, int incx, double alpha,
+                           double* y, int n, int m)
+{
+#if defined(ACML)
+  dgemv('N', n, m, alpha, &gamma[0][0], n, x, incx, 0.0, y, 1);
+#else
+  cblas_dgemv(CblasColMajor, CblasNoTrans, n, m, alpha, &gamma[0][0], n, x,
+              incx, 0.0, y, 1);
+#endif  // ACML
+}
+
+/****************************************************************
+ *
+ * lineqsys_solve: solve lineqsys . q == p with the lapack driver
+ *            dsysvx, returns its info value (> 0 if singular)
+ *
+ ****************************************************************/
+
+static int lineqsys_solve(double** lineqsys, double* p, double* q,
+                          double* cond, double* ferror, double* berror)
+{
+  static double** les_inverse; /* LU decomp. of the lineqsys */
+  static int* perm_indx;       /* Keeps track of LU pivoting */
+  char fact[1] = "N";
+  char uplo[1] = "U"; // char used in dsysvx
+  int j = 1;          /* 1 rhs */
+  int info = 0;
+#if !defined(ACML) // work arrays not needed for ACML
+  static double* work; // work array to be used by dsysvx
+  static int* iwork;
+  int worksize = 64 * g_calc.ndim;
+
+  if (work == NULL) {
+    work = (double*)Malloc(worksize * sizeof(double));
+    iwork = (int*)Malloc(g_calc.ndim * sizeof(int));
+  }
+#endif  // ACML
+
+  if (les_inverse == NULL) {
+    les_inverse = mat_double(g_calc.ndim, g_calc.ndim);
+    perm_indx = (int*)Malloc(g_calc.ndim * sizeof(int));
+  }
+
+/* Linear Equation Solution (lapack) */
+#if defined(MKL)
+  dsysvx(fact, uplo, &g_calc.ndim, &j, &lineqsys[0][0], &g_calc.ndim,
+         &les_inverse[0][0], &g_calc.ndim, perm_indx, p, &g_calc.ndim, q,
+         &g_calc.ndim, cond, ferror, berror, work, &worksize, iwork, &info);
+#elif defined(ACML)
+  dsysvx(fact[0], uplo[0], g_calc.ndim, j, &lineqsys[0][0], g_calc.ndim,
+         &les_inverse[0][0], g_calc.ndim, perm_indx, p, g_calc.ndim, q,
+         g_calc.ndim, cond, ferror, berror, &info);
+#elif defined(__ACCELERATE__) || defined(LAPACK)
+  dsysvx_(fact, uplo, &g_calc.ndim, &j, &lineqsys[0][0], &g_calc.ndim,
+          &les_inverse[0][0], &g_calc.ndim, perm_indx, p, &g_calc.ndim, q,
+          &g_calc.ndim, cond, ferror, berror, work, &worksize, iwork, &info);
+#endif
+
+  return info;
+}
+
+/****************************************************************
+ *
+ * use_stream_jacobian: check if the LES can be built block by block
+ *            with lineqsys_stream, see the stream_jacobian parameter
+ *
+ ****************************************************************/
+
+static int use_stream_jacobian(void)
+{
+#if defined(EXACT_JACOBIAN)
+  if (g_param.stream_jacobian) {
+    if (have_exact_jacobian())
+      return 1;
+    warning("stream_jacobian needs exact derivatives of all potentials, "
+            "storing gamma\n");
+  }
+#endif  // EXACT_JACOBIAN
+
+  return 0;
+}
+
+/****************************************************************
+ *
+ * use_broyden_update: check if gamma is kept across the outer loops,
+ *            see broyden_age
+ *
+ ****************************************************************/
+
+static int use_broyden_update(int dist)
+{
+  if (g_param.broyden_age == 0 || dist)
+    return 0;
+
+#if defined(EXACT_JACOBIAN)
+  /* exact derivatives are cheaper than finite differences anyway */
+  if (have_exact_jacobian()) {
+    warning("broyden_age is not used with exact derivatives of all "
+            "potentials\n");
+    return 0;
+  }
+#endif  // EXACT_JACOBIAN
+
+  return 1;
+}
+
+/****************************************************************
+ *
+ * break_flagfile: returns 1 (and removes the file) if the break
+ *            flagfile exists
+ *
+ ****************************************************************/
+
+int break_flagfile(void)
+{
+  if (g_files.flagfile && *g_files.flagfile != '\0') {
+    FILE* ff = fopen(g_files.flagfile, "r");
+    if (ff != NULL) {
+      printf(
+          "Fit terminated prematurely in presence of break flagfile "
+          "\"%s\"!\n",
+          g_files.flagfile);
+      fclose(ff);
+      remove(g_files.flagfile);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/****************************************************************
+ *
+ * residual_weight: square root of the weight of row j of the force
+ *            vector in the error sum of calc_forces, for local != 0
+ *            the row belongs to the configurations of this process
+ *
+ ****************************************************************/
+
+static double residual_weight(int j, int local)
+{
+  if (j < g_calc.energy_p) {
+    const atom_t* atom = local
+                             ? g_config.conf_atoms + j / 3 - g_mpi.firstatom
+                             : g_config.atoms + j / 3;
+    const int c = atom->conf;
+    const int uf =
+        local ? g_config.conf_uf[c - g_mpi.firstconf] : g_config.useforce[c];
+
+#if defined(CONTRIB)
+    if (!atom->contrib)
+      return 0.0;
+#endif  // CONTRIB
+
+    return uf ? sqrt(g_config.conf_weight[c]) : 0.0;
+  }
+
+  if (j < g_calc.energy_p + g_config.nconf)
+    return sqrt(g_config.conf_weight[j - g_calc.energy_p] * g_param.eweight);
+
+#if defined(STRESS)
+  if (j < g_calc.stress_p + 6 * g_config.nconf) {
+    const int c = (j - g_calc.stress_p) / 6;
+    const int uf =
+        local ? g_config.conf_uf[c - g_mpi.firstconf] : g_config.useforce[c];
+    const int us =
+        local ? g_config.conf_us[c - g_mpi.firstconf] : g_config.usestress[c];
+
+    return (uf && us) ? sqrt(g_config.conf_weight[c] * g_param.sweight) : 0.0;
+  }
+#endif  // STRESS
+
+#if defined(EAM) || defined(ADP) || defined(MEAM)
+  /* the limiting constraints only count with RESCALE, MEAM weighs the
+     residual itself */
+  if (j < g_calc.limit_p + g_config.nconf) {
+#if defined(RESCALE) && !defined(MEAM)
+    return sqrt(g_config.conf_weight[j - g_calc.limit_p]);
+#elif defined(RESCALE)
+    return 1.0;
+#else
+    return 0.0;
+#endif  // RESCALE && !MEAM
+  }
+#endif  // EAM || ADP || MEAM
+
+  /* constraints and punishments are not weighted */
+  return 1.0;
+}
+
+#if defined(APOT)
+
+/****************************************************************
+ *
+ * apot_limit_step: shorten the step delta of the i-th free
+ *            parameter so that xi + delta stays within its bounds
+ *
+ ****************************************************************/
+
+static void apot_limit_step(double* xi, double* delta, int i)
+{
+  const int k = g_pot.opt_pot.idx[i];
+  const double pmin = g_pot.apot_table.pmin[g_pot.apot_table.idxpot[i]]
+                                           [g_pot.apot_table.idxparam[i]];
+  const double pmax = g_pot.apot_table.pmax[g_pot.apot_table.idxpot[i]]
+                                           [g_pot.apot_table.idxparam[i]];
+
+  if (xi[k] + delta[k] < pmin)
+    delta[k] = pmin - xi[k];
+  if (xi[k] + delta[k] > pmax)
+    delta[k] = pmax - xi[k];
+}
+
+/****************************************************************
+ *
+ * apot_active: returns 1 if the i-th free parameter sits at one of
+ *            its bounds and the direction delta_k points outside
+ *
+ ****************************************************************/
+
+static int apot_active(double* xi, double delta_k, int i)
+{
+  const int k = g_pot.opt_pot.idx[i];
+  const double pmin = g_pot.apot_table.pmin[g_pot.apot_table.idxpot[i]]
+                                           [g_pot.apot_table.idxparam[i]];
+  const double pmax = g_pot.apot_table.pmax[g_pot.apot_table.idxpot[i]]
+                                           [g_pot.apot_table.idxparam[i]];
+
+  return (xi[k] <= pmin && delta_k < 0.0) || (xi[k] >= pmax && delta_k > 0.0);
+}
+
+#endif  // APOT
+
+#if defined(MPI)
+
+/****************************************************************
+ *
+ * dist_init: find the local rows, these are the ones collected by
+ *            gather_forces, root takes the remaining global rows
+ *
+ ****************************************************************/
+
+static void dist_init(int n)
+{
+#if defined(STRESS)
+  int end = g_calc.stress_p + 6 * g_config.nconf;
+#else
+  int end = g_calc.energy_p + g_config.nconf;
+#endif  // STRESS
+#if defined(RESCALE) && (defined(EAM) || defined(ADP) || defined(MEAM))
+  end = g_calc.limit_p + g_config.nconf;
+#endif  // RESCALE && (EAM || ADP || MEAM)
+  int num = 0;
+
+  g_dist.n = n;
+  g_dist.row = (int*)Malloc(g_calc.mdim * sizeof(int));
+
+  for (int k = 0; k < 3 * g_mpi.myatoms; k++)
+    g_dist.row[num++] = 3 * g_mpi.firstatom + k;
+  for (int k = 0; k < g_mpi.myconf; k++)
+    g_dist.row[num++] = g_calc.energy_p + g_mpi.firstconf + k;
+#if defined(STRESS)
+  for (int k = 0; k < 6 * g_mpi.myconf; k++)
+    g_dist.row[num++] = g_calc.stress_p + 6 * g_mpi.firstconf + k;
+#endif  // STRESS
+#if defined(RESCALE) && (defined(EAM) || defined(ADP) || defined(MEAM))
+  for (int k = 0; k < g_mpi.myconf; k++)
+    g_dist.row[num++] = g_calc.limit_p + g_mpi.firstconf + k;
+#endif  // RESCALE && (EAM || ADP || MEAM)
+  if (g_mpi.myid == 0)
+    for (int k = end; k < g_calc.mdim; k++)
+      g_dist.row[num++] = k;
+
+  g_dist.nrows = num;
+  g_dist.gamma = mat_double(MAX(num, 1), n);
+  g_dist.weight = (double*)Malloc(MAX(num, 1) * sizeof(double));
+  g_dist.wf = (double*)Malloc(MAX(num, 1) * sizeof(double));
+  for (int k = 0; k < num; k++)
+    g_dist.weight[k] = residual_weight(g_dist.row[k], 1);
+  g_dist.sum = (double*)Malloc((n * n + n) * sizeof(double));
+  g_dist.les = (double**)Malloc(n * sizeof(double*));
+  for (int i = 0; i < n; i++)
+    g_dist.les[i] = g_dist.sum + i * n;
+  if (g_mpi.myid == 0)
+    g_dist.total = (double*)Malloc((n * n + n) * sizeof(double));
+}
+
+/****************************************************************
+ *
+ * dist_slot: slot of the force vector f of root, a new one is
+ *            added for unknown vectors (f == NULL on the workers)
+ *
+ ****************************************************************/
+
+static int dist_slot(double* f)
+{
+  for (int s = 0; s < g_dist.nslots && f != NULL; s++)
+    if (g_dist.key[s] == f)
+      return s;
+
+  const int s = g_dist.nslots++;
+
+  g_dist.key = (double**)Realloc(g_dist.key, g_dist.nslots * sizeof(double*));
+  g_dist.slot = (double**)Realloc(g_dist.slot, g_dist.nslots * sizeof(double*));
+  g_dist.key[s] = f;
+  g_dist.slot[s] = (double*)Malloc(MAX(g_dist.nrows, 1) * sizeof(double));
+
+  return s;
+}
+
+/****************************************************************
+ *
+ * powell_lsq_store: keep the local rows of a force vector,
+ *            called by gather_forces on all processes
+ *
+ ****************************************************************/
+
+void powell_lsq_store(double* forces)
+{
+  int s = (g_mpi.myid == 0) ? dist_slot(forces) : 0;
+
+  MPI_Bcast(&s, 1, MPI_INT, 0, g_mpi.comm);
+
+  if (s == g_dist.nslots)
+    dist_slot(NULL);
+
+  for (int k = 0; k < g_dist.nrows; k++)
+    g_dist.slot[s][k] = forces[g_dist.row[k]];
+}
+
+/****************************************************************
+ *
+ * dist_column_norm: normalize column i of the local gamma with the
+ *            norm of the whole column, which is returned
+ *
+ ****************************************************************/
+
+static double dist_column_norm(int i)
+{
+  double sum = 0.0;
+  double total = 0.0;
+
+  for (int k = 0; k < g_dist.nrows; k++)
+    sum += dsquare(g_dist.gamma[k][i]);
+
+  MPI_Allreduce(&sum, &total, 1, MPI_DOUBLE, MPI_SUM, g_mpi.comm);
+
+  const double temp = sqrt(total);
+
+  if (temp > VERY_SMALL)
+    for (int k = 0; k < g_dist.nrows; k++)
+      g_dist.gamma[k][i] /= temp;
+
+  return temp;
+}
+
+/****************************************************************
+ *
+ * dist_execute: receive the command of root and run it on all
+ *            processes, norms are returned in cmd->x
+ *
+ ****************************************************************/
+
+static void dist_execute(dist_cmd_t* cmd)
+{
+  MPI_Bcast(cmd, sizeof(dist_cmd_t), MPI_BYTE, 0, g_mpi.comm);
+
+  const int n = g_dist.n;
+  const int m = g_dist.nrows;
+  double** gamma = g_dist.gamma;
+
+  switch (cmd->task) {
+    case DIST_START:
+      if (g_dist.row == NULL)
+        dist_init(cmd->i);
+      g_mpi.distributed_lsq = 1;
+      break;
+    case DIST_STOP:
+      g_mpi.distributed_lsq = 0;
+      break;
+    case DIST_COPY:
+      if (cmd->a == g_dist.nslots)
+        dist_slot(NULL);
+      memcpy(g_dist.slot[cmd->a], g_dist.slot[cmd->b], m * sizeof(double));
+      break;
+    case DIST_GAMMA_INIT: {
+      const double* f = g_dist.slot[cmd->a];
+      const double* f_xi = g_dist.slot[cmd->b];
+
+      for (int k = 0; k < m; k++)
+        gamma[k][cmd->i] = (f[k] - f_xi[k]) / cmd->x;
+
+      cmd->x = dist_column_norm(cmd->i);
+      break;
+    }
+    case DIST_GAMMA_UPDATE: {
+      const double* fa = g_dist.slot[cmd->a];
+      const double* fb = g_dist.slot[cmd->b];
+      double mu[2] = {0.0, 0.0};
+
+      for (int k = 0; k < m; k++) {
+        gamma[k][cmd->i] = (fa[k] - fb[k]) / cmd->x;
+        mu[0] += gamma[k][cmd->i] * fa[k];
+      }
+
+      MPI_Allreduce(mu, mu + 1, 1, MPI_DOUBLE, MPI_SUM, g_mpi.comm);
+
+      for (int k = 0; k < m; k++)
+        gamma[k][cmd->i] -= mu[1] / cmd->y * fa[k];
+
+      cmd->x = dist_column_norm(cmd->i);
+      break;
+    }
+    case DIST_LINEQSYS_INIT: {
+      double* f = g_dist.slot[cmd->a];
+
+      if (cmd->i) {
+        for (int k = 0; k < m; k++) {
+          for (int j = 0; j < n; j++)
+            gamma[k][j] *= g_dist.weight[k];
+          g_dist.wf[k] = g_dist.weight[k] * f[k];
+        }
+        f = g_dist.wf;
+      }
+
+      normal_equations(&gamma[0][0], f, 0.0, g_dist.les, g_dist.sum + n * n,
+                       n, m);
+      MPI_Reduce(g_dist.sum, g_dist.total, n * n + n, MPI_DOUBLE, MPI_SUM, 0,
+                 g_mpi.comm);
+      break;
+    }
+    case DIST_LINEQSYS_UPDATE:
+      gamma_t_vector(gamma, &gamma[0][cmd->i], n, 1.0, g_dist.sum, n, m);
+      gamma_t_vector(gamma, g_dist.slot[cmd->a], 1, -1.0, g_dist.sum + n, n,
+                     m);
+      MPI_Reduce(g_dist.sum, g_dist.total, 2 * n, MPI_DOUBLE, MPI_SUM, 0,
+                 g_mpi.comm);
+      break;
+  }
+}
+
+/****************************************************************
+ *
+ * powell_lsq_worker: one step of the distributed powell_lsq,
+ *            called by the workers from calc_forces with flag 4
+ *
+ ****************************************************************/
+
+void powell_lsq_worker()
+{
+  dist_cmd_t cmd;
+
+  dist_execute(&cmd);
+}
+
+/****************************************************************
+ *
+ * dist_command: wake up the workers and run a step on all processes
+ *
+ ****************************************************************/
+
+static double dist_command(int task, int i, double* fa, double* fb, double x,
+                           double y)
+{
+  dist_cmd_t cmd = {task, i, 0, 0, x, y};
+  int flag = 4;
+
+  if (fa != NULL)
+    cmd.a = dist_slot(fa);
+  if (fb != NULL)
+    cmd.b = dist_slot(fb);
+
+  MPI_Bcast(&flag, 1, MPI_INT, 0, g_mpi.comm);
+
+  dist_execute(&cmd);
+
+  return cmd.x;
+}
+
+#endif  // MPI
@@ -29,7 +29,7 @@
 
 #include "potfit.h"
 
-#if !defined(EVO)
+#if !defined(EVO) && !defined(CMAES)
 
 #include <ctype.h>
 
@@ -154,7 +154,7 @@ double get_annealing_temperature(const double* xi, double* xi_new,
 
       randomize_parameter((int)(eqdist() * g_calc.ndim), xi_new, displacements);
 
-      double F_new = calc_forces(xi_new, forces, 0);
+      double F_new = calc_forces(xi_new, forces, 3);
 
       if (F_new <= F) {
         m1++;
@@ -206,7 +206,7 @@ typedef struct {
 
 void store_pot_data(pot_data_t* pot_data)
 {
-#if !defined(APOT)
+#if defined(MEAM) && !defined(APOT)
   if (pot_data->begin == NULL) {
     pot_data->begin = (double*)Malloc(g_param.ntypes * sizeof(double));
     pot_data->end = (double*)Malloc(g_param.ntypes * sizeof(double));
@@ -229,7 +229,7 @@ void store_pot_data(pot_data_t* pot_data)
       pot_data->xcoord[j] = g_pot.opt_pot.xcoord[j];
     k++;
   }
-#endif  // !APOT
+#endif  // MEAM && !APOT
 }
 
 /****************************************************************
@@ -259,6 +259,224 @@ void restore_pot_data(const pot_data_t* pot_data)
   }
 }
 
+/****************************************************************
+ *
+ * run_parallel_tempering
+ * 	double *xi: 	pointer to all parameters
+ *
+ * Replica exchange variant of the annealing: g_param.anneal_replicas
+ * chains run at the temperatures T, T * q, T * q^2, ... with the ratio
+ * q = g_param.anneal_ladder (default 0.5).
+ * The proposals of all chains for one parameter are evaluated
+ * together by calc_errors(), after every sweep neighboring chains
+ * try to swap their states. The whole ladder is cooled like the
+ * single chain of run_simulated_annealing().
+ *
+ ****************************************************************/
+
+void run_parallel_tempering(double* const xi)
+{
+  const int R = g_param.anneal_replicas;
+  int loop_counter = 0;
+  int loop_again = 0;
+  int swaps = 0;
+  int attempts = 0;
+
+  /* backlog of previous F values of the coldest chain */
+  double* F_old = (double*)Malloc(NEPS * sizeof(double));
+
+  /* current and proposed state, displacements and temperature per chain */
+  double** x = (double**)Malloc(R * sizeof(double*));
+  double** x_new = (double**)Malloc(R * sizeof(double*));
+  double** v = (double**)Malloc(R * sizeof(double*));
+  int** naccept = (int**)Malloc(R * sizeof(int*));
+  double* F = (double*)Malloc(R * sizeof(double));
+  double* F_new = (double*)Malloc(R * sizeof(double));
+  double* T = (double*)Malloc(R * sizeof(double));
+
+  /* optimal value */
+  double* xi_opt = (double*)Malloc(g_calc.ndimtot * sizeof(double));
+
+  /* latest force vector */
+  double* forces = (double*)Malloc(g_calc.mdim * sizeof(double));
+
+  for (int r = 0; r < R; r++) {
+    x[r] = (double*)Malloc(g_calc.ndimtot * sizeof(double));
+    x_new[r] = (double*)Malloc(g_calc.ndimtot * sizeof(double));
+    v[r] = (double*)Malloc(g_calc.ndim * sizeof(double));
+    naccept[r] = (int*)Malloc(g_calc.ndim * sizeof(int));
+
+    memcpy(x[r], xi, g_calc.ndimtot * sizeof(double));
+
+    for (int i = 0; i < g_calc.ndim; i++)
+      v[r][i] = 0.1;
+  }
+
+  memcpy(xi_opt, xi, g_calc.ndimtot * sizeof(double));
+
+  double F_opt = calc_forces(xi, forces, 3);
+
+  /* Temperature of the hottest chain */
+  double T_max = get_annealing_temperature(xi, x_new[0], forces, v[0], F_opt);
+
+  /* don't anneal if starttemp equal zero */
+  if (T_max == 0.0)
+    return;
+
+  for (int r = 0; r < R; r++) {
+    F[r] = F_opt;
+    T[r] = T_max * pow(g_param.anneal_ladder, r);
+  }
+
+  printf("Parallel tempering with %d replicas, T of the coldest is shown\n", R);
+  printf("  k\tT        \t  m\tF          \tF_opt     \tswaps\n");
+  printf("%3d\t%f\t%3d\t%f\t%f\n", 0, T[R - 1], 0, F[R - 1], F_opt);
+  fflush(stdout);
+
+  for (int n = 0; n < NEPS; n++)
+    F_old[n] = F[R - 1];
+
+  /* annealing loop */
+  do {
+    for (int m = 0; m < NTEMP; m++) {
+      for (int j = 0; j < NSTEP; j++) {
+        for (int h = 0; h < g_calc.ndim; h++) {
+          for (int r = 0; r < R; r++) {
+            memcpy(x_new[r], x[r], g_calc.ndimtot * sizeof(double));
+            randomize_parameter(h, x_new[r], v[r]);
+          }
+
+          calc_errors(x_new, F_new, R, g_calc.ndimtot);
+
+          for (int r = 0; r < R; r++) {
+            if (F_new[r] > F[r] && eqdist() >= exp((F[r] - F_new[r]) / T[r]))
+              continue;
+
+            /* accept new point */
+            double* temp = x[r];
+            x[r] = x_new[r];
+            x_new[r] = temp;
+            F[r] = F_new[r];
+            naccept[r][h]++;
+
+            if (F[r] < F_opt) {
+              memcpy(xi_opt, x[r], g_calc.ndimtot * sizeof(double));
+              F_opt = F[r];
+
+              if (*g_files.tempfile != '\0') {
+                memcpy(xi, xi_opt, g_calc.ndimtot * sizeof(double));
+#if defined(APOT)
+                update_apot_table(xi);
+#endif
+                write_pot_table_potfit(g_files.tempfile);
+              }
+            }
+          }
+        }  // loop over parameters
+
+        /* swap neighboring chains, even and odd pairs alternate */
+        for (int r = j % 2; r < R - 1; r += 2) {
+          double delta = (F[r] - F[r + 1]) * (1.0 / T[r] - 1.0 / T[r + 1]);
+
+          attempts++;
+
+          if (delta >= 0.0 || eqdist() < exp(delta)) {
+            double* temp = x[r];
+            x[r] = x[r + 1];
+            x[r + 1] = temp;
+
+            double F_temp = F[r];
+            F[r] = F[r + 1];
+            F[r + 1] = F_temp;
+
+            swaps++;
+          }
+        }
+      }  // steps per temperature
+
+      /* Step adjustment, the displacements stay with the temperature */
+      for (int r = 0; r < R; r++) {
+        for (int n = 0; n < g_calc.ndim; n++) {
+          if (naccept[r][n] > (0.6 * NSTEP))
+            v[r][n] *=
+                (1 + STEPVAR * ((double)naccept[r][n] / NSTEP - 0.6) / 0.4);
+          else if (naccept[r][n] < (0.4 * NSTEP))
+            v[r][n] /=
+                (1 + STEPVAR * (0.4 - (double)naccept[r][n] / NSTEP) / 0.4);
+          naccept[r][n] = 0;
+        }
+      }
+
+      printf("%3d\t%f\t%3d\t%f\t%f\t%d/%d\n", loop_counter, T[R - 1], m + 1,
+             F[R - 1], F_opt, swaps, attempts);
+      fflush(stdout);
+
+      swaps = 0;
+      attempts = 0;
+
+      /* End annealing if break flagfile exists */
+      if (g_files.flagfile && *g_files.flagfile != '\0') {
+        FILE* ff = fopen(g_files.flagfile, "r");
+        if (NULL != ff) {
+          printf("Annealing terminated in presence of break flagfile \"%s\"!\n",
+                 g_files.flagfile);
+          printf("Temperature was %f, returning optimum configuration\n",
+                 T[R - 1]);
+
+          loop_counter = KMAX + 1;
+          fclose(ff);
+          remove(g_files.flagfile);
+          break;
+        }
+      }
+    }
+
+    /*Temp adjustment */
+    for (int r = 0; r < R; r++)
+      T[r] *= TEMPVAR;
+    loop_counter++;
+
+    for (int i = 0; i < NEPS - 1; i++)
+      F_old[i] = F_old[i + 1];
+
+    F_old[NEPS - 1] = F[R - 1];
+
+    loop_again = 0;
+
+    for (int n = 0; n < NEPS - 1; n++) {
+      if (fabs(F[R - 1] - F_old[n]) > (EPS * F[R - 1] * 0.01)) {
+        loop_again = 1;
+        break;
+      }
+    }
+
+    /* restart the coldest chain from the optimum */
+    if (!loop_again && ((F[R - 1] - F_opt) > (EPS * F[R - 1] * 0.01))) {
+      memcpy(x[R - 1], xi_opt, g_calc.ndimtot * sizeof(double));
+      F[R - 1] = F_opt;
+      loop_again = 1;
+    }
+  } while (loop_counter < KMAX && loop_again);
+
+  memcpy(xi, xi_opt, g_calc.ndimtot * sizeof(double));
+
+#if defined(MPI)
+  // only the first group takes part in the following optimization, unless
+  // its line search evaluates several points
+  if (g_param.linmin_points == 1)
+    stop_groups();
+#endif  // MPI
+
+  printf("Finished annealing, starting powell minimization ...\n");
+
+  if (*g_files.tempfile != '\0') {
+#if defined(APOT)
+    update_apot_table(xi_opt);
+#endif  // APOT
+    write_pot_table_potfit(g_files.tempfile);
+  }
+}
+
 /****************************************************************
  *
  * run_simulated_annealing
@@ -271,6 +489,11 @@ void restore_pot_data(const pot_data_t* pot_data)
 
 void run_simulated_annealing(double* const xi)
 {
+  if (g_param.anneal_replicas > 1) {
+    run_parallel_tempering(xi);
+    return;
+  }
+
   int loop_counter = 0;
   int loop_again = 0;
 
@@ -291,6 +514,9 @@ void run_simulated_annealing(double* const xi)
   double F_opt = 0;
   double F_new = 0;
 
+  /* number of proposals evaluated together */
+  const int nspec = g_param.anneal_speculate;
+
   /* backlog of previous F values */
   double* F_old = (double*)Malloc(NEPS * sizeof(double));
 
@@ -299,7 +525,13 @@ void run_simulated_annealing(double* const xi)
 
   /* optimal value */
   double* xi_opt = (double*)Malloc(g_calc.ndimtot * sizeof(double));
-  double* xi_new = (double*)Malloc(g_calc.ndimtot * sizeof(double));
+
+  /* proposals for the next nspec parameters and their errors */
+  double** xi_new = (double**)Malloc(nspec * sizeof(double*));
+  double* F_spec = (double*)Malloc(nspec * sizeof(double));
+
+  for (int k = 0; k < nspec; k++)
+    xi_new[k] = (double*)Malloc(g_calc.ndimtot * sizeof(double));
 
   /* latest force vector */
   double* forces = (double*)Malloc(g_calc.mdim * sizeof(double));
@@ -311,15 +543,16 @@ void run_simulated_annealing(double* const xi)
   for (int i = 0; i < g_calc.ndim; i++)
     v[i] = 0.1;
 
-  memcpy(xi_new, xi, g_calc.ndimtot * sizeof(double));
+  memcpy(xi_new[0], xi, g_calc.ndimtot * sizeof(double));
   memcpy(xi_opt, xi, g_calc.ndimtot * sizeof(double));
 
-  F = calc_forces(xi, forces, 0);
+  // annealing only needs the error sums, flag 3 skips collecting the forces
+  F = calc_forces(xi, forces, 3);
 
   F_opt = F;
 
   /* Temperature */
-  double T = get_annealing_temperature(xi, xi_new, forces, v, F);
+  double T = get_annealing_temperature(xi, xi_new[0], forces, v, F);
 
   /* don't anneal if starttemp equal zero */
   if (T == 0.0)
@@ -338,44 +571,63 @@ void run_simulated_annealing(double* const xi)
   do {
     for (int m = 0; m < NTEMP; m++) {
       for (int j = 0; j < NSTEP; j++) {
-        for (int h = 0; h < g_calc.ndim; h++) {
-          /* Step #1 */
-          memcpy(xi_new, xi, g_calc.ndimtot * sizeof(double));
+        int h = 0;
+
+        while (h < g_calc.ndim) {
+          /* Step #1, the next K proposals all start from the current point */
+          const int K = MIN(nspec, g_calc.ndim - h);
+
+          for (int k = 0; k < K; k++) {
+            memcpy(xi_new[k], xi, g_calc.ndimtot * sizeof(double));
+            randomize_parameter(h + k, xi_new[k], v);
+          }
+
+          if (K == 1)
+            F_spec[0] = calc_forces(xi_new[0], forces, 3);
+          else
+            calc_errors(xi_new, F_spec, K, g_calc.ndimtot);
+
+          /* Metropolis test in sequential order, the proposals after the
+             first accepted one are discarded */
+          int k = 0;
 
-          randomize_parameter(h, xi_new, v);
+          while (k < K && F_spec[k] > F &&
+                 eqdist() >= exp((F - F_spec[k]) / T))
+            k++;
 
-          F_new = calc_forces(xi_new, forces, 0);
+          h += k;
+
+          if (k == K)
+            continue;
 
           /* accept new point */
-          if (F_new <= F) {
+          F_new = F_spec[k];
+
 #if defined(APOT)
-            xi[g_pot.opt_pot.idx[h]] = xi_new[g_pot.opt_pot.idx[h]];
+          xi[g_pot.opt_pot.idx[h]] = xi_new[k][g_pot.opt_pot.idx[h]];
 #else
-            memcpy(xi, xi_new, g_calc.ndimtot * sizeof(double));
+          memcpy(xi, xi_new[k], g_calc.ndimtot * sizeof(double));
 #endif  // APOT
-            F = F_new;
+          F = F_new;
 
-            naccept[h]++;
+          naccept[h]++;
 
-            if (F_new < F_opt) {
-              memcpy(xi_opt, xi_new, g_calc.ndimtot * sizeof(double));
+          if (F_new < F_opt) {
+            memcpy(xi_opt, xi_new[k], g_calc.ndimtot * sizeof(double));
 
-              store_pot_data(&pot_data);
+            store_pot_data(&pot_data);
 
-              F_opt = F_new;
+            F_opt = F_new;
 
-              if (*g_files.tempfile != '\0') {
+            if (*g_files.tempfile != '\0') {
 #if defined(APOT)
-                update_apot_table(xi);
+              update_apot_table(xi);
 #endif
-                write_pot_table_potfit(g_files.tempfile);
-              }
+              write_pot_table_potfit(g_files.tempfile);
             }
-          } else if (eqdist() < (exp((F - F_new) / T))) {
-            memcpy(xi, xi_new, g_calc.ndimtot * sizeof(double));
-            F = F_new;
-            naccept[h]++;
           }
+
+          h++;
         }  // loop over parameters
       }    // steps per temperature
 
@@ -467,6 +719,13 @@ void run_simulated_annealing(double* const xi)
 
   memcpy(xi, xi_opt, g_calc.ndimtot * sizeof(double));
 
+#if defined(MPI)
+  // only the first group takes part in the following optimization, unless
+  // its line search evaluates several points
+  if (g_param.linmin_points == 1)
+    stop_groups();
+#endif  // MPI
+
 #if defined(MEAM) && !defined(APOT)
   restore_pot_data(&pot_data);
 
@@ -483,4 +742,4 @@ void run_simulated_annealing(double* const xi)
   }
 }
 
-#endif  // !EVO
+#endif  // !EVO && !CMAES
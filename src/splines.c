@@ -186,6 +186,34 @@ double splint_grad_ed(pot_table_t* pt, double* xi, int col, double r)
              (6.0 * pt->invstep[col]);
 }
 
+/****************************************************************
+ *
+ * splint_grad2_ed: calculates the second derivative from spline
+ *            interpolation (equidistant x[i])
+ *
+ ****************************************************************/
+
+double splint_grad2_ed(pot_table_t* pt, int col, double r)
+{
+  /* check for distances shorter than minimal distance in table */
+  double rr = r - pt->begin[col];
+
+  if (rr < 0)
+    error(1, "short distance! in splint_grad2_ed\n");
+
+  /* indices into potential table */
+  int k = (int)(rr * pt->invstep[col]);
+  double b = (rr - k * pt->step[col]) * pt->invstep[col];
+  k += pt->first[col];
+  /* Check if we are at the last index */
+  if (k >= pt->last[col]) {
+    k--;
+    b += 1.0;
+  }
+
+  return (1.0 - b) * pt->d2tab[k] + b * pt->d2tab[k + 1];
+}
+
 /****************************************************************
  *
  * splint_dir: interpolates the function with splines
@@ -454,3 +482,193 @@ double splint_grad_ne(pot_table_t* pt, double* xi, int col, double r)
           (3 * (a * a) - 1) * pt->d2tab[klo]) *
              h / 6.0;
 }
+
+/****************************************************************
+ *
+ * spline_ed_adjoint: reverse of spline_ed, adds the derivatives of a
+ *            function of the second derivatives y2 with respect to y
+ *            to y_bar and with respect to yp1 and ypn to yp_bar[0]
+ *            and yp_bar[1]; y2_bar holds d/d(y2) and is overwritten
+ *            (equidistant x[i])
+ *
+ ****************************************************************/
+
+void spline_ed_adjoint(double xstep, int n, double yp1, double ypn,
+                       double* y2_bar, double* y_bar, double* yp_bar)
+{
+  static double* c = NULL; /* y2[] of spline_ed before back-substitution */
+  static double* p = NULL;
+  static int nmax = 0;
+
+  if (n > nmax) {
+    c = (double*)Realloc(c, n * sizeof(double));
+    p = (double*)Realloc(p, n * sizeof(double));
+    nmax = n;
+  }
+
+  const double h2 = 3.0 / (xstep * xstep);
+  const double qn = (ypn > 0.99e30) ? 0.0 : 0.5;
+
+  c[0] = (yp1 > 0.99e30) ? 0.0 : -0.5;
+  for (int i = 1; i < n - 1; i++) {
+    p[i] = 0.5 * c[i - 1] + 2.0;
+    c[i] = (-0.5) / p[i];
+  }
+
+  /* back-substitution, y2_bar becomes the adjoint of u */
+  for (int k = 0; k < n - 1; k++)
+    y2_bar[k + 1] += c[k] * y2_bar[k];
+
+  const double un_bar = y2_bar[n - 1] / (qn * c[n - 2] + 1.0);
+
+  y2_bar[n - 2] -= qn * un_bar;
+
+  if (qn > 0.0) {
+    yp_bar[1] += (3.0 / xstep) * un_bar;
+    y_bar[n - 1] -= h2 * un_bar;
+    y_bar[n - 2] += h2 * un_bar;
+  }
+
+  for (int i = n - 2; i > 0; i--) {
+    const double t = y2_bar[i] / p[i];
+    y_bar[i + 1] += h2 * t;
+    y_bar[i] -= 2.0 * h2 * t;
+    y_bar[i - 1] += h2 * t;
+    y2_bar[i - 1] -= 0.5 * t;
+  }
+
+  if (yp1 <= 0.99e30) {
+    y_bar[1] += h2 * y2_bar[0];
+    y_bar[0] -= h2 * y2_bar[0];
+    yp_bar[0] -= (3.0 / xstep) * y2_bar[0];
+  }
+}
+
+/****************************************************************
+ *
+ * spline_ne_adjoint: reverse of spline_ne, see spline_ed_adjoint
+ *            (nonequidistant x[i])
+ *
+ ****************************************************************/
+
+void spline_ne_adjoint(double* x, int n, double yp1, double ypn,
+                       double* y2_bar, double* y_bar, double* yp_bar)
+{
+  static double* c = NULL; /* y2[] of spline_ne before back-substitution */
+  static double* p = NULL;
+  static int nmax = 0;
+
+  if (n > nmax) {
+    c = (double*)Realloc(c, n * sizeof(double));
+    p = (double*)Realloc(p, n * sizeof(double));
+    nmax = n;
+  }
+
+  const double qn = (ypn > 0.99e30) ? 0.0 : 0.5;
+
+  c[0] = (yp1 > 0.99e30) ? 0.0 : -0.5;
+  for (int i = 1; i < n - 1; i++) {
+    double sig = (x[i] - x[i - 1]) / (x[i + 1] - x[i - 1]);
+    p[i] = sig * c[i - 1] + 2.0;
+    c[i] = (sig - 1.0) / p[i];
+  }
+
+  /* back-substitution, y2_bar becomes the adjoint of u */
+  for (int k = 0; k < n - 1; k++)
+    y2_bar[k + 1] += c[k] * y2_bar[k];
+
+  const double un_bar = y2_bar[n - 1] / (qn * c[n - 2] + 1.0);
+
+  y2_bar[n - 2] -= qn * un_bar;
+
+  if (qn > 0.0) {
+    const double h = x[n - 1] - x[n - 2];
+    yp_bar[1] += (3.0 / h) * un_bar;
+    y_bar[n - 1] -= 3.0 / (h * h) * un_bar;
+    y_bar[n - 2] += 3.0 / (h * h) * un_bar;
+  }
+
+  for (int i = n - 2; i > 0; i--) {
+    const double sig = (x[i] - x[i - 1]) / (x[i + 1] - x[i - 1]);
+    const double t = y2_bar[i] / p[i];
+    const double s = 6.0 * t / (x[i + 1] - x[i - 1]);
+    y_bar[i + 1] += s / (x[i + 1] - x[i]);
+    y_bar[i] -= s / (x[i + 1] - x[i]) + s / (x[i] - x[i - 1]);
+    y_bar[i - 1] += s / (x[i] - x[i - 1]);
+    y2_bar[i - 1] -= sig * t;
+  }
+
+  if (yp1 <= 0.99e30) {
+    const double h = x[1] - x[0];
+    y_bar[1] += 3.0 / (h * h) * y2_bar[0];
+    y_bar[0] -= 3.0 / (h * h) * y2_bar[0];
+    yp_bar[0] -= (3.0 / h) * y2_bar[0];
+  }
+}
+
+/****************************************************************
+ *
+ * splint_index: index position k, shift b and step of r in column
+ *            col, as used by splint_dir (equidistant AND NON-eq.dist
+ *            x[i])
+ *
+ ****************************************************************/
+
+void splint_index(pot_table_t* pt, int col, double r, int* k, double* b,
+                  double* step)
+{
+  if (g_pot.format_type == POTENTIAL_FORMAT_TABULATED_NON_EQ_DIST) {
+    int klo = pt->first[col];
+    int khi = pt->last[col];
+
+    /* Find index by bisection */
+    while (khi - klo > 1) {
+      int m = (khi + klo) >> 1;
+      if (pt->xcoord[m] > r)
+        khi = m;
+      else
+        klo = m;
+    }
+
+    *k = klo;
+    *step = pt->xcoord[khi] - pt->xcoord[klo];
+    *b = (r - pt->xcoord[klo]) / *step;
+    return;
+  }
+
+  double rr = r - pt->begin[col];
+
+  *k = (int)(rr * pt->invstep[col]);
+  *b = (rr - *k * pt->step[col]) * pt->invstep[col];
+  *k += pt->first[col];
+  *step = pt->step[col];
+  /* Check if we are at the last index */
+  if (*k >= pt->last[col]) {
+    (*k)--;
+    *b += 1.0;
+  }
+}
+
+/****************************************************************
+ *
+ * splint_dir_adjoint: adds val_bar times the derivatives of
+ *            splint_dir and grad_bar times those of splint_grad_dir
+ *            with respect to the table (xi_bar) and to its second
+ *            derivatives (d2_bar)
+ *
+ ****************************************************************/
+
+void splint_dir_adjoint(int k, double b, double step, double val_bar,
+                        double grad_bar, double* xi_bar, double* d2_bar)
+{
+  double a = 1.0 - b;
+
+  xi_bar[k] += a * val_bar - grad_bar / step;
+  xi_bar[k + 1] += b * val_bar + grad_bar / step;
+  d2_bar[k] += ((a * a * a - a) * step * val_bar -
+                (3 * (a * a) - 1) * grad_bar) *
+               step / 6.0;
+  d2_bar[k + 1] += ((b * b * b - b) * step * val_bar +
+                    (3 * (b * b) - 1) * grad_bar) *
+                   step / 6.0;
+}
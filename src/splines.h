@@ -33,6 +33,7 @@
 void spline_ed(double, double*, int, double, double, double*);
 double splint_ed(pot_table_t*, double*, int, double);
 double splint_grad_ed(pot_table_t*, double*, int, double);
+double splint_grad2_ed(pot_table_t*, int, double);
 double splint_comb_ed(pot_table_t*, double*, int, double, double*);
 double splint_dir(pot_table_t*, double*, int, double, double);
 double splint_comb_dir(pot_table_t*, double*, int, double, double, double*);
@@ -43,4 +44,11 @@ double splint_ne_lin(pot_table_t*, double*, int, double);
 double splint_comb_ne(pot_table_t*, double*, int, double, double*);
 double splint_grad_ne(pot_table_t*, double*, int, double);
 
+// reverse of the spline routines for calc_gradient()
+void spline_ed_adjoint(double, int, double, double, double*, double*, double*);
+void spline_ne_adjoint(double*, int, double, double, double*, double*,
+                       double*);
+void splint_index(pot_table_t*, int, double, int*, double*, double*);
+void splint_dir_adjoint(int, double, double, double, double, double*, double*);
+
 #endif  // SPLINES_H_INCLUDED
@@ -230,6 +230,25 @@ typedef struct {
 #endif
 } atom_t;
 
+// neighbor table of one configuration in structure-of-arrays layout
+// holds only the neighbor data used by the pair and EAM force kernels
+
+#if defined(PAIR) || defined(EAM)
+typedef struct {
+  int len;              /* total number of neighbors in configuration */
+  int* start;           /* first neighbor of each atom, start[inconf] = len */
+  int* nr;              /* number of neighboring atom */
+  int* type;            /* type of neighboring atom */
+  double* r;            /* r */
+  vector* dist;         /* real distance vector */
+  vector* dist_r;       /* normalized distance vector */
+  int* slot[SLOTS];     /* the slot, belonging to the neighbor distance */
+  double* shift[SLOTS]; /* how far into the slot we have to go, in [0..1] */
+  double* step[SLOTS];  /* step size */
+  int* col[SLOTS];      /* coloumn of interaction for this neighbor */
+} neigh_list_t;
+#endif  // PAIR || EAM
+
 // potential table: holds tabulated potential data
 
 typedef struct {
@@ -251,6 +270,8 @@ typedef struct {
 #if defined(APOT)
 // function pointer for analytic potential evaluation
 typedef void (*fvalue_pointer)(const double, const double*, double*);
+// function pointer for derivatives with respect to the potential parameters
+typedef void (*fdparam_pointer)(const double, const double*, double*);
 
 // potential table: holds analytic potential data
 
@@ -307,11 +328,33 @@ typedef struct {
   tersoff_t tersoff;
 #endif
 
-  fvalue_pointer* fvalue; /* function pointers for analytic potentials */
+  fvalue_pointer* fvalue;   /* function pointers for analytic potentials */
+  fdparam_pointer* fdparam; /* parameter derivatives, NULL if unavailable */
 } apot_table_t;
 
+// derivatives of the calc_pot table with respect to the free parameters
+
+typedef struct {
+  pot_table_t* dpot; /* one table per free parameter, layout of calc_pot */
+  int** slot_par;    /* free parameter of each potential parameter or -1 */
+  int* num_par;      /* number of free parameters acting on each column */
+  int** par;         /* free parameters acting on each column */
+} apot_dtab_t;
+
 #endif  // APOT
 
+// partial sums of one configuration in calc_forces
+
+typedef struct {
+  double error; /* contribution to the sum of squares */
+#if defined(EAM) || defined(ADP) || defined(MEAM)
+  double rho; /* sum of the atomic densities */
+#if defined(TBEAM)
+  double rho_s; /* sum of the s-band densities */
+#endif          // TBEAM
+#endif          // EAM || ADP || MEAM
+} conf_sum_t;
+
 // potfit_calculation table: holds data for force calculation
 
 typedef struct {
@@ -324,10 +367,13 @@ typedef struct {
   double d_eps;   /* abortion criterion for powell_lsq */
   double* force;  //
 
+  conf_sum_t* conf_sum; /* partial sums of each configuration */
+
   struct {
     double* vecu_bracket;
     double* vecu_brent;
     double* f_vec3;
+    double* f_vecu;
   } linmin;
 
   /* pointers for force-vector */
@@ -358,12 +404,19 @@ typedef struct {
 
   atom_t* atoms;      /* atoms array */
   atom_t* conf_atoms; /* Atoms in configuration */
+#if defined(PAIR) || defined(EAM)
+  neigh_list_t* conf_neigh; /* neighbor tables of local configurations */
+#endif                      // PAIR || EAM
 
   char const** elements; /* element names from configuration files */
 
   int** na_type; /* number of atoms per atom type */
 
   int* cnfstart; /* index of first atom in each config */
+#if defined(MPI)
+  long* conf_offset; /* file position of each config (distributed input) */
+  int* conf_line;    /* line number of each config (distributed input) */
+#endif              // MPI
   int* inconf;   /* number of atoms in each config */
   int* conf_uf;  /* local array of "use forces in config X" */
   int* useforce; /* global array of "use forces in config X" */
@@ -432,6 +485,17 @@ typedef struct {
   int* conf_dist; /* config distribution for each process (starting index) */
   int* conf_len;  /* config distribution for each process (number of configs) */
 
+  MPI_Comm comm;        /* processes sharing one force calculation */
+  MPI_Comm leader_comm; /* root processes of all groups */
+  int group;            /* group of this process */
+  int num_groups;       /* number of groups with a copy of all configurations */
+
+  double eval_start; /* start of the current force calculation */
+  double eval_time;  /* time spent in force calculations, for rebalancing */
+  int num_evals;     /* number of timed force calculations */
+
+  int distributed_lsq; /* residuals stay on their process, see powell_lsq */
+
   /* MPI datatypes */
   MPI_Datatype MPI_ATOM;
   MPI_Datatype MPI_NEIGH;
@@ -462,9 +526,16 @@ typedef struct {
 
 #if defined(EVO)
   double evo_threshold;
+#elif defined(CMAES)
+  double cmaes_threshold; /* stopping criterion of cma-es */
+  double cmaes_sigma;     /* initial step size, relative to the parameters */
+  int cmaes_lambda;       /* samples per generation, 0 for the default */
 #else
   const char* anneal_temp;
-#endif  // EVO
+  int anneal_replicas; /* chains of the parallel tempering */
+  double anneal_ladder; /* temperature ratio of neighboring replicas */
+  int anneal_speculate; /* proposals evaluated together in one step */
+#endif  // EVO || CMAES
   double eweight;
   double sweight;
   double extend; /* how far should one extend imd pot */
@@ -472,9 +543,30 @@ typedef struct {
   int compnodes; /* how many additional composition nodes */
   int enable_cp; /* switch chemical potential on/off */
   double apot_punish_value;
+  int box_constraints; /* bounded lm steps instead of punishments */
   double plotmin;           /* minimum for plotfile */
 #endif                      // APOT
   double global_cell_scale; /* global scaling parameter */
+  int neigh_cache;          /* cache neighbor lists in <config>.nbcache */
+  int distributed_input;    /* every process reads its own configurations */
+  int rebalance; /* redistribute configurations after N force calculations */
+  int distributed_lsq; /* powell_lsq without collecting the residuals */
+  int batch_size; /* parameter vectors per calc_forces_batch() call */
+  int num_groups; /* groups of MPI processes sharing calc_errors() */
+  int linmin_points; /* step lengths evaluated together in linmin() */
+  int broyden_age; /* outer loops powell_lsq keeps a column of gamma */
+#if defined(PAIR)
+  int column_cache; /* keep the contribution of each potential column */
+#endif                // PAIR
+#if defined(PAIR) && !defined(APOT)
+  int design_matrix; /* evaluate forces with a precompiled design matrix */
+#endif                // PAIR && !APOT
+#if defined(EXACT_JACOBIAN)
+  int stream_jacobian; /* accumulate gamma^t.gamma without storing gamma */
+#endif                 // EXACT_JACOBIAN
+#if defined(ADJOINT_GRADIENT)
+  int lbfgs_memory; /* correction pairs kept by run_lbfgs() */
+#endif              // ADJOINT_GRADIENT
 } potfit_parameters;
 
 // potfit_potentials: holds information from potential file
@@ -493,6 +585,7 @@ typedef struct {
   int have_globals;     /* do we have global parameters? */
   double* calc_list;    /* list of current potential in the calc table */
   double* compnodelist; /* list of the composition nodes */
+  apot_dtab_t calc_dtab; /* parameter derivatives of calc_pot */
 #endif                  // APOT
 
   /* potential tables */
@@ -52,6 +52,8 @@
 #include <amdlibm.h>
 #elif defined(__ACCELERATE__)
 #include <Accelerate/Accelerate.h>
+#elif defined(LAPACK)
+// plain pow() from math.h
 #else
 #error No math library defined!
 #endif
@@ -94,7 +96,7 @@ void power_1(double* result, const double* x, const double* y)
   vdPow(1, x, y, result);
 #elif defined(ACML4)
   *result = fastpow(*x, *y);
-#elif defined(ACML5)
+#elif defined(ACML5) || defined(LAPACK)
   *result = pow(*x, *y);
 #elif defined(__ACCELERATE__)
   vvpow(result, y, x, &g_dim);
@@ -115,7 +117,7 @@ void power_m(int dim, double* result, const double* x, const double* y)
   int i;
   for (i = 0; i < dim; i++)
     *(result + i) = fastpow(*(x + i), *(y + i));
-#elif defined(ACML5)
+#elif defined(ACML5) || defined(LAPACK)
   int i;
   for (i = 0; i < dim; i++)
     *(result + i) = pow(*(x + i), *(y + i));